@@ -0,0 +1,487 @@
+// Analyser file for static 6502 code analysis
+#include "Analyser.h"
+#include "Bus.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+// Constructor
+Analyser::Analyser()
+{
+    // Control flow and length of every opcode from the lookup table
+    for (int op = 0; op < 256; op++)
+    {
+        cpu6502::ADDRMODE mode = cpu.GetAddrMode(op);
+        const std::string &name = cpu.GetName(op);
+        length[op] = cpu6502::GetLength(mode);
+
+        if (!cpu.IsLegal(op)) flow[op] = FLOW_ILLEGAL;
+        else if (mode == cpu6502::AM_REL) flow[op] = FLOW_BRANCH;
+        else if (name == "JMP") flow[op] = (mode == cpu6502::AM_IND || mode == cpu6502::AM_IAX) ? FLOW_INDIRECT : FLOW_JUMP;
+        else if (name == "JSR") flow[op] = FLOW_CALL;
+        else if (name == "RTS" || name == "RTI" || name == "BRK") flow[op] = FLOW_STOP;
+        else flow[op] = FLOW_NEXT;
+    }
+    pages.fill(-1);
+}
+
+// Destructor
+Analyser::~Analyser()
+{
+
+}
+
+// 64-bit FNV-1a
+uint64_t Analyser::Hash(const std::vector<uint8_t> &image)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (uint8_t b : image)
+    {
+        h ^= b;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+// Clear the results
+void Analyser::Begin(const uint8_t *data, size_t size)
+{
+    image = data;
+    pages.fill(-1);
+    map.assign(size, 0);
+    addrs.assign(size, 0);
+    edges.clear();
+    blocks.clear();
+    functions.clear();
+}
+
+// Map CPU pages first..last to consecutive image pages starting at offset, wrapping (mirroring) over size bytes
+void Analyser::MapPages(uint8_t first, uint8_t last, size_t offset, size_t size)
+{
+    for (uint32_t p = first; p <= last; p++)
+    {
+        size_t base = offset + (((p - first) << 8) % size);
+        pages[p] = (base + 0xFF < map.size()) ? (int32_t)base : -1;
+    }
+}
+
+// Offline analysis of a PRG ROM image
+void Analyser::AnalysePRG(const std::vector<uint8_t> &prg)
+{
+    Begin(prg.data(), prg.size());
+    hash = Hash(prg);
+    if (prg.size() < 256)
+    {
+        return;
+    }
+
+    std::vector<uint16_t> work;
+    if (prg.size() <= 32 * 1024)
+    {
+        // NROM layout, 16KB images are mirrored into $C000
+        MapPages(0x80, 0xFF, 0, prg.size());
+        AddVectors(work);
+        Trace(work, nullptr);
+    }
+    else
+    {
+        // Last bank fixed at $C000 first, with the switchable window unmapped
+        size_t banks = prg.size() / 0x4000;
+        MapPages(0xC0, 0xFF, (banks - 1) * 0x4000, 0x4000);
+        std::vector<uint16_t> outside;
+        AddVectors(work);
+        Trace(work, &outside);
+
+        // Entry points into the switchable window
+        std::vector<uint16_t> entries;
+        for (uint16_t addr : outside)
+        {
+            if (addr >= 0x8000 && addr < 0xC000) entries.push_back(addr);
+        }
+        std::sort(entries.begin(), entries.end());
+        entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+        // Then each switchable bank from those entries
+        for (size_t b = 0; b + 1 < banks; b++)
+        {
+            MapPages(0x80, 0xBF, b * 0x4000, 0x4000);
+            work = entries;
+            Trace(work, nullptr);
+        }
+    }
+
+    Finish();
+}
+
+// Offline analysis with a cache keyed by the image hash
+bool Analyser::AnalysePRGCached(const std::vector<uint8_t> &prg, const std::string &cacheDir)
+{
+    uint64_t h = Hash(prg);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cfg", (unsigned long long)h);
+    std::string path = cacheDir + "/" + name;
+
+    if (Load(path) && hash == h && map.size() == prg.size())
+    {
+        return true;
+    }
+
+    AnalysePRG(prg);
+    Save(path);
+    return false;
+}
+
+// Online analysis of the address space the bus currently maps
+void Analyser::AnalyseBus(Bus &bus)
+{
+    snapshot.resize(64 * 1024);
+    for (uint32_t addr = 0; addr < 0x10000; addr++)
+    {
+        snapshot[addr] = bus.read(addr, true);
+    }
+
+    Begin(snapshot.data(), snapshot.size());
+    hash = Hash(snapshot);
+    MapPages(0x00, 0xFF, 0, snapshot.size());
+
+    std::vector<uint16_t> work;
+    AddVectors(work);
+    Trace(work, nullptr);
+    Finish();
+}
+
+// Roots from the vectors cpu6502::nmi(), reset() and irq() read
+void Analyser::AddVectors(std::vector<uint16_t> &work)
+{
+    for (uint16_t vector : { 0xFFFA, 0xFFFC, 0xFFFE })
+    {
+        int32_t lo = Offset(vector);
+        int32_t hi = Offset(vector + 1);
+        if (lo < 0 || hi < 0) continue;
+
+        map[lo] |= BYTE_VECTOR | BYTE_DATA;
+        map[hi] |= BYTE_VECTOR | BYTE_DATA;
+
+        uint16_t target = image[lo] | (image[hi] << 8);
+        int32_t t = Offset(target);
+        if (t >= 0) map[t] |= BYTE_FUNCTION;
+        work.push_back(target);
+    }
+}
+
+// Recursive disassembly with an explicit work list
+void Analyser::Trace(std::vector<uint16_t> &work, std::vector<uint16_t> *outside)
+{
+    // Record an edge and queue its target
+    auto Target = [&](int32_t from, uint16_t target, uint8_t kind)
+    {
+        int32_t t = Offset(target);
+        edges.push_back({ from, t, kind });
+        if (t >= 0)
+        {
+            map[t] |= (kind == EDGE_CALL) ? (BYTE_TARGET | BYTE_FUNCTION) : BYTE_TARGET;
+            work.push_back(target);
+        }
+        else if (outside != nullptr)
+        {
+            outside->push_back(target);
+        }
+    };
+
+    while (!work.empty())
+    {
+        uint16_t addr = work.back();
+        work.pop_back();
+
+        while (true)
+        {
+            int32_t off = Offset(addr);
+            if (off < 0)
+            {
+                if (outside != nullptr) outside->push_back(addr);
+                break;
+            }
+
+            // Already decoded from another path
+            if (map[off] & BYTE_OPCODE) break;
+            // Inside another instruction
+            if (map[off] & BYTE_CODE)
+            {
+                map[off] |= BYTE_CONFLICT;
+                break;
+            }
+
+            uint8_t op = image[off];
+            if (flow[op] == FLOW_ILLEGAL) break;
+
+            // Operand bytes must be mapped and not already decoded as opcodes
+            uint8_t len = length[op];
+            int32_t o1 = (len > 1) ? Offset(addr + 1) : off;
+            int32_t o2 = (len > 2) ? Offset(addr + 2) : off;
+            if (o1 < 0 || o2 < 0) break;
+            if ((len > 1 && (map[o1] & BYTE_OPCODE)) || (len > 2 && (map[o2] & BYTE_OPCODE)))
+            {
+                map[off] |= BYTE_CONFLICT;
+                break;
+            }
+
+            map[off] |= BYTE_CODE | BYTE_OPCODE;
+            addrs[off] = addr;
+            if (len > 1) map[o1] |= BYTE_CODE;
+            if (len > 2) map[o2] |= BYTE_CODE;
+
+            uint16_t operand = (len == 3) ? (image[o1] | (image[o2] << 8)) : (len == 2) ? image[o1] : 0;
+            uint16_t next = addr + len;
+
+            bool bContinue = true;
+            switch (flow[op])
+            {
+                case FLOW_BRANCH:
+                    Target(off, next + (int8_t)operand, EDGE_BRANCH);
+                    break;
+                case FLOW_JUMP:
+                    Target(off, operand, EDGE_JUMP);
+                    bContinue = false;
+                    break;
+                case FLOW_INDIRECT:
+                {
+                    // The pointer is data, the target is not known statically
+                    int32_t p = Offset(operand);
+                    if (p >= 0) map[p] |= BYTE_DATA;
+                    edges.push_back({ off, -1, EDGE_JUMP });
+                    bContinue = false;
+                    break;
+                }
+                case FLOW_CALL:
+                    Target(off, operand, EDGE_CALL);
+                    break;
+                case FLOW_STOP:
+                    bContinue = false;
+                    break;
+                default:
+                {
+                    // Absolute operands are data references, indexed ones mark the table base
+                    cpu6502::ADDRMODE mode = cpu.GetAddrMode(op);
+                    if (mode == cpu6502::AM_ABS || mode == cpu6502::AM_ABX || mode == cpu6502::AM_ABY)
+                    {
+                        int32_t d = Offset(operand);
+                        if (d >= 0) map[d] |= BYTE_DATA;
+                    }
+                    break;
+                }
+            }
+
+            if (!bContinue) break;
+            addr = next;
+        }
+    }
+}
+
+// Build basic blocks, fall through edges and function extents
+void Analyser::Finish()
+{
+    int32_t size = (int32_t)map.size();
+    int32_t last = -1; // Last instruction of the open block, -1 if no block is open
+
+    for (int32_t off = 0; off < size; )
+    {
+        if (!(map[off] & BYTE_OPCODE))
+        {
+            last = -1;
+            off++;
+            continue;
+        }
+
+        uint8_t op = image[off];
+        uint8_t len = length[op];
+
+        // A jump target, or code that does not follow on in CPU space, starts a new block
+        if (last >= 0)
+        {
+            bool bLeader = (map[off] & (BYTE_TARGET | BYTE_FUNCTION)) != 0;
+            bool bApart = addrs[off] != (uint16_t)(addrs[last] + length[image[last]]);
+            if (bLeader || bApart)
+            {
+                if (!bApart) edges.push_back({ last, off, EDGE_FALL });
+                last = -1;
+            }
+        }
+        if (last < 0)
+        {
+            blocks.push_back({ off, off, addrs[off] });
+        }
+
+        last = off;
+        off += len;
+        blocks.back().end = off;
+
+        // Branches, jumps, calls and returns end the block
+        if (flow[op] != FLOW_NEXT)
+        {
+            if ((flow[op] == FLOW_BRANCH || flow[op] == FLOW_CALL) && off < size && (map[off] & BYTE_OPCODE))
+            {
+                edges.push_back({ last, off, EDGE_FALL });
+                map[off] |= BYTE_TARGET;
+            }
+            last = -1;
+        }
+    }
+
+    // Block index by start offset and the block containing an offset
+    auto Find = [&](int32_t off) -> int32_t
+    {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), off, [](int32_t o, const Block &b) { return o < b.start; });
+        if (it == blocks.begin()) return -1;
+        --it;
+        return (off < it->end) ? (int32_t)(it - blocks.begin()) : -1;
+    };
+
+    // Successors inside a function, calls are not followed
+    std::vector<std::vector<int32_t>> succ(blocks.size());
+    for (auto &e : edges)
+    {
+        if (e.kind == EDGE_CALL || e.to < 0) continue;
+        int32_t from = Find(e.from);
+        int32_t to = Find(e.to);
+        if (from >= 0 && to >= 0) succ[from].push_back(to);
+    }
+
+    // Function extents
+    std::vector<uint32_t> seen(blocks.size(), 0);
+    uint32_t mark = 0;
+    std::vector<int32_t> stack;
+    for (int32_t off = 0; off < size; off++)
+    {
+        if (!(map[off] & BYTE_FUNCTION) || !(map[off] & BYTE_OPCODE)) continue;
+
+        int32_t entry = Find(off);
+        if (entry < 0) continue;
+
+        Function f = { off, addrs[off], 0, 0 };
+        mark++;
+        stack.push_back(entry);
+        seen[entry] = mark;
+        while (!stack.empty())
+        {
+            int32_t b = stack.back();
+            stack.pop_back();
+            f.blocks++;
+            f.bytes += blocks[b].end - blocks[b].start;
+            for (int32_t s : succ[b])
+            {
+                if (seen[s] != mark)
+                {
+                    seen[s] = mark;
+                    stack.push_back(s);
+                }
+            }
+        }
+        functions.push_back(f);
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Binary export
+// "NCFG", version, hash, counts, then the byte map, edges, blocks and functions (little endian hosts)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static const uint32_t FILE_VERSION = 1;
+// Bytes each record takes in the file, the fields are written one by one without padding
+static const uint64_t EDGE_BYTES = 4 + 4 + 1;
+static const uint64_t BLOCK_BYTES = 4 + 4 + 2;
+static const uint64_t FUNCTION_BYTES = 4 + 2 + 4 + 4;
+
+template <typename T>
+static void Put(std::ofstream &f, T v)
+{
+    f.write((const char *)&v, sizeof(T));
+}
+
+template <typename T>
+static bool Get(std::ifstream &f, T &v)
+{
+    return (bool)f.read((char *)&v, sizeof(T));
+}
+
+// Save the results
+bool Analyser::Save(const std::string &path) const
+{
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+
+    f.write("NCFG", 4);
+    Put<uint32_t>(f, FILE_VERSION);
+    Put<uint64_t>(f, hash);
+    Put<uint32_t>(f, (uint32_t)map.size());
+    Put<uint32_t>(f, (uint32_t)edges.size());
+    Put<uint32_t>(f, (uint32_t)blocks.size());
+    Put<uint32_t>(f, (uint32_t)functions.size());
+
+    f.write((const char *)map.data(), map.size());
+    for (auto &e : edges)
+    {
+        Put(f, e.from); Put(f, e.to); Put(f, e.kind);
+    }
+    for (auto &b : blocks)
+    {
+        Put(f, b.start); Put(f, b.end); Put(f, b.addr);
+    }
+    for (auto &fn : functions)
+    {
+        Put(f, fn.entry); Put(f, fn.addr); Put(f, fn.blocks); Put(f, fn.bytes);
+    }
+    return (bool)f;
+}
+
+// Load results saved by Save()
+bool Analyser::Load(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+
+    f.seekg(0, std::ios::end);
+    const uint64_t fileSize = (uint64_t)f.tellg();
+    f.seekg(0, std::ios::beg);
+
+    char magic[4];
+    uint32_t version, mapSize, edgeCount, blockCount, functionCount;
+    uint64_t fileHash;
+    if (!f.read(magic, 4) || std::string(magic, 4) != "NCFG") return false;
+    if (!Get(f, version) || version != FILE_VERSION) return false;
+    if (!Get(f, fileHash) || !Get(f, mapSize) || !Get(f, edgeCount) || !Get(f, blockCount) || !Get(f, functionCount)) return false;
+    // The counts must add up to the file, a truncated or damaged one is not allowed to size the allocations
+    const uint64_t expected = 4 + 4 + 8 + 4 * 4 + (uint64_t)mapSize + (uint64_t)edgeCount * EDGE_BYTES +
+        (uint64_t)blockCount * BLOCK_BYTES + (uint64_t)functionCount * FUNCTION_BYTES;
+    if (expected != fileSize) return false;
+
+    std::vector<uint8_t> newMap(mapSize);
+    std::vector<Edge> newEdges(edgeCount);
+    std::vector<Block> newBlocks(blockCount);
+    std::vector<Function> newFunctions(functionCount);
+
+    if (!f.read((char *)newMap.data(), mapSize)) return false;
+    // Offsets must land in the map, -1 only where an edge leaves the image
+    const int32_t size = (int32_t)mapSize;
+    for (auto &e : newEdges)
+    {
+        if (!Get(f, e.from) || !Get(f, e.to) || !Get(f, e.kind)) return false;
+        if (e.from < 0 || e.from >= size || e.to < -1 || e.to >= size || e.kind > EDGE_CALL) return false;
+    }
+    for (auto &b : newBlocks)
+    {
+        if (!Get(f, b.start) || !Get(f, b.end) || !Get(f, b.addr)) return false;
+        if (b.start < 0 || b.end <= b.start || b.end > size) return false;
+    }
+    for (auto &fn : newFunctions)
+    {
+        if (!Get(f, fn.entry) || !Get(f, fn.addr) || !Get(f, fn.blocks) || !Get(f, fn.bytes)) return false;
+        if (fn.entry < 0 || fn.entry >= size) return false;
+    }
+
+    hash = fileHash;
+    map.swap(newMap);
+    edges.swap(newEdges);
+    blocks.swap(newBlocks);
+    functions.swap(newFunctions);
+    return true;
+}
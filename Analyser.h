@@ -0,0 +1,141 @@
+// Analyser header file to define the static 6502 code analysis class
+// Recursively disassembles from the NMI, reset and IRQ vectors using the cpu6502 lookup table and builds
+// a code/data byte map, a control-flow graph of basic blocks and the function boundaries.
+// Faster execution tiers can use the result to pre-warm caches before the code first runs.
+// https://www.nesdev.org/wiki/CPU_memory_map
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include "cpu6502.h"
+
+class Bus;
+
+class Analyser
+{
+    public:
+        // Constructor and Destructor
+        Analyser();
+        ~Analyser();
+
+        // Flags for each byte of the image
+        enum BYTEFLAGS
+        {
+            BYTE_CODE = (1 << 0), // Part of an instruction
+            BYTE_OPCODE = (1 << 1), // First byte of an instruction
+            BYTE_DATA = (1 << 2), // Read as data by an absolute addressing mode
+            BYTE_TARGET = (1 << 3), // Target of a branch or jump (starts a basic block)
+            BYTE_FUNCTION = (1 << 4), // Entry of a function (JSR target or vector)
+            BYTE_VECTOR = (1 << 5), // Part of the NMI, reset or IRQ vector
+            BYTE_CONFLICT = (1 << 6), // Decoded at two different instruction alignments
+        };
+
+        // Control-flow edge kinds
+        enum EDGEKIND
+        {
+            EDGE_FALL, // Fall through into the next block
+            EDGE_BRANCH, // Taken conditional branch
+            EDGE_JUMP, // JMP
+            EDGE_CALL, // JSR
+        };
+
+        // Edges and blocks use image offsets, so banks with the same CPU addresses stay apart.
+        // Offset -1 is a target outside the image (RAM, I/O or an indirect jump).
+        struct Edge
+        {
+            int32_t from; // Offset of the last instruction of the source block
+            int32_t to; // Offset of the target
+            uint8_t kind; // EDGEKIND
+        };
+
+        struct Block
+        {
+            int32_t start; // Offset of the first instruction
+            int32_t end; // Offset one past the last byte of the last instruction
+            uint16_t addr; // CPU address of the first instruction
+        };
+
+        struct Function
+        {
+            int32_t entry; // Offset of the entry point
+            uint16_t addr; // CPU address of the entry point
+            uint32_t blocks; // Basic blocks reachable from the entry without following calls
+            uint32_t bytes; // Code bytes in those blocks
+        };
+
+        // Offline analysis of a PRG ROM image.
+        // Up to 32KB is mapped at $8000 (16KB is mirrored), larger images are analysed as a 16KB switchable
+        // bank at $8000 with the last bank fixed at $C000. Entry points into the switchable window are tried
+        // in every bank and a trace stops at the first illegal opcode.
+        void AnalysePRG(const std::vector<uint8_t> &prg);
+        // Same, but loads the result from cacheDir if this image was analysed before and saves it otherwise
+        // Returns true on a cache hit
+        bool AnalysePRGCached(const std::vector<uint8_t> &prg, const std::string &cacheDir);
+        // Online analysis of whatever the bus currently maps, offsets are CPU addresses
+        void AnalyseBus(Bus &bus);
+
+        // Compact binary export, Load() returns false, keeping the results it had, on I/O errors or a file that is
+        // not whole: counts that do not add up to its length or offsets outside the map
+        bool Save(const std::string &path) const;
+        bool Load(const std::string &path);
+
+        // 64-bit FNV-1a hash of an image, used as the cache key
+        static uint64_t Hash(const std::vector<uint8_t> &image);
+
+        // Results
+        uint64_t hash = 0; // Hash of the analysed image
+        std::vector<uint8_t> map; // BYTEFLAGS per image byte
+        std::vector<Edge> edges;
+        std::vector<Block> blocks;
+        std::vector<Function> functions;
+
+        // Queries for execution tiers
+        bool IsCode(int32_t offset) const { return offset >= 0 && offset < (int32_t)map.size() && (map[offset] & BYTE_OPCODE); }
+        bool IsFunction(int32_t offset) const { return offset >= 0 && offset < (int32_t)map.size() && (map[offset] & BYTE_FUNCTION); }
+
+    private:
+        // Opcode table source
+        cpu6502 cpu;
+
+        // Control flow of each opcode, built once from the lookup table
+        enum FLOW
+        {
+            FLOW_NEXT, // Continue with the next instruction
+            FLOW_BRANCH, // Conditional branch
+            FLOW_JUMP, // JMP absolute
+            FLOW_INDIRECT, // JMP indirect
+            FLOW_CALL, // JSR
+            FLOW_STOP, // RTS, RTI, BRK
+            FLOW_ILLEGAL, // Illegal opcode, the trace stops
+        };
+        std::array<uint8_t, 256> flow;
+        std::array<uint8_t, 256> length;
+
+        // Image being analysed and the image offset of each 256 byte CPU page, -1 if unmapped
+        const uint8_t *image = nullptr;
+        std::array<int32_t, 256> pages;
+        // CPU address each decoded instruction was found at
+        std::vector<uint16_t> addrs;
+        // Copy of the address space for AnalyseBus()
+        std::vector<uint8_t> snapshot;
+
+        // Map a CPU address to an image offset, -1 if unmapped
+        int32_t Offset(uint16_t addr) const
+        {
+            int32_t base = pages[addr >> 8];
+            return base < 0 ? -1 : base + (addr & 0xFF);
+        }
+
+        // Clear results for an image of a size
+        void Begin(const uint8_t *data, size_t size);
+        // Map a range of CPU pages to an image offset, pages past the end of the image stay unmapped
+        void MapPages(uint8_t first, uint8_t last, size_t offset, size_t size);
+        // Add the three vectors as roots
+        void AddVectors(std::vector<uint16_t> &work);
+        // Trace from a list of roots in the current mapping, returns targets outside the mapped image
+        void Trace(std::vector<uint16_t> &work, std::vector<uint16_t> *outside);
+        // Build basic blocks and function extents from the byte map and edges
+        void Finish();
+};
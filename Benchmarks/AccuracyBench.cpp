@@ -0,0 +1,58 @@
+// Benchmark for the cost of the cycle accurate tier against the instruction tier
+//   make AccuracyBench
+#include "Bus.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+// Indexed loads and stores, a read-modify-write and a branch
+//   $8000 LDX #$00
+//   $8002 LDA $0200,X
+//   $8005 CLC
+//   $8006 ADC #$01
+//   $8008 STA $0200,X
+//   $800B INC $10
+//   $800D INX
+//   $800E BNE $8002
+//   $8010 JMP $8000
+static const uint8_t program[] =
+{
+    0xA2, 0x00, 0xBD, 0x00, 0x02, 0x18, 0x69, 0x01, 0x9D, 0x00, 0x02, 0xE6, 0x10, 0xE8, 0xD0, 0xF2, 0x4C, 0x00, 0x80,
+};
+
+// Run a number of clocks and return emulated MHz
+static double Run(Bus &nes, cpu6502::ACCURACY accuracy, uint64_t clocks)
+{
+    nes.cpu.SetAccuracy(accuracy);
+    nes.cpu.reset();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < clocks; i++)
+    {
+        nes.cpu.clock();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)clocks / elapsed.count() / 1e6;
+}
+
+int main()
+{
+    const uint64_t clocks = 100000000;
+
+    auto nes = std::make_unique<Bus>();
+    // 32KB PRG-ROM with the program at $8000 and the reset vector pointing at it
+    static std::array<uint8_t, 32 * 1024> prg = {};
+    for (size_t i = 0; i < sizeof(program); i++)
+    {
+        prg[i] = program[i];
+    }
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+    nes->InsertPRG(prg.data(), prg.size());
+
+    double fast = Run(*nes, cpu6502::ACCURACY_INSTRUCTION, clocks);
+    double exact = Run(*nes, cpu6502::ACCURACY_CYCLE, clocks);
+    printf("instruction tier   %8.2f MHz\n", fast);
+    printf("cycle tier         %8.2f MHz\n", exact);
+    printf("cost               %8.2fx\n", fast / exact);
+    return 0;
+}
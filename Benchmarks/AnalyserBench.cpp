@@ -0,0 +1,178 @@
+// Analyser benchmark, milliseconds to analyse a 512KB PRG image of generated code (31 switchable banks and a fixed one),
+// then the cache: a miss that writes it, a hit that loads the same results, and truncated or damaged cache files that
+// are rejected and analysed again. Exits non-zero if the analysis takes more than MAX_MS or a cache check fails.
+//   make AnalyserBench
+//   ./AnalyserBench [max milliseconds]
+#include "Analyser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static constexpr size_t BANK = 16 * 1024;
+static constexpr size_t BANKS = 32;
+static constexpr double MAX_MS = 50.0;
+
+// A function every 256 bytes of a bank: loads, stores, arithmetic, table reads, short loops back, calls into the
+// switchable window and the fixed bank, and an RTS, the rest of the 256 bytes is data
+static void Function(std::vector<uint8_t> &prg, size_t at, uint16_t window, std::mt19937 &rng)
+{
+    std::vector<size_t> starts;
+    size_t pc = at;
+    const size_t end = at + 160 + rng() % 64;
+    while (pc < end)
+    {
+        starts.push_back(pc);
+        auto put = [&](std::initializer_list<uint8_t> bytes) { for (uint8_t b : bytes) prg[pc++] = b; };
+        switch (rng() % 10)
+        {
+            case 0: put({ 0xA9, (uint8_t)rng() }); break; // LDA #
+            case 1: put({ 0x8D, (uint8_t)rng(), (uint8_t)(0x02 + rng() % 6) }); break; // STA $0200-$07FF
+            case 2: put({ 0xBD, (uint8_t)rng(), (uint8_t)((window >> 8) + 0x30 + rng() % 0x10) }); break; // LDA table,X
+            case 3: put({ 0x18, 0x65, (uint8_t)rng() }); break; // CLC, ADC zp
+            case 4: put({ 0xE8 }); break; // INX
+            case 5: put({ 0xC9, (uint8_t)rng() }); break; // CMP #
+            case 6: // BNE to an earlier instruction of this function
+            {
+                size_t target = starts[starts.size() - 1 - rng() % std::min<size_t>(starts.size(), 8)];
+                put({ 0xD0, (uint8_t)(target - (pc + 2)) });
+                break;
+            }
+            case 7: put({ 0xF0, 0x00 }); break; // BEQ to the next instruction
+            case 8: put({ 0x20, 0x00, (uint8_t)(0x80 + rng() % 0x30) }); break; // JSR into the window
+            case 9: put({ 0x20, 0x00, (uint8_t)(0xC1 + rng() % 0x2F) }); break; // JSR into the fixed bank
+        }
+    }
+    prg[pc] = 0x60; // RTS
+}
+
+static std::vector<uint8_t> Image()
+{
+    std::mt19937 rng(6502);
+    std::vector<uint8_t> prg(BANK * BANKS);
+    for (auto &b : prg) b = (uint8_t)rng();
+    for (size_t bank = 0; bank < BANKS; bank++)
+    {
+        const bool bFixed = (bank == BANKS - 1);
+        for (size_t f = bFixed ? 1 : 0; f < 0x30; f++) Function(prg, bank * BANK + f * 256, bFixed ? 0xC000 : 0x8000, rng);
+    }
+    // Fixed bank: reset calls every function of the window, NMI and IRQ return
+    uint8_t *fixed = &prg[(BANKS - 1) * BANK];
+    size_t pc = 0;
+    for (int f = 0; f < 0x30; f++)
+    {
+        fixed[pc++] = 0x20;
+        fixed[pc++] = 0x00;
+        fixed[pc++] = (uint8_t)(0x80 + f);
+    }
+    fixed[pc++] = 0x4C;
+    fixed[pc++] = 0x00;
+    fixed[pc++] = 0xC0;
+    fixed[pc] = 0x40; // RTI
+    const uint16_t rti = (uint16_t)(0xC000 + pc);
+    fixed[0x3FFA] = (uint8_t)rti; fixed[0x3FFB] = (uint8_t)(rti >> 8);
+    fixed[0x3FFC] = 0x00; fixed[0x3FFD] = 0xC0;
+    fixed[0x3FFE] = (uint8_t)rti; fixed[0x3FFF] = (uint8_t)(rti >> 8);
+    return prg;
+}
+
+static bool Same(const Analyser &a, const Analyser &b)
+{
+    auto edge = [](const Analyser::Edge &x, const Analyser::Edge &y) { return x.from == y.from && x.to == y.to && x.kind == y.kind; };
+    auto block = [](const Analyser::Block &x, const Analyser::Block &y) { return x.start == y.start && x.end == y.end && x.addr == y.addr; };
+    auto function = [](const Analyser::Function &x, const Analyser::Function &y)
+    {
+        return x.entry == y.entry && x.addr == y.addr && x.blocks == y.blocks && x.bytes == y.bytes;
+    };
+    return a.hash == b.hash && a.map == b.map &&
+        std::equal(a.edges.begin(), a.edges.end(), b.edges.begin(), b.edges.end(), edge) &&
+        std::equal(a.blocks.begin(), a.blocks.end(), b.blocks.begin(), b.blocks.end(), block) &&
+        std::equal(a.functions.begin(), a.functions.end(), b.functions.begin(), b.functions.end(), function);
+}
+
+static bool Check(const char *name, bool bOk)
+{
+    printf("%-40s %s\n", name, bOk ? "ok" : "FAILED");
+    return bOk;
+}
+
+int main(int argc, char *argv[])
+{
+    const double maxMs = (argc > 1) ? atof(argv[1]) : MAX_MS;
+    const std::vector<uint8_t> prg = Image();
+
+    // Analysis time, the median of 9
+    Analyser analyser;
+    std::vector<double> ms;
+    for (int i = 0; i < 9; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        analyser.AnalysePRG(prg);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        ms.push_back(elapsed.count());
+    }
+    std::sort(ms.begin(), ms.end());
+    size_t code = std::count_if(analyser.map.begin(), analyser.map.end(), [](uint8_t f) { return f & Analyser::BYTE_CODE; });
+    printf("512KB image %8.2f ms  %zu code bytes  %zu blocks  %zu functions  %zu edges\n", ms[ms.size() / 2], code,
+        analyser.blocks.size(), analyser.functions.size(), analyser.edges.size());
+    bool bOk = Check("analysis within the time limit", ms[ms.size() / 2] <= maxMs);
+    bOk &= Check("most of the image decoded as code", code > prg.size() / 2);
+
+    // Cache
+    char dir[] = "/tmp/nes-analyserbench-XXXXXX";
+    if (mkdtemp(dir) == nullptr) return 1;
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.cfg", (unsigned long long)Analyser::Hash(prg));
+    const std::string path = std::string(dir) + name;
+
+    Analyser cached;
+    bOk &= Check("first run misses and writes the cache", !cached.AnalysePRGCached(prg, dir) && access(path.c_str(), F_OK) == 0);
+    auto start = std::chrono::steady_clock::now();
+    bool bHit = cached.AnalysePRGCached(prg, dir);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    printf("cache hit   %8.2f ms\n", elapsed.count());
+    bOk &= Check("second run hits with the same results", bHit && Same(cached, analyser));
+
+    // Truncated: rejected, the results loaded before are kept, the cached analysis redoes it
+    FILE *f = fopen(path.c_str(), "rb");
+    std::vector<uint8_t> file;
+    if (f != nullptr)
+    {
+        uint8_t buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) file.insert(file.end(), buffer, buffer + n);
+        fclose(f);
+    }
+    auto write = [&](const std::vector<uint8_t> &data)
+    {
+        FILE *out = fopen(path.c_str(), "wb");
+        if (out == nullptr) return;
+        fwrite(data.data(), 1, data.size(), out);
+        fclose(out);
+    };
+    std::vector<uint8_t> damaged(file.begin(), file.begin() + file.size() / 2);
+    write(damaged);
+    bOk &= Check("truncated file is rejected", !cached.Load(path) && Same(cached, analyser));
+    bOk &= Check("truncated cache is a miss and rewritten", !cached.AnalysePRGCached(prg, dir) && cached.AnalysePRGCached(prg, dir));
+
+    // Counts that ask for gigabytes, and an offset outside the map
+    damaged = file;
+    uint32_t huge = 0x7FFFFFFF;
+    memcpy(&damaged[20], &huge, 4); // Edge count
+    write(damaged);
+    bOk &= Check("edge count past the file is rejected", !cached.Load(path));
+    damaged = file;
+    int32_t outside = (int32_t)prg.size();
+    memcpy(&damaged[32 + prg.size() + 4], &outside, 4); // Target of the first edge
+    write(damaged);
+    bOk &= Check("edge outside the map is rejected", !cached.Load(path) && Same(cached, analyser));
+
+    unlink(path.c_str());
+    rmdir(dir);
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+// Batch benchmark, many instances run round robin the way a rollout worker drives them
+// Reports the memory per instance and the cache behaviour of switching between instances.
+//   make BatchBench
+//   ./BatchBench [instances]
+#include "Bus.h"
+#include "PerfCounters.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Walks a 256 byte table in RAM with a zero page pointer, then calls a subroutine that uses the stack
+//   $8000 LDY #$00
+//   $8002 LDA ($10),Y
+//   $8004 EOR #$5A
+//   $8006 STA ($10),Y
+//   $8008 JSR $8010
+//   $800B INY
+//   $800C BNE $8002
+//   $800E BEQ $8000
+//   $8010 PHA
+//   $8011 INC $20
+//   $8013 PLA
+//   $8014 RTS
+static const uint8_t program[] =
+{
+    0xA0, 0x00, 0xB1, 0x10, 0x49, 0x5A, 0x91, 0x10, 0x20, 0x10, 0x80, 0xC8, 0xD0, 0xF4, 0xF0, 0xF0,
+    0x48, 0xE6, 0x20, 0x68, 0x60,
+};
+
+// Bytes allocated on the heap so far
+static size_t HeapInUse()
+{
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t instances = (argc > 1) ? (size_t)atoi(argv[1]) : 4096;
+    const uint64_t slice = 1000; // Cycles per instance before switching to the next one
+    const uint64_t rounds = 200;
+
+    // One PRG-ROM image shared by every instance
+    static std::array<uint8_t, 32 * 1024> prg = {};
+    for (size_t i = 0; i < sizeof(program); i++)
+    {
+        prg[i] = program[i];
+    }
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+
+    size_t heapBefore = HeapInUse();
+    std::vector<std::unique_ptr<Bus>> nes(instances);
+    for (size_t n = 0; n < instances; n++)
+    {
+        nes[n] = std::make_unique<Bus>();
+        nes[n]->InsertPRG(prg.data(), prg.size());
+        nes[n]->cpu.reset();
+        // Each instance walks its own page, pointer at $10
+        nes[n]->ram[0x10] = 0x00;
+        nes[n]->ram[0x11] = 0x02 + (n & 0x03);
+    }
+    size_t heapAfter = HeapInUse();
+
+    PerfCounters perf;
+    perf.Start();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t r = 0; r < rounds; r++)
+    {
+        for (size_t n = 0; n < instances; n++)
+        {
+            for (uint64_t c = 0; c < slice; c++)
+            {
+                nes[n]->cpu.clock();
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    perf.Stop();
+
+    double clocks = (double)instances * (double)slice * (double)rounds;
+    printf("instances             %zu\n", instances);
+    printf("sizeof(Bus)           %zu bytes\n", sizeof(Bus));
+    if (heapAfter > heapBefore)
+    {
+        printf("memory per instance   %zu bytes (object and heap)\n", (heapAfter - heapBefore) / instances);
+    }
+    printf("aggregate             %.2f emulated MHz\n", clocks / elapsed.count() / 1e6);
+
+    double l1 = perf.L1HitRate();
+    double l2 = perf.L2HitRate();
+    if (l1 >= 0.0) printf("L1D hit rate          %.2f%%\n", l1 * 100.0);
+    else printf("L1D hit rate          unavailable\n");
+    if (l2 >= 0.0) printf("L2 hit rate (est.)    %.2f%% of L1D misses\n", l2 * 100.0);
+    else printf("L2 hit rate (est.)    unavailable\n");
+    if (perf.Valid(PerfCounters::LL_READ_MISS)) printf("LLC read misses       %llu\n", (unsigned long long)perf.Get(PerfCounters::LL_READ_MISS));
+    return 0;
+}
@@ -0,0 +1,240 @@
+// Checkpoint benchmark, what checkpoints cost the emulation thread: time spent in Capture() against capturing and
+// waiting for the write as a synchronous checkpoint would, and frames per second with one a second and with one every
+// frame against none. On a machine with one core the writer thread's work comes out of the frame rate as well.
+// Then the size on disk after page deduplication and compression, and a resume from the newest checkpoint (and from
+// the one before after the newest is damaged) that must carry on exactly like the emulation that wrote it, also when
+// it was taken right after a branch in the cycle tier.
+//   make CheckpointBench
+//   ./CheckpointBench [frames]
+#include "Bus.h"
+#include "Checkpointer.h"
+#include "TestRom.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+
+// Frame counting loop, the NMI fills $0300-$033F and keeps a score in PRG-RAM
+static const TestRom rom(TestRom::HANDLER_SCORE);
+
+static void Clear(const std::string &directory)
+{
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr) return;
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.') unlink((directory + "/" + entry->d_name).c_str());
+    }
+    closedir(dir);
+}
+
+static int Files(const std::string &directory)
+{
+    int count = 0;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr) return 0;
+    while (struct dirent *entry = readdir(dir)) count += (entry->d_name[0] != '.');
+    closedir(dir);
+    return count;
+}
+
+static double Median(std::vector<double> &v)
+{
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+static double ThreadSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Frames per second with a checkpoint every 'every' frames (0 for none), with bSync the emulation waits for each write.
+// The cost of a checkpoint is emulation thread CPU time, so on a machine with fewer cores than threads the writer
+// running in between does not count, and wall time for the synchronous checkpoints that wait for it.
+static double Run(const std::string &directory, int frames, int every, bool bSync, std::vector<double> &cost, Checkpointer::Stats &stats)
+{
+    Clear(directory);
+    auto nes = rom.Make();
+    Checkpointer checkpoints;
+    checkpoints.Start(directory);
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 1; f <= frames; f++)
+    {
+        nes->frame();
+        if (every == 0 || f % every != 0) continue;
+        auto wall = std::chrono::steady_clock::now();
+        double cpu = ThreadSeconds();
+        checkpoints.Capture(*nes);
+        if (bSync)
+        {
+            checkpoints.Flush();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - wall;
+            cost.push_back(elapsed.count() * 1e6);
+        }
+        else
+        {
+            cost.push_back((ThreadSeconds() - cpu) * 1e6);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    checkpoints.Stop();
+    stats = checkpoints.GetStats();
+    return frames / elapsed.count();
+}
+
+static void Print(const char *name, double change, std::vector<double> &cost, const Checkpointer::Stats &stats)
+{
+    std::sort(cost.begin(), cost.end());
+    printf("%-26s %+6.1f%% frames/s  per checkpoint p50 %7.1f us  p99 %7.1f us  max %7.1f us  written %llu  replaced %llu\n",
+        name, change, cost[cost.size() / 2], cost[(size_t)(0.99 * (cost.size() - 1))], cost.back(),
+        (unsigned long long)stats.written, (unsigned long long)stats.replaced);
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = (argc > 1) ? atoi(argv[1]) : 3000;
+
+    char path[] = "/tmp/nes-checkpointbench-XXXXXX";
+    if (mkdtemp(path) == nullptr) return 1;
+    const std::string directory = path;
+
+    // Frames per second against the runs without checkpoints either side, the median over the pairs
+    std::vector<double> second, every, secondCost, everyCost, syncCost, none;
+    Checkpointer::Stats stats, secondStats, everyStats, syncStats;
+    double before = Run(directory, frames, 0, false, none, stats);
+    for (int i = 0; i < 5; i++)
+    {
+        double on = Run(directory, frames, 60, false, secondCost, secondStats);
+        double after = Run(directory, frames, 0, false, none, stats);
+        second.push_back((2.0 * on / (before + after) - 1.0) * 100.0);
+        on = Run(directory, frames, 1, false, everyCost, everyStats);
+        before = Run(directory, frames, 0, false, none, stats);
+        every.push_back((2.0 * on / (before + after) - 1.0) * 100.0);
+    }
+    printf("%-26s %7.0f frames/s\n", "no checkpoints", before);
+    Print("one a second", Median(second), secondCost, secondStats);
+    Print("every frame", Median(every), everyCost, everyStats);
+    double sync = Run(directory, std::min(frames, 600), 1, true, syncCost, syncStats);
+    Print("every frame, synchronous", (sync / before - 1.0) * 100.0, syncCost, syncStats);
+
+    // Size on disk, from the last run of one a second
+    const Checkpointer::Stats &s = secondStats;
+    printf("%-26s %llu checkpoints, %llu full  %.0f bytes of state  %.0f bytes on disk each  %.1fx smaller  pages deduplicated %.1f%%\n",
+        "size", (unsigned long long)s.written, (unsigned long long)s.keys, (double)s.imageBytes / s.written,
+        (double)s.fileBytes / s.written, (double)s.imageBytes / s.fileBytes,
+        100.0 * s.pagesDeduplicated / (s.pagesStored + s.pagesDeduplicated));
+    printf("%-26s %.1f us per checkpoint, %d files kept of the %llu synchronous ones\n", "writer thread", s.writeSeconds / s.written * 1e6,
+        Files(directory), (unsigned long long)syncStats.written);
+
+    // Resume: checkpoint mid run, resume a fresh instance and check both carry on the same
+    Clear(directory);
+    bool bOk = true;
+    auto nes = rom.Make();
+    std::vector<uint8_t> expected, older, resumed;
+    {
+        Checkpointer checkpoints;
+        checkpoints.Start(directory, "checkpoint", 8);
+        for (int f = 1; f <= 1000; f++)
+        {
+            nes->frame();
+            if (f % 10 != 0) continue;
+            checkpoints.Capture(*nes);
+            checkpoints.Flush();
+            older.swap(expected);
+            expected.clear();
+            nes->SaveState(expected);
+        }
+        // Mid instruction in the cycle tier as well
+        nes->cpu.SetAccuracy(cpu6502::ACCURACY_CYCLE);
+        for (int c = 0; c < 12345; c++) nes->cpu.clock();
+        checkpoints.Capture(*nes);
+        bOk &= checkpoints.Flush();
+        older.swap(expected);
+        expected.clear();
+        nes->SaveState(expected);
+    }
+    auto copy = rom.Make();
+    uint64_t sequence = 0;
+    bOk &= Checkpointer::Resume(directory, *copy, "checkpoint", &sequence);
+    copy->SaveState(resumed);
+    bOk &= (resumed == expected);
+    for (int c = 0; c < 200000; c++)
+    {
+        nes->cpu.clock();
+        copy->cpu.clock();
+    }
+    for (int f = 0; f < 120; f++)
+    {
+        nes->frame();
+        copy->frame();
+    }
+    expected.clear();
+    resumed.clear();
+    nes->SaveState(expected);
+    copy->SaveState(resumed);
+    bOk &= (resumed == expected);
+    printf("%-26s checkpoint %llu  %s\n", "resume", (unsigned long long)sequence, bOk ? "same state, same 120 frames after" : "MISMATCH");
+
+    // Damage the newest, resume must fall back to the one before
+    char name[64];
+    snprintf(name, sizeof(name), "/checkpoint-%010llu.ckpt", (unsigned long long)sequence);
+    if (truncate((directory + name).c_str(), 100) != 0) bOk = false;
+    copy = rom.Make();
+    uint64_t fallback = 0;
+    bool bFallback = Checkpointer::Resume(directory, *copy, "checkpoint", &fallback);
+    resumed.clear();
+    copy->SaveState(resumed);
+    bFallback &= (fallback + 1 == sequence) && (resumed == older);
+    printf("%-26s checkpoint %llu  %s\n", "resume after damage", (unsigned long long)fallback, bFallback ? "same state" : "MISMATCH");
+
+    // Right after a taken branch in the cycle tier, which leaves the micro-op sequence shorter than the opcode's
+    //   $0200 LDX #$05, DEX, BNE $0202, JMP $800F
+    static const uint8_t loop[] = { 0xA2, 0x05, 0xCA, 0xD0, 0xFD, 0x4C, 0x0F, 0x80 };
+    Clear(directory);
+    nes = rom.Make();
+    nes->cpu.SetAccuracy(cpu6502::ACCURACY_CYCLE);
+    nes->cpu.step();
+    for (size_t i = 0; i < sizeof(loop); i++) nes->write(0x0200 + i, loop[i]);
+    nes->cpu.pc = 0x0200;
+    for (int i = 0; i < 3; i++) nes->cpu.step();
+    bool bBranch = (nes->cpu.pc == 0x0202);
+    {
+        Checkpointer checkpoints;
+        checkpoints.Start(directory, "branch");
+        checkpoints.Capture(*nes);
+        bBranch &= checkpoints.Flush();
+    }
+    copy = rom.Make();
+    bBranch &= Checkpointer::Resume(directory, *copy, "branch");
+    expected.clear();
+    resumed.clear();
+    nes->SaveState(expected);
+    copy->SaveState(resumed);
+    bBranch &= (resumed == expected);
+    for (int f = 0; f < 120; f++)
+    {
+        nes->frame();
+        copy->frame();
+    }
+    expected.clear();
+    resumed.clear();
+    nes->SaveState(expected);
+    copy->SaveState(resumed);
+    bBranch &= (resumed == expected);
+    printf("%-26s %s\n", "resume after a branch", bBranch ? "same state, same 120 frames after" : "MISMATCH");
+
+    Clear(directory);
+    rmdir(path);
+    return (bOk && bFallback && bBranch) ? 0 : 1;
+}
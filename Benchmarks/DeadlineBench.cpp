@@ -0,0 +1,144 @@
+// Deadline scheduler benchmark, how many 60 Hz sessions admission control lets in and their frame latency, then a
+// scene change that makes every session with an odd id three times as expensive, pinned with neither migration nor
+// shedding, then with both. The scene change runs on two workers, all on worker 0, or on one with a single core, where
+// two workers would only take turns on it. Exits non-zero if the p99 latency of the admitted sessions or of the heavy
+// scene with migration goes over the frame period, the deadline.
+//   make DeadlineBench
+//   ./DeadlineBench [seconds per run] [workers]
+#include "Bus.h"
+#include "DeadlineScheduler.h"
+#include "TestRom.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Frame counting loop, the NMI fills $0300-$033F
+static const TestRom rom;
+
+struct Session
+{
+    std::unique_ptr<Bus> bus;
+    std::vector<uint8_t> pixels;
+    int id = -1;
+};
+
+static std::unique_ptr<Session> Make()
+{
+    auto s = std::make_unique<Session>();
+    s->bus = rom.Make();
+    s->pixels.resize(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+    s->bus->ppu.frameBuffer = s->pixels.data();
+    return s;
+}
+
+static void Print(const char *name, const DeadlineScheduler::Stats &s)
+{
+    printf("%-22s %4u sessions  %7llu frames  p50 %5.2f ms  p99 %5.2f ms  p99.9 %5.2f ms  max %6.2f ms  missed %.3f%%  skipped %llu  moved %llu  shed %llu\n",
+        name, s.sessions, (unsigned long long)s.frames, s.p50 * 1e3, s.p99 * 1e3, s.p999 * 1e3, s.max * 1e3,
+        s.frames ? 100.0 * s.misses / s.frames : 0.0, (unsigned long long)s.skipped, (unsigned long long)s.migrations,
+        (unsigned long long)s.shed);
+    printf("%-22s utilization", "");
+    for (double u : s.utilization) printf(" %.2f", u);
+    printf("\n");
+}
+
+// Spin for the extra cost of a heavy scene
+static void Spin(double seconds)
+{
+    auto until = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    while (std::chrono::steady_clock::now() < until) {}
+}
+
+// p99 latency within the deadline
+static bool Check(const char *name, const DeadlineScheduler::Stats &s)
+{
+    const double budget = std::chrono::duration<double>(DeadlineScheduler::NTSC_PERIOD).count();
+    bool bOk = s.frames > 0 && s.p99 <= budget;
+    printf("%-22s p99 %5.2f ms against a %5.2f ms budget  %s\n", name, s.p99 * 1e3, budget * 1e3, bOk ? "ok" : "FAILED");
+    return bOk;
+}
+
+int main(int argc, char *argv[])
+{
+    const double seconds = (argc > 1) ? atof(argv[1]) : 3.0;
+    const int workers = (argc > 2) ? atoi(argv[2]) : 0;
+    auto wait = std::chrono::duration<double>(seconds);
+    bool bOk = true;
+
+    // Sessions until admission control says the box is full
+    {
+        DeadlineScheduler::Config config;
+        config.workers = workers;
+        DeadlineScheduler scheduler(config);
+        std::vector<std::unique_ptr<Session>> sessions;
+        for (int i = 0; i < 4096; i++)
+        {
+            auto s = Make();
+            s->id = scheduler.Add(s->bus.get());
+            if (s->id < 0) break;
+            sessions.push_back(std::move(s));
+        }
+        printf("workers                %d, frame cost probed at admission, %.0f%% utilization bound\n",
+            scheduler.Workers(), config.utilization * 100.0);
+        // Settle, shedding what the probes let in on top of what the box can run, then measure
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        printf("%-22s %zu admitted, %llu shed while settling\n", "", sessions.size(),
+            (unsigned long long)scheduler.GetStats().shed);
+        scheduler.ResetStats();
+        std::this_thread::sleep_for(wait);
+        DeadlineScheduler::Stats s = scheduler.GetStats();
+        Print("admitted until full", s);
+        bOk &= Check("admitted until full", s);
+        printf("\n%s\n", scheduler.Metrics().c_str());
+        for (auto &session : sessions) scheduler.Remove(session->id);
+    }
+
+    // Sessions alternate between two workers when admitted, odd ids land on worker 0 and get heavy
+    for (bool bMigrate : { false, true })
+    {
+        DeadlineScheduler::Config config;
+        config.workers = std::min(2u, std::max(1u, std::thread::hardware_concurrency()));
+        config.utilization = 0.5;
+        config.bMigrate = bMigrate;
+        config.bShed = bMigrate;
+        DeadlineScheduler scheduler(config);
+
+        std::vector<std::unique_ptr<Session>> sessions;
+        std::atomic<bool> bHeavy{ false };
+        auto start = std::chrono::steady_clock::now();
+        double cost = 0.0;
+        {
+            auto probe = Make();
+            probe->bus->frame();
+            start = std::chrono::steady_clock::now();
+            probe->bus->frame();
+            cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        // Each of two workers starts at 0.2, heavy sessions cost three times as much and take worker 0 to 0.6, over its
+        // bound. A single worker goes from 0.4 to 0.8.
+        const int count = std::max(2, (int)(0.2 / (cost * 60.0)) * 2);
+        for (int i = 0; i < count; i++)
+        {
+            auto s = Make();
+            s->id = scheduler.Add(s->bus.get(), [&bHeavy, cost](int id, Bus &)
+            {
+                if ((id & 1) && bHeavy.load(std::memory_order_relaxed)) Spin(2.0 * cost);
+            }, DeadlineScheduler::NTSC_PERIOD, cost);
+            if (s->id >= 0) sessions.push_back(std::move(s));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        bHeavy = true;
+        scheduler.ResetStats();
+        std::this_thread::sleep_for(wait);
+        DeadlineScheduler::Stats s = scheduler.GetStats();
+        Print(bMigrate ? "heavy scene, migrate" : "heavy scene, pinned", s);
+        if (bMigrate) bOk &= Check("heavy scene, migrate", s);
+        for (auto &session : sessions) scheduler.Remove(session->id);
+    }
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+// Benchmark for the cost of the debugger hooks
+// Compare the "no watchpoints" line of the two builds, the one with the debugger should match the one without:
+//   make DebuggerBench DebuggerBenchNoDbg
+#include "Bus.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+// Loop over page $02 with loads, adds, stores and a branch
+//   $8000 LDX #$00
+//   $8002 LDA $0200,X
+//   $8005 CLC
+//   $8006 ADC #$01
+//   $8008 STA $0200,X
+//   $800B INX
+//   $800C BNE $8002
+//   $800E JMP $8000
+static const uint8_t program[] =
+{
+    0xA2, 0x00, 0xBD, 0x00, 0x02, 0x18, 0x69, 0x01, 0x9D, 0x00, 0x02, 0xE8, 0xD0, 0xF4, 0x4C, 0x00, 0x80,
+};
+
+// Run a number of clocks and return emulated MHz
+static double Run(Bus &nes, uint64_t clocks)
+{
+    nes.cpu.reset();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < clocks; i++)
+    {
+        nes.cpu.clock();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)clocks / elapsed.count() / 1e6;
+}
+
+int main()
+{
+    const uint64_t clocks = 100000000;
+
+    auto nes = std::make_unique<Bus>();
+    // 32KB PRG-ROM with the program at $8000 and the reset vector pointing at it
+    static std::array<uint8_t, 32 * 1024> prg = {};
+    for (size_t i = 0; i < sizeof(program); i++)
+    {
+        prg[i] = program[i];
+    }
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+    nes->InsertPRG(prg.data(), prg.size());
+
+#ifdef NES_NO_DEBUGGER
+    printf("build without debugger\n");
+#else
+    printf("build with debugger\n");
+#endif
+    printf("no watchpoints               %8.2f MHz\n", Run(*nes, clocks));
+
+#ifndef NES_NO_DEBUGGER
+    Debugger dbg;
+    dbg.Attach(nes.get());
+
+    // Watched pages that the program never touches
+    dbg.AddBreakpoint(0x9000);
+    dbg.AddWatchpoint(0x3000, 0x30FF, Debugger::WATCH_READ | Debugger::WATCH_WRITE);
+    printf("watchpoints on other pages   %8.2f MHz\n", Run(*nes, clocks));
+
+    // A watched page the program touches, with a condition that never holds
+    dbg.AddWatchpoint(0x0200, 0x02FF, Debugger::WATCH_WRITE, "DATA == $100");
+    printf("watchpoint on touched page   %8.2f MHz\n", Run(*nes, clocks));
+
+    // Breakpoint in the loop that only counts hits
+    dbg.Clear();
+    int id = dbg.AddBreakpoint(0x800B, "X == $FF", nullptr, false);
+    double mhz = Run(*nes, clocks);
+    printf("breakpoint in the loop       %8.2f MHz (%u hits)\n", mhz, dbg.Get(id)->hits);
+#endif
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+// Zero page and stack fast path benchmark, emulated MHz of a zero page heavy loop and a call heavy loop with the CPU's
+// direct page pointers against the same CPU sending those accesses through the bus, in both accuracy tiers. Then the
+// same for sprite DMA, the block copy from the page directPage() returns against a byte at a time through the bus.
+//   make DirectPageBench
+//   ./DirectPageBench [millions of clocks per run]
+#include "Bus.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Zero page loads, stores, indexed, indirect and read-modify-write
+//   $8000 LDX #$00
+//   $8002 LDA $10,X, ADC $20, STA $30,X, LDA ($40),Y, INC $50, LDY $51, STX $52, INX, BNE $8002
+//   $8013 JMP $8000
+static const uint8_t zeroPage[] =
+{
+    0xA2, 0x00,
+    0xB5, 0x10, 0x65, 0x20, 0x95, 0x30, 0xB1, 0x40, 0xE6, 0x50, 0xA4, 0x51, 0x86, 0x52, 0xE8, 0xD0, 0xEF,
+    0x4C, 0x00, 0x80,
+};
+
+// Nested calls and pushes
+//   $8000 LDX #$FF, TXS
+//   $8003 JSR $8010, PHA, PHP, PLP, PLA, JMP $8003
+//   $8010 JSR $8014, RTS
+//   $8014 PHA, PLA, RTS
+static const uint8_t calls[] =
+{
+    0xA2, 0xFF, 0x9A,
+    0x20, 0x10, 0x80, 0x48, 0x08, 0x28, 0x68, 0x4C, 0x03, 0x80,
+    0xEA, 0xEA, 0xEA,
+    0x20, 0x14, 0x80, 0x60,
+    0x48, 0x68, 0x60,
+};
+
+static std::array<uint8_t, 32 * 1024> prg = {};
+
+// Emulated MHz
+static double Run(cpu6502::ACCURACY accuracy, bool bDirect, uint64_t clocks)
+{
+    auto nes = std::make_unique<Bus>();
+    nes->InsertPRG(prg.data(), prg.size());
+    nes->cpu.SetAccuracy(accuracy);
+    nes->cpu.reset();
+    // What a bus that maps something else on these pages gets
+    if (!bDirect)
+    {
+        nes->cpu.zeroPageRead = nullptr;
+        nes->cpu.zeroPageWrite = nullptr;
+        nes->cpu.stackPageRead = nullptr;
+        nes->cpu.stackPageWrite = nullptr;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < clocks; i++) nes->cpu.clock();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)clocks / elapsed.count() / 1e6;
+}
+
+// Speed up in percent, the median over direct runs each between two runs through the bus
+static double Gain(cpu6502::ACCURACY accuracy, uint64_t clocks, double &mhz)
+{
+    std::vector<double> ratio, speed;
+    for (int i = 0; i < 21; i++)
+    {
+        double before = Run(accuracy, false, clocks);
+        double on = Run(accuracy, true, clocks);
+        double after = Run(accuracy, false, clocks);
+        ratio.push_back(2.0 * on / (before + after));
+        speed.push_back(on);
+    }
+    std::sort(ratio.begin(), ratio.end());
+    std::sort(speed.begin(), speed.end());
+    mhz = speed[speed.size() / 2];
+    return (ratio[ratio.size() / 2] - 1.0) * 100.0;
+}
+
+// Sprite DMA, host ns per transfer: the block copy with one stall credit against 256 reads and $2004 writes through the
+// bus followed by 513 idle cycles clocked one at a time, each with the PPU caught up, and a bare 256 byte memcpy
+static void SpriteDMA(int transfers)
+{
+    prg.fill(0xEA); // NOP
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+    auto block = std::make_unique<Bus>();
+    auto bytes = std::make_unique<Bus>();
+    for (Bus *nes : { block.get(), bytes.get() })
+    {
+        nes->InsertPRG(prg.data(), prg.size());
+        nes->cpu.reset();
+        for (int i = 0; i < 256; i++) nes->ram[0x0200 + i] = (uint8_t)(i * 7);
+        nes->step();
+    }
+
+    std::vector<double> blockNs, bytesNs, copyNs;
+    std::array<uint8_t, 256> page = {}, oam;
+    for (int r = 0; r < 11; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < transfers; n++)
+        {
+            block->ram[0x0200]++;
+            block->oamDMA(0x02);
+            block->step(); // The stall and the next instruction
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        blockNs.push_back(elapsed.count() * 1e9 / transfers);
+
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < transfers; n++)
+        {
+            bytes->ram[0x0200]++;
+            for (uint16_t i = 0; i < 256; i++) bytes->write(0x2004, bytes->read(0x0200 + i));
+            uint32_t stall = 513 + (bytes->cpu.clock_count & 1);
+            for (uint32_t c = 0; c < stall; c++)
+            {
+                bytes->cpu.clock_count++;
+                bytes->ppu.run(bytes->cpu.clock_count * 3);
+            }
+            bytes->step();
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        bytesNs.push_back(elapsed.count() * 1e9 / transfers);
+
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < transfers; n++)
+        {
+            page[0]++;
+            memcpy(oam.data(), page.data(), 256);
+            asm volatile("" : : "r"(oam.data()) : "memory");
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        copyNs.push_back(elapsed.count() * 1e9 / transfers);
+    }
+    for (auto *v : { &blockNs, &bytesNs, &copyNs }) std::sort(v->begin(), v->end());
+    const bool bSame = block->oam == bytes->oam && block->cpu.clock_count == bytes->cpu.clock_count;
+    printf("%-16s %8.1f ns block copy and stall credit  %8.1f ns per byte through the bus  %6.1f ns memcpy  %s\n",
+        "sprite DMA", blockNs[5], bytesNs[5], copyNs[5], bSame ? "same OAM and cycles" : "MISMATCH");
+}
+
+int main(int argc, char *argv[])
+{
+    const uint64_t clocks = (uint64_t)((argc > 1) ? atof(argv[1]) : 5.0) * 1000000;
+    const char *tiers[] = { "instruction", "cycle" };
+
+    struct Program
+    {
+        const char *name;
+        const uint8_t *code;
+        size_t size;
+    };
+    const Program programs[] = { { "zero page", zeroPage, sizeof(zeroPage) }, { "calls and stack", calls, sizeof(calls) } };
+    for (auto &p : programs)
+    {
+        prg.fill(0x00);
+        memcpy(prg.data(), p.code, p.size);
+        prg[0x7FFC] = 0x00;
+        prg[0x7FFD] = 0x80;
+        for (auto accuracy : { cpu6502::ACCURACY_INSTRUCTION, cpu6502::ACCURACY_CYCLE })
+        {
+            double mhz;
+            double gain = Gain(accuracy, clocks, mhz);
+            printf("%-16s %-12s %8.1f MHz direct  %+6.1f%% against the bus\n", p.name, tiers[accuracy], mhz, gain);
+        }
+    }
+    SpriteDMA(20000);
+    return 0;
+}
@@ -0,0 +1,238 @@
+// Frame export benchmark, a consumer process reads frames and audio through the shared memory ring and through a pipe,
+// checks every frame arrives in order with its own audio, and reports latency from publication to the consumer and
+// frames dropped. Frames run flat out, then paced at 60 fps where the consumer sleeps between frames.
+//   make ExportBench
+//   ./ExportBench [frames]
+#include "Bus.h"
+#include "FrameExport.h"
+#include "TestRom.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Frame counting loop, the NMI fills $0300-$033F
+static const TestRom rom;
+static const char *NAME = "/nes-exportbench";
+static constexpr uint64_t END = ~0ULL;
+static constexpr auto PERIOD = std::chrono::nanoseconds(16639267);
+
+// A frame of audio, every sample holds the frame number so the consumer can tell it belongs to the frame
+static void Tone(int16_t *samples, uint32_t count, uint64_t frame)
+{
+    for (uint32_t i = 0; i < count; i++) samples[i] = (int16_t)frame;
+}
+
+// What the consumer saw, printed by the consumer process
+struct Report
+{
+    uint64_t frames = 0;
+    uint64_t outOfOrder = 0; // Sequence not one more than the last, or frame number not increasing
+    uint64_t badAudio = 0;
+    uint64_t gaps = 0; // Frame numbers skipped, the producer dropped them
+    std::vector<uint64_t> latency;
+    uint64_t last = END;
+    uint64_t sequence = 0;
+
+    void Frame(uint64_t sequence, uint64_t frame, uint64_t timestamp, const int16_t *samples, uint32_t count)
+    {
+        latency.push_back(FrameExport::Now() - timestamp);
+        if (sequence != this->sequence || (last != END && frame <= last)) outOfOrder++;
+        if (last != END && frame > last + 1) gaps += frame - last - 1;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (samples[i] != (int16_t)frame)
+            {
+                badAudio++;
+                break;
+            }
+        }
+        last = frame;
+        this->sequence = sequence + 1;
+        frames++;
+    }
+
+    void Print(const char *name)
+    {
+        std::sort(latency.begin(), latency.end());
+        auto at = [&](double p) { return latency.empty() ? 0.0 : latency[(size_t)(p * (latency.size() - 1))] / 1e3; };
+        printf("%-24s %6llu frames  latency p50 %7.1f us  p99 %7.1f us  max %8.1f us  out of order %llu  bad audio %llu  gaps %llu",
+            name, (unsigned long long)frames, at(0.5), at(0.99), at(1.0), (unsigned long long)outOfOrder,
+            (unsigned long long)badAudio, (unsigned long long)gaps);
+        printf("\n");
+        fflush(stdout);
+    }
+};
+
+// Consumer process on the ring
+static int ConsumeRing(const char *name)
+{
+    FrameExport ring;
+    if (!ring.Open(NAME)) return 1;
+    Report report;
+    for (;;)
+    {
+        const FrameExport::SlotHeader *slot = ring.Next();
+        if (slot->frame == END) break;
+        report.Frame(slot->sequence, slot->frame, slot->timestamp, ring.Samples(slot), slot->audioSamples);
+        ring.Release();
+    }
+    ring.Release();
+    report.Print(name);
+    return 0;
+}
+
+// Consumer process on a pipe, the same slot layout one frame after the other
+static int ConsumePipe(const char *name, int fd, size_t size)
+{
+    std::vector<uint8_t> buffer(size);
+    Report report;
+    for (;;)
+    {
+        size_t got = 0;
+        while (got < size)
+        {
+            ssize_t n = read(fd, buffer.data() + got, size - got);
+            if (n <= 0) return 1;
+            got += n;
+        }
+        FrameExport::SlotHeader slot;
+        memcpy(&slot, buffer.data(), sizeof(slot));
+        if (slot.frame == END) break;
+        const int16_t *samples = reinterpret_cast<const int16_t *>(buffer.data() + sizeof(slot) + ppu2C02::WIDTH * ppu2C02::HEIGHT);
+        report.Frame(slot.sequence, slot.frame, slot.timestamp, samples, slot.audioSamples);
+    }
+    report.Print(name);
+    return 0;
+}
+
+// Frames per second of the producer through the ring, the consumer prints what it saw
+static double Ring(const char *name, int frames, bool bPaced, uint64_t &dropped, uint64_t &wakes)
+{
+    FrameExport ring;
+    if (!ring.Create(NAME))
+    {
+        printf("could not create %s\n", NAME);
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) _exit(ConsumeRing(name));
+
+    auto nes = rom.Make();
+    const uint32_t samples = ring.GetHeader()->audioRate / 60;
+    auto start = std::chrono::steady_clock::now();
+    auto next = start;
+    for (int f = 0; f < frames; f++)
+    {
+        int16_t *audio = ring.Audio();
+        if (audio != nullptr) Tone(audio, samples, nes->ppu.frameCount);
+        ring.Frame(*nes, samples);
+        if (bPaced)
+        {
+            next += PERIOD;
+            std::this_thread::sleep_until(next);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    while (ring.Acquire() == nullptr) sched_yield();
+    ring.Publish(END, 0);
+    waitpid(child, nullptr, 0);
+    dropped = ring.Dropped();
+    wakes = ring.Wakes();
+    return frames / elapsed.count();
+}
+
+// The same through a pipe, rendered into a buffer and written
+static double Pipe(const char *name, int frames, bool bPaced)
+{
+    const uint32_t samples = 48000 / 60;
+    const size_t size = sizeof(FrameExport::SlotHeader) + ppu2C02::WIDTH * ppu2C02::HEIGHT + (48000 / 60 + 1) * sizeof(int16_t);
+    int fds[2];
+    if (pipe(fds) != 0) exit(1);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        close(fds[1]);
+        _exit(ConsumePipe(name, fds[0], size));
+    }
+    close(fds[0]);
+
+    auto nes = rom.Make();
+    std::vector<uint8_t> buffer(size);
+    auto *slot = reinterpret_cast<FrameExport::SlotHeader *>(buffer.data());
+    nes->ppu.frameBuffer = buffer.data() + sizeof(FrameExport::SlotHeader);
+    int16_t *audio = reinterpret_cast<int16_t *>(nes->ppu.frameBuffer + ppu2C02::WIDTH * ppu2C02::HEIGHT);
+    auto write = [&]()
+    {
+        size_t put = 0;
+        while (put < size)
+        {
+            ssize_t n = ::write(fds[1], buffer.data() + put, size - put);
+            if (n <= 0) exit(1);
+            put += n;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto next = start;
+    for (int f = 0; f < frames; f++)
+    {
+        Tone(audio, samples, nes->ppu.frameCount);
+        slot->frame = nes->ppu.frameCount;
+        nes->frame();
+        slot->sequence = f;
+        slot->timestamp = FrameExport::Now();
+        slot->audioSamples = samples;
+        write();
+        if (bPaced)
+        {
+            next += PERIOD;
+            std::this_thread::sleep_until(next);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    slot->frame = END;
+    write();
+    close(fds[1]);
+    waitpid(child, nullptr, 0);
+    return frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = (argc > 1) ? atoi(argv[1]) : 3000;
+
+    // Rendering into a private buffer, nothing exported
+    {
+        auto nes = rom.Make();
+        std::vector<uint8_t> pixels(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+        nes->ppu.frameBuffer = pixels.data();
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) nes->frame();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("%-24s %9.0f frames/s\n", "no export", frames / elapsed.count());
+    }
+
+    uint64_t dropped, wakes;
+    double fps = Ring("shared memory ring", frames, false, dropped, wakes);
+    printf("%-24s %9.0f frames/s  dropped %llu  wake ups %llu\n", "  producer", fps, (unsigned long long)dropped, (unsigned long long)wakes);
+    fps = Pipe("pipe", frames, false);
+    printf("%-24s %9.0f frames/s\n", "  producer", fps);
+
+    const int paced = 120;
+    Ring("ring at 60 fps", paced, true, dropped, wakes);
+    printf("%-24s dropped %llu  wake ups %llu\n", "  producer", (unsigned long long)dropped, (unsigned long long)wakes);
+    Pipe("pipe at 60 fps", paced, true);
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Fuzzer benchmark, the cost of recording edge coverage, then executions per second forking from snapshots compared to
+// replaying every input from power on, and how fast each finds its way through a combination lock.
+// The lock is an NMI that reads controller 1 once a frame and looks at new presses only, like a game would: it moves on
+// when the next button of an 8 button combination is pressed alone and starts over on any other press. Holding or
+// letting go does nothing. Each stage is its own edge.
+//   make FuzzBench
+//   ./FuzzBench [seconds per run] [threads]
+#include "Bus.h"
+#include "Fuzzer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+static std::array<uint8_t, 32 * 1024> prg = {};
+static const uint8_t combination[8] = { 0x08, 0x01, 0x80, 0x02, 0x10, 0x40, 0x04, 0x20 };
+
+// Just enough of an assembler for the lock, forward branches and jumps are patched by Here()
+struct Asm
+{
+    uint16_t org = 0x8000;
+    std::vector<uint8_t> code;
+
+    uint16_t PC() const { return (uint16_t)(org + code.size()); }
+    void Emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+    // Branch or jump with the target to come, returns where to patch
+    size_t Branch(uint8_t op) { Emit({ op, 0x00 }); return code.size() - 1; }
+    size_t Jump() { Emit({ 0x4C, 0x00, 0x00 }); return code.size() - 2; }
+    void Here(size_t at, bool bJump)
+    {
+        if (bJump)
+        {
+            code[at] = PC() & 0xFF;
+            code[at + 1] = PC() >> 8;
+        }
+        else
+        {
+            code[at] = (uint8_t)(PC() - (org + at + 1));
+        }
+    }
+};
+
+// Reset enables the NMI and spins, the NMI is the lock
+//   $20 buttons this frame, $21 stage, $22 presses since it opened, $23 buttons last frame
+static void Build()
+{
+    Asm a;
+    a.Emit({ 0x78, 0xD8, 0xA2, 0xFF, 0x9A }); // SEI, CLD, LDX #$FF, TXS
+    a.Emit({ 0xA9, 0x80, 0x8D, 0x00, 0x20 }); // LDA #$80, STA $2000
+    uint16_t spin = a.PC();
+    a.Emit({ 0x4C, (uint8_t)(spin & 0xFF), (uint8_t)(spin >> 8) }); // JMP spin
+
+    uint16_t nmi = a.PC();
+    a.Emit({ 0x48, 0x8A, 0x48 }); // PHA, TXA, PHA
+    a.Emit({ 0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40 }); // Strobe $4016
+    a.Emit({ 0xA2, 0x08 }); // LDX #8
+    uint16_t read = a.PC();
+    a.Emit({ 0xAD, 0x16, 0x40, 0x4A, 0x66, 0x20, 0xCA }); // LDA $4016, LSR A, ROR $20, DEX
+    a.Emit({ 0xD0, (uint8_t)(read - (a.PC() + 2)) }); // BNE read
+    a.Emit({ 0xA5, 0x20, 0xC5, 0x23 }); // LDA $20, CMP $23
+    size_t held = a.Branch(0xF0); // BEQ done
+    a.Emit({ 0x85, 0x23, 0xC9, 0x00 }); // STA $23, CMP #0
+    size_t idle = a.Branch(0xF0); // BEQ done
+    a.Emit({ 0xA6, 0x21 }); // LDX $21
+
+    std::vector<size_t> fails, dones;
+    for (int k = 0; k < 8; k++)
+    {
+        a.Emit({ 0xE0, (uint8_t)k }); // CPX #k
+        size_t next = a.Branch(0xD0); // BNE next
+        a.Emit({ 0xC9, combination[k] }); // CMP #button
+        fails.push_back(a.Branch(0xD0)); // BNE fail
+        a.Emit({ 0xE6, 0x21 }); // INC $21
+        dones.push_back(a.Jump()); // JMP done
+        a.Here(next, false);
+    }
+    a.Emit({ 0xE6, 0x22 }); // Open, INC $22
+    dones.push_back(a.Jump());
+    for (size_t f : fails) a.Here(f, false);
+    a.Emit({ 0xA2, 0x00, 0x86, 0x21 }); // LDX #0, STX $21
+    for (size_t d : dones) a.Here(d, true);
+    a.Here(held, false);
+    a.Here(idle, false);
+    a.Emit({ 0x68, 0xAA, 0x68, 0x40 }); // PLA, TAX, PLA, RTI
+
+    std::copy(a.code.begin(), a.code.end(), prg.begin());
+    prg[0x7FFA] = nmi & 0xFF;
+    prg[0x7FFB] = nmi >> 8;
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+}
+
+static std::unique_ptr<Bus> Make()
+{
+    auto nes = std::make_unique<Bus>();
+    nes->InsertPRG(prg.data(), prg.size());
+    nes->cpu.reset();
+    return nes;
+}
+
+// Frames per second of the lock with the same buttons every frame
+static double Run(uint8_t *map, int frames)
+{
+    auto nes = Make();
+    nes->cpu.coverage = map;
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        nes->controller[0] = combination[f % 8];
+        nes->frame();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames / elapsed.count();
+}
+
+// Furthest stage any input of the corpus reaches
+static int Stage(const std::vector<std::vector<uint8_t>> &corpus)
+{
+    int best = 0;
+    for (auto &input : corpus)
+    {
+        auto nes = Make();
+        for (uint8_t buttons : input)
+        {
+            nes->controller[0] = buttons;
+            nes->frame();
+            best = std::max<int>(best, nes->ram[0x21]);
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const double seconds = (argc > 1) ? atof(argv[1]) : 5.0;
+    const int threads = (argc > 2) ? atoi(argv[2]) : 0;
+    Build();
+
+    // Recording coverage, runs with the map each between two runs without it, median of the ratios
+    {
+        std::vector<uint8_t> map(65536);
+        std::vector<double> ratio, speed;
+        for (int i = 0; i < 31; i++)
+        {
+            double before = Run(nullptr, 100);
+            double on = Run(map.data(), 100);
+            double after = Run(nullptr, 100);
+            ratio.push_back((before + after) / (2.0 * on));
+            speed.push_back(on);
+        }
+        std::sort(ratio.begin(), ratio.end());
+        std::sort(speed.begin(), speed.end());
+        printf("coverage map          %9.0f frames/s  %5.2f%% slower than none\n", speed[speed.size() / 2],
+            (ratio[ratio.size() / 2] - 1.0) * 100.0);
+    }
+
+    // The same fuzzer, forking every 10 frames and replaying every input from the start
+    const char *names[] = { "fork every 10 frames", "replay from frame 0" };
+    const uint32_t every[] = { 10, 0 };
+    for (int m = 0; m < 2; m++)
+    {
+        auto nes = Make();
+        Fuzzer::Config config;
+        config.frames = 60;
+        config.snapshotEvery = every[m];
+        config.threads = threads;
+        Fuzzer fuzzer(*nes, config);
+        fuzzer.Run(seconds);
+
+        Fuzzer::Stats s = fuzzer.GetStats();
+        printf("%-21s %9.0f execs/s  %5.1f frames/exec  %3u edges  %3u inputs  stage %d of 8\n", names[m],
+            s.execs / s.seconds, (double)s.frames / s.execs, s.edges, s.corpus, Stage(fuzzer.GetCorpus()));
+        printf("  edges over time:");
+        for (auto &g : fuzzer.GetGrowth()) printf(" %.2fs:%u", g.seconds, g.edges);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Scripting hook benchmark, frames per second with 10 hooks batched and synchronous compared to no hooks, with a
+// script that pays a microsecond to be entered
+// The hooks sit on the zero page and the code page the main loop runs in, so every instruction and most writes go
+// through the filter tables, while only the NMI handler's writes and PCs match.
+//   make HookBench
+//   ./HookBench [frames per run]
+#include "Bus.h"
+#include "TestRom.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Frame counting loop, the NMI fills $0300-$033F
+static const TestRom rom;
+
+enum MODE
+{
+    MODE_NONE,
+    MODE_BATCHED,
+    MODE_SYNC,
+};
+
+// What a script would do with the events, count them per type
+// Every call pays for entering the scripting runtime, about a microsecond for marshalling and the interpreter
+struct Script
+{
+    uint64_t counts[3] = {};
+    uint64_t calls = 0;
+    static void Enter()
+    {
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(1);
+        while (std::chrono::steady_clock::now() < until) {}
+    }
+    void Batch(const Hooks::Event *events, size_t count)
+    {
+        Enter();
+        calls++;
+        for (size_t i = 0; i < count; i++) counts[events[i].type]++;
+    }
+    void Event(const Hooks::Event &e)
+    {
+        Enter();
+        calls++;
+        counts[e.type]++;
+    }
+};
+
+// Frames per second, the script's counts are added up
+static double Run(MODE mode, int frames, Script &script)
+{
+    auto nes = rom.Make();
+
+    Hooks hooks;
+    if (mode != MODE_NONE)
+    {
+        Hooks::Callback sync = nullptr;
+        if (mode == MODE_SYNC) sync = [&script](const Hooks::Event &e) { script.Event(e); };
+        hooks.SetBatchHandler([&script](const Hooks::Event *events, size_t count) { script.Batch(events, count); });
+        hooks.AddWrite(0x0011, 0x0011, sync); // Frame counter, once a frame
+        hooks.AddWrite(0x0300, 0x033F, sync); // The NMI's block, 64 writes a frame
+        hooks.AddWrite(0x0400, 0x04FF, sync); // Never written
+        hooks.AddWrite(0x0700, 0x0700, sync); // Never written
+        hooks.AddExec(0x801A, sync); // NMI entry
+        hooks.AddExec(0x8029, sync); // NMI exit
+        hooks.AddExec(0x8000, sync); // Reset, never again
+        hooks.AddExec(0x9000, sync); // Never run
+        hooks.AddFrame(sync);
+        hooks.AddFrame(sync);
+        hooks.Attach(nes.get());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) nes->frame();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames / elapsed.count();
+}
+
+// Slowdown in percent, the median over runs with hooks each between two runs without them
+static double Overhead(MODE mode, int frames, double &fps, Script &script)
+{
+    std::vector<double> ratio, speed;
+    Script none;
+    for (int i = 0; i < 31; i++)
+    {
+        double before = Run(MODE_NONE, frames, none);
+        double on = Run(mode, frames, script);
+        double after = Run(MODE_NONE, frames, none);
+        ratio.push_back((before + after) / (2.0 * on));
+        speed.push_back(on);
+    }
+    std::sort(ratio.begin(), ratio.end());
+    std::sort(speed.begin(), speed.end());
+    fps = speed[speed.size() / 2];
+    return (ratio[ratio.size() / 2] - 1.0) * 100.0;
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = (argc > 1) ? atoi(argv[1]) : 100;
+
+    Script none;
+    printf("no hooks              %9.0f frames/s\n", Run(MODE_NONE, frames * 10, none));
+
+    const char *names[] = { "", "10 hooks, batched", "10 hooks, sync" };
+    for (MODE mode : { MODE_BATCHED, MODE_SYNC })
+    {
+        Script script;
+        double fps;
+        double overhead = Overhead(mode, frames, fps, script);
+        uint64_t events = script.counts[0] + script.counts[1] + script.counts[2];
+        printf("%-21s %9.0f frames/s  %5.2f%% slower  %llu events (%llu writes, %llu PCs, %llu frames) in %llu calls\n",
+            names[mode], fps, overhead, (unsigned long long)events, (unsigned long long)script.counts[0],
+            (unsigned long long)script.counts[1], (unsigned long long)script.counts[2], (unsigned long long)script.calls);
+    }
+    return 0;
+}
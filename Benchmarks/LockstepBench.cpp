@@ -0,0 +1,273 @@
+// Lockstep check of the accuracy tiers, the instruction tier and the cycle tier run the same random programs side by
+// side one step() at a time and must agree on the cycles of every step, the registers and all of RAM and PRG-RAM after
+// it, with IRQs and NMIs raised at random steps. Programs are legal opcodes with every addressing mode, branches, jumps
+// and calls to instruction starts, and no access to the PPU or I/O registers, whose timing the tiers do differently on
+// purpose. Then NMI entry through the PPU on both tiers: vblank starting in the first cycle of a NOP must be taken
+// right after that NOP, and in its last cycle after the next one. Exits non-zero on the first mismatch, printing the
+// program seed and the step.
+//   make LockstepBench
+//   ./LockstepBench [programs]
+#include "Bus.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+static constexpr int STEPS = 2000; // Per program
+static constexpr int INSTRUCTIONS = 96; // Per program, then a JMP back to the start
+static constexpr uint16_t IRQ_HANDLER = 0xF000; // INC $0300, RTI
+static constexpr uint16_t NMI_HANDLER = 0xF004; // INC $0301, RTI
+
+static std::array<uint8_t, 32 * 1024> prg = {};
+
+// High bytes for every pointer and absolute operand: RAM, PRG-RAM and PRG-ROM, never a mirror of the zero page (which
+// holds the pointers) and never the PPU or I/O registers, even after an index carries into the next page
+static bool SafePage(uint8_t page)
+{
+    if (page >= 0x60) return page != 0xFF;
+    return page < 0x1F && (page & 0x07) != 0x00 && (page & 0x07) != 0x07;
+}
+
+static uint8_t Page(std::mt19937 &rng)
+{
+    uint8_t page;
+    do page = (uint8_t)rng(); while (!SafePage(page));
+    return page;
+}
+
+// Opcodes a program is drawn from, no BRK, RTS, RTI or JMP indirect, which would leave the program, and no writes in
+// zero page modes, which would overwrite the pointers
+static std::vector<uint8_t> Opcodes(const cpu6502 &cpu)
+{
+    std::vector<uint8_t> ops;
+    for (int op = 0; op < 256; op++)
+    {
+        if (!cpu.IsLegal((uint8_t)op) || op == 0x00 || op == 0x40 || op == 0x60 || op == 0x6C) continue;
+        const std::string &name = cpu.GetName((uint8_t)op);
+        cpu6502::ADDRMODE mode = cpu.GetAddrMode((uint8_t)op);
+        bool bWrites = name == "STA" || name == "STX" || name == "STY" || name == "ASL" || name == "LSR" || name == "ROL" ||
+            name == "ROR" || name == "INC" || name == "DEC";
+        bool bZeroPage = mode == cpu6502::AM_ZP0 || mode == cpu6502::AM_ZPX || mode == cpu6502::AM_ZPY;
+        if (bWrites && bZeroPage) continue;
+        ops.push_back((uint8_t)op);
+    }
+    return ops;
+}
+
+// Random program at $8000, interrupt handlers at $F000
+static void Program(const cpu6502 &cpu, const std::vector<uint8_t> &ops, std::mt19937 &rng)
+{
+    for (auto &b : prg) b = (uint8_t)rng();
+
+    // Opcodes first so branches and jumps can land on any instruction
+    std::vector<uint16_t> starts;
+    uint16_t at = 0x8000;
+    for (int i = 0; i < INSTRUCTIONS; i++)
+    {
+        uint8_t op = ops[rng() % ops.size()];
+        starts.push_back(at);
+        prg[at & 0x7FFF] = op;
+        at += cpu6502::GetLength(cpu.GetAddrMode(op));
+    }
+    prg[at & 0x7FFF] = 0x4C; // JMP $8000
+    prg[(at + 1) & 0x7FFF] = 0x00;
+    prg[(at + 2) & 0x7FFF] = 0x80;
+
+    for (uint16_t start : starts)
+    {
+        uint8_t op = prg[start & 0x7FFF];
+        uint8_t *operand = &prg[(start + 1) & 0x7FFF];
+        uint16_t target = starts[rng() % starts.size()];
+        switch (cpu.GetAddrMode(op))
+        {
+            case cpu6502::AM_REL:
+            {
+                // Any instruction in reach, the next one if the one drawn is too far
+                int offset = (int)target - (start + 2);
+                operand[0] = (offset >= -128 && offset <= 127) ? (uint8_t)offset : 0x00;
+                break;
+            }
+            case cpu6502::AM_ABS:
+                if (op == 0x4C || op == 0x20) // JMP, JSR
+                {
+                    operand[0] = (uint8_t)target;
+                    operand[1] = (uint8_t)(target >> 8);
+                    break;
+                }
+                [[fallthrough]];
+            case cpu6502::AM_ABX:
+            case cpu6502::AM_ABY:
+                operand[1] = Page(rng);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Handlers and vectors
+    const uint8_t handlers[] = { 0xEE, 0x00, 0x03, 0x40, 0xEE, 0x01, 0x03, 0x40 };
+    memcpy(&prg[IRQ_HANDLER & 0x7FFF], handlers, sizeof(handlers));
+    prg[0x7FFA] = (uint8_t)NMI_HANDLER; prg[0x7FFB] = (uint8_t)(NMI_HANDLER >> 8);
+    prg[0x7FFC] = 0x00; prg[0x7FFD] = 0x80;
+    prg[0x7FFE] = (uint8_t)IRQ_HANDLER; prg[0x7FFF] = (uint8_t)(IRQ_HANDLER >> 8);
+}
+
+static void Memory(Bus &nes, std::mt19937 &rng)
+{
+    for (auto &b : nes.ram) b = (uint8_t)rng();
+    for (auto &b : nes.prgRam) b = (uint8_t)rng();
+    // Zero page bytes double as pointers, every byte a safe page
+    for (int i = 0; i < 0x100; i++) nes.ram[i] = Page(rng);
+}
+
+static bool Same(const Bus &a, const Bus &b)
+{
+    return a.cpu.a == b.cpu.a && a.cpu.x == b.cpu.x && a.cpu.y == b.cpu.y && a.cpu.pc == b.cpu.pc &&
+        a.cpu.stkp == b.cpu.stkp && a.cpu.status == b.cpu.status && a.cpu.clock_count == b.cpu.clock_count &&
+        a.ram == b.ram && a.prgRam == b.prgRam;
+}
+
+static void Print(const char *name, const Bus &nes, uint32_t cycles)
+{
+    printf("  %-12s PC $%04X  A $%02X  X $%02X  Y $%02X  SP $%02X  P $%02X  cycle %llu  step %u cycles\n", name, nes.cpu.pc,
+        nes.cpu.a, nes.cpu.x, nes.cpu.y, nes.cpu.stkp, nes.cpu.status, (unsigned long long)nes.cpu.clock_count, cycles);
+}
+
+// Run one program on both tiers, returns false on the first step they disagree
+static bool Lockstep(cpu6502::VARIANT variant, const std::vector<uint8_t> &ops, uint32_t seed, uint64_t &cycles)
+{
+    std::mt19937 rng(seed);
+    auto fast = std::make_unique<Bus>(variant);
+    auto exact = std::make_unique<Bus>(variant);
+    Program(fast->cpu, ops, rng);
+    fast->InsertPRG(prg.data(), prg.size(), true);
+    exact->InsertPRG(prg.data(), prg.size(), true);
+    Memory(*fast, rng);
+    exact->ram = fast->ram;
+    exact->prgRam = fast->prgRam;
+    fast->cpu.SetAccuracy(cpu6502::ACCURACY_INSTRUCTION);
+    exact->cpu.SetAccuracy(cpu6502::ACCURACY_CYCLE);
+    fast->cpu.reset();
+    exact->cpu.reset();
+
+    int irqSteps = 0;
+    for (int s = 0; s < STEPS; s++)
+    {
+        // Interrupt lines change between steps, the same on both
+        uint32_t r = rng() % 1000;
+        if (irqSteps == 0 && r < 5) irqSteps = 1 + r * 3;
+        bool bIrq = irqSteps > 0;
+        if (irqSteps > 0) irqSteps--;
+        fast->cpu.SetIRQ(cpu6502::IRQ_MAPPER, bIrq);
+        exact->cpu.SetIRQ(cpu6502::IRQ_MAPPER, bIrq);
+        bool bNmi = r >= 998;
+        fast->cpu.SetNMI(bNmi);
+        exact->cpu.SetNMI(bNmi);
+
+        uint16_t pc = fast->cpu.pc;
+        uint32_t fastCycles = fast->cpu.step();
+        uint32_t exactCycles = exact->cpu.step();
+        cycles += fastCycles;
+        if (fastCycles != exactCycles || !Same(*fast, *exact))
+        {
+            printf("MISMATCH %s seed %u step %d, %s at $%04X\n", variant == cpu6502::VARIANT_NMOS ? "NMOS" : "2A03", seed, s,
+                fast->cpu.GetName(prg[pc & 0x7FFF]).c_str(), pc);
+            Print("instruction", *fast, fastCycles);
+            Print("cycle", *exact, exactCycles);
+            for (size_t i = 0; i < fast->ram.size(); i++)
+            {
+                if (fast->ram[i] != exact->ram[i]) printf("  RAM $%04zX  $%02X  $%02X\n", i, fast->ram[i], exact->ram[i]);
+            }
+            for (size_t i = 0; i < fast->prgRam.size(); i++)
+            {
+                if (fast->prgRam[i] != exact->prgRam[i]) printf("  PRG-RAM $%04zX  $%02X  $%02X\n", 0x6000 + i, fast->prgRam[i], exact->prgRam[i]);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// Dots from the PPU's position to the start of vblank, rendering is off so every line is 341 dots
+static int64_t ToVblank(const ppu2C02 &ppu)
+{
+    int64_t d = (241 - ppu.scanline) * 341 + (1 - ppu.dot);
+    return (d > 0) ? d : d + 262 * 341;
+}
+
+// NOPs with the NMI enabled, step until vblank starts in the given cycle (0 or 1) of the next NOP and return the
+// address the NMI comes back to, relative to that NOP, or -1 if it is not taken within two instructions
+static int NmiReturn(cpu6502::ACCURACY accuracy, int64_t cycle)
+{
+    // $8000 LDA #$80, STA $2000, NOPs, JMP $8005 at $F000, the NMI handler at $F004 loops on itself
+    prg.fill(0xEA);
+    const uint8_t start[] = { 0xA9, 0x80, 0x8D, 0x00, 0x20 };
+    const uint8_t end[] = { 0x4C, 0x05, 0x80, 0x4C, 0x04, 0xF0 };
+    memcpy(&prg[0x0000], start, sizeof(start));
+    memcpy(&prg[0x7000], end, sizeof(end));
+    prg[0x7FFA] = 0x04; prg[0x7FFB] = 0xF0;
+    prg[0x7FFC] = 0x00; prg[0x7FFD] = 0x80;
+
+    auto nes = std::make_unique<Bus>();
+    nes->InsertPRG(prg.data(), prg.size());
+    nes->cpu.SetAccuracy(accuracy);
+    nes->cpu.reset();
+    nes->step();
+    nes->step();
+    // The PPU is caught up to the CPU after every step, each cycle of the next NOP covers 3 more dots
+    for (int i = 0; i < 200000; i++)
+    {
+        uint16_t pc = nes->cpu.pc;
+        int64_t d = ToVblank(nes->ppu);
+        if (pc >= 0x8005 && pc < 0xEFFE && d / 3 == cycle)
+        {
+            for (int n = 0; n < 3 && nes->cpu.pc < 0xF004; n++) nes->step();
+            if (nes->cpu.pc < 0xF004) return -1;
+            uint16_t back = nes->ram[0x0100 + (uint8_t)(nes->cpu.stkp + 2)] | (nes->ram[0x0100 + (uint8_t)(nes->cpu.stkp + 3)] << 8);
+            return back - pc;
+        }
+        nes->step();
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const int programs = (argc > 1) ? atoi(argv[1]) : 500;
+
+    bool bOk = true;
+    for (cpu6502::VARIANT variant : { cpu6502::VARIANT_2A03, cpu6502::VARIANT_NMOS })
+    {
+        cpu6502 cpu(variant);
+        const std::vector<uint8_t> ops = Opcodes(cpu);
+        uint64_t cycles = 0;
+        int passed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int p = 0; p < programs && bOk; p++)
+        {
+            bOk = Lockstep(variant, ops, 1000 * (uint32_t)variant + (uint32_t)p, cycles);
+            passed += bOk;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("%s  %zu opcodes  %d of %d programs  %d steps each  %llu cycles agree  %.2f s\n",
+            variant == cpu6502::VARIANT_NMOS ? "NMOS" : "2A03", ops.size(), passed, programs, STEPS,
+            (unsigned long long)cycles, elapsed.count());
+        if (!bOk) break;
+    }
+
+    // One NOP and the NMI when vblank starts in its first cycle, two when it starts in its last
+    for (cpu6502::ACCURACY accuracy : { cpu6502::ACCURACY_INSTRUCTION, cpu6502::ACCURACY_CYCLE })
+    {
+        if (!bOk) break;
+        int first = NmiReturn(accuracy, 0);
+        int last = NmiReturn(accuracy, 1);
+        bool bNmi = first == 1 && last == 2;
+        printf("%s tier  vblank in the first cycle of a NOP, NMI after %d instruction(s), in the last after %d  %s\n",
+            accuracy == cpu6502::ACCURACY_CYCLE ? "cycle" : "instruction", first, last, bNmi ? "ok" : "MISMATCH");
+        bOk &= bNmi;
+    }
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+// Hardware cache counters for the benchmarks, read through perf_event_open on Linux
+// Counters that the kernel or the CPU does not offer read as unavailable instead of failing the benchmark.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class PerfCounters
+{
+    public:
+        enum COUNTER
+        {
+            CYCLES, // Host CPU cycles
+            INSTRUCTIONS, // Host instructions retired
+            L1D_READ_ACCESS, // L1 data cache reads
+            L1D_READ_MISS, // L1 data cache read misses
+            LL_READ_ACCESS, // Last level cache reads
+            LL_READ_MISS, // Last level cache read misses
+            COUNTER_COUNT,
+        };
+
+        PerfCounters()
+        {
+            for (int i = 0; i < COUNTER_COUNT; i++)
+            {
+                fd[i] = -1;
+                value[i] = 0;
+            }
+#ifdef __linux__
+            Open(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            Open(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            Open(L1D_READ_ACCESS, PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+            Open(L1D_READ_MISS, PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            Open(LL_READ_ACCESS, PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+            Open(LL_READ_MISS, PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS));
+#endif
+        }
+
+        ~PerfCounters()
+        {
+#ifdef __linux__
+            for (int i = 0; i < COUNTER_COUNT; i++)
+            {
+                if (fd[i] >= 0) close(fd[i]);
+            }
+#endif
+        }
+
+        void Start()
+        {
+#ifdef __linux__
+            for (int i = 0; i < COUNTER_COUNT; i++)
+            {
+                if (fd[i] < 0) continue;
+                ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+
+        void Stop()
+        {
+#ifdef __linux__
+            for (int i = 0; i < COUNTER_COUNT; i++)
+            {
+                if (fd[i] < 0) continue;
+                ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (::read(fd[i], &value[i], sizeof(uint64_t)) != sizeof(uint64_t)) value[i] = 0;
+            }
+#endif
+        }
+
+        bool Valid(COUNTER c) const { return fd[c] >= 0; }
+        uint64_t Get(COUNTER c) const { return value[c]; }
+
+        // L1 data misses that were served before the last level cache, an estimate of the L2 hit rate
+        // Returns a negative value if the counters are not available
+        double L2HitRate() const
+        {
+            if (!Valid(L1D_READ_MISS) || !Valid(LL_READ_ACCESS) || value[L1D_READ_MISS] == 0) return -1.0;
+            double reachedLL = (double)value[LL_READ_ACCESS] / (double)value[L1D_READ_MISS];
+            return reachedLL > 1.0 ? 0.0 : 1.0 - reachedLL;
+        }
+
+        // Fraction of L1 data reads that hit, negative if not available
+        double L1HitRate() const
+        {
+            if (!Valid(L1D_READ_ACCESS) || !Valid(L1D_READ_MISS) || value[L1D_READ_ACCESS] == 0) return -1.0;
+            return 1.0 - (double)value[L1D_READ_MISS] / (double)value[L1D_READ_ACCESS];
+        }
+
+    private:
+        int fd[COUNTER_COUNT];
+        uint64_t value[COUNTER_COUNT];
+
+#ifdef __linux__
+        static uint64_t Cache(uint64_t cache, uint64_t result)
+        {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+        }
+
+        void Open(COUNTER c, uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd[c] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+};
@@ -0,0 +1,89 @@
+// Pool benchmark, time to first instruction of a fresh emulation
+// Compares new Bus() + cpu.reset() with BusPool::Acquire() from a captured template, then runs the pool from several threads.
+//   make PoolBench
+//   ./PoolBench [huge]
+#include "BusPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// LDA #$01, STA $00, JMP $8000
+static const uint8_t program[] = { 0xA9, 0x01, 0x85, 0x00, 0x4C, 0x00, 0x80 };
+
+int main(int argc, char *argv[])
+{
+    const bool bHuge = (argc > 1) && strcmp(argv[1], "huge") == 0;
+    const int iterations = 200000;
+
+    static std::array<uint8_t, 32 * 1024> prg = {};
+    memcpy(prg.data(), program, sizeof(program));
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+
+    // new Bus() + cpu.reset(), then the first instruction
+    uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        Bus *nes = new Bus();
+        nes->InsertPRG(prg.data(), prg.size());
+        nes->cpu.reset();
+        sink += nes->cpu.step();
+        delete nes;
+    }
+    std::chrono::duration<double> heap = std::chrono::steady_clock::now() - start;
+
+    // Pool, the template already has the cartridge inserted and the CPU reset
+    BusPool pool(1024, bHuge);
+    if (!pool.Valid())
+    {
+        printf("could not map the arena\n");
+        return 1;
+    }
+    {
+        Bus nes;
+        nes.InsertPRG(prg.data(), prg.size());
+        nes.cpu.reset();
+        pool.Capture(nes);
+    }
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        Bus *nes = pool.Acquire();
+        sink += nes->cpu.step();
+        pool.Release(nes);
+    }
+    std::chrono::duration<double> pooled = std::chrono::steady_clock::now() - start;
+
+    printf("instance size         %zu bytes, stride %zu, %s pages\n", sizeof(Bus), pool.Stride(), pool.HugePages() ? "2MB" : "4KB");
+    printf("new Bus() + reset     %.1f ns to first instruction\n", heap.count() * 1e9 / iterations);
+    printf("BusPool::Acquire()    %.1f ns to first instruction (%.1fx)\n", pooled.count() * 1e9 / iterations, heap.count() / pooled.count());
+
+    // Several workers sharing the pool, each holding a few instances at a time
+    const int workers = (int)std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    start = std::chrono::steady_clock::now();
+    for (int t = 0; t < workers; t++)
+    {
+        threads.emplace_back([&pool]()
+        {
+            Bus *held[4];
+            for (int i = 0; i < iterations / 4; i++)
+            {
+                for (auto &h : held) h = pool.Acquire();
+                for (auto &h : held)
+                {
+                    if (h != nullptr) h->cpu.step();
+                    pool.Release(h);
+                }
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+    std::chrono::duration<double> shared = std::chrono::steady_clock::now() - start;
+    printf("%d threads             %.1f ns per acquire and release\n", workers, shared.count() * 1e9 / ((double)workers * (iterations / 4) * 4));
+
+    return sink == 0;
+}
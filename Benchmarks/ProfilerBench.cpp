@@ -0,0 +1,173 @@
+// Profiler benchmark, frames per second with and without the sampling profiler, and the folded stacks it collects
+// on a program with nested calls, a tail call and an NMI handler, symbolised from an ld65 debug file
+//   make ProfilerBench
+//   ./ProfilerBench [frames per run] [folded output]
+#include "Bus.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// reset   $8000 SEI, CLD, LDX #$FF, TXS, LDA #$80, STA $2000
+// main    $800A JSR update, JSR draw, JMP main
+// update  $8013 LDX #$40
+// @loop   $8015 JSR mul, DEX, BNE @loop, RTS
+// mul     $801C LDA #$00, LDY #$08
+// @shift  $8020 ASL A, ADC $10, DEY, BNE @shift, STA $11, RTS
+// draw    $8029 LDX #$20
+// @copy   $802B LDA $0200,X, EOR #$FF, STA $0300,X, DEX, BNE @copy, JMP blit
+// blit    $8039 LDY #$10
+// @wait   $803B DEY, BNE @wait, RTS
+// nmi     $803F PHA, JSR nmisub, PLA, RTI
+// nmisub  $8045 LDA #$40, STA $21
+// @spin   $804B DEC $21, BNE @spin, RTS
+static const uint8_t program[] =
+{
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x80, 0x8D, 0x00, 0x20,
+    0x20, 0x13, 0x80, 0x20, 0x29, 0x80, 0x4C, 0x0A, 0x80,
+    0xA2, 0x40,
+    0x20, 0x1C, 0x80, 0xCA, 0xD0, 0xFA, 0x60,
+    0xA9, 0x00, 0xA0, 0x08,
+    0x0A, 0x65, 0x10, 0x88, 0xD0, 0xFA, 0x85, 0x11, 0x60,
+    0xA2, 0x20,
+    0xBD, 0x00, 0x02, 0x49, 0xFF, 0x9D, 0x00, 0x03, 0xCA, 0xD0, 0xF5, 0x4C, 0x39, 0x80,
+    0xA0, 0x10,
+    0x88, 0xD0, 0xFD, 0x60,
+    0x48, 0x20, 0x45, 0x80, 0x68, 0x40,
+    0xA9, 0x40, 0x85, 0x21,
+    0xC6, 0x21, 0xD0, 0xFC, 0x60,
+};
+
+// The labels as ld65 writes them to a debug file, equates are skipped
+static const char *dbgFile =
+    "version\tmajor=2,minor=0\n"
+    "sym\tid=0,name=\"reset\",addrsize=absolute,scope=0,def=1,val=0x8000,seg=0,type=lab\n"
+    "sym\tid=1,name=\"main\",addrsize=absolute,scope=0,def=2,val=0x800A,seg=0,type=lab\n"
+    "sym\tid=2,name=\"update\",addrsize=absolute,scope=0,def=3,val=0x8013,seg=0,type=lab\n"
+    "sym\tid=3,name=\"@loop\",addrsize=absolute,scope=0,def=4,val=0x8015,seg=0,type=lab\n"
+    "sym\tid=4,name=\"mul\",addrsize=absolute,scope=0,def=5,val=0x801C,seg=0,type=lab\n"
+    "sym\tid=5,name=\"draw\",addrsize=absolute,scope=0,def=6,val=0x8029,seg=0,type=lab\n"
+    "sym\tid=6,name=\"blit\",addrsize=absolute,scope=0,def=7,val=0x8039,seg=0,type=lab\n"
+    "sym\tid=7,name=\"nmi\",addrsize=absolute,scope=0,def=8,val=0x803F,seg=0,type=lab\n"
+    "sym\tid=8,name=\"nmisub\",addrsize=absolute,scope=0,def=9,val=0x8045,seg=0,type=lab\n"
+    "sym\tid=9,name=\"PPUCTRL\",addrsize=absolute,scope=0,def=10,val=0x2000,type=equ\n";
+
+static std::array<uint8_t, 32 * 1024> prg = {};
+
+static std::unique_ptr<Bus> Make(cpu6502::ACCURACY accuracy)
+{
+    auto nes = std::make_unique<Bus>();
+    nes->InsertPRG(prg.data(), prg.size());
+    nes->cpu.SetAccuracy(accuracy);
+    nes->cpu.reset();
+    return nes;
+}
+
+// Frames per second, with a profiler at the given period or without one (period 0)
+static double Run(uint32_t period, int frames)
+{
+    auto nes = Make(cpu6502::ACCURACY_INSTRUCTION);
+    Profiler prof(period == 0 ? 1000 : period);
+    if (period != 0) prof.Attach(nes.get());
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) nes->frame();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames / elapsed.count();
+}
+
+// Overhead in percent, the median over short runs with the profiler each between two runs without it
+// A shared host drifts by more than 5% over a long run, the pairs only see the drift within a few milliseconds
+static double Overhead(uint32_t period, int frames, double &fps)
+{
+    std::vector<double> ratio, speed;
+    for (int i = 0; i < 41; i++)
+    {
+        double before = Run(0, frames);
+        double on = Run(period, frames);
+        double after = Run(0, frames);
+        ratio.push_back((before + after) / (2.0 * on));
+        speed.push_back(on);
+    }
+    std::sort(ratio.begin(), ratio.end());
+    std::sort(speed.begin(), speed.end());
+    fps = speed[speed.size() / 2];
+    return (ratio[ratio.size() / 2] - 1.0) * 100.0;
+}
+
+// Folded stacks of a profiled run
+static std::string Profile(cpu6502::ACCURACY accuracy, const std::string &symbols, int frames, uint64_t &samples)
+{
+    auto nes = Make(accuracy);
+    Profiler prof;
+    prof.LoadSymbols(symbols);
+    prof.Attach(nes.get());
+    for (int f = 0; f < frames; f++) nes->frame();
+    samples = prof.Samples();
+    return prof.Folded();
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = (argc > 1) ? atoi(argv[1]) : 100;
+    memcpy(prg.data(), program, sizeof(program));
+    prg[0x7FFA] = 0x3F;
+    prg[0x7FFB] = 0x80;
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+
+    char path[] = "/tmp/profbenchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    FILE *f = fdopen(fd, "w");
+    fputs(dbgFile, f);
+    fclose(f);
+
+    // Stacks, both tiers hook the same calls and returns
+    uint64_t samples[2];
+    std::string folded = Profile(cpu6502::ACCURACY_INSTRUCTION, path, 120, samples[0]);
+    std::string cycle = Profile(cpu6502::ACCURACY_CYCLE, path, 120, samples[1]);
+    remove(path);
+
+    std::vector<std::pair<uint64_t, std::string>> lines;
+    std::istringstream in(folded);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t space = line.rfind(' ');
+        lines.push_back({ strtoull(line.c_str() + space + 1, nullptr, 10), line.substr(0, space) });
+    }
+    std::sort(lines.rbegin(), lines.rend());
+    printf("120 frames, %llu samples (cycle tier %llu), %zu stacks\n",
+        (unsigned long long)samples[0], (unsigned long long)samples[1], lines.size());
+    for (size_t i = 0; i < lines.size() && i < 10; i++)
+    {
+        printf("  %6llu  %s\n", (unsigned long long)lines[i].first, lines[i].second.c_str());
+    }
+    bool bSame = folded == cycle;
+    printf("cycle tier stacks     %s\n", bSame ? "identical" : "differ");
+
+    if (argc > 2)
+    {
+        f = fopen(argv[2], "w");
+        if (f != nullptr)
+        {
+            fputs(folded.c_str(), f);
+            fclose(f);
+        }
+    }
+
+    // Overhead
+    const uint32_t periods[] = { 1000, 100, 10 };
+    printf("no profiler           %9.0f frames/s\n", Run(0, frames * 10));
+    for (uint32_t period : periods)
+    {
+        double fps;
+        double overhead = Overhead(period, frames, fps);
+        printf("period %-14u %9.0f frames/s  %5.2f%% overhead\n", period, fps, overhead);
+    }
+    return 0;
+}
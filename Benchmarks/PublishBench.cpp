@@ -0,0 +1,158 @@
+// State publishing benchmark, the cost of Publish() per subscription size and frames per second with 4 reader threads
+// sampling the published state, compared to no publishing at all. Readers check every snapshot is consistent.
+//   make PublishBench
+//   ./PublishBench [frames per run]
+#include "Bus.h"
+#include "StatePublisher.h"
+#include "TestRom.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Frame counting loop, the NMI fills $0300-$033F
+static const TestRom rom;
+
+static std::unique_ptr<Bus> Make(uint8_t *pixels)
+{
+    auto nes = rom.Make();
+    nes->ppu.frameBuffer = pixels;
+    return nes;
+}
+
+// Nanoseconds per Publish() of a bus that is not running
+static double PublishCost(StatePublisher &pub, const Bus &nes, uint32_t &bytes)
+{
+    const int n = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) pub.Publish(nes);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bytes = pub.PublishBytes();
+    return elapsed.count() / n * 1e9;
+}
+
+// Readers, a UI that wants the frame buffer and three metrics readers that want a few RAM ranges
+struct Readers
+{
+    StatePublisher &pub;
+    std::atomic<bool> bStop{ false };
+    std::atomic<uint64_t> reads{ 0 };
+    std::atomic<uint64_t> torn{ 0 };
+    std::atomic<uint64_t> retries{ 0 };
+    std::vector<std::thread> threads;
+
+    Readers(StatePublisher &p, int count) : pub(p)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int id = pub.AddReader(i == 0);
+            pub.Subscribe(id, 0x0000, 0x0020);
+            pub.Subscribe(id, 0x0300, 0x0040);
+            threads.emplace_back([this, id] { Run(id); });
+        }
+    }
+
+    ~Readers()
+    {
+        bStop = true;
+        for (auto &t : threads) t.join();
+    }
+
+    // Sample at about 2kHz, a snapshot is consistent when the NMI's block all holds the frame counter
+    void Run(int id)
+    {
+        StatePublisher::State s;
+        uint64_t last = 0;
+        while (!bStop)
+        {
+            if (pub.Read(id, s) && s.sequence != last)
+            {
+                last = s.sequence;
+                bool bOk = true;
+                for (int i = 0; i < 0x40; i++) bOk &= s.ram[0x300 + i] == s.ram[0x11];
+                if (!bOk) torn++;
+                reads++;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        retries += pub.Retries(id);
+        pub.RemoveReader(id);
+    }
+};
+
+// Frames per second, publishing every frame when a publisher is given
+static double Run(StatePublisher *pub, int frames)
+{
+    std::vector<uint8_t> pixels(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+    auto nes = Make(pixels.data());
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        nes->frame();
+        if (pub != nullptr) pub->Publish(*nes);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = (argc > 1) ? atoi(argv[1]) : 100;
+
+    // Cost of one publish, it only grows with what readers subscribed to
+    {
+        std::vector<uint8_t> pixels(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+        auto nes = Make(pixels.data());
+        StatePublisher pub;
+        uint32_t bytes;
+        double ns = PublishCost(pub, *nes, bytes);
+        printf("publish, registers only        %7.1f ns  %6u bytes\n", ns, bytes);
+        int id = pub.AddReader();
+        pub.Subscribe(id, 0x0000, 0x0020);
+        pub.Subscribe(id, 0x0300, 0x0040);
+        ns = PublishCost(pub, *nes, bytes);
+        printf("publish, 2 RAM ranges          %7.1f ns  %6u bytes\n", ns, bytes);
+        pub.Subscribe(id, 0x0000, 0x0800);
+        ns = PublishCost(pub, *nes, bytes);
+        printf("publish, all RAM               %7.1f ns  %6u bytes\n", ns, bytes);
+        pub.RemoveReader(id);
+        id = pub.AddReader(true);
+        pub.Subscribe(id, 0x0000, 0x0020);
+        ns = PublishCost(pub, *nes, bytes);
+        printf("publish, RAM and frame buffer  %7.1f ns  %6u bytes\n", ns, bytes);
+    }
+
+    // Throughput, runs with the readers sampling each between two runs without publishing, median of the ratios
+    StatePublisher pub;
+    std::vector<double> ratio, speed;
+    uint64_t reads, torn, retries;
+    {
+        Readers readers(pub, 4);
+        for (int i = 0; i < 31; i++)
+        {
+            double before = Run(nullptr, frames);
+            double on = Run(&pub, frames);
+            double after = Run(nullptr, frames);
+            ratio.push_back((before + after) / (2.0 * on));
+            speed.push_back(on);
+        }
+        readers.bStop = true;
+        for (auto &t : readers.threads) t.join();
+        readers.threads.clear();
+        reads = readers.reads;
+        torn = readers.torn;
+        retries = readers.retries;
+    }
+    std::sort(ratio.begin(), ratio.end());
+    std::sort(speed.begin(), speed.end());
+    printf("publishing with 4 readers      %7.0f frames/s  %5.2f%% slower than no publishing\n",
+        speed[speed.size() / 2], (ratio[ratio.size() / 2] - 1.0) * 100.0);
+    printf("reads %llu, torn %llu, retries %llu, published %llu\n", (unsigned long long)reads, (unsigned long long)torn,
+        (unsigned long long)retries, (unsigned long long)pub.Published());
+    return torn == 0 ? 0 : 1;
+}
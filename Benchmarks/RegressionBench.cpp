@@ -0,0 +1,172 @@
+// Regression benchmark, hash throughput, a corpus recorded and compared against its golden database, and a
+// regression in one entry caught with a pixel diff
+//   make RegressionBench
+//   ./RegressionBench [golden file] [entries]
+#include "Regression.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Sets up the palette, nametable and sprites, turns on rendering and NMI, then polls $2002 for sprite 0 hit every frame.
+// The NMI does the sprite DMA, scrolls by one pixel and moves sprites 1-15, 12 of which share a line for overflow.
+//   $8000 SEI, CLD, LDX #$FF, TXS
+//   $8005 BIT $2002, BPL $8005, BIT $2002, BPL $800A
+//   $800F LDA #$3F, STA $2006, LDA #$00, STA $2006, LDX #$00
+//   $801B LDA $9000,X, STA $2007, INX, CPX #$20, BNE $801B
+//   $8026 LDA #$20, STA $2006, LDA #$00, STA $2006, LDY #$04, LDX #$00
+//   $8034 TXA, AND #$03, STA $2007, INX, BNE $8034, DEY, BNE $8034
+//   $8040 LDX #$00
+//   $8042 LDA $9100,X, STA $0200,X, INX, BNE $8042
+//   $804B LDA #$02, STA $4014, LDA #$00, STA $2005, STA $2005, LDA #$80, STA $2000, LDA #$1E, STA $2001
+//   $8062 BIT $2002, BVS $8062
+//   $8067 BIT $2002, BVC $8067
+//   $806C INC $10, LDA $10, EOR $11, STA $12, JMP $8062
+// NMI
+//   $8077 PHA, LDA #$02, STA $4014, INC $11, LDA $11, STA $2005, LDA #$00, STA $2005, LDX #$04
+//   $808B INC $0203,X, INX, INX, INX, INX, CPX #$40, BNE $808B, PLA, RTI
+static const uint8_t program[] =
+{
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0x2C, 0x02, 0x20, 0x10, 0xFB, 0x2C, 0x02, 0x20, 0x10, 0xFB,
+    0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA2, 0x00,
+    0xBD, 0x00, 0x90, 0x8D, 0x07, 0x20, 0xE8, 0xE0, 0x20, 0xD0, 0xF5,
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA0, 0x04, 0xA2, 0x00,
+    0x8A, 0x29, 0x03, 0x8D, 0x07, 0x20, 0xE8, 0xD0, 0xF7, 0x88, 0xD0, 0xF4,
+    0xA2, 0x00,
+    0xBD, 0x00, 0x91, 0x9D, 0x00, 0x02, 0xE8, 0xD0, 0xF7,
+    0xA9, 0x02, 0x8D, 0x14, 0x40, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, 0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20,
+    0x2C, 0x02, 0x20, 0x70, 0xFB,
+    0x2C, 0x02, 0x20, 0x50, 0xFB,
+    0xE6, 0x10, 0xA5, 0x10, 0x45, 0x11, 0x85, 0x12, 0x4C, 0x62, 0x80,
+    0x48, 0xA9, 0x02, 0x8D, 0x14, 0x40, 0xE6, 0x11, 0xA5, 0x11, 0x8D, 0x05, 0x20, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0xA2, 0x04,
+    0xFE, 0x03, 0x02, 0xE8, 0xE8, 0xE8, 0xE8, 0xE0, 0x40, 0xD0, 0xF5, 0x68, 0x40,
+};
+
+// One image per corpus entry, the palette and sprites differ between entries
+static void Build(uint8_t *prg, uint8_t *chr, int n)
+{
+    memcpy(prg, program, sizeof(program));
+    for (int i = 0; i < 32; i++) prg[0x1000 + i] = (i * 7 + n) & 0x3F;
+    for (int i = 0; i < 64; i++)
+    {
+        uint8_t *s = &prg[0x1100 + i * 4];
+        s[0] = 0xFF; // Off screen
+        s[1] = 1 + ((i + n) % 3);
+        s[2] = (i & 0x03) | ((i & 0x04) << 3) | ((i & 0x08) << 3);
+        s[3] = i * 16 + n;
+        if (i >= 1 && i < 16) s[0] = 40 + i * 8;
+    }
+    prg[0x1100] = 100; // Sprite 0 over the background
+    prg[0x1101] = 2;
+    prg[0x1102] = 0x00;
+    prg[0x1103] = 120;
+    prg[0x7FFA] = 0x77;
+    prg[0x7FFB] = 0x80;
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+    prg[0x7FFE] = 0x77;
+    prg[0x7FFF] = 0x80;
+
+    for (int row = 0; row < 8; row++)
+    {
+        chr[0x10 + row] = 0xFF;
+        chr[0x20 + row] = 0xAA;
+        chr[0x28 + row] = 0x55;
+        chr[0x30 + row] = 0xF0 >> (row & 3);
+        chr[0x38 + row] = 0x0F;
+    }
+}
+
+static const char *names[] = { "pass", "FAIL", "new", "MISSING" };
+
+int main(int argc, char *argv[])
+{
+    const char *path = (argc > 1) ? argv[1] : "golden.db";
+    const int entries = (argc > 2) ? atoi(argv[2]) : 32;
+
+    // Hash throughput on a frame
+    {
+        std::vector<uint8_t> frame(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+        for (size_t i = 0; i < frame.size(); i++) frame[i] = (uint8_t)(i * 31 + (i >> 8));
+        const int rounds = 20000;
+        volatile uint64_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++)
+        {
+            frame[r % frame.size()]++;
+            sink = sink + Regression::Hash64(frame.data(), frame.size());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("hash                  %6.2f GB/s, %5.2f us per frame\n",
+            (double)frame.size() * rounds / elapsed.count() / 1e9, elapsed.count() / rounds * 1e6);
+    }
+
+    // Corpus, every entry checks frames 10, 60 and 300 and the 20th NMI
+    std::vector<std::vector<uint8_t>> prg(entries, std::vector<uint8_t>(32 * 1024));
+    std::vector<std::vector<uint8_t>> chr(entries, std::vector<uint8_t>(8 * 1024));
+    std::vector<Regression::Rom> corpus(entries);
+    for (int i = 0; i < entries; i++)
+    {
+        Build(prg[i].data(), chr[i].data(), i);
+        auto &rom = corpus[i];
+        rom.name = "synthetic/" + std::to_string(i);
+        rom.prg = prg[i].data();
+        rom.prgSize = prg[i].size();
+        rom.chr = chr[i].data();
+        rom.chrSize = chr[i].size();
+        rom.checkpoints =
+        {
+            { Regression::Checkpoint::KIND_FRAME, 10, 1 },
+            { Regression::Checkpoint::KIND_PC, 0x8077, 20 },
+            { Regression::Checkpoint::KIND_FRAME, 60, 1 },
+            { Regression::Checkpoint::KIND_FRAME, 300, 1 },
+        };
+        rom.maxFrames = 400;
+    }
+
+    // Results stream in as each checkpoint completes, only the interesting ones are printed
+    auto report = [](const Regression::Result &r)
+    {
+        if (r.status != Regression::STATUS_FAIL && r.status != Regression::STATUS_MISSING) return;
+        printf("  %-14s checkpoint %u  %s  frame %llu", r.rom->name.c_str(), r.checkpoint, names[r.status], (unsigned long long)r.frame);
+        if (r.diff.pixels > 0)
+        {
+            printf("  %u pixels in (%d,%d)-(%d,%d)", r.diff.pixels, r.diff.left, r.diff.top, r.diff.right, r.diff.bottom);
+        }
+        if (r.diff.ramBytes > 0) printf("  %u RAM bytes from $%04X", r.diff.ramBytes, r.diff.firstRam);
+        printf("\n");
+    };
+    auto summary = [](const char *what, const Regression &reg)
+    {
+        auto &s = reg.GetStats();
+        printf("%-21s %llu checkpoints: %llu pass, %llu fail, %llu new, %llu missing, compare %.2f%% of emulation\n", what,
+            (unsigned long long)s.checkpoints, (unsigned long long)s.passed, (unsigned long long)s.failed,
+            (unsigned long long)s.added, (unsigned long long)s.missing, s.compareSeconds / s.emulateSeconds * 100.0);
+    };
+
+    remove(path);
+    Regression regression(path);
+    if (!regression.Run(corpus, Regression::MODE_RECORD, report))
+    {
+        printf("could not write %s\n", path);
+        return 1;
+    }
+    summary("record", regression);
+    printf("                      %u golden records in %s\n", regression.Records(), path);
+
+    auto start = std::chrono::steady_clock::now();
+    regression.Run(corpus, Regression::MODE_COMPARE, report);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    summary("compare", regression);
+    printf("                      %.0f frames/s over the corpus\n", entries * 300 / elapsed.count());
+    bool bOk = regression.GetStats().passed == regression.GetStats().checkpoints;
+
+    // A regression, one sprite of one entry moved
+    prg[entries / 2][0x1100 + 14 * 4 + 3] += 5;
+    regression.Run(corpus, Regression::MODE_COMPARE, report);
+    summary("regressed", regression);
+    bOk = bOk && regression.GetStats().failed > 0;
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// Render-skip benchmark, frames per second rendering every frame, one frame in 4 and none, and a check that the
+// CPU trace is bit-identical in all three
+//   make RenderSkipBench
+//   ./RenderSkipBench [frames]
+#include "Bus.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Sets up the palette, nametable and sprites, turns on rendering and NMI, then polls $2002 for sprite 0 hit every frame.
+// The NMI does the sprite DMA, scrolls by one pixel and moves sprites 1-15, 12 of which share a line for overflow.
+//   $8000 SEI, CLD, LDX #$FF, TXS
+//   $8005 BIT $2002, BPL $8005, BIT $2002, BPL $800A
+//   $800F LDA #$3F, STA $2006, LDA #$00, STA $2006, LDX #$00
+//   $801B LDA $9000,X, STA $2007, INX, CPX #$20, BNE $801B
+//   $8026 LDA #$20, STA $2006, LDA #$00, STA $2006, LDY #$04, LDX #$00
+//   $8034 TXA, AND #$03, STA $2007, INX, BNE $8034, DEY, BNE $8034
+//   $8040 LDX #$00
+//   $8042 LDA $9100,X, STA $0200,X, INX, BNE $8042
+//   $804B LDA #$02, STA $4014, LDA #$00, STA $2005, STA $2005, LDA #$80, STA $2000, LDA #$1E, STA $2001
+//   $8062 BIT $2002, BVS $8062
+//   $8067 BIT $2002, BVC $8067
+//   $806C INC $10, LDA $10, EOR $11, STA $12, JMP $8062
+// NMI
+//   $8077 PHA, LDA #$02, STA $4014, INC $11, LDA $11, STA $2005, LDA #$00, STA $2005, LDX #$04
+//   $808B INC $0203,X, INX, INX, INX, INX, CPX #$40, BNE $808B, PLA, RTI
+static const uint8_t program[] =
+{
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0x2C, 0x02, 0x20, 0x10, 0xFB, 0x2C, 0x02, 0x20, 0x10, 0xFB,
+    0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA2, 0x00,
+    0xBD, 0x00, 0x90, 0x8D, 0x07, 0x20, 0xE8, 0xE0, 0x20, 0xD0, 0xF5,
+    0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA0, 0x04, 0xA2, 0x00,
+    0x8A, 0x29, 0x03, 0x8D, 0x07, 0x20, 0xE8, 0xD0, 0xF7, 0x88, 0xD0, 0xF4,
+    0xA2, 0x00,
+    0xBD, 0x00, 0x91, 0x9D, 0x00, 0x02, 0xE8, 0xD0, 0xF7,
+    0xA9, 0x02, 0x8D, 0x14, 0x40, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, 0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20,
+    0x2C, 0x02, 0x20, 0x70, 0xFB,
+    0x2C, 0x02, 0x20, 0x50, 0xFB,
+    0xE6, 0x10, 0xA5, 0x10, 0x45, 0x11, 0x85, 0x12, 0x4C, 0x62, 0x80,
+    0x48, 0xA9, 0x02, 0x8D, 0x14, 0x40, 0xE6, 0x11, 0xA5, 0x11, 0x8D, 0x05, 0x20, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0xA2, 0x04,
+    0xFE, 0x03, 0x02, 0xE8, 0xE8, 0xE8, 0xE8, 0xE0, 0x40, 0xD0, 0xF5, 0x68, 0x40,
+};
+
+static std::array<uint8_t, 32 * 1024> prg = {};
+static std::array<uint8_t, 8 * 1024> chr = {};
+
+// Program, palette at $9000, sprites at $9100, vectors, and tiles 1-3 in CHR
+static void Build()
+{
+    memcpy(prg.data(), program, sizeof(program));
+    for (int i = 0; i < 32; i++) prg[0x1000 + i] = (i * 7 + 1) & 0x3F;
+    for (int i = 0; i < 64; i++)
+    {
+        uint8_t *s = &prg[0x1100 + i * 4];
+        s[0] = 0xFF; // Off screen
+        s[1] = 1 + (i % 3);
+        s[2] = (i & 0x03) | ((i & 0x04) << 3) | ((i & 0x08) << 3); // Palette, behind and horizontal flip
+        s[3] = i * 16;
+        if (i >= 1 && i <= 12) s[0] = 60;
+        else if (i > 12 && i < 16) s[0] = 150 + i;
+    }
+    prg[0x1100] = 100; // Sprite 0 over the background
+    prg[0x1101] = 2;
+    prg[0x1102] = 0x00;
+    prg[0x1103] = 120;
+    prg[0x7FFA] = 0x77;
+    prg[0x7FFB] = 0x80;
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+    prg[0x7FFE] = 0x77;
+    prg[0x7FFF] = 0x80;
+
+    for (int row = 0; row < 8; row++)
+    {
+        chr[0x10 + row] = 0xFF; // Tile 1, solid colour 1
+        chr[0x20 + row] = 0xAA; // Tile 2, stripes
+        chr[0x28 + row] = 0x55;
+        chr[0x30 + row] = 0xF0 >> (row & 3); // Tile 3, steps
+        chr[0x38 + row] = 0x0F;
+    }
+}
+
+static std::unique_ptr<Bus> Make(uint8_t *pixels, uint32_t renderEvery)
+{
+    auto nes = std::make_unique<Bus>();
+    nes->InsertPRG(prg.data(), prg.size());
+    nes->InsertCHR(chr.data(), chr.size(), ppu2C02::MIRROR_HORIZONTAL); // Scrolling right wraps into the same nametable
+    nes->cpu.reset();
+    nes->ppu.frameBuffer = pixels;
+    nes->ppu.renderEvery = renderEvery;
+    return nes;
+}
+
+// FNV-1a over the CPU state after every instruction and RAM after every frame
+static uint64_t Trace(uint32_t renderEvery, int frames, uint64_t &hits, uint64_t &rendered)
+{
+    std::vector<uint8_t> pixels(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+    auto nes = Make(pixels.data(), renderEvery);
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](uint64_t v)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            h ^= (v >> (i * 8)) & 0xFF;
+            h *= 1099511628211ull;
+        }
+    };
+
+    rendered = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        uint64_t count = nes->ppu.frameCount;
+        while (nes->ppu.frameCount == count)
+        {
+            nes->step();
+            mix(nes->cpu.pc | (uint64_t)nes->cpu.a << 16 | (uint64_t)nes->cpu.x << 24 | (uint64_t)nes->cpu.y << 32 |
+                (uint64_t)nes->cpu.status << 40 | (uint64_t)nes->cpu.stkp << 48);
+            mix(nes->cpu.clock_count);
+        }
+        for (uint8_t b : nes->ram) mix(b);
+        if (nes->ppu.bFrameRendered) rendered++;
+    }
+    hits = nes->ram[0x10];
+    return h;
+}
+
+// Frames per second
+static double Run(uint32_t renderEvery, int frames)
+{
+    std::vector<uint8_t> pixels(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+    auto nes = Make(pixels.data(), renderEvery);
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) nes->frame();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    const int frames = (argc > 1) ? atoi(argv[1]) : 2000;
+    Build();
+
+    // Trace
+    uint64_t hits[3], rendered[3];
+    uint64_t all = Trace(1, 600, hits[0], rendered[0]);
+    uint64_t some = Trace(4, 600, hits[1], rendered[1]);
+    uint64_t none = Trace(0, 600, hits[2], rendered[2]);
+    bool bSame = all == some && all == none;
+    printf("trace, 600 frames     render all %016llx, 1 in 4 %016llx, none %016llx  %s\n",
+        (unsigned long long)all, (unsigned long long)some, (unsigned long long)none, bSame ? "identical" : "MISMATCH");
+    printf("                      sprite 0 hits %llu, frames rendered %llu / %llu / %llu\n",
+        (unsigned long long)hits[0], (unsigned long long)rendered[0], (unsigned long long)rendered[1], (unsigned long long)rendered[2]);
+
+    // Speed
+    double fpsAll = Run(1, frames);
+    double fpsSome = Run(4, frames);
+    double fpsNone = Run(0, frames);
+    printf("render every frame    %9.0f frames/s\n", fpsAll);
+    printf("render 1 in 4         %9.0f frames/s  %5.2fx\n", fpsSome, fpsSome / fpsAll);
+    printf("render none           %9.0f frames/s  %5.2fx\n", fpsNone, fpsNone / fpsAll);
+    return bSame ? 0 : 1;
+}
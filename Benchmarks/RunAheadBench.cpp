@@ -0,0 +1,70 @@
+// Run-ahead benchmark, cost of a host frame for each run-ahead depth and the depth that fits in 60 Hz
+//   make RunAheadBench
+//   ./RunAheadBench [max frames]
+#include "RunAhead.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Reads controller 1 into $00 every loop and counts loops in $01, like a game polling input once per frame
+//   $8000 LDA #$01, STA $4016, LDA #$00, STA $4016, LDX #$08
+//   $800C LDA $4016, LSR A, ROL $00, DEX, BNE $800C
+//   $8015 INC $01, JMP $8000
+static const uint8_t program[] =
+{
+    0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40, 0xA2, 0x08,
+    0xAD, 0x16, 0x40, 0x4A, 0x26, 0x00, 0xCA, 0xD0, 0xF7,
+    0xE6, 0x01, 0x4C, 0x00, 0x80,
+};
+
+int main(int argc, char *argv[])
+{
+    const int maxFrames = (argc > 1) ? atoi(argv[1]) : 8;
+    const int hostFrames = 120;
+    const double frameTime = 1.0 / 60.0;
+
+    static std::array<uint8_t, 32 * 1024> prg = {};
+    memcpy(prg.data(), program, sizeof(program));
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+
+    for (auto mode : { RunAhead::MODE_SINGLE, RunAhead::MODE_SECONDARY })
+    {
+        printf("%s\n", mode == RunAhead::MODE_SINGLE ? "single instance" : "secondary instance");
+        double frameCost = 0.0;
+        for (int n = 0; n <= maxFrames; n++)
+        {
+            Bus nes;
+            nes.InsertPRG(prg.data(), prg.size());
+            nes.cpu.reset();
+
+            RunAhead ahead(nes, n, mode);
+            ahead.budget = 1e9; // Measure every depth, no fallback
+            auto start = std::chrono::steady_clock::now();
+            for (int f = 0; f < hostFrames; f++)
+            {
+                ahead.Frame((f & 16) ? Bus::BUTTON_A : 0);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            double perFrame = elapsed.count() / hostFrames;
+            if (n == 0) frameCost = perFrame;
+            printf("  N=%-2d  %7.3f ms per host frame, %5.1f%% of 60 Hz\n", n, perFrame * 1e3, perFrame / frameTime * 100.0);
+        }
+        // Each run-ahead frame costs about one emulated frame plus the copy
+        printf("  achievable N at 60 Hz (80%% budget) about %d\n", (int)(0.8 * frameTime / frameCost) - 1);
+    }
+
+    // Fallback, a budget that only fits a few frames
+    {
+        Bus nes;
+        nes.InsertPRG(prg.data(), prg.size());
+        nes.cpu.reset();
+        RunAhead ahead(nes, 1000);
+        ahead.budget = 0.002;
+        for (int f = 0; f < hostFrames; f++) ahead.Frame(0);
+        printf("fallback              asked for 1000 frames, %d fit a 2 ms budget (%llu host frames over)\n",
+            ahead.GetStats().effective, (unsigned long long)ahead.GetStats().overBudget);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Scheduler benchmark, cost of a yield and how many sessions the workers sustain
+//   make SchedulerBench
+//   ./SchedulerBench [sessions] [workers]
+#include "Scheduler.h"
+#include "BusPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Busy loop over zero page, LDX #$00, INC $00,X, INX, BNE $8002, JMP $8000
+static const uint8_t program[] = { 0xA2, 0x00, 0xF6, 0x00, 0xE8, 0xD0, 0xFB, 0x4C, 0x00, 0x80 };
+
+// Yields n times without doing anything else
+static Scheduler::Task Spinner(Scheduler &s, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        co_await s.Yield();
+    }
+}
+
+// A client session, runs one frame every time input arrives
+static Scheduler::Task Session(Bus &bus, Scheduler::Event &input, const bool &bQuit, std::atomic<uint64_t> &frames)
+{
+    for (;;)
+    {
+        co_await input;
+        if (bQuit) break;
+        bus.frame();
+        frames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Runs frames back to back, yielding at every frame boundary
+static Scheduler::Task Player(Scheduler &s, Bus &bus, int n, std::atomic<uint64_t> &frames)
+{
+    for (int i = 0; i < n; i++)
+    {
+        bus.frame();
+        frames.fetch_add(1, std::memory_order_relaxed);
+        co_await s.Yield();
+    }
+}
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char *argv[])
+{
+    const int sessions = (argc > 1) ? atoi(argv[1]) : 10000;
+    const int threads = (argc > 2) ? atoi(argv[2]) : 0;
+
+    static std::array<uint8_t, 32 * 1024> prg = {};
+    memcpy(prg.data(), program, sizeof(program));
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x80;
+
+    Scheduler scheduler(threads);
+    printf("workers               %d\n", scheduler.Workers());
+
+    // Scheduling overhead, sessions that only yield
+    {
+        const int spinners = 1000, yields = 2000;
+        auto start = Clock::now();
+        for (int i = 0; i < spinners; i++)
+        {
+            scheduler.Spawn(Spinner(scheduler, yields));
+        }
+        scheduler.Wait();
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        printf("yield                 %.1f ns per yield (%d sessions, %llu steals)\n",
+            elapsed.count() * 1e9 / ((double)spinners * yields), spinners, (unsigned long long)scheduler.Steals());
+    }
+
+    BusPool pool(sessions);
+    if (!pool.Valid())
+    {
+        printf("could not map the arena\n");
+        return 1;
+    }
+    {
+        Bus nes;
+        nes.InsertPRG(prg.data(), prg.size());
+        nes.cpu.reset();
+        pool.Capture(nes);
+    }
+    std::vector<Bus *> buses(sessions);
+    for (auto &b : buses) b = pool.Acquire();
+
+    // Idle sessions parked on their input events, then woken once each
+    {
+        std::vector<std::unique_ptr<Scheduler::Event>> inputs;
+        bool bQuit = false;
+        std::atomic<uint64_t> frames{ 0 };
+        for (int i = 0; i < sessions; i++)
+        {
+            inputs.push_back(std::make_unique<Scheduler::Event>(scheduler));
+            scheduler.Spawn(Session(*buses[i], *inputs[i], bQuit, frames));
+        }
+
+        auto start = Clock::now();
+        for (auto &in : inputs) in->Set();
+        while (frames.load() < (uint64_t)sessions) std::this_thread::yield();
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        printf("idle sessions         %d parked, all woken for one frame in %.1f ms\n", sessions, elapsed.count() * 1e3);
+
+        bQuit = true;
+        for (auto &in : inputs) in->Set();
+        scheduler.Wait();
+    }
+
+    // Sessions playing continuously, how many 60 fps clients the workers keep up with
+    {
+        const int frames = 20;
+        std::atomic<uint64_t> count{ 0 };
+        int players = std::min(sessions, 256);
+        auto start = Clock::now();
+        for (int i = 0; i < players; i++)
+        {
+            pool.Reset(buses[i]);
+            scheduler.Spawn(Player(scheduler, *buses[i], frames, count));
+        }
+        scheduler.Wait();
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        double fps = (double)count.load() / elapsed.count();
+        printf("frames                %.0f per second over %d sessions\n", fps, players);
+        printf("sustained             %.0f sessions at 60 fps\n", fps / 60.0);
+    }
+
+    for (auto b : buses) pool.Release(b);
+    return 0;
+}
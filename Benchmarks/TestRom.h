@@ -0,0 +1,78 @@
+// Test ROM shared by the benchmarks, a main loop with rendering and the NMI on and an NMI handler that does a frame's work
+//   $8000 SEI, CLD, LDX #$FF, TXS, LDA #$80, STA $2000, LDA #$1E, STA $2001
+//   $800F INC $10, LDA $10, EOR $11, STA $12, JMP $800F
+// NMI, HANDLER_FILL fills $0300-$033F with the frame counter at $11
+//   $801A PHA, TXA, PHA, INC $11, LDA $11, LDX #$3F
+//   $8023 STA $0300,X, DEX, BPL $8023, PLA, TAX, PLA, RTI
+// NMI, HANDLER_SCORE does the same and keeps a score in PRG-RAM
+//   $801A PHA, TXA, PHA, INC $11, LDA $11, LDX #$3F
+//   $8023 STA $0300,X, DEX, BPL $8023, INC $6000, PLA, TAX, PLA, RTI
+// NMI, HANDLER_DMA copies a page of sprites with OAM DMA
+//   $801A PHA, INC $11, LDA #$02, STA $4014, PLA, RTI
+#pragma once
+#include "Bus.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+class TestRom
+{
+    public:
+        enum HANDLER
+        {
+            HANDLER_FILL,
+            HANDLER_SCORE,
+            HANDLER_DMA,
+        };
+
+        TestRom(HANDLER h = HANDLER_FILL) : handler(h)
+        {
+            static const uint8_t loop[] =
+            {
+                0x78, 0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20,
+                0xE6, 0x10, 0xA5, 0x10, 0x45, 0x11, 0x85, 0x12, 0x4C, 0x0F, 0x80,
+            };
+            static const uint8_t fill[] =
+            {
+                0x48, 0x8A, 0x48, 0xE6, 0x11, 0xA5, 0x11, 0xA2, 0x3F,
+                0x9D, 0x00, 0x03, 0xCA, 0x10, 0xFA, 0x68, 0xAA, 0x68, 0x40,
+            };
+            static const uint8_t score[] =
+            {
+                0x48, 0x8A, 0x48, 0xE6, 0x11, 0xA5, 0x11, 0xA2, 0x3F,
+                0x9D, 0x00, 0x03, 0xCA, 0x10, 0xFA, 0xEE, 0x00, 0x60, 0x68, 0xAA, 0x68, 0x40,
+            };
+            static const uint8_t dma[] =
+            {
+                0x48, 0xE6, 0x11, 0xA9, 0x02, 0x8D, 0x14, 0x40, 0x68, 0x40,
+            };
+            memcpy(prg.data(), loop, sizeof(loop));
+            uint8_t *nmi = prg.data() + sizeof(loop);
+            switch (handler)
+            {
+                case HANDLER_FILL: memcpy(nmi, fill, sizeof(fill)); break;
+                case HANDLER_SCORE: memcpy(nmi, score, sizeof(score)); break;
+                case HANDLER_DMA: memcpy(nmi, dma, sizeof(dma)); break;
+            }
+            prg[0x7FFA] = 0x1A;
+            prg[0x7FFB] = 0x80;
+            prg[0x7FFC] = 0x00;
+            prg[0x7FFD] = 0x80;
+        }
+
+        // Powered on instance running the ROM, with PRG-RAM for the score. The images are shared, so the ROM must
+        // outlive it.
+        std::unique_ptr<Bus> Make() const
+        {
+            auto nes = std::make_unique<Bus>();
+            nes->InsertPRG(prg.data(), prg.size(), handler == HANDLER_SCORE);
+            nes->InsertCHR(chr.data(), chr.size(), ppu2C02::MIRROR_HORIZONTAL);
+            nes->cpu.reset();
+            return nes;
+        }
+
+        HANDLER handler;
+        std::array<uint8_t, 32 * 1024> prg = {};
+        std::array<uint8_t, 8 * 1024> chr = {};
+};
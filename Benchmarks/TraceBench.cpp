@@ -0,0 +1,121 @@
+// Host tracing benchmark, the CPU time a span costs the traced thread with no tracer started and with one started (on
+// one thread and on four at once), next to the cost of the timestamp it takes twice, and frames per second of a
+// rendering game loop with tracing off and on. The trace of the last run is left in the file given, open it in
+// ui.perfetto.dev. On a machine with one core the flusher shares it with the emulation, which shows in the frame rate.
+//   make TraceBench
+//   ./TraceBench [trace.json] [frames per run]
+#include "Bus.h"
+#include "Tracer.h"
+#include "TestRom.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <time.h>
+
+// Frame counting loop with rendering on, the NMI copies a page of sprites with OAM DMA
+static const TestRom rom(TestRom::HANDLER_DMA);
+
+// CPU time of the calling thread, so the flusher's time on a shared core is not counted against the spans
+static double ThreadNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Nanoseconds per span, bursts of burst spans on each of threads threads with a pause between them for the flusher
+// to drain the rings, only the bursts are timed
+static double Spans(int threads, uint64_t burst, int bursts)
+{
+    std::vector<std::thread> pool;
+    std::vector<double> ns(threads);
+    for (int t = 0; t < threads; t++)
+    {
+        pool.emplace_back([&, t]()
+        {
+            double elapsed = 0.0;
+            for (int b = 0; b < bursts; b++)
+            {
+                double start = ThreadNs();
+                for (uint64_t i = 0; i < burst; i++)
+                {
+                    NES_TRACE_SCOPE("span");
+                }
+                elapsed += ThreadNs() - start;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            ns[t] = elapsed / (burst * bursts);
+        });
+    }
+    for (auto &p : pool) p.join();
+    return *std::max_element(ns.begin(), ns.end());
+}
+
+// Frames per second
+static double Run(int frames)
+{
+    auto nes = rom.Make();
+    std::vector<uint8_t> pixels(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+    nes->ppu.frameBuffer = pixels.data();
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) nes->frame();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = (argc > 1) ? argv[1] : "/tmp/nes-trace.json";
+    const int frames = (argc > 2) ? atoi(argv[2]) : 300;
+
+    printf("%-32s %6.2f ns per span\n", "no tracer started", Spans(1, 1000000, 2));
+    printf("%-32s %6.2f ns\n", "timestamp", [&]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t sum = 0;
+        for (int i = 0; i < 10000000; i++) sum += Tracer::Now();
+        if (sum == 1) printf("\n");
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1e7;
+    }());
+
+    // Bursts of half a ring, the flusher writes them out between bursts
+    Tracer tracer;
+    for (int threads : { 1, 4 })
+    {
+        if (!tracer.Start(path))
+        {
+            printf("could not write %s\n", path);
+            return 1;
+        }
+        double ns = Spans(threads, 32768, 20);
+        tracer.Stop();
+        printf("%-22s %2d thread%s %6.2f ns per span  %llu written  %llu dropped\n", "tracing", threads, threads > 1 ? "s" : " ", ns,
+            (unsigned long long)tracer.Spans(), (unsigned long long)tracer.Dropped());
+    }
+
+    // Emulation, the median over traced runs each between two untraced runs
+    std::vector<double> ratio, speed;
+    uint64_t spans = 0;
+    for (int i = 0; i < 11; i++)
+    {
+        double before = Run(frames);
+        tracer.Start(path);
+        Tracer::NameThread("emulation");
+        double on = Run(frames);
+        tracer.Stop();
+        spans = tracer.Spans();
+        double after = Run(frames);
+        ratio.push_back(2.0 * on / (before + after));
+        speed.push_back(on);
+    }
+    std::sort(ratio.begin(), ratio.end());
+    std::sort(speed.begin(), speed.end());
+    printf("%-32s %6.0f frames/s  %+5.1f%% against untraced  %.0f spans per frame  trace in %s\n", "rendering game loop traced",
+        speed[speed.size() / 2], (ratio[ratio.size() / 2] - 1.0) * 100.0, (double)spans / frames, path);
+    return 0;
+}
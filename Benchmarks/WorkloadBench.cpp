@@ -0,0 +1,407 @@
+// Workload benchmark suite, built-in 6502 programs run from internal RAM on both accuracy tiers
+// Reports emulated MHz, host ns per instruction and host cache counters, writes JSON and compares it against a baseline.
+//   make WorkloadBench (or make suite to run it against WorkloadBaseline.json)
+//   ./WorkloadBench [--json out.json] [--baseline base.json] [--tolerance percent] [--strict] [--scale factor]
+#include "Bus.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Programs, all loaded at $0200 and looping forever
+// ALU, loads, adds, shifts and rotates on the zero page
+//   $0200 LDA $10, CLC, ADC #$37, EOR $11, STA $10, ASL A, ROL $11, AND #$F3, ORA $12, SEC, SBC $13, STA $12, LSR $13, INX, BNE $0200, INC $13, JMP $0200
+static const uint8_t alu[] =
+{
+    0xA5, 0x10, 0x18, 0x69, 0x37, 0x45, 0x11, 0x85, 0x10, 0x0A, 0x26, 0x11, 0x29, 0xF3, 0x05, 0x12,
+    0x38, 0xE5, 0x13, 0x85, 0x12, 0x46, 0x13, 0xE8, 0xD0, 0xE6, 0xE6, 0x13, 0x4C, 0x00, 0x02,
+};
+
+// Memory copy, a page with absolute indexed and one with indirect indexed ($20 -> $0400, $22 -> $0500)
+//   $0200 LDX #$00
+//   $0202 LDA $0300,X, STA $0400,X, INX, BNE $0202, LDY #$00
+//   $020D LDA ($20),Y, STA ($22),Y, INY, BNE $020D, JMP $0200
+static const uint8_t copy[] =
+{
+    0xA2, 0x00, 0xBD, 0x00, 0x03, 0x9D, 0x00, 0x04, 0xE8, 0xD0, 0xF7, 0xA0, 0x00, 0xB1, 0x20, 0x91,
+    0x22, 0xC8, 0xD0, 0xF9, 0x4C, 0x00, 0x02,
+};
+
+// Table walk, follows a shuffled ring of 4 byte nodes (next pointer, value) through ($20),Y and sums the values
+//   $0200 LDY #$02, LDA ($20),Y, CLC, ADC $90, STA $90, LDY #$00, LDA ($20),Y, TAX, INY, LDA ($20),Y, STA $21, STX $20, JMP $0200
+static const uint8_t walk[] =
+{
+    0xA0, 0x02, 0xB1, 0x20, 0x18, 0x65, 0x90, 0x85, 0x90, 0xA0, 0x00, 0xB1, 0x20, 0xAA, 0xC8, 0xB1,
+    0x20, 0x85, 0x21, 0x86, 0x20, 0x4C, 0x00, 0x02,
+};
+
+// Branches, steps a 16-bit LFSR at $50 and branches on its bits into one of six counters
+//   $0200 LSR $51, ROR $50, BCC $020C, LDA $51, EOR #$B4, STA $51
+//   $020C LDA $50, BMI $022E, AND #$03, BEQ $021D, CMP #$02, BCS $0222, INC $60, JMP $0200
+//   $021D INC $61, JMP $0200
+//   $0222 BNE $0229, INC $62, JMP $0200
+//   $0229 INC $63, JMP $0200
+//   $022E ASL A, BPL $0236, DEC $64, JMP $0200
+//   $0236 INC $64, JMP $0200
+static const uint8_t branch[] =
+{
+    0x46, 0x51, 0x66, 0x50, 0x90, 0x06, 0xA5, 0x51, 0x49, 0xB4, 0x85, 0x51, 0xA5, 0x50, 0x30, 0x1E,
+    0x29, 0x03, 0xF0, 0x09, 0xC9, 0x02, 0xB0, 0x0A, 0xE6, 0x60, 0x4C, 0x00, 0x02, 0xE6, 0x61, 0x4C,
+    0x00, 0x02, 0xD0, 0x05, 0xE6, 0x62, 0x4C, 0x00, 0x02, 0xE6, 0x63, 0x4C, 0x00, 0x02, 0x0A, 0x10,
+    0x05, 0xC6, 0x64, 0x4C, 0x00, 0x02, 0xE6, 0x64, 0x4C, 0x00, 0x02,
+};
+
+// Recursion, naive Fibonacci of 16 with JSR / RTS and the argument saved on the stack
+//   $0200 LDA #$10, JSR $0208, JMP $0200
+//   $0208 CMP #$02, BCC $021C, PHA, SEC, SBC #$01, JSR $0208, PLA, PHA, SEC, SBC #$02, JSR $0208, PLA
+//   $021C INC $70, RTS
+static const uint8_t recursion[] =
+{
+    0xA9, 0x10, 0x20, 0x08, 0x02, 0x4C, 0x00, 0x02, 0xC9, 0x02, 0x90, 0x10, 0x48, 0x38, 0xE9, 0x01,
+    0x20, 0x08, 0x02, 0x68, 0x48, 0x38, 0xE9, 0x02, 0x20, 0x08, 0x02, 0x68, 0xE6, 0x70, 0x60,
+};
+
+// Interrupt storm, a short loop with IRQs enabled, the suite raises an IRQ every 8 instructions and an NMI every 64
+//   $0200 CLI
+//   $0201 INX, INY, LDA $32, ADC #$01, STA $32, JMP $0201
+static const uint8_t storm[] =
+{
+    0x58, 0xE8, 0xC8, 0xA5, 0x32, 0x69, 0x01, 0x85, 0x32, 0x4C, 0x01, 0x02,
+};
+
+// Handlers at $0600, loaded for every program
+//   $0600 INC $31, RTI (NMI)
+//   $0603 PHA, TXA, PHA, INC $30, PLA, TAX, PLA, RTI (IRQ)
+static const uint8_t handlers[] =
+{
+    0xE6, 0x31, 0x40, 0x48, 0x8A, 0x48, 0xE6, 0x30, 0x68, 0xAA, 0x68, 0x40,
+};
+
+struct Workload
+{
+    const char *name;
+    const uint8_t *program;
+    size_t size;
+    bool bStorm;
+};
+
+static const Workload workloads[] =
+{
+    { "alu", alu, sizeof(alu), false },
+    { "copy", copy, sizeof(copy), false },
+    { "walk", walk, sizeof(walk), false },
+    { "branch", branch, sizeof(branch), false },
+    { "recursion", recursion, sizeof(recursion), false },
+    { "storm", storm, sizeof(storm), true },
+};
+
+// Only the vectors live in PRG-ROM: NMI $0600, reset $0200, IRQ $0603
+static std::array<uint8_t, 32 * 1024> prg = {};
+
+static std::unique_ptr<Bus> Load(const Workload &w, cpu6502::ACCURACY accuracy)
+{
+    auto nes = std::make_unique<Bus>();
+    nes->InsertPRG(prg.data(), prg.size());
+    for (size_t i = 0; i < nes->ram.size(); i++) nes->ram[i] = (uint8_t)(i * 13 + 7);
+    memcpy(&nes->ram[0x0200], w.program, w.size);
+    memcpy(&nes->ram[0x0600], handlers, sizeof(handlers));
+
+    // Copy pointers
+    nes->ram[0x20] = 0x00;
+    nes->ram[0x21] = 0x04;
+    nes->ram[0x22] = 0x00;
+    nes->ram[0x23] = 0x05;
+    // Walk ring, 192 nodes in $0300-$05FF visited in a shuffled order
+    if (w.program == walk)
+    {
+        uint16_t order[192];
+        for (int i = 0; i < 192; i++) order[i] = i;
+        uint32_t seed = 1;
+        for (int i = 191; i > 0; i--)
+        {
+            seed = seed * 1103515245 + 12345;
+            std::swap(order[i], order[(seed >> 16) % (i + 1)]);
+        }
+        for (int i = 0; i < 192; i++)
+        {
+            uint16_t node = 0x0300 + order[i] * 4;
+            uint16_t next = 0x0300 + order[(i + 1) % 192] * 4;
+            nes->ram[node] = next & 0xFF;
+            nes->ram[node + 1] = next >> 8;
+            nes->ram[node + 2] = (uint8_t)i;
+        }
+        nes->ram[0x20] = (0x0300 + order[0] * 4) & 0xFF;
+        nes->ram[0x21] = (0x0300 + order[0] * 4) >> 8;
+    }
+
+    nes->cpu.SetAccuracy(accuracy);
+    nes->cpu.reset();
+    nes->cpu.step(); // Finish the reset sequence
+    return nes;
+}
+
+// Run a number of instructions, returns the emulated cycles
+static uint64_t Run(Bus &nes, const Workload &w, uint64_t instructions)
+{
+    uint64_t start = nes.cpu.clock_count;
+    if (w.bStorm)
+    {
+        for (uint64_t i = 0; i < instructions; i++)
+        {
+            if ((i & 7) == 0) nes.cpu.irq();
+            if ((i & 63) == 32) nes.cpu.nmi();
+            nes.cpu.step();
+        }
+    }
+    else
+    {
+        for (uint64_t i = 0; i < instructions; i++) nes.cpu.step();
+    }
+    return nes.cpu.clock_count - start;
+}
+
+struct Result
+{
+    std::string name;
+    std::string tier;
+    uint64_t instructions = 0;
+    double mhz = 0.0;
+    double ns = 0.0; // Host ns per emulated instruction
+    double ipc = -1.0; // Host instructions per host cycle, negative if unavailable
+    double hostInstructions = -1.0; // Host instructions per emulated instruction
+    double l1Miss = -1.0; // L1D read misses per 1000 emulated instructions
+    double llMiss = -1.0; // Last level read misses per 1000 emulated instructions
+};
+
+// Median of repeated runs, counters from the median run
+static Result Measure(const Workload &w, cpu6502::ACCURACY accuracy, uint64_t instructions, int repeats)
+{
+    Result r;
+    r.name = w.name;
+    r.tier = (accuracy == cpu6502::ACCURACY_CYCLE) ? "cycle" : "instruction";
+    r.instructions = instructions;
+
+    struct Sample
+    {
+        double seconds;
+        uint64_t cycles;
+        uint64_t counter[PerfCounters::COUNTER_COUNT];
+        bool bValid[PerfCounters::COUNTER_COUNT];
+    };
+    std::vector<Sample> samples;
+    PerfCounters perf;
+    for (int i = 0; i <= repeats; i++)
+    {
+        auto nes = Load(w, accuracy);
+        Run(*nes, w, instructions / 10); // Warm up the caches and branch predictors
+        perf.Start();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t cycles = Run(*nes, w, instructions);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        perf.Stop();
+        if (i == 0) continue; // First run only warms up the process
+
+        Sample s = { elapsed.count(), cycles, {}, {} };
+        for (int c = 0; c < PerfCounters::COUNTER_COUNT; c++)
+        {
+            s.counter[c] = perf.Get((PerfCounters::COUNTER)c);
+            s.bValid[c] = perf.Valid((PerfCounters::COUNTER)c);
+        }
+        samples.push_back(s);
+    }
+    std::sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) { return a.seconds < b.seconds; });
+    const Sample &m = samples[samples.size() / 2];
+
+    r.mhz = (double)m.cycles / m.seconds / 1e6;
+    r.ns = m.seconds / (double)instructions * 1e9;
+    if (m.bValid[PerfCounters::CYCLES] && m.bValid[PerfCounters::INSTRUCTIONS] && m.counter[PerfCounters::CYCLES] > 0)
+    {
+        r.ipc = (double)m.counter[PerfCounters::INSTRUCTIONS] / (double)m.counter[PerfCounters::CYCLES];
+        r.hostInstructions = (double)m.counter[PerfCounters::INSTRUCTIONS] / (double)instructions;
+    }
+    if (m.bValid[PerfCounters::L1D_READ_MISS]) r.l1Miss = (double)m.counter[PerfCounters::L1D_READ_MISS] * 1000.0 / (double)instructions;
+    if (m.bValid[PerfCounters::LL_READ_MISS]) r.llMiss = (double)m.counter[PerfCounters::LL_READ_MISS] * 1000.0 / (double)instructions;
+    return r;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// JSON
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static std::string HostCpu()
+{
+    std::string model = "unknown";
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f == nullptr) return model;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != nullptr)
+    {
+        if (strncmp(line, "model name", 10) != 0) continue;
+        const char *colon = strchr(line, ':');
+        if (colon == nullptr) break;
+        model = colon + 2;
+        while (!model.empty() && (model.back() == '\n' || model.back() == '"' || model.back() == '\\')) model.pop_back();
+        break;
+    }
+    fclose(f);
+    return model;
+}
+
+// Unavailable counters are null
+static void Number(FILE *f, const char *key, double v, const char *format)
+{
+    fprintf(f, "\"%s\": ", key);
+    if (v < 0.0) fprintf(f, "null");
+    else fprintf(f, format, v);
+}
+
+// One result per line, so the baseline can be read back without a JSON library
+static bool WriteJson(const char *path, const std::vector<Result> &results)
+{
+    FILE *f = fopen(path, "w");
+    if (f == nullptr) return false;
+    fprintf(f, "{\n");
+    fprintf(f, "  \"suite\": \"6502 workloads\",\n");
+    fprintf(f, "  \"version\": 1,\n");
+    fprintf(f, "  \"host\": { \"cpu\": \"%s\", \"compiler\": \"%s\" },\n", HostCpu().c_str(), __VERSION__);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        fprintf(f, "    { \"name\": \"%s\", \"tier\": \"%s\", \"instructions\": %llu, ", r.name.c_str(), r.tier.c_str(), (unsigned long long)r.instructions);
+        Number(f, "mhz", r.mhz, "%.3f");
+        fprintf(f, ", ");
+        Number(f, "ns_per_instruction", r.ns, "%.4f");
+        fprintf(f, ", ");
+        Number(f, "host_ipc", r.ipc, "%.3f");
+        fprintf(f, ", ");
+        Number(f, "host_instructions_per_instruction", r.hostInstructions, "%.2f");
+        fprintf(f, ", ");
+        Number(f, "l1d_miss_per_kinstr", r.l1Miss, "%.4f");
+        fprintf(f, ", ");
+        Number(f, "ll_miss_per_kinstr", r.llMiss, "%.4f");
+        fprintf(f, " }%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Reads "name", "tier" and "ns_per_instruction" back from a file written by WriteJson()
+static bool ReadJson(const char *path, std::vector<Result> &results)
+{
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) return false;
+    char line[1024];
+    auto field = [](const char *line, const char *key) -> const char *
+    {
+        const char *p = strstr(line, key);
+        return (p != nullptr) ? p + strlen(key) : nullptr;
+    };
+    while (fgets(line, sizeof(line), f) != nullptr)
+    {
+        const char *name = field(line, "\"name\": \"");
+        const char *tier = field(line, "\"tier\": \"");
+        const char *ns = field(line, "\"ns_per_instruction\": ");
+        if (name == nullptr || tier == nullptr || ns == nullptr) continue;
+        Result r;
+        r.name.assign(name, strcspn(name, "\""));
+        r.tier.assign(tier, strcspn(tier, "\""));
+        r.ns = atof(ns);
+        results.push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *jsonPath = "WorkloadBench.json";
+    const char *baselinePath = nullptr;
+    double tolerance = 5.0;
+    double scale = 1.0;
+    bool bStrict = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--json") && i + 1 < argc) jsonPath = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) baselinePath = argv[++i];
+        else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc) scale = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--strict")) bStrict = true;
+        else
+        {
+            printf("usage: %s [--json out.json] [--baseline base.json] [--tolerance percent] [--strict] [--scale factor]\n", argv[0]);
+            return 2;
+        }
+    }
+
+#ifdef __linux__
+    // Stay on one core so the caches and counters belong to one CPU
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+
+    prg[0x7FFA] = 0x00;
+    prg[0x7FFB] = 0x06;
+    prg[0x7FFC] = 0x00;
+    prg[0x7FFD] = 0x02;
+    prg[0x7FFE] = 0x03;
+    prg[0x7FFF] = 0x06;
+
+    std::vector<Result> results;
+    printf("%-10s %-11s %9s %9s %7s %9s %9s\n", "workload", "tier", "MHz", "ns/instr", "IPC", "L1D/k", "LL/k");
+    for (auto accuracy : { cpu6502::ACCURACY_INSTRUCTION, cpu6502::ACCURACY_CYCLE })
+    {
+        uint64_t instructions = (uint64_t)((accuracy == cpu6502::ACCURACY_CYCLE ? 2000000 : 10000000) * scale);
+        for (auto &w : workloads)
+        {
+            Result r = Measure(w, accuracy, std::max<uint64_t>(instructions, 1000), 5);
+            printf("%-10s %-11s %9.2f %9.3f", r.name.c_str(), r.tier.c_str(), r.mhz, r.ns);
+            if (r.ipc >= 0.0) printf(" %7.2f", r.ipc); else printf(" %7s", "-");
+            if (r.l1Miss >= 0.0) printf(" %9.3f", r.l1Miss); else printf(" %9s", "-");
+            if (r.llMiss >= 0.0) printf(" %9.3f", r.llMiss); else printf(" %9s", "-");
+            printf("\n");
+            results.push_back(r);
+        }
+    }
+    if (!WriteJson(jsonPath, results))
+    {
+        printf("could not write %s\n", jsonPath);
+        return 1;
+    }
+    printf("wrote %s\n", jsonPath);
+
+    // Baseline, ns per instruction against the stored run, positive is slower
+    if (baselinePath == nullptr) return 0;
+    std::vector<Result> baseline;
+    if (!ReadJson(baselinePath, baseline))
+    {
+        printf("could not read %s\n", baselinePath);
+        return 1;
+    }
+    int regressions = 0;
+    printf("\nagainst %s (tolerance %.1f%%)\n", baselinePath, tolerance);
+    for (auto &r : results)
+    {
+        auto b = std::find_if(baseline.begin(), baseline.end(), [&](const Result &b) { return b.name == r.name && b.tier == r.tier; });
+        if (b == baseline.end() || b->ns <= 0.0)
+        {
+            printf("%-10s %-11s not in baseline\n", r.name.c_str(), r.tier.c_str());
+            continue;
+        }
+        double change = (r.ns / b->ns - 1.0) * 100.0;
+        const char *verdict = (change > tolerance) ? "SLOWER" : (change < -tolerance) ? "faster" : "same";
+        if (change > tolerance) regressions++;
+        printf("%-10s %-11s %9.3f -> %9.3f ns  %+6.1f%%  %s\n", r.name.c_str(), r.tier.c_str(), b->ns, r.ns, change, verdict);
+    }
+    return (bStrict && regressions > 0) ? 1 : 0;
+}
@@ -1,8 +1,32 @@
 // File that acts as a bus for the program
 #include "Bus.h"
+#include "Tracer.h"
+#include <cstring>
 
 // Constructor
-Bus::Bus()
+Bus::Bus(cpu6502::VARIANT variant) : cpu(variant)
+{
+    // Clear RAM and registers, PRG-RAM is cleared when a cartridge with PRG-RAM is inserted
+    reset();
+
+    // Nothing is watched until a debugger is attached
+    pageWatch.fill(0);
+
+    // Connect the CPU and PPU to the bus
+    cpu.ConnectBus(this);
+    ppu.ConnectBus(this);
+    mapDirectPages();
+
+}
+
+// Destructor
+Bus::~Bus()
+{
+    
+}
+
+// Power on state
+void Bus::reset()
 {
     /* 
     Clear RAM
@@ -12,37 +36,310 @@ Bus::Bus()
     "&" means that i is a reference, so we can modify the actual element in the array.   
     */
     for(auto &i : ram) i = 0x00;
+    if (bPrgRam) prgRam.fill(0x00);
+    ppu.reset();
+    ioRegs.fill(0x00);
+    controller.fill(0x00);
+    controllerShift.fill(0x00);
+    bStrobe = false;
+    oam.fill(0x00);
+    oamAddr = 0x00;
+}
 
-    // Connect the CPU to the bus
+// Copy the emulation state of another bus
+void Bus::copyState(const Bus &from)
+{
+    NES_TRACE_SCOPE("copy state");
+    // The coverage map is an attachment like the debugger, the previous edge is state
+    uint8_t *coverage = cpu.coverage;
+    cpu = from.cpu;
     cpu.ConnectBus(this);
+    cpu.coverage = coverage;
+    mapDirectPages();
+    ram = from.ram;
+    bPrgRam = from.bPrgRam;
+    if (bPrgRam) prgRam = from.prgRam;
+    ppu.copyState(from.ppu);
+    ioRegs = from.ioRegs;
+    controller = from.controller;
+    controllerShift = from.controllerShift;
+    bStrobe = from.bStrobe;
+    prgRom = from.prgRom;
+    prgMask = from.prgMask;
+    oam = from.oam;
+    oamAddr = from.oamAddr;
+}
 
+namespace
+{
+    struct BUSSTATE
+    {
+        uint16_t prgMask;
+        uint8_t bPrgRam;
+        uint8_t bStrobe;
+        uint8_t oamAddr;
+        uint8_t controller[2];
+        uint8_t controllerShift[2];
+        uint8_t ioRegs[0x20];
+    };
 }
 
-// Destructor
-Bus::~Bus()
+// The registers, RAM, OAM and PRG-RAM, then the CPU and the PPU
+void Bus::SaveState(std::vector<uint8_t> &out) const
 {
-    
+    BUSSTATE s = {};
+    s.prgMask = prgMask;
+    s.bPrgRam = bPrgRam;
+    s.bStrobe = bStrobe;
+    s.oamAddr = oamAddr;
+    memcpy(s.controller, controller.data(), 2);
+    memcpy(s.controllerShift, controllerShift.data(), 2);
+    memcpy(s.ioRegs, ioRegs.data(), ioRegs.size());
+
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&s);
+    out.insert(out.end(), p, p + sizeof(s));
+    out.insert(out.end(), ram.begin(), ram.end());
+    out.insert(out.end(), oam.begin(), oam.end());
+    if (bPrgRam) out.insert(out.end(), prgRam.begin(), prgRam.end());
+    cpu.SaveState(out);
+    ppu.SaveState(out);
+}
+
+bool Bus::LoadState(const uint8_t *data, size_t size)
+{
+    const uint8_t *end = data + size;
+    BUSSTATE s;
+    if (size < sizeof(s)) return false;
+    memcpy(&s, data, sizeof(s));
+    const size_t memory = ram.size() + oam.size() + (s.bPrgRam ? prgRam.size() : 0);
+    if (size - sizeof(s) < memory || s.prgMask != prgMask || (s.bPrgRam != 0) != bPrgRam) return false;
+    const uint8_t *memoryData = data + sizeof(s);
+    const uint8_t *p = memoryData + memory;
+
+    // CPU and PPU into copies first, nothing changes unless all of it loads
+    cpu6502 cpuState = cpu;
+    ppu2C02 ppuState;
+    ppuState.copyState(ppu);
+    if (!cpuState.LoadState(p, end) || !ppuState.LoadState(p, end) || p != end) return false;
+
+    cpu = cpuState;
+    ppu.copyState(ppuState);
+    bStrobe = s.bStrobe != 0;
+    oamAddr = s.oamAddr;
+    memcpy(controller.data(), s.controller, 2);
+    memcpy(controllerShift.data(), s.controllerShift, 2);
+    memcpy(ioRegs.data(), s.ioRegs, ioRegs.size());
+    memcpy(ram.data(), memoryData, ram.size());
+    memoryData += ram.size();
+    memcpy(oam.data(), memoryData, oam.size());
+    memoryData += oam.size();
+    if (bPrgRam) memcpy(prgRam.data(), memoryData, prgRam.size());
+    return true;
+}
+
+// Zero page and stack are always internal RAM here, only watches and hooks need the bus to see them
+void Bus::mapDirectPages()
+{
+    cpu.zeroPageRead = (pageWatch[0x00] & Debugger::WATCH_READ) ? nullptr : ram.data();
+    cpu.zeroPageWrite = (pageWatch[0x00] & Debugger::WATCH_WRITE) ? nullptr : ram.data();
+    cpu.stackPageRead = (pageWatch[0x01] & Debugger::WATCH_READ) ? nullptr : ram.data() + 0x0100;
+    cpu.stackPageWrite = (pageWatch[0x01] & Debugger::WATCH_WRITE) ? nullptr : ram.data() + 0x0100;
+    cpu.bZeroPageHooked = (pageWatch[0x00] & Hooks::HOOK_WRITE) != 0;
+    cpu.bStackPageHooked = (pageWatch[0x01] & Hooks::HOOK_WRITE) != 0;
+}
+
+// Map a PRG-ROM image
+void Bus::InsertPRG(const uint8_t *data, size_t size, bool bHasPrgRam)
+{
+    if (size > 0x8000)
+    {
+        data += size - 0x8000;
+        size = 0x8000;
+    }
+    prgRom = (size >= 0x4000) ? data : nullptr;
+    prgMask = (size >= 0x8000) ? 0x7FFF : 0x3FFF;
+
+    bPrgRam = bHasPrgRam;
+    if (bPrgRam) prgRam.fill(0x00);
+}
+
+// Map a CHR-ROM image
+void Bus::InsertCHR(const uint8_t *data, size_t size, ppu2C02::MIRROR mirror)
+{
+    ppu.InsertCHR(data, size, mirror);
+}
+
+// One instruction, then the PPU catches up. Vblank inside the instruction latches NMI on the cycle it started in,
+// so it is taken after this instruction when it started before the last cycle, else after the next one.
+uint32_t Bus::step()
+{
+    uint32_t cycles = cpu.step();
+    ppu.run(cpu.clock_count * 3);
+    return cycles;
+}
+
+// Run to the end of the PPU frame
+uint32_t Bus::frame()
+{
+    NES_TRACE_SCOPE("frame");
+    uint64_t start = cpu.clock_count;
+    uint64_t count = ppu.frameCount;
+    while (ppu.frameCount == count)
+    {
+        if (step() == 0) break;
+    }
+#ifndef NES_NO_DEBUGGER
+    if (hooks != nullptr && ppu.frameCount != count) hooks->OnFrame();
+#endif
+    return (uint32_t)(cpu.clock_count - start);
 }
 
 // Write function to bus that does not return anything, takes a 16-bit address and 8-bit data.
 void Bus::write(uint16_t addr, uint8_t data)
 {   
-    // If the address is within the range of the RAM, write the data to the address.
-    if (addr >= 0x0000 && addr <= 0xFFFF)
+    if (addr < 0x2000)
+    {
+        // Internal RAM, mirrored every 2KB
+        ram[addr & 0x07FF] = data;
+    }
+    else if (addr >= 0x8000)
+    {
+        // PRG-ROM, writes go to the mapper once there is one
+    }
+    else if (addr >= 0x6000)
+    {
+        if (bPrgRam) prgRam[addr & 0x1FFF] = data;
+    }
+    else if (addr < 0x4000)
+    {
+        // PPU registers, mirrored every 8 bytes
+        ppu.run(cpu.clock_count * 3);
+        ppu.cpuWrite(addr & 0x0007, data);
+    }
+    else if (addr < 0x4020)
+    {
+        // Sprite DMA register
+        if (addr == 0x4014)
+        {
+            oamDMA(data);
+        }
+        // Controller strobe, the buttons are reloaded while it is high
+        else if (addr == 0x4016)
+        {
+            bStrobe = data & 0x01;
+            if (bStrobe) controllerShift = controller;
+        }
+        ioRegs[addr & 0x001F] = data;
+    }
+
+#ifndef NES_NO_DEBUGGER
+    // Only watched or hooked pages pay for the flag tests
+    uint8_t watch = pageWatch[addr >> 8];
+    if (watch != 0)
     {
-        ram[addr] = data;
+        if (watch & Debugger::WATCH_WRITE) debugger->OnWrite(addr, data);
+        if (watch & Hooks::HOOK_WRITE) hooks->OnWrite(addr, data);
     }
+#endif
 }
 
 // Read function to bus that returns 8-bit data, takes a 16-bit address and a read only flag.
 uint8_t Bus::read(uint16_t addr, bool bReadOnly)
 {
-    // If the address is within the range of the RAM, return the data at the address.
-    if (addr >= 0x0000 && addr <= 0xFFFF)
+    // Unmapped addresses read as 0x00
+    uint8_t data = 0x00;
+
+    if (addr < 0x2000)
+    {
+        // Internal RAM, mirrored every 2KB
+        data = ram[addr & 0x07FF];
+    }
+    else if (addr >= 0x8000)
+    {
+        if (prgRom != nullptr) data = prgRom[addr & prgMask];
+    }
+    else if (addr >= 0x6000)
+    {
+        if (bPrgRam) data = prgRam[addr & 0x1FFF];
+    }
+    else if (addr < 0x4000)
+    {
+        // PPU registers, mirrored every 8 bytes
+        ppu.run(cpu.clock_count * 3);
+        data = ppu.cpuRead(addr & 0x0007, bReadOnly);
+    }
+    else if (addr == 0x4016 || addr == 0x4017)
+    {
+        // Controller serial port, one button per read from A to Right, then 1s
+        // Bit 6 is open bus, the high byte of the address
+        uint8_t &shift = controllerShift[addr & 0x0001];
+        if (bStrobe) shift = controller[addr & 0x0001];
+        data = 0x40 | (shift & 0x01);
+        if (!bReadOnly && !bStrobe) shift = (shift >> 1) | 0x80;
+    }
+    else if (addr < 0x4020)
+    {
+        data = ioRegs[addr & 0x001F];
+    }
+
+#ifndef NES_NO_DEBUGGER
+    // Only pages with a read watch pay for the call, reads from the debugger itself are ignored
+    if ((pageWatch[addr >> 8] & Debugger::WATCH_READ) && !bReadOnly)
+    {
+        debugger->OnRead(addr, data);
+    }
+#endif
+    return data;
+}
+
+// Pointer to a page of plain memory for block transfers.
+const uint8_t *Bus::directPage(uint8_t page)
+{
+#ifndef NES_NO_DEBUGGER
+    // Pages with a read watch go through read() so the debugger sees the DMA
+    if (pageWatch[page] & Debugger::WATCH_READ)
+    {
+        return nullptr;
+    }
+#endif
+
+    // Only memory without side effects can be copied directly
+    if (page < 0x20) return &ram[(page & 0x07) << 8];
+    if (page >= 0x80) return (prgRom != nullptr) ? &prgRom[(page << 8) & prgMask] : nullptr;
+    if (page >= 0x60) return bPrgRam ? &prgRam[(page & 0x1F) << 8] : nullptr;
+    return nullptr;
+}
+
+// Sprite DMA, one block copy instead of 256 reads and writes.
+void Bus::oamDMA(uint8_t page)
+{
+    NES_TRACE_SCOPE("oam dma");
+    const uint8_t *src = directPage(page);
+    if (src != nullptr)
     {
-        return ram[addr];
+        // OAM is written from OAMADDR and wraps, so the copy is at most two pieces
+        size_t first = 256 - oamAddr;
+        memcpy(&oam[oamAddr], src, first);
+        memcpy(&oam[0], src + first, 256 - first);
     }
+    else
+    {
+        for (uint16_t i = 0; i < 256; i++)
+        {
+            oam[(oamAddr + i) & 0xFF] = read((page << 8) | i);
+        }
+    }
+
+    // 1 halt cycle, 256 read / write pairs and 1 more to align to a read cycle
+    cpu.stall(513, true);
+}
+
+// DMC sample fetch, one byte read directly with a single stall credit.
+uint8_t Bus::dmcDMA(uint16_t addr)
+{
+    const uint8_t *src = directPage(addr >> 8);
+    uint8_t data = (src != nullptr) ? src[addr & 0xFF] : read(addr);
 
-    // If the address is not within the range of the RAM, return 0x00.
-    return 0x00;
+    cpu.stall(4);
+    return data;
 }
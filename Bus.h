@@ -1,15 +1,27 @@
 // Bus header file to define the bus class
+// https://www.nesdev.org/wiki/CPU_memory_map
+// $0000-$1FFF 2KB internal RAM, mirrored every 2KB
+// $2000-$3FFF PPU registers, mirrored every 8 bytes
+// $4000-$401F APU and I/O registers
+// $4020-$5FFF Cartridge expansion, unmapped
+// $6000-$7FFF PRG-RAM, if the cartridge has it
+// $8000-$FFFF PRG-ROM
 
 #pragma once
 #include <cstdint>
 #include "cpu6502.h"
+#include "ppu2C02.h"
+#include "Debugger.h"
+#include "Profiler.h"
+#include "Hooks.h"
 #include <array>
+#include <vector>
 
 class Bus
 {
     public:
-        // Constructor and Destructor
-        Bus();
+        // Constructor and Destructor, the CPU variant is fixed for the lifetime of the bus
+        Bus(cpu6502::VARIANT variant = cpu6502::VARIANT_2A03);
         ~Bus();
 
         // Write function to bus that does not return anything, takes a 16-bit address and 8-bit data.
@@ -17,11 +29,94 @@ class Bus
         // Read function to bus that returns 8-bit data, takes a 16-bit address and a read only flag.
         uint8_t read(uint16_t addr, bool bReadOnly = false);
 
+        // Power on state, only internal RAM, the registers, the PPU and PRG-RAM (if present) are cleared
+        void reset();
+        // Save / restore, copy the whole emulation state (CPU included) of another bus into this one
+        // Attachments stay as they are: the debugger, hooks, watched pages, profiler and coverage map are not copied.
+        // PRG-RAM is only copied when the cartridge has it and the PRG-ROM image is shared, not copied.
+        void copyState(const Bus &from);
+        // Serialized emulation state for checkpoints on disk, what copyState() copies, host byte order.
+        // LoadState() needs the same cartridge inserted, it returns false and changes nothing if the data does not fit it.
+        void SaveState(std::vector<uint8_t> &out) const;
+        bool LoadState(const uint8_t *data, size_t size);
+
+        // Cartridge
+        // PRG-ROM is not copied, many instances can share one image. Up to 32KB is mapped at $8000 (16KB is mirrored),
+        // larger images map their last 32KB until mappers exist. The size must be a multiple of 16KB.
+        void InsertPRG(const uint8_t *data, size_t size, bool bHasPrgRam = false);
+        // 8KB CHR-ROM image, shared like PRG-ROM, nullptr for CHR-RAM
+        void InsertCHR(const uint8_t *data, size_t size, ppu2C02::MIRROR mirror);
+
+        // Frames
+        // Nominal CPU cycles per NTSC frame, 29780.5 rounded up, odd frames are a third of a cycle shorter while rendering
+        static constexpr uint32_t CYCLES_PER_FRAME = 29781;
+        // Run one instruction and catch the PPU up to it, returns the cycles run (0 if halted by the debugger)
+        uint32_t step();
+        // Run whole instructions until the PPU finishes its frame at the start of vblank, returns the cycles run (stops early if halted)
+        uint32_t frame();
+
+        // Controllers
+        // https://www.nesdev.org/wiki/Standard_controller
+        enum BUTTON
+        {
+            BUTTON_A = (1 << 0),
+            BUTTON_B = (1 << 1),
+            BUTTON_SELECT = (1 << 2),
+            BUTTON_START = (1 << 3),
+            BUTTON_UP = (1 << 4),
+            BUTTON_DOWN = (1 << 5),
+            BUTTON_LEFT = (1 << 6),
+            BUTTON_RIGHT = (1 << 7),
+        };
+
+        // DMA
+        // https://www.nesdev.org/wiki/DMA
+        // Sprite DMA from a write to $4014, copies page data << 8 into OAM and stalls the CPU for 513/514 cycles
+        void oamDMA(uint8_t page);
+        // DMC sample fetch, returns the byte and stalls the CPU for 4 cycles
+        uint8_t dmcDMA(uint16_t addr);
+        // Pointer to 256 bytes of plain memory for a page, nullptr if reads of the page must go through read()
+        const uint8_t *directPage(uint8_t page);
+
         //~~~~~~~~~~~~~~~
         // Components of the bus
         //~~~~~~~~~~~~~~~
         // CPU 6502
         cpu6502 cpu;
-        // 64KB RAM
-        std::array<uint8_t, 64 * 1024> ram;
+        // 2KB internal RAM
+        std::array<uint8_t, 2 * 1024> ram;
+        // 8KB PRG-RAM, only touched when the cartridge has it
+        std::array<uint8_t, 8 * 1024> prgRam;
+        bool bPrgRam = false;
+        // PPU 2C02, caught up to the CPU before every register access and after every step()
+        ppu2C02 ppu;
+        // Last values written to the APU / I/O registers
+        std::array<uint8_t, 0x20> ioRegs;
+        // PRG-ROM image and the mask for its mirrors
+        const uint8_t *prgRom = nullptr;
+        uint16_t prgMask = 0x0000;
+        // BUTTON bits held on each controller, set by the host, latched into the shift registers by a strobe on $4016
+        std::array<uint8_t, 2> controller;
+        std::array<uint8_t, 2> controllerShift;
+        bool bStrobe = false;
+        // Sprite memory, filled by oamDMA() and $2004, read by the PPU
+        std::array<uint8_t, 256> oam;
+        // OAM address the DMA starts at (PPU OAMADDR, $2003)
+        uint8_t oamAddr = 0x00;
+
+        //~~~~~~~~~~~~~~~
+        // Debugging
+        //~~~~~~~~~~~~~~~
+        // Attached debugger, set by Debugger::Attach()
+        Debugger *debugger = nullptr;
+        // Debugger::WATCH and Hooks::HOOK flags for each 256 byte page, all zero when nothing is watched
+        std::array<uint8_t, 256> pageWatch;
+        // Point the CPU's zero page and stack fast paths at internal RAM, or clear the read ones while a read watch and the
+        // write ones while a write watch on page 0 or 1 has to see the accesses, and flag the pages with write hooks.
+        // Called by whatever changes pageWatch.
+        void mapDirectPages();
+        // Attached scripting hooks, set by Hooks::Attach()
+        Hooks *hooks = nullptr;
+        // Attached profiler, set by Profiler::Attach()
+        Profiler *profiler = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,112 @@
+// File that pools Bus instances in one arena
+#include "BusPool.h"
+#include <new>
+#include <sys/mman.h>
+
+// Constructor
+BusPool::BusPool(uint32_t capacity, bool bHugePages) : capacity(capacity)
+{
+    head.store(EMPTY);
+    if (capacity == 0 || capacity == EMPTY) return;
+
+    // Slot 0 is the template, instances follow, each on its own cache lines so threads do not share lines
+    stride = (sizeof(Bus) + 63) & ~size_t(63);
+    arenaSize = stride * (size_t(capacity) + 1);
+
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (bHugePages)
+    {
+        const size_t huge = 2 * 1024 * 1024;
+        size_t size = (arenaSize + huge - 1) & ~(huge - 1);
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            arenaSize = size;
+            bHuge = true;
+        }
+    }
+#endif
+    if (p == MAP_FAILED)
+    {
+        p = mmap(nullptr, arenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return;
+#ifdef MADV_HUGEPAGE
+        if (bHugePages) madvise(p, arenaSize, MADV_HUGEPAGE);
+#endif
+    }
+    arena = static_cast<uint8_t *>(p);
+
+    // Construct everything once, from here on instances are only ever copied over
+    templ = new (arena) Bus();
+    next = new std::atomic<uint32_t>[capacity];
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        new (Slot(i)) Bus();
+        next[i].store(i + 1 < capacity ? i + 1 : EMPTY);
+    }
+    head.store(0);
+}
+
+// Destructor
+BusPool::~BusPool()
+{
+    if (arena == nullptr) return;
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        Slot(i)->~Bus();
+    }
+    templ->~Bus();
+    delete[] next;
+    munmap(arena, arenaSize);
+}
+
+// Capture the template state
+void BusPool::Capture(const Bus &bus)
+{
+    if (templ == nullptr) return;
+    templ->copyState(bus);
+}
+
+// Reset an instance to the template, detaching whatever was attached to it
+void BusPool::Reset(Bus *bus)
+{
+    bus->copyState(*templ);
+    bus->debugger = nullptr;
+    bus->hooks = nullptr;
+    bus->cpu.coverage = nullptr;
+    bus->pageWatch.fill(0);
+    bus->mapDirectPages();
+    bus->profiler = nullptr;
+}
+
+// Pop a free slot
+Bus *BusPool::Acquire()
+{
+    uint64_t old = head.load(std::memory_order_acquire);
+    uint32_t top;
+    do
+    {
+        top = uint32_t(old);
+        if (top == EMPTY) return nullptr;
+    } while (!head.compare_exchange_weak(old, (((old >> 32) + 1) << 32) | next[top].load(std::memory_order_relaxed),
+        std::memory_order_acquire, std::memory_order_acquire));
+
+    Bus *bus = Slot(top);
+    Reset(bus);
+    return bus;
+}
+
+// Push a slot back
+void BusPool::Release(Bus *bus)
+{
+    if (bus == nullptr) return;
+    uint32_t i = uint32_t((reinterpret_cast<uint8_t *>(bus) - arena) / stride) - 1;
+
+    uint64_t old = head.load(std::memory_order_relaxed);
+    do
+    {
+        next[i].store(uint32_t(old), std::memory_order_relaxed);
+    } while (!head.compare_exchange_weak(old, (old & 0xFFFFFFFF00000000ULL) | i,
+        std::memory_order_release, std::memory_order_relaxed));
+}
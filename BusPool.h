@@ -0,0 +1,60 @@
+// BusPool header file to define the pooled instance allocator
+// Every Bus lives in one contiguous arena, optionally on 2MB huge pages. Acquire() hands out a free instance
+// reset to a captured template state, which is a plain copy of the template: no heap activity, no table rebuild.
+// The free list is a lock-free stack, so worker threads can acquire and release instances concurrently.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "Bus.h"
+
+class BusPool
+{
+    public:
+        // Constructor and Destructor
+        // Reserves the arena for capacity instances, with bHugePages it tries MAP_HUGETLB first and falls back
+        // to normal pages with a transparent huge page hint.
+        BusPool(uint32_t capacity, bool bHugePages = false);
+        ~BusPool();
+
+        BusPool(const BusPool &) = delete;
+        BusPool &operator=(const BusPool &) = delete;
+
+        // Capture the state new instances start from, for example a bus with a cartridge inserted and the CPU reset.
+        // The PRG-ROM image is shared, not copied, and must outlive the pool. A debugger is never captured.
+        // Not thread safe against Acquire(), capture before handing the pool to workers.
+        void Capture(const Bus &bus);
+
+        // Take a free instance reset to the template, nullptr if the pool is exhausted
+        Bus *Acquire();
+        // Reset an instance in use back to the template without giving it up
+        void Reset(Bus *bus);
+        // Give an instance back, a debugger must be detached first
+        void Release(Bus *bus);
+
+        uint32_t Capacity() const { return capacity; }
+        // Bytes between instances, a multiple of the cache line size
+        size_t Stride() const { return stride; }
+        // True if the arena is on explicit huge pages
+        bool HugePages() const { return bHuge; }
+        // True if the arena could be mapped
+        bool Valid() const { return arena != nullptr; }
+
+    private:
+        // Arena holding the template followed by the instances
+        uint8_t *arena = nullptr;
+        size_t arenaSize = 0;
+        size_t stride = 0;
+        uint32_t capacity = 0;
+        bool bHuge = false;
+
+        Bus *templ = nullptr;
+        Bus *Slot(uint32_t i) const { return reinterpret_cast<Bus *>(arena + stride * (i + 1)); }
+
+        // Free list, a Treiber stack of slot indices
+        // The head packs the top index (low 32 bits) with a tag that changes on every pop (high 32 bits) against ABA
+        static constexpr uint32_t EMPTY = 0xFFFFFFFF;
+        alignas(64) std::atomic<uint64_t> head;
+        std::atomic<uint32_t> *next = nullptr;
+};
@@ -0,0 +1,501 @@
+// File that writes checkpoints of the emulation state to disk on a background thread
+#include "Checkpointer.h"
+#include "Regression.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// File format
+// Header, then the LZ4 block of: a bitmap with one bit per page of the serialized state, and the pages whose bit is
+// set. A full checkpoint has every bit set, a delta takes the others from the checkpoint base (little endian hosts).
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static const char MAGIC[8] = { 'N', 'E', 'S', 'C', 'K', 'P', 'T', 0 };
+static const uint32_t FILE_VERSION = 1;
+// Far more than a bus serializes to, a damaged header is not allowed to ask for gigabytes
+static const uint32_t MAX_IMAGE = 1 << 20;
+
+namespace
+{
+    struct HEADER
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t pageSize;
+        uint64_t sequence;
+        uint64_t base; // Checkpoint the pages not stored come from, the sequence itself for a full one
+        uint64_t frame; // Frames completed when captured
+        uint64_t rom; // Hash64 of the mapped PRG-ROM
+        uint64_t image; // Hash64 of the serialized state
+        uint32_t imageSize;
+        uint32_t rawSize; // Bitmap and pages before compression
+        uint32_t packedSize;
+        uint32_t bKey;
+    };
+}
+
+static std::string FileName(const std::string &directory, const std::string &name, uint64_t sequence)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "-%010llu.ckpt", (unsigned long long)sequence);
+    return directory + "/" + name + number;
+}
+
+// Sequence numbers of the checkpoints of a name in a directory, oldest first
+static std::vector<uint64_t> Sequences(const std::string &directory, const std::string &name)
+{
+    std::vector<uint64_t> found;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr) return found;
+    const std::string prefix = name + "-";
+    while (struct dirent *entry = readdir(dir))
+    {
+        const char *file = entry->d_name;
+        if (strncmp(file, prefix.c_str(), prefix.size()) != 0) continue;
+        const char *digits = file + prefix.size();
+        char *end = nullptr;
+        unsigned long long sequence = strtoull(digits, &end, 10);
+        if (end == digits || *digits < '0' || *digits > '9' || strcmp(end, ".ckpt") != 0) continue;
+        found.push_back(sequence);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+static uint64_t RomHash(const Bus &bus)
+{
+    return bus.prgRom != nullptr ? Regression::Hash64(bus.prgRom, (size_t)bus.prgMask + 1) : 0;
+}
+
+// Write and fsync, the data is on disk before the rename makes it the checkpoint
+static bool WriteFile(const std::string &path, const HEADER &header, const std::vector<uint8_t> &payload)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr) return false;
+    bool bOk = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (bOk && !payload.empty()) bOk = fwrite(payload.data(), payload.size(), 1, f) == 1;
+    bOk = bOk && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    return (fclose(f) == 0) && bOk;
+}
+
+// The rename itself is only durable once the directory is synced
+static void SyncDirectory(const std::string &directory)
+{
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+static bool ReadFile(const std::string &path, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) return false;
+    data.clear();
+    uint8_t buffer[16384];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+    bool bOk = !ferror(f);
+    fclose(f);
+    return bOk;
+}
+
+// Header of a checkpoint file, false if it is not one this version wrote whole
+static bool ParseHeader(const std::vector<uint8_t> &file, HEADER &header)
+{
+    if (file.size() < sizeof(header)) return false;
+    memcpy(&header, file.data(), sizeof(header));
+    return memcmp(header.magic, MAGIC, 8) == 0 && header.version == FILE_VERSION && header.pageSize == Checkpointer::PAGE &&
+        header.packedSize == file.size() - sizeof(header) && header.imageSize <= MAX_IMAGE && header.rawSize <= 2 * MAX_IMAGE;
+}
+
+// Serialized state of a checkpoint: walk back to the full checkpoint of its chain, then apply the deltas forward
+static bool Load(const std::string &directory, const std::string &name, uint64_t sequence, uint64_t rom, std::vector<uint8_t> &image)
+{
+    std::vector<std::vector<uint8_t>> chain;
+    for (uint64_t s = sequence;;)
+    {
+        chain.emplace_back();
+        HEADER header;
+        if (!ReadFile(FileName(directory, name, s), chain.back()) || !ParseHeader(chain.back(), header)) return false;
+        if (header.sequence != s || header.rom != rom) return false;
+        if (header.bKey) break;
+        if (header.base >= s) return false;
+        s = header.base;
+    }
+
+    std::vector<uint8_t> raw;
+    for (auto file = chain.rbegin(); file != chain.rend(); ++file)
+    {
+        HEADER header;
+        memcpy(&header, file->data(), sizeof(header));
+        const uint32_t pages = (header.imageSize + Checkpointer::PAGE - 1) / Checkpointer::PAGE;
+        const size_t bitmap = (pages + 7) / 8;
+        if (header.bKey) image.assign(header.imageSize, 0x00);
+        else if (image.size() != header.imageSize) return false;
+
+        raw.resize(header.rawSize);
+        if (raw.size() < bitmap || !Checkpointer::Decompress(file->data() + sizeof(header), header.packedSize, raw.data(), raw.size())) return false;
+        size_t at = bitmap;
+        for (uint32_t i = 0; i < pages; i++)
+        {
+            const bool bStored = (raw[i >> 3] >> (i & 7)) & 1;
+            if (!bStored)
+            {
+                if (header.bKey) return false;
+                continue;
+            }
+            const size_t offset = (size_t)i * Checkpointer::PAGE;
+            const size_t size = std::min<size_t>(Checkpointer::PAGE, image.size() - offset);
+            if (raw.size() - at < size) return false;
+            memcpy(image.data() + offset, raw.data() + at, size);
+            at += size;
+        }
+        if (at != raw.size() || Regression::Hash64(image.data(), image.size()) != header.image) return false;
+    }
+    return true;
+}
+
+// Constructor
+Checkpointer::Checkpointer()
+{
+
+}
+
+// Destructor
+Checkpointer::~Checkpointer()
+{
+    Stop();
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Emulation thread
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool Checkpointer::Start(const std::string &d, const std::string &n, uint32_t k)
+{
+    if (IsStarted()) return false;
+    if (mkdir(d.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    struct stat st;
+    if (stat(d.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+
+    directory = d;
+    name = n;
+    keyEvery = std::max<uint32_t>(k, 1);
+    std::vector<uint64_t> existing = Sequences(directory, name);
+    sequence = existing.empty() ? 0 : existing.back() + 1;
+    lastKey = 0;
+    sinceKey = 0;
+    bHavePrevious = false;
+    queued = -1;
+    writing = -1;
+    bStop = false;
+    bLastFailed = false;
+    thread = std::thread(&Checkpointer::Run, this);
+    return true;
+}
+
+void Checkpointer::Stop()
+{
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        bStop = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+bool Checkpointer::Capture(const Bus &bus)
+{
+    if (!IsStarted()) return false;
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        // The slot the writer is not on, a capture still queued there is replaced
+        int slot = (writing >= 0) ? 1 - writing : (queued >= 0) ? queued : 0;
+        if (queued == slot) stats.replaced++;
+        // The spare buses are made by the first capture
+        if (slots[slot] == nullptr || slots[slot]->cpu.GetVariant() != bus.cpu.GetVariant()) slots[slot] = std::make_unique<Bus>(bus.cpu.GetVariant());
+        slots[slot]->copyState(bus);
+        queued = slot;
+        stats.captures++;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        stats.captureSeconds += elapsed.count();
+        stats.captureMaxSeconds = std::max(stats.captureMaxSeconds, elapsed.count());
+    }
+    wake.notify_one();
+    return true;
+}
+
+bool Checkpointer::Flush()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this]() { return queued < 0 && writing < 0; });
+    return !bLastFailed;
+}
+
+Checkpointer::Stats Checkpointer::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Writer thread
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Checkpointer::Run()
+{
+    Tracer::NameThread("checkpoint");
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;)
+    {
+        // Stop only once nothing is queued
+        wake.wait(guard, [this]() { return queued >= 0 || bStop; });
+        if (queued < 0) break;
+        writing = queued;
+        queued = -1;
+        guard.unlock();
+
+        Stats local;
+        auto start = std::chrono::steady_clock::now();
+        bool bOk = Write(*slots[writing], local);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        guard.lock();
+        stats.written += local.written;
+        stats.keys += local.keys;
+        stats.failed += bOk ? 0 : 1;
+        stats.imageBytes += local.imageBytes;
+        stats.fileBytes += local.fileBytes;
+        stats.pagesStored += local.pagesStored;
+        stats.pagesDeduplicated += local.pagesDeduplicated;
+        stats.writeSeconds += elapsed.count();
+        bLastFailed = !bOk;
+        writing = -1;
+        done.notify_all();
+    }
+}
+
+// Serialize, keep the pages that changed, compress and write one checkpoint
+bool Checkpointer::Write(const Bus &bus, Stats &local)
+{
+    NES_TRACE_SCOPE("checkpoint");
+    image.clear();
+    bus.SaveState(image);
+    const bool bKey = !bHavePrevious || previous.size() != image.size() || sinceKey + 1 >= keyEvery;
+    const uint32_t pages = (uint32_t)((image.size() + PAGE - 1) / PAGE);
+
+    raw.assign((pages + 7) / 8, 0x00);
+    uint32_t stored = 0;
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        const size_t offset = (size_t)i * PAGE;
+        const size_t size = std::min<size_t>(PAGE, image.size() - offset);
+        if (!bKey && memcmp(image.data() + offset, previous.data() + offset, size) == 0) continue;
+        raw[i >> 3] |= 1 << (i & 7);
+        raw.insert(raw.end(), image.begin() + offset, image.begin() + offset + size);
+        stored++;
+    }
+    Compress(raw.data(), raw.size(), packed);
+
+    HEADER header = {};
+    memcpy(header.magic, MAGIC, 8);
+    header.version = FILE_VERSION;
+    header.pageSize = PAGE;
+    header.sequence = sequence;
+    header.base = bKey ? sequence : base;
+    header.frame = bus.ppu.frameCount;
+    header.rom = RomHash(bus);
+    header.image = Regression::Hash64(image.data(), image.size());
+    header.imageSize = (uint32_t)image.size();
+    header.rawSize = (uint32_t)raw.size();
+    header.packedSize = (uint32_t)packed.size();
+    header.bKey = bKey;
+
+    const std::string path = FileName(directory, name, sequence);
+    const std::string temp = path + ".tmp";
+    sequence++;
+    if (!WriteFile(temp, header, packed) || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        remove(temp.c_str());
+        // The chain is broken, the next one stores every page
+        bHavePrevious = false;
+        return false;
+    }
+    SyncDirectory(directory);
+
+    local.written++;
+    local.imageBytes += image.size();
+    local.fileBytes += sizeof(header) + packed.size();
+    local.pagesStored += stored;
+    local.pagesDeduplicated += pages - stored;
+    previous.swap(image);
+    bHavePrevious = true;
+    base = header.sequence;
+    if (bKey)
+    {
+        local.keys++;
+        sinceKey = 0;
+        // Keep the chain before this one, in case this one is lost
+        RemoveBefore(lastKey);
+        lastKey = header.sequence;
+    }
+    else
+    {
+        sinceKey++;
+    }
+    return true;
+}
+
+void Checkpointer::RemoveBefore(uint64_t first)
+{
+    for (uint64_t s : Sequences(directory, name))
+    {
+        if (s >= first) break;
+        remove(FileName(directory, name, s).c_str());
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Resume
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool Checkpointer::Resume(const std::string &directory, Bus &bus, const std::string &name, uint64_t *sequence)
+{
+    const std::vector<uint64_t> found = Sequences(directory, name);
+    const uint64_t rom = RomHash(bus);
+    std::vector<uint8_t> image;
+    // Newest first, a checkpoint that is damaged or missing part of its chain falls back to the one before
+    for (auto s = found.rbegin(); s != found.rend(); ++s)
+    {
+        if (!Load(directory, name, *s, rom, image) || !bus.LoadState(image.data(), image.size())) continue;
+        if (sequence != nullptr) *sequence = *s;
+        return true;
+    }
+    return false;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LZ4 block format
+// Sequences of a token (literal length << 4 | match length - 4), more literal length bytes while 255, the literals, a
+// 16 bit offset back and more match length bytes. The last sequence has literals only, the last 5 bytes are always
+// literals and no match starts in the last 12 bytes.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t LAST_LITERALS = 5;
+static constexpr size_t MATCH_LIMIT = 12;
+static constexpr int HASH_BITS = 12;
+
+static uint32_t Load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// A length that does not fit its 4 bits of the token
+static void PutLength(std::vector<uint8_t> &out, size_t length)
+{
+    for (; length >= 255; length -= 255) out.push_back(255);
+    out.push_back((uint8_t)length);
+}
+
+static void PutSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t count, size_t offset, size_t match)
+{
+    const size_t extra = (match >= MIN_MATCH) ? match - MIN_MATCH : 0;
+    out.push_back((uint8_t)((std::min<size_t>(count, 15) << 4) | std::min<size_t>(extra, 15)));
+    if (count >= 15) PutLength(out, count - 15);
+    out.insert(out.end(), literals, literals + count);
+    if (match < MIN_MATCH) return;
+    out.push_back((uint8_t)offset);
+    out.push_back((uint8_t)(offset >> 8));
+    if (extra >= 15) PutLength(out, extra - 15);
+}
+
+void Checkpointer::Compress(const uint8_t *src, size_t size, std::vector<uint8_t> &out)
+{
+    out.clear();
+    size_t anchor = 0;
+    if (size > MATCH_LIMIT)
+    {
+        std::vector<uint32_t> table(1 << HASH_BITS, 0);
+        const size_t last = size - MATCH_LIMIT; // Last position a match may start at
+        const size_t end = size - LAST_LITERALS; // Matches end before this
+        size_t ip = 0;
+        while (ip <= last)
+        {
+            const uint32_t sequence = Load32(src + ip);
+            const uint32_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            const size_t candidate = table[h];
+            table[h] = (uint32_t)ip;
+            if (candidate >= ip || ip - candidate > 0xFFFF || Load32(src + candidate) != sequence)
+            {
+                // Skip faster through data that does not compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            size_t match = MIN_MATCH;
+            while (ip + match < end && src[candidate + match] == src[ip + match]) match++;
+            PutSequence(out, src + anchor, ip - anchor, ip - candidate, match);
+            ip += match;
+            anchor = ip;
+        }
+    }
+    PutSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool Checkpointer::Decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize)
+{
+    const uint8_t *ip = src;
+    const uint8_t *const end = src + size;
+    size_t op = 0;
+    auto length = [&](size_t &n)
+    {
+        uint8_t b;
+        do
+        {
+            if (ip == end) return false;
+            b = *ip++;
+            n += b;
+        } while (b == 255);
+        return true;
+    };
+
+    for (;;)
+    {
+        if (ip == end) return false;
+        const uint8_t token = *ip++;
+        size_t count = token >> 4;
+        if (count == 15 && !length(count)) return false;
+        if (count > (size_t)(end - ip) || count > dstSize - op) return false;
+        if (count > 0) memcpy(dst + op, ip, count);
+        ip += count;
+        op += count;
+        // The last sequence has no match
+        if (ip == end) return op == dstSize;
+
+        if (end - ip < 2) return false;
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match = token & 0x0F;
+        if (match == 15 && !length(match)) return false;
+        match += MIN_MATCH;
+        if (offset == 0 || offset > op || match > dstSize - op) return false;
+        // Byte by byte, the match may overlap what it writes
+        for (size_t i = 0; i < match; i++) dst[op + i] = dst[op - offset + i];
+        op += match;
+    }
+}
@@ -0,0 +1,113 @@
+// Checkpointer header file to define asynchronous on-disk checkpoints of long running emulations
+// The emulation thread captures the state at a frame boundary by copying it into one of two spare buses, which takes
+// microseconds and touches no file. A writer thread serializes the capture, keeps only the 256 byte pages that changed
+// since the checkpoint before it, compresses them in the LZ4 block format and writes the file next to its final name,
+// then fsyncs it and renames it into place, so a crash leaves either the old checkpoint or the new one.
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+// Every keyEvery-th checkpoint stores every page, the ones in between only refer back to the one before. Writing a
+// full checkpoint removes the chains before the previous one, so the newest two chains are kept.
+//
+//     Checkpointer checkpoints;
+//     Checkpointer::Resume("saves", bus); // Carry on from the newest checkpoint, if there is one
+//     checkpoints.Start("saves");
+//     for (...) { bus.frame(); if (bus.ppu.frameCount % 600 == 0) checkpoints.Capture(bus); }
+//     checkpoints.Stop();
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bus.h"
+
+class Checkpointer
+{
+    public:
+        // Constructor and Destructor, the destructor stops a started writer after it wrote what was captured
+        Checkpointer();
+        ~Checkpointer();
+
+        Checkpointer(const Checkpointer &) = delete;
+        Checkpointer &operator=(const Checkpointer &) = delete;
+
+        // Start writing name-<sequence>.ckpt files into directory, which is created if missing. Sequence numbers carry
+        // on after the newest checkpoint of that name already there and the first one written stores every page.
+        // Returns false if already started or the directory cannot be used.
+        bool Start(const std::string &directory, const std::string &name = "checkpoint", uint32_t keyEvery = 64);
+        // Write out what was captured and stop the writer
+        void Stop();
+        bool IsStarted() const { return thread.joinable(); }
+
+        // Take a checkpoint, called on the emulation thread between frames. The state is copied into the spare bus the
+        // writer is not working on and the call returns. A capture the writer has not picked up yet is replaced by the
+        // newer one rather than waited for. Returns false if not started.
+        // The PRG-ROM image is shared with the capture, not copied, keep it alive until Flush() or Stop().
+        bool Capture(const Bus &bus);
+        // Wait until everything captured so far is on disk, returns false if the last write failed
+        bool Flush();
+
+        // Load the newest checkpoint of that name in directory that reads back whole into bus, returns false, leaving
+        // the bus alone, if none does. The bus needs the cartridge the checkpoint was taken with, others are skipped.
+        static bool Resume(const std::string &directory, Bus &bus, const std::string &name = "checkpoint", uint64_t *sequence = nullptr);
+
+        struct Stats
+        {
+            uint64_t captures = 0;
+            uint64_t replaced = 0; // Captures overwritten by a newer one before they were written
+            uint64_t written = 0; // Checkpoint files, full ones included
+            uint64_t keys = 0; // Full checkpoints
+            uint64_t failed = 0;
+            uint64_t imageBytes = 0; // Serialized state of the written checkpoints
+            uint64_t fileBytes = 0;
+            uint64_t pagesStored = 0;
+            uint64_t pagesDeduplicated = 0; // Pages left out, unchanged since the checkpoint before
+            double captureSeconds = 0.0; // On the emulation thread
+            double captureMaxSeconds = 0.0;
+            double writeSeconds = 0.0; // On the writer thread, serializing, compressing and writing
+        };
+        Stats GetStats() const;
+
+        //~~~~~~~~~~~~~~~
+        // Building blocks
+        //~~~~~~~~~~~~~~~
+        static constexpr uint32_t PAGE = 256;
+        // LZ4 block format, greedy matches through a 4096 entry hash table. Decompress() checks every length and offset
+        // and returns false unless the data is well formed and fills dst exactly.
+        static void Compress(const uint8_t *src, size_t size, std::vector<uint8_t> &out);
+        static bool Decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize);
+
+    private:
+        std::string directory;
+        std::string name;
+        uint32_t keyEvery = 64;
+
+        // Guards everything below that both threads touch
+        mutable std::mutex lock;
+        std::condition_variable wake; // Something was captured, or stop
+        std::condition_variable done; // A write finished
+        std::unique_ptr<Bus> slots[2];
+        int queued = -1; // Slot captured and not picked up yet
+        int writing = -1; // Slot the writer is on
+        bool bStop = false;
+        bool bLastFailed = false;
+        Stats stats;
+        std::thread thread;
+
+        // Writer
+        uint64_t sequence = 0; // Of the next checkpoint
+        uint64_t base = 0; // Sequence of previous, the image the next one is a delta against
+        uint64_t lastKey = 0; // Last full checkpoint, files before it are removed when the next one is written
+        uint32_t sinceKey = 0;
+        bool bHavePrevious = false;
+        std::vector<uint8_t> previous;
+        std::vector<uint8_t> image;
+        std::vector<uint8_t> raw;
+        std::vector<uint8_t> packed;
+        void Run();
+        bool Write(const Bus &bus, Stats &local);
+        void RemoveBefore(uint64_t first);
+};
@@ -0,0 +1,439 @@
+// File that runs hosted sessions' frames earliest deadline first
+#include "DeadlineScheduler.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+// Constructor
+DeadlineScheduler::DeadlineScheduler(const Config &c) : config(c)
+{
+    int count = config.workers;
+    if (count <= 0) count = (int)std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < count; i++)
+    {
+        auto w = std::make_unique<Worker>();
+        w->histogram.fill(0);
+        w->nextBalance = Clock::now() + config.balanceEvery;
+        workers.push_back(std::move(w));
+    }
+    for (int i = 0; i < count; i++)
+    {
+        workers[i]->thread = std::thread(&DeadlineScheduler::Run, this, i);
+    }
+}
+
+// Destructor
+DeadlineScheduler::~DeadlineScheduler()
+{
+    bStop = true;
+    for (auto &w : workers)
+    {
+        {
+            std::lock_guard<std::mutex> guard(w->lock);
+        }
+        w->wake.notify_all();
+    }
+    for (auto &w : workers) w->thread.join();
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Sessions
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// CPU time of the calling thread, what a frame costs whether or not the thread was preempted while running it
+static double ThreadSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double DeadlineScheduler::Probe(const Bus &bus)
+{
+    // The copy renders too if the session does, pixels are most of a frame
+    auto copy = std::make_unique<Bus>(bus.cpu.GetVariant());
+    copy->copyState(bus);
+    std::vector<uint8_t> pixels;
+    if (bus.ppu.frameBuffer != nullptr)
+    {
+        pixels.resize(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+        copy->ppu.frameBuffer = pixels.data();
+    }
+    // The first frame warms the caches, a single timed one after it can be off by a factor of two either way
+    copy->frame();
+    std::array<double, PROBE_FRAMES> seconds;
+    for (double &s : seconds)
+    {
+        double start = ThreadSeconds();
+        copy->frame();
+        s = ThreadSeconds() - start;
+    }
+    std::nth_element(seconds.begin(), seconds.begin() + PROBE_FRAMES / 2, seconds.end());
+    return seconds[PROBE_FRAMES / 2];
+}
+
+int DeadlineScheduler::Add(Bus *bus, Callback callback, Clock::duration period, double estimate)
+{
+    if (estimate <= 0.0) estimate = Probe(*bus);
+    const double share = estimate / std::chrono::duration<double>(period).count();
+
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    // Least loaded worker, if it has room
+    int best = -1;
+    double bestLoad = 0.0;
+    for (int i = 0; i < (int)workers.size(); i++)
+    {
+        std::lock_guard<std::mutex> wg(workers[i]->lock);
+        if (best < 0 || workers[i]->load < bestLoad)
+        {
+            best = i;
+            bestLoad = workers[i]->load;
+        }
+    }
+    if (bestLoad + share * config.headroom > config.utilization)
+    {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+
+    auto s = std::make_unique<Session>();
+    s->id = nextId++;
+    s->bus = bus;
+    s->callback = callback;
+    s->period = period;
+    s->release = Clock::now();
+    s->cost = estimate;
+    s->worker = best;
+    Worker &w = *workers[best];
+    {
+        std::lock_guard<std::mutex> wg(w.lock);
+        Insert(w, s.get());
+    }
+    w.wake.notify_one();
+    int id = s->id;
+    sessions[id] = std::move(s);
+    return id;
+}
+
+bool DeadlineScheduler::Remove(int id)
+{
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    auto it = sessions.find(id);
+    if (it == sessions.end()) return false;
+    Session *s = it->second.get();
+
+    // Moves need the sessions lock, the session stays on this worker
+    Worker &w = *workers[s->worker];
+    std::unique_lock<std::mutex> wg(w.lock);
+    w.idle.wait(wg, [&]() { return w.running != s; });
+    Extract(w, s);
+    wg.unlock();
+    sessions.erase(it);
+    return true;
+}
+
+bool DeadlineScheduler::IsShed(int id) const
+{
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    auto it = sessions.find(id);
+    return it != sessions.end() && it->second->bShed;
+}
+
+void DeadlineScheduler::SetInput(int id, uint8_t buttons)
+{
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    auto it = sessions.find(id);
+    if (it != sessions.end()) it->second->input.store(buttons, std::memory_order_relaxed);
+}
+
+void DeadlineScheduler::Insert(Worker &w, Session *s)
+{
+    w.pending.push_back(s);
+    std::push_heap(w.pending.begin(), w.pending.end(), LaterRelease);
+    w.load += s->cost / std::chrono::duration<double>(s->period).count();
+}
+
+bool DeadlineScheduler::Extract(Worker &w, Session *s)
+{
+    for (auto *heap : { &w.pending, &w.ready })
+    {
+        auto it = std::find(heap->begin(), heap->end(), s);
+        if (it == heap->end()) continue;
+        heap->erase(it);
+        if (heap == &w.pending) std::make_heap(heap->begin(), heap->end(), LaterRelease);
+        else std::make_heap(heap->begin(), heap->end(), LaterDeadline);
+        w.load -= s->cost / std::chrono::duration<double>(s->period).count();
+        if (w.load < 0.0) w.load = 0.0;
+        return true;
+    }
+    return false;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Workers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void DeadlineScheduler::Run(int index)
+{
+    Worker &w = *workers[index];
+    std::unique_lock<std::mutex> guard(w.lock);
+    while (!bStop.load(std::memory_order_relaxed))
+    {
+        // Released frames move over to the deadline heap
+        Clock::time_point now = Clock::now();
+        while (!w.pending.empty() && w.pending.front()->release <= now)
+        {
+            std::pop_heap(w.pending.begin(), w.pending.end(), LaterRelease);
+            w.ready.push_back(w.pending.back());
+            w.pending.pop_back();
+            std::push_heap(w.ready.begin(), w.ready.end(), LaterDeadline);
+        }
+
+        if (w.ready.empty())
+        {
+            NES_TRACE_SCOPE("idle");
+            if (w.pending.empty()) w.wake.wait(guard);
+            else w.wake.wait_until(guard, w.pending.front()->release);
+            continue;
+        }
+
+        std::pop_heap(w.ready.begin(), w.ready.end(), LaterDeadline);
+        Session *s = w.ready.back();
+        w.ready.pop_back();
+        w.running = s;
+        guard.unlock();
+
+        const double cpu = ThreadSeconds();
+        s->bus->controller[0] = s->input.load(std::memory_order_relaxed);
+        s->bus->frame();
+        if (s->callback != nullptr) s->callback(s->id, *s->bus);
+        const double cost = ThreadSeconds() - cpu;
+        Clock::time_point end = Clock::now();
+
+        guard.lock();
+        w.running = nullptr;
+        const double latency = std::chrono::duration<double>(end - s->release).count();
+        const Clock::time_point deadline = s->release + s->period;
+        w.frames++;
+        int bucket = std::min(BUCKETS - 1, (int)(latency / BUCKET));
+        w.histogram[bucket]++;
+        w.max = std::max(w.max, latency);
+        if (end > deadline)
+        {
+            w.misses++;
+            w.missesSinceBalance++;
+        }
+
+        // Next release, a session a whole period behind drops frames to get back in phase
+        const double period = std::chrono::duration<double>(s->period).count();
+        w.load -= s->cost / period;
+        s->cost += (cost - s->cost) / 8.0;
+        w.load += s->cost / period;
+        s->release = deadline;
+        if (end > s->release + s->period)
+        {
+            int64_t behind = (end - s->release) / s->period;
+            s->release += behind * s->period;
+            w.skipped += behind;
+        }
+        w.pending.push_back(s);
+        std::push_heap(w.pending.begin(), w.pending.end(), LaterRelease);
+        w.idle.notify_all();
+
+        if ((config.bMigrate || config.bShed) && end >= w.nextBalance)
+        {
+            w.nextBalance = end + config.balanceEvery;
+            bool bOver = w.load > config.utilization || w.missesSinceBalance > 0;
+            w.missesSinceBalance = 0;
+            if (bOver)
+            {
+                guard.unlock();
+                NES_TRACE_SCOPE("balance");
+                if (config.bMigrate) Balance(index);
+                if (config.bShed) Shed(index);
+                guard.lock();
+            }
+        }
+    }
+}
+
+// Hand the sessions that fit to the least loaded worker until this one is back under the bound
+void DeadlineScheduler::Balance(int index)
+{
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    Worker &w = *workers[index];
+    for (;;)
+    {
+        int target = -1;
+        double targetLoad = 0.0;
+        for (int i = 0; i < (int)workers.size(); i++)
+        {
+            if (i == index) continue;
+            std::lock_guard<std::mutex> wg(workers[i]->lock);
+            if (target < 0 || workers[i]->load < targetLoad)
+            {
+                target = i;
+                targetLoad = workers[i]->load;
+            }
+        }
+        if (target < 0) return;
+
+        // The largest waiting session that fits, it is not running since this is the worker's own thread
+        Session *move = nullptr;
+        {
+            std::lock_guard<std::mutex> wg(w.lock);
+            const double room = config.utilization - targetLoad;
+            // Moving only helps if it leaves both workers better off than this one is
+            if (w.load <= targetLoad) return;
+            double best = 0.0;
+            for (auto *heap : { &w.pending, &w.ready })
+            {
+                for (Session *s : *heap)
+                {
+                    double share = s->cost / std::chrono::duration<double>(s->period).count();
+                    if (share <= room && share < w.load - targetLoad && share > best)
+                    {
+                        best = share;
+                        move = s;
+                    }
+                }
+            }
+            if (move == nullptr) return;
+            Extract(w, move);
+            move->worker = target;
+            if (w.load <= config.utilization) w.nextBalance = Clock::now() + config.balanceEvery;
+        }
+        Worker &t = *workers[target];
+        {
+            std::lock_guard<std::mutex> wg(t.lock);
+            Insert(t, move);
+        }
+        t.wake.notify_one();
+        migrations.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> wg(w.lock);
+        if (w.load <= config.utilization) return;
+    }
+}
+
+// Newest first, the sessions that were running before it came keep their frames. Only measured load counts here, misses
+// with the load under the bound are left to Balance().
+void DeadlineScheduler::Shed(int index)
+{
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    Worker &w = *workers[index];
+    std::lock_guard<std::mutex> wg(w.lock);
+    while (w.load > config.utilization)
+    {
+        Session *newest = nullptr;
+        for (auto *heap : { &w.pending, &w.ready })
+        {
+            for (Session *s : *heap)
+            {
+                if (newest == nullptr || s->id > newest->id) newest = s;
+            }
+        }
+        if (newest == nullptr) return;
+        Extract(w, newest);
+        newest->bShed = true;
+        shed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Metrics
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+DeadlineScheduler::Stats DeadlineScheduler::GetStats() const
+{
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> guard(sessionsLock);
+        for (auto &s : sessions) stats.sessions += !s.second->bShed;
+    }
+    stats.rejected = rejected.load(std::memory_order_relaxed);
+    stats.shed = shed.load(std::memory_order_relaxed);
+    stats.migrations = migrations.load(std::memory_order_relaxed);
+
+    std::vector<uint64_t> histogram(BUCKETS, 0);
+    for (auto &w : workers)
+    {
+        std::lock_guard<std::mutex> guard(w->lock);
+        stats.frames += w->frames;
+        stats.misses += w->misses;
+        stats.skipped += w->skipped;
+        stats.max = std::max(stats.max, w->max);
+        stats.utilization.push_back(w->load);
+        for (int i = 0; i < BUCKETS; i++) histogram[i] += w->histogram[i];
+    }
+
+    // Upper edge of the bucket the percentile falls in
+    auto percentile = [&](double p)
+    {
+        uint64_t rank = (uint64_t)(p * stats.frames);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            seen += histogram[i];
+            if (seen > rank) return std::min((i + 1) * BUCKET, stats.max);
+        }
+        return stats.max;
+    };
+    if (stats.frames > 0)
+    {
+        stats.p50 = percentile(0.50);
+        stats.p99 = percentile(0.99);
+        stats.p999 = percentile(0.999);
+    }
+    return stats;
+}
+
+void DeadlineScheduler::ResetStats()
+{
+    for (auto &w : workers)
+    {
+        std::lock_guard<std::mutex> guard(w->lock);
+        w->frames = 0;
+        w->misses = 0;
+        w->skipped = 0;
+        w->max = 0.0;
+        w->histogram.fill(0);
+    }
+    rejected = 0;
+    shed = 0;
+    migrations = 0;
+}
+
+std::string DeadlineScheduler::Metrics() const
+{
+    Stats s = GetStats();
+    std::string out;
+    char line[160];
+    auto add = [&](const char *name, const char *type, double value)
+    {
+        snprintf(line, sizeof(line), "# TYPE nes_%s %s\nnes_%s %.9g\n", name, type, name, value);
+        out += line;
+    };
+    add("sessions", "gauge", s.sessions);
+    add("frames_total", "counter", (double)s.frames);
+    add("deadline_misses_total", "counter", (double)s.misses);
+    add("frames_skipped_total", "counter", (double)s.skipped);
+    add("sessions_rejected_total", "counter", (double)s.rejected);
+    add("sessions_shed_total", "counter", (double)s.shed);
+    add("session_migrations_total", "counter", (double)s.migrations);
+    out += "# TYPE nes_frame_latency_seconds summary\n";
+    const std::pair<const char *, double> quantiles[] = { { "0.5", s.p50 }, { "0.99", s.p99 }, { "0.999", s.p999 }, { "1", s.max } };
+    for (auto &q : quantiles)
+    {
+        snprintf(line, sizeof(line), "nes_frame_latency_seconds{quantile=\"%s\"} %.9g\n", q.first, q.second);
+        out += line;
+    }
+    out += "# TYPE nes_worker_utilization gauge\n";
+    for (size_t i = 0; i < s.utilization.size(); i++)
+    {
+        snprintf(line, sizeof(line), "nes_worker_utilization{worker=\"%zu\"} %.4f\n", i, s.utilization[i]);
+        out += line;
+    }
+    return out;
+}
@@ -0,0 +1,157 @@
+// DeadlineScheduler header file to define the real-time frame scheduler for hosted sessions
+// Every session owes a frame each period (16.64ms for NTSC) and each frame is due one period after it is released.
+// Workers pin their own sessions and always run the released frame with the earliest deadline (EDF), sleeping until
+// the next release when nothing is ready. A session is only admitted when some worker still has room for its frame
+// cost, the median of a few frames run on a copy of the bus with some headroom on top, so a full box rejects new
+// sessions instead of making every session late. Frame cost is thread CPU time, which workers sharing a core do not
+// inflate for each other. Admission is provisional: every frame a session runs updates its cost, and a worker that
+// misses deadlines or goes over the utilization bound hands sessions to the least loaded worker with room for them,
+// then sheds its newest sessions while its measured load is still over the bound.
+// Latency is from release to the end of the frame, a frame that ends after its deadline is a miss, and a session more
+// than a whole period behind skips frames to catch up instead of running them back to back.
+// https://en.wikipedia.org/wiki/Earliest_deadline_first_scheduling
+
+#pragma once
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bus.h"
+
+class DeadlineScheduler
+{
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // NTSC frame period, 1 / 60.0988 seconds
+        static constexpr Clock::duration NTSC_PERIOD = std::chrono::nanoseconds(16639267);
+
+        struct Config
+        {
+            int workers = 0; // 0 for one per hardware thread
+            double utilization = 0.8; // Frame time per period a worker is filled to, EDF meets every deadline up to 1.0
+            double headroom = 1.25; // Admission counts a probed or estimated frame cost times this
+            bool bMigrate = true;
+            bool bShed = true; // Drop the newest sessions of a worker whose measured load stays over the bound
+            Clock::duration balanceEvery = std::chrono::milliseconds(250); // How often a worker looks at its load
+        };
+
+        // Called by the worker after every frame of the session
+        using Callback = std::function<void(int id, Bus &bus)>;
+
+        // Constructor and Destructor, the destructor stops the workers, sessions still added are dropped
+        DeadlineScheduler(const Config &config);
+        ~DeadlineScheduler();
+
+        DeadlineScheduler(const DeadlineScheduler &) = delete;
+        DeadlineScheduler &operator=(const DeadlineScheduler &) = delete;
+
+        // Add a session, returns its id or -1 if no worker has room for it. The bus must stay alive until Remove().
+        // The cost of a frame is the median of PROBE_FRAMES frames run on a copy of the bus unless an estimate in
+        // seconds is given.
+        int Add(Bus *bus, Callback callback = nullptr, Clock::duration period = NTSC_PERIOD, double estimate = 0.0);
+        // Remove a session, waits for a frame it is running to end
+        bool Remove(int id);
+        // Whether the session was shed to bring its worker back under the bound, its frames no longer run until Remove()
+        bool IsShed(int id) const;
+        // Controller 1 buttons for the next frames of the session
+        void SetInput(int id, uint8_t buttons);
+
+        struct Stats
+        {
+            uint32_t sessions = 0; // Running, shed ones not counted
+            uint64_t frames = 0;
+            uint64_t misses = 0; // Frames that ended after their deadline
+            uint64_t skipped = 0; // Frames dropped by sessions that fell a whole period behind
+            uint64_t rejected = 0; // Sessions refused by admission control
+            uint64_t shed = 0; // Sessions dropped after admission when their worker stayed over the bound
+            uint64_t migrations = 0;
+            double p50 = 0.0; // Frame latency percentiles in seconds, release to end of frame
+            double p99 = 0.0;
+            double p999 = 0.0;
+            double max = 0.0;
+            std::vector<double> utilization; // Measured frame cost per period of each worker's sessions
+        };
+        // Counters and latencies since the start or the last ResetStats()
+        Stats GetStats() const;
+        void ResetStats();
+        // The same as Prometheus text, for a metrics endpoint https://prometheus.io/docs/instrumenting/exposition_formats/
+        std::string Metrics() const;
+
+        int Workers() const { return (int)workers.size(); }
+
+    private:
+        Config config;
+
+        struct Session
+        {
+            int id;
+            Bus *bus;
+            Callback callback;
+            Clock::duration period;
+            Clock::time_point release; // When the next frame may start, it is due one period later
+            double cost; // Seconds per frame, moving average
+            std::atomic<uint8_t> input{ 0x00 };
+            int worker;
+            bool bShed = false;
+        };
+
+        // Latency histogram, 50us buckets up to 4 NTSC periods, the last bucket holds everything above
+        static constexpr double BUCKET = 50e-6;
+        static constexpr int BUCKETS = 1332;
+
+        struct alignas(64) Worker
+        {
+            std::mutex lock;
+            std::condition_variable wake; // New work, or the next release moved earlier
+            std::condition_variable idle; // The running frame ended
+            std::vector<Session *> pending; // Min heap on release
+            std::vector<Session *> ready; // Min heap on deadline
+            Session *running = nullptr;
+            double load = 0.0; // Sum of cost / period of the sessions on the worker
+            Clock::time_point nextBalance;
+            uint64_t missesSinceBalance = 0;
+
+            uint64_t frames = 0;
+            uint64_t misses = 0;
+            uint64_t skipped = 0;
+            double max = 0.0;
+            std::array<uint64_t, BUCKETS> histogram;
+            std::thread thread;
+        };
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> bStop{ false };
+
+        // Sessions by id, taken before any worker lock by everything that adds, removes or moves sessions
+        mutable std::mutex sessionsLock;
+        std::map<int, std::unique_ptr<Session>> sessions;
+        int nextId = 1;
+        std::atomic<uint64_t> rejected{ 0 };
+        std::atomic<uint64_t> shed{ 0 };
+        std::atomic<uint64_t> migrations{ 0 };
+
+        // Heap orders, std heaps keep the largest on top
+        static bool LaterRelease(const Session *a, const Session *b) { return a->release > b->release; }
+        static bool LaterDeadline(const Session *a, const Session *b) { return a->release + a->period > b->release + b->period; }
+
+        void Run(int index);
+        // Seconds of a frame of the bus, the median of PROBE_FRAMES run on a copy after one that warms the caches
+        static constexpr int PROBE_FRAMES = 5;
+        static double Probe(const Bus &bus);
+        // Queue a session on a worker, the worker's lock must be held
+        void Insert(Worker &w, Session *s);
+        // Take a session off a worker's heaps, false if it is not on them, the worker's lock must be held
+        bool Extract(Worker &w, Session *s);
+        // Move sessions off an overloaded worker, called by the worker between frames
+        void Balance(int index);
+        // Drop the newest sessions of a worker until it is back under the bound, called by the worker after Balance()
+        void Shed(int index);
+};
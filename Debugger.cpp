@@ -0,0 +1,495 @@
+// Debugger file for breakpoints and watchpoints
+#include "Debugger.h"
+#include "Bus.h"
+#include <cctype>
+
+// Operations used by compiled conditions
+// Values are pushed with OP_NUM / OP_REG followed by the value or register in the next slot
+enum CONDITION_OP
+{
+    OP_NUM, OP_REG,
+    OP_OR, OP_AND, OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_BOR, OP_BXOR, OP_BAND, OP_ADD, OP_SUB, OP_NOT, OP_INV, OP_NEG,
+};
+
+// Registers and access values that conditions can read
+enum CONDITION_REG
+{
+    REG_A, REG_X, REG_Y, REG_S, REG_P, REG_PC, REG_ADDR, REG_DATA,
+};
+
+// Constructor
+Debugger::Debugger()
+{
+    pcBitmap.fill(0);
+}
+
+// Destructor
+Debugger::~Debugger()
+{
+    Detach();
+}
+
+// Attach to a bus
+void Debugger::Attach(Bus *n)
+{
+    Detach();
+    bus = n;
+    bus->debugger = this;
+    Rebuild();
+}
+
+// Detach from the bus and clear its page flags so the hot path is back to a single load
+void Debugger::Detach()
+{
+    if (bus != nullptr)
+    {
+        for (auto &p : bus->pageWatch) p &= ~(WATCH_READ | WATCH_WRITE | WATCH_EXEC);
+        bus->mapDirectPages();
+        bus->debugger = nullptr;
+        bus = nullptr;
+    }
+}
+
+// Add a PC breakpoint
+int Debugger::AddBreakpoint(uint16_t addr, const std::string &condition, Callback callback, bool bHalt)
+{
+    return AddWatchpoint(addr, addr, WATCH_EXEC, condition, callback, bHalt);
+}
+
+// Add a watchpoint on an address range
+int Debugger::AddWatchpoint(uint16_t start, uint16_t end, uint8_t type, const std::string &condition, Callback callback, bool bHalt)
+{
+    Condition cond;
+    if (!Compile(condition, cond) || start > end || (type & (WATCH_READ | WATCH_WRITE | WATCH_EXEC)) == 0)
+    {
+        return -1;
+    }
+
+    Watchpoint w;
+    w.id = nextId++;
+    w.start = start;
+    w.end = end;
+    w.type = type;
+    w.condition = condition;
+    w.callback = callback;
+    w.bHalt = bHalt;
+    watchpoints.push_back(w);
+    conditions.push_back(cond);
+
+    Rebuild();
+    return w.id;
+}
+
+// Remove a watchpoint by id
+bool Debugger::Remove(int id)
+{
+    for (size_t i = 0; i < watchpoints.size(); i++)
+    {
+        if (watchpoints[i].id == id)
+        {
+            watchpoints.erase(watchpoints.begin() + i);
+            conditions.erase(conditions.begin() + i);
+            Rebuild();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Enable or disable a watchpoint by id
+bool Debugger::Enable(int id, bool bEnable)
+{
+    for (auto &w : watchpoints)
+    {
+        if (w.id == id)
+        {
+            w.bEnabled = bEnable;
+            Rebuild();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Remove all watchpoints
+void Debugger::Clear()
+{
+    watchpoints.clear();
+    conditions.clear();
+    Rebuild();
+}
+
+// Look up a watchpoint by id
+const Debugger::Watchpoint *Debugger::Get(int id) const
+{
+    for (auto &w : watchpoints)
+    {
+        if (w.id == id) return &w;
+    }
+    return nullptr;
+}
+
+// Resume after a break, the breakpoint at the current PC is stepped over once
+void Debugger::Continue()
+{
+    if (bBreak && bus != nullptr)
+    {
+        skipPC = bus->cpu.pc;
+    }
+    bBreak = false;
+}
+
+// Read hook
+void Debugger::OnRead(uint16_t addr, uint8_t data)
+{
+    Check(WATCH_READ, addr, data);
+}
+
+// Write hook
+void Debugger::OnWrite(uint16_t addr, uint8_t data)
+{
+    Check(WATCH_WRITE, addr, data);
+}
+
+// Execute hook, called before the opcode at addr is fetched
+bool Debugger::OnExecute(uint16_t addr)
+{
+    // The page has an execution watch, but this address may not
+    if ((pcBitmap[addr >> 6] & (1ULL << (addr & 0x3F))) == 0)
+    {
+        return false;
+    }
+
+    // Stepping over the breakpoint we just stopped at
+    if (skipPC == addr)
+    {
+        skipPC = -1;
+        return false;
+    }
+
+    // Still halted from a previous hit
+    if (bBreak)
+    {
+        return true;
+    }
+
+    Check(WATCH_EXEC, addr, bus->read(addr, true));
+    return bBreak;
+}
+
+// Check every watchpoint of a type against an access
+void Debugger::Check(uint8_t type, uint16_t addr, uint8_t data)
+{
+    for (size_t i = 0; i < watchpoints.size(); i++)
+    {
+        Watchpoint &w = watchpoints[i];
+        if (!w.bEnabled || (w.type & type) == 0 || addr < w.start || addr > w.end)
+        {
+            continue;
+        }
+
+        if (!Evaluate(conditions[i], addr, data))
+        {
+            continue;
+        }
+
+        w.hits++;
+        if (w.callback != nullptr)
+        {
+            w.callback(w, addr, data);
+        }
+        if (w.bHalt)
+        {
+            bBreak = true;
+            lastHit = w.id;
+        }
+    }
+}
+
+// Rebuild the page flags on the bus and the PC bitmap
+void Debugger::Rebuild()
+{
+    pcBitmap.fill(0);
+    if (bus == nullptr)
+    {
+        return;
+    }
+
+    // Only the debugger's flags, Hooks keeps its own on the same pages
+    for (auto &p : bus->pageWatch) p &= ~(WATCH_READ | WATCH_WRITE | WATCH_EXEC);
+    for (auto &w : watchpoints)
+    {
+        if (!w.bEnabled) continue;
+
+        for (uint32_t page = w.start >> 8; page <= (uint32_t)(w.end >> 8); page++)
+        {
+            bus->pageWatch[page] |= w.type;
+        }
+
+        if (w.type & WATCH_EXEC)
+        {
+            for (uint32_t addr = w.start; addr <= w.end; addr++)
+            {
+                pcBitmap[addr >> 6] |= 1ULL << (addr & 0x3F);
+            }
+        }
+    }
+    bus->mapDirectPages();
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Conditions
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Recursive descent parser that emits a postfix program
+// Lowest to highest precedence: || && comparisons | ^ & + - unary
+namespace
+{
+    struct Parser
+    {
+        const std::string &s;
+        size_t i = 0;
+        std::vector<int32_t> &code;
+        bool bError = false;
+
+        Parser(const std::string &src, std::vector<int32_t> &out) : s(src), code(out) {}
+
+        void Skip()
+        {
+            while (i < s.size() && isspace((unsigned char)s[i])) i++;
+        }
+
+        // Match a token at the current position
+        bool Accept(const char *tok)
+        {
+            Skip();
+            size_t n = 0;
+            while (tok[n] != '\0') n++;
+            if (s.compare(i, n, tok) != 0) return false;
+            // Do not take "|" from "||", "&" from "&&" or "<", ">", "!" from "<=", ">=", "!="
+            if (n == 1 && i + 1 < s.size())
+            {
+                char next = s[i + 1];
+                if ((tok[0] == '|' || tok[0] == '&') && next == tok[0]) return false;
+                if ((tok[0] == '<' || tok[0] == '>' || tok[0] == '!') && next == '=') return false;
+            }
+            i += n;
+            return true;
+        }
+
+        void Or()
+        {
+            And();
+            while (!bError && Accept("||")) { And(); code.push_back(OP_OR); }
+        }
+
+        void And()
+        {
+            Compare();
+            while (!bError && Accept("&&")) { Compare(); code.push_back(OP_AND); }
+        }
+
+        void Compare()
+        {
+            BitOr();
+            while (!bError)
+            {
+                int32_t op;
+                if (Accept("==")) op = OP_EQ;
+                else if (Accept("!=")) op = OP_NE;
+                else if (Accept("<=")) op = OP_LE;
+                else if (Accept(">=")) op = OP_GE;
+                else if (Accept("<")) op = OP_LT;
+                else if (Accept(">")) op = OP_GT;
+                else break;
+                BitOr();
+                code.push_back(op);
+            }
+        }
+
+        void BitOr()
+        {
+            BitXor();
+            while (!bError && Accept("|")) { BitXor(); code.push_back(OP_BOR); }
+        }
+
+        void BitXor()
+        {
+            BitAnd();
+            while (!bError && Accept("^")) { BitAnd(); code.push_back(OP_BXOR); }
+        }
+
+        void BitAnd()
+        {
+            Add();
+            while (!bError && Accept("&")) { Add(); code.push_back(OP_BAND); }
+        }
+
+        void Add()
+        {
+            Unary();
+            while (!bError)
+            {
+                int32_t op;
+                if (Accept("+")) op = OP_ADD;
+                else if (Accept("-")) op = OP_SUB;
+                else break;
+                Unary();
+                code.push_back(op);
+            }
+        }
+
+        void Unary()
+        {
+            if (Accept("!")) { Unary(); code.push_back(OP_NOT); }
+            else if (Accept("~")) { Unary(); code.push_back(OP_INV); }
+            else if (Accept("-")) { Unary(); code.push_back(OP_NEG); }
+            else Primary();
+        }
+
+        void Primary()
+        {
+            Skip();
+            if (i >= s.size()) { bError = true; return; }
+
+            if (Accept("("))
+            {
+                Or();
+                if (!Accept(")")) bError = true;
+                return;
+            }
+
+            // Numbers: $FF, 0xFF or decimal
+            int base = 10;
+            if (s[i] == '$') { base = 16; i++; }
+            else if (s.compare(i, 2, "0x") == 0 || s.compare(i, 2, "0X") == 0) { base = 16; i += 2; }
+            if (base == 16 || isdigit((unsigned char)s[i]))
+            {
+                size_t start = i;
+                int32_t value = 0;
+                while (i < s.size() && isxdigit((unsigned char)s[i]) && (base == 16 || isdigit((unsigned char)s[i])))
+                {
+                    int d = isdigit((unsigned char)s[i]) ? s[i] - '0' : (toupper((unsigned char)s[i]) - 'A' + 10);
+                    value = (value * base + d) & 0xFFFFFF;
+                    i++;
+                }
+                if (i == start) { bError = true; return; }
+                code.push_back(OP_NUM);
+                code.push_back(value);
+                return;
+            }
+
+            // Register names
+            size_t start = i;
+            while (i < s.size() && isalpha((unsigned char)s[i])) i++;
+            std::string name = s.substr(start, i - start);
+            for (auto &c : name) c = (char)toupper((unsigned char)c);
+
+            int32_t reg;
+            if (name == "A") reg = REG_A;
+            else if (name == "X") reg = REG_X;
+            else if (name == "Y") reg = REG_Y;
+            else if (name == "S" || name == "SP") reg = REG_S;
+            else if (name == "P") reg = REG_P;
+            else if (name == "PC") reg = REG_PC;
+            else if (name == "ADDR") reg = REG_ADDR;
+            else if (name == "DATA") reg = REG_DATA;
+            else { bError = true; return; }
+
+            code.push_back(OP_REG);
+            code.push_back(reg);
+        }
+    };
+}
+
+// Compile a condition string, an empty string compiles to an empty (always true) program
+bool Debugger::Compile(const std::string &source, Condition &out)
+{
+    out.code.clear();
+
+    Parser p(source, out.code);
+    p.Skip();
+    if (p.i == source.size())
+    {
+        return true;
+    }
+
+    p.Or();
+    p.Skip();
+    if (p.bError || p.i != source.size())
+    {
+        out.code.clear();
+        return false;
+    }
+    return true;
+}
+
+// Evaluate a compiled condition against the current CPU registers
+bool Debugger::Evaluate(const Condition &cond, uint16_t addr, uint8_t data) const
+{
+    if (cond.code.empty())
+    {
+        return true;
+    }
+
+    int32_t stack[32];
+    int sp = 0;
+    for (size_t i = 0; i < cond.code.size(); i++)
+    {
+        int32_t op = cond.code[i];
+        if (op == OP_NUM)
+        {
+            if (sp >= 32) return false;
+            stack[sp++] = cond.code[++i];
+            continue;
+        }
+        if (op == OP_REG)
+        {
+            if (sp >= 32) return false;
+            int32_t v = 0;
+            switch (cond.code[++i])
+            {
+                case REG_A: v = bus->cpu.a; break;
+                case REG_X: v = bus->cpu.x; break;
+                case REG_Y: v = bus->cpu.y; break;
+                case REG_S: v = bus->cpu.stkp; break;
+                case REG_P: v = bus->cpu.status; break;
+                case REG_PC: v = bus->cpu.pc; break;
+                case REG_ADDR: v = addr; break;
+                case REG_DATA: v = data; break;
+            }
+            stack[sp++] = v;
+            continue;
+        }
+
+        // Unary operators
+        if (op == OP_NOT || op == OP_INV || op == OP_NEG)
+        {
+            int32_t &v = stack[sp - 1];
+            v = (op == OP_NOT) ? !v : (op == OP_INV) ? ~v : -v;
+            continue;
+        }
+
+        // Binary operators
+        int32_t r = stack[--sp];
+        int32_t &l = stack[sp - 1];
+        switch (op)
+        {
+            case OP_OR: l = (l || r); break;
+            case OP_AND: l = (l && r); break;
+            case OP_EQ: l = (l == r); break;
+            case OP_NE: l = (l != r); break;
+            case OP_LT: l = (l < r); break;
+            case OP_LE: l = (l <= r); break;
+            case OP_GT: l = (l > r); break;
+            case OP_GE: l = (l >= r); break;
+            case OP_BOR: l = (l | r); break;
+            case OP_BXOR: l = (l ^ r); break;
+            case OP_BAND: l = (l & r); break;
+            case OP_ADD: l = (l + r); break;
+            case OP_SUB: l = (l - r); break;
+        }
+    }
+    return sp == 1 && stack[0] != 0;
+}
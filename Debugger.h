@@ -0,0 +1,104 @@
+// Debugger header file to define the breakpoint and watchpoint class
+// The bus keeps one flag byte per 256 byte page, and the debugger keeps a bitmap with one bit per PC address.
+// Nothing is checked beyond a single page flag load unless a watched page is touched.
+// Define NES_NO_DEBUGGER to compile the hooks out of Bus and cpu6502 entirely.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <functional>
+
+class Bus;
+
+class Debugger
+{
+    public:
+        // Constructor and Destructor
+        Debugger();
+        ~Debugger();
+
+        // Page flags, stored per page in Bus::pageWatch
+        enum WATCH
+        {
+            WATCH_READ = (1 << 0), // Watch reads
+            WATCH_WRITE = (1 << 1), // Watch writes
+            WATCH_EXEC = (1 << 2), // Watch execution (PC breakpoints)
+        };
+
+        // A breakpoint or watchpoint on an address range
+        struct Watchpoint;
+        // Callback when a watchpoint is hit, receives the watchpoint, the address and the data read / written (opcode for execution)
+        using Callback = std::function<void(const Watchpoint &, uint16_t addr, uint8_t data)>;
+
+        struct Watchpoint
+        {
+            int id = 0; // Handle returned when added
+            uint16_t start = 0x0000; // First address watched
+            uint16_t end = 0x0000; // Last address watched (inclusive)
+            uint8_t type = 0; // WATCH flags
+            std::string condition; // Condition source, empty means always
+            Callback callback = nullptr; // Called on every hit where the condition holds
+            bool bHalt = true; // Set bBreak when hit
+            bool bEnabled = true; // Disabled watchpoints are skipped
+            uint32_t hits = 0; // Number of hits where the condition held
+        };
+
+        // Attach to a bus, the bus and CPU start calling into the debugger for watched pages
+        void Attach(Bus *n);
+        void Detach();
+
+        // Add a PC breakpoint, returns the id or -1 if the condition does not parse
+        // With bHalt false the breakpoint only counts hits and calls the callback
+        int AddBreakpoint(uint16_t addr, const std::string &condition = "", Callback callback = nullptr, bool bHalt = true);
+        // Add a watchpoint on an address range, returns the id or -1 if the condition does not parse
+        int AddWatchpoint(uint16_t start, uint16_t end, uint8_t type, const std::string &condition = "", Callback callback = nullptr, bool bHalt = true);
+        // Remove, enable or disable a watchpoint by id
+        bool Remove(int id);
+        bool Enable(int id, bool bEnable);
+        void Clear();
+        // Look up a watchpoint by id, nullptr if it does not exist
+        const Watchpoint *Get(int id) const;
+        const std::vector<Watchpoint> &GetAll() const { return watchpoints; }
+
+        // Set when a watchpoint with bHalt is hit, cpu6502::clock() does not execute while it is set on a PC breakpoint
+        bool bBreak = false;
+        // Id of the last watchpoint that set bBreak
+        int lastHit = -1;
+        // Clear bBreak and step over the breakpoint at the current PC
+        void Continue();
+
+        // Hooks called from the bus and CPU for flagged pages only
+        void OnRead(uint16_t addr, uint8_t data);
+        void OnWrite(uint16_t addr, uint8_t data);
+        bool OnExecute(uint16_t addr); // Returns true if execution should halt before this instruction
+
+        // Condition expressions
+        // Registers A X Y S P PC, the accessed ADDR and DATA, numbers as $FF, 0xFF or 255
+        // Operators || && == != < <= > >= | ^ & + - ! ~ and parentheses, for example "A == $10 && X > 3"
+        struct Condition
+        {
+            std::vector<int32_t> code; // Compiled postfix program, empty means always true
+        };
+        static bool Compile(const std::string &source, Condition &out);
+        bool Evaluate(const Condition &cond, uint16_t addr, uint8_t data) const;
+
+    private:
+        // Pointer to the bus
+        Bus *bus = nullptr;
+
+        int nextId = 1;
+        std::vector<Watchpoint> watchpoints;
+        std::vector<Condition> conditions; // Parallel to watchpoints
+
+        // One bit per address that has an enabled execution watch
+        std::array<uint64_t, 1024> pcBitmap;
+        // Address to step over after Continue(), -1 if none
+        int32_t skipPC = -1;
+
+        // Rebuild Bus::pageWatch and the PC bitmap from the watchpoint list
+        void Rebuild();
+        // Shared hit handling for all watch types
+        void Check(uint8_t type, uint16_t addr, uint8_t data);
+};
@@ -0,0 +1,246 @@
+// File that exports frames and audio through a shared memory ring
+#include "FrameExport.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static const char MAGIC[8] = { 'N', 'E', 'S', 'R', 'I', 'N', 'G', 0 };
+static constexpr size_t PAGE = 4096;
+
+// Shared futex, the ring is mapped by two processes
+static void FutexWait(std::atomic<uint32_t> *word, uint32_t value, int64_t timeout)
+{
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000000000;
+    ts.tv_nsec = timeout % 1000000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, value, timeout < 0 ? nullptr : &ts, nullptr, 0);
+#else
+    (void)word;
+    (void)value;
+    (void)timeout;
+    usleep(100);
+#endif
+}
+
+static void FutexWake(std::atomic<uint32_t> *word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+// Constructor
+FrameExport::FrameExport()
+{
+
+}
+
+// Destructor
+FrameExport::~FrameExport()
+{
+    Close();
+}
+
+uint64_t FrameExport::Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void FrameExport::Close()
+{
+    if (map != nullptr) munmap(map, mapSize);
+    if (bProducer) shm_unlink(name.c_str());
+    map = nullptr;
+    mapSize = 0;
+    header = nullptr;
+    bProducer = false;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Producer
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool FrameExport::Create(const std::string &n, uint32_t slots, uint32_t audioRate)
+{
+    Close();
+    if (slots == 0) return false;
+    const uint32_t width = ppu2C02::WIDTH, height = ppu2C02::HEIGHT;
+    // A frame of audio at the NTSC frame rate, rounded up
+    const uint32_t audioCapacity = (uint32_t)(audioRate / 60.0988) + 1;
+    size_t slotSize = sizeof(SlotHeader) + width * height + audioCapacity * sizeof(int16_t);
+    slotSize = (slotSize + PAGE - 1) & ~(PAGE - 1);
+    const size_t size = PAGE + slots * slotSize;
+
+    shm_unlink(n.c_str());
+    int fd = shm_open(n.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        shm_unlink(n.c_str());
+        return false;
+    }
+    // Populated up front, the emulator should not take page faults in the slots
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(n.c_str());
+        return false;
+    }
+
+    name = n;
+    bProducer = true;
+    map = static_cast<uint8_t *>(p);
+    mapSize = size;
+    header = new (map) Header();
+    memcpy(header->magic, MAGIC, 8);
+    header->version = VERSION;
+    header->headerSize = PAGE;
+    header->slots = slots;
+    header->slotSize = (uint32_t)slotSize;
+    header->width = width;
+    header->height = height;
+    header->audioRate = audioRate;
+    header->audioCapacity = audioCapacity;
+    header->writeCount.store(0, std::memory_order_relaxed);
+    header->wake.store(0, std::memory_order_relaxed);
+    header->dropped.store(0, std::memory_order_relaxed);
+    header->readCount.store(0, std::memory_order_relaxed);
+    header->consumerWaiting.store(0, std::memory_order_release);
+    return true;
+}
+
+uint8_t *FrameExport::Acquire()
+{
+    uint64_t w = header->writeCount.load(std::memory_order_relaxed);
+    if (w - header->readCount.load(std::memory_order_acquire) >= header->slots) return nullptr;
+    return reinterpret_cast<uint8_t *>(Slot(w)) + sizeof(SlotHeader);
+}
+
+int16_t *FrameExport::Audio()
+{
+    uint8_t *pixels = Acquire();
+    return pixels != nullptr ? reinterpret_cast<int16_t *>(pixels + header->width * header->height) : nullptr;
+}
+
+void FrameExport::Publish(uint64_t frame, uint32_t audioSamples)
+{
+    uint64_t w = header->writeCount.load(std::memory_order_relaxed);
+    SlotHeader *slot = Slot(w);
+    slot->sequence = w;
+    slot->frame = frame;
+    slot->timestamp = Now();
+    slot->audioSamples = std::min(audioSamples, header->audioCapacity);
+
+    // Sequentially consistent against the consumer's consumerWaiting store and writeCount load
+    header->writeCount.store(w + 1, std::memory_order_seq_cst);
+    header->wake.store((uint32_t)(w + 1), std::memory_order_seq_cst);
+    if (header->consumerWaiting.load(std::memory_order_seq_cst) != 0)
+    {
+        wakes++;
+        FutexWake(&header->wake);
+    }
+}
+
+bool FrameExport::Frame(Bus &bus, uint32_t audioSamples)
+{
+    // A full ring skips rendering as well, the frame would be thrown away
+    uint8_t *pixels = Acquire();
+    uint8_t *previous = bus.ppu.frameBuffer;
+    uint64_t count = bus.ppu.frameCount;
+    bus.ppu.frameBuffer = pixels;
+    bus.frame();
+    bus.ppu.frameBuffer = previous;
+    if (pixels == nullptr)
+    {
+        header->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Stopped by the debugger, or skipped by renderEvery
+    if (bus.ppu.frameCount == count || !bus.ppu.bFrameRendered) return false;
+    Publish(count, audioSamples);
+    return true;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Consumer
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool FrameExport::Open(const std::string &n)
+{
+    Close();
+    int fd = shm_open(n.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= PAGE)
+    {
+        p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    name = n;
+    map = static_cast<uint8_t *>(p);
+    mapSize = st.st_size;
+    header = reinterpret_cast<Header *>(map);
+    if (memcmp(header->magic, MAGIC, 8) != 0 || header->version != VERSION || header->slots == 0 ||
+        header->headerSize + (size_t)header->slots * header->slotSize > mapSize)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+const FrameExport::SlotHeader *FrameExport::Next(int64_t timeout)
+{
+    const uint64_t r = header->readCount.load(std::memory_order_relaxed);
+    const uint64_t end = (timeout < 0) ? 0 : Now() + timeout;
+    for (;;)
+    {
+        if (header->writeCount.load(std::memory_order_acquire) != r) return Slot(r);
+
+        // Say we are asleep, then look again before sleeping, the producer only wakes a consumer that said so
+        header->consumerWaiting.store(1, std::memory_order_seq_cst);
+        uint64_t w = header->writeCount.load(std::memory_order_seq_cst);
+        if (w == r)
+        {
+            int64_t left = -1;
+            if (timeout >= 0)
+            {
+                uint64_t now = Now();
+                left = (now < end) ? (int64_t)(end - now) : 0;
+            }
+            if (left != 0) FutexWait(&header->wake, (uint32_t)w, left);
+        }
+        header->consumerWaiting.store(0, std::memory_order_relaxed);
+
+        if (header->writeCount.load(std::memory_order_acquire) != r) return Slot(r);
+        if (timeout >= 0 && Now() >= end) return nullptr;
+    }
+}
+
+void FrameExport::Release()
+{
+    header->readCount.fetch_add(1, std::memory_order_release);
+}
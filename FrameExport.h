@@ -0,0 +1,112 @@
+// FrameExport header file to define the shared memory video and audio ring for out-of-process encoders
+// The producer maps a ring of frame slots in POSIX shared memory (/dev/shm/<name>) and points the PPU's frame buffer
+// straight at the next free slot, so the pixels are rendered where the encoder reads them and nothing is copied or
+// written to a pipe. One consumer process maps the same name, reads published slots in order and releases them.
+// The producer never waits: when the consumer is a whole ring behind, the frame is not rendered and counts as dropped.
+// Wake ups are a futex on the shared published counter, and the producer only makes the syscall when the consumer
+// says it is asleep, so a consumer that keeps up costs the emulator two atomic stores per frame.
+// https://man7.org/linux/man-pages/man7/shm_overview.7.html https://man7.org/linux/man-pages/man2/futex.2.html
+//
+// Layout, little endian, every offset from the start of the mapping
+//   0       Header, one 4KB page
+//   4096    slot 0, then every slotSize bytes the next slot, slotSize is a multiple of 4KB
+// Slot
+//   0       SlotHeader, 64 bytes
+//   64      pixels, width x height palette indices (0-63), one byte each, rows top to bottom
+//   64 + width * height    audio, audioCapacity signed 16-bit mono samples at audioRate, audioSamples of them valid
+// Published frame n (counting from 0) is in slot n % slots. A consumer reads slots while readCount < writeCount
+// (acquire), then stores readCount + 1 (release) to hand the slot back. To sleep it sets consumerWaiting to 1,
+// checks writeCount again and waits on the futex word wake while it still equals the low 32 bits it saw.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include "Bus.h"
+
+class FrameExport
+{
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        struct Header
+        {
+            char magic[8]; // "NESRING"
+            uint32_t version;
+            uint32_t headerSize; // Offset of slot 0
+            uint32_t slots;
+            uint32_t slotSize;
+            uint32_t width;
+            uint32_t height;
+            uint32_t audioRate; // Samples per second
+            uint32_t audioCapacity; // Samples per slot
+
+            alignas(64) std::atomic<uint64_t> writeCount; // Frames published, written by the producer
+            std::atomic<uint32_t> wake; // Low 32 bits of writeCount, the futex word
+            std::atomic<uint64_t> dropped; // Frames not exported because the ring was full
+            alignas(64) std::atomic<uint64_t> readCount; // Frames released, written by the consumer
+            std::atomic<uint32_t> consumerWaiting; // 1 while the consumer is asleep on the futex
+        };
+        struct SlotHeader
+        {
+            uint64_t sequence; // Frames published before this one
+            uint64_t frame; // PPU frame count
+            uint64_t timestamp; // CLOCK_MONOTONIC nanoseconds at publication
+            uint32_t audioSamples;
+            uint32_t reserved[9];
+        };
+        static_assert(sizeof(SlotHeader) == 64, "slot header is one cache line");
+
+        // Constructor and Destructor, the producer unlinks the name when it is destroyed
+        FrameExport();
+        ~FrameExport();
+
+        FrameExport(const FrameExport &) = delete;
+        FrameExport &operator=(const FrameExport &) = delete;
+
+        // Producer
+        // Create the ring under a name like "/nes0", replacing a stale one
+        bool Create(const std::string &name, uint32_t slots = 8, uint32_t audioRate = 48000);
+        // Run one frame of the bus rendering into the next slot, then publish it with the audio written to Audio()
+        // Returns false if the frame was dropped because the consumer is a whole ring behind
+        bool Frame(Bus &bus, uint32_t audioSamples = 0);
+        // Samples of the slot the next frame goes to, nullptr when it will be dropped
+        int16_t *Audio();
+        // The same in two steps, for hosts that run the frame themselves: Acquire() the pixels of the next slot
+        // (nullptr when full), then Publish() once it is rendered
+        uint8_t *Acquire();
+        void Publish(uint64_t frame, uint32_t audioSamples);
+
+        // Consumer
+        bool Open(const std::string &name);
+        // The oldest published slot not released yet, waits up to timeout nanoseconds (-1 forever) for one
+        const SlotHeader *Next(int64_t timeout = -1);
+        const uint8_t *Pixels(const SlotHeader *slot) const { return reinterpret_cast<const uint8_t *>(slot) + sizeof(SlotHeader); }
+        const int16_t *Samples(const SlotHeader *slot) const { return reinterpret_cast<const int16_t *>(Pixels(slot) + header->width * header->height); }
+        // Hand the slot from Next() back to the producer
+        void Release();
+
+        bool Valid() const { return header != nullptr; }
+        const Header *GetHeader() const { return header; }
+        uint64_t Dropped() const { return header != nullptr ? header->dropped.load(std::memory_order_relaxed) : 0; }
+        // Futex wake ups the producer made
+        uint64_t Wakes() const { return wakes; }
+
+        // CLOCK_MONOTONIC nanoseconds, the clock of SlotHeader::timestamp
+        static uint64_t Now();
+
+    private:
+        std::string name;
+        bool bProducer = false;
+        uint8_t *map = nullptr;
+        size_t mapSize = 0;
+        Header *header = nullptr;
+        uint64_t wakes = 0;
+
+        SlotHeader *Slot(uint64_t n) const
+        {
+            return reinterpret_cast<SlotHeader *>(map + header->headerSize + (n % header->slots) * (size_t)header->slotSize);
+        }
+        void Close();
+};
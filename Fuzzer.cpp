@@ -0,0 +1,326 @@
+// File that fuzzes controller input for new guest edge coverage
+#include "Fuzzer.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// What every worker thread owns, nothing here is shared
+struct Fuzzer::Worker
+{
+    std::unique_ptr<Bus> bus;
+    std::vector<uint8_t> trace; // Hit counts of the current execution, classified after it
+    std::vector<uint8_t> virgin; // Copy of the shared virgin map, only ever has more bits than the real one
+    std::vector<std::shared_ptr<Bus>> fresh; // Snapshots taken by the current execution
+    uint64_t rng;
+
+    // xorshift64* https://vigna.di.unimi.it/ftp/papers/xorshift.pdf
+    uint64_t Next()
+    {
+        rng ^= rng >> 12;
+        rng ^= rng << 25;
+        rng ^= rng >> 27;
+        return rng * 0x2545F4914F6CDD1DULL;
+    }
+    uint32_t Below(uint32_t n) { return (uint32_t)((Next() >> 32) * n >> 32); }
+};
+
+// Constructor
+Fuzzer::Fuzzer(const Bus &b, const Config &c) : config(c), variant(b.cpu.GetVariant()), virgin(MAP_SIZE, 0xFF)
+{
+    if (config.frames == 0) config.frames = 1;
+    if (config.snapshotEvery > config.frames) config.snapshotEvery = 0;
+    snapshots = (config.snapshotEvery == 0) ? 1 : (config.frames + config.snapshotEvery - 1) / config.snapshotEvery;
+    auto s = std::make_shared<Bus>(variant);
+    s->copyState(b);
+    start = s;
+}
+
+// Destructor
+Fuzzer::~Fuzzer()
+{
+
+}
+
+void Fuzzer::AddSeed(const std::vector<uint8_t> &input)
+{
+    std::vector<uint8_t> seed(input);
+    seed.resize(config.frames, 0x00);
+    seeds.push_back(std::move(seed));
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Coverage
+// https://lcamtuf.coredump.cx/afl/technical_details.txt
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static constexpr uint8_t Bucket(int n)
+{
+    if (n == 0) return 0;
+    if (n <= 3) return (uint8_t)(1 << (n - 1));
+    if (n <= 7) return 8;
+    if (n <= 15) return 16;
+    if (n <= 31) return 32;
+    if (n <= 127) return 64;
+    return 128;
+}
+
+struct BucketTable
+{
+    uint8_t bucket[256];
+};
+static constexpr BucketTable MakeBuckets()
+{
+    BucketTable t = {};
+    for (int n = 0; n < 256; n++) t.bucket[n] = Bucket(n);
+    return t;
+}
+static constexpr BucketTable buckets = MakeBuckets();
+
+// Most of the map is zero, eight entries are tested at once
+void Fuzzer::Classify(uint8_t *map)
+{
+    for (size_t i = 0; i < MAP_SIZE; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, map + i, 8);
+        if (word == 0) continue;
+        for (size_t j = i; j < i + 8; j++) map[j] = buckets.bucket[map[j]];
+    }
+}
+
+// True if the map has a bit the virgin map still has
+static bool HasNew(const uint8_t *map, const uint8_t *virgin, size_t size)
+{
+    for (size_t i = 0; i < size; i += 8)
+    {
+        uint64_t m, v;
+        memcpy(&m, map + i, 8);
+        if (m == 0) continue;
+        memcpy(&v, virgin + i, 8);
+        if ((m & v) != 0) return true;
+    }
+    return false;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Executions
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Fuzzer::Execute(Worker &w, const std::vector<uint8_t> &input, const Bus &state, uint32_t fork)
+{
+    Bus &bus = *w.bus;
+    bus.copyState(state);
+    std::fill(w.trace.begin(), w.trace.end(), 0);
+    bus.cpu.coverage = w.trace.data();
+
+    const uint32_t every = config.snapshotEvery;
+    uint32_t from = fork * every;
+    for (uint32_t f = from; f < config.frames; f++)
+    {
+        if (every != 0 && f != from && f % every == 0)
+        {
+            auto &snap = w.fresh[f / every];
+            if (snap == nullptr) snap = std::make_shared<Bus>(variant);
+            snap->copyState(bus);
+        }
+        bus.controller[0] = input[f];
+        bus.frame();
+    }
+    bus.cpu.coverage = nullptr;
+    Classify(w.trace.data());
+
+    execs.fetch_add(1, std::memory_order_relaxed);
+    frames.fetch_add(config.frames - from, std::memory_order_relaxed);
+}
+
+bool Fuzzer::Merge(Worker &w, const std::vector<uint8_t> &input, const Entry *parent, uint32_t fork)
+{
+    // Checked against the worker's copy first, the shared map is only locked when something looks new
+    if (!HasNew(w.trace.data(), w.virgin.data(), MAP_SIZE)) return false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    bool bNew = false;
+    for (size_t i = 0; i < MAP_SIZE; i++)
+    {
+        uint8_t hit = w.trace[i] & virgin[i];
+        if (hit == 0) continue;
+        if (virgin[i] == 0xFF) edges++;
+        virgin[i] &= ~hit;
+        bNew = true;
+    }
+    w.virgin = virgin;
+    if (!bNew) return false;
+
+    Add(w, input, parent, fork);
+    growth.push_back({ Now(), execs.load(std::memory_order_relaxed), edges });
+    return true;
+}
+
+void Fuzzer::Add(Worker &w, const std::vector<uint8_t> &input, const Entry *parent, uint32_t fork)
+{
+    auto entry = std::make_shared<Entry>();
+    entry->input = input;
+    entry->snapshots.resize(snapshots);
+    for (uint32_t i = 0; i < snapshots; i++)
+    {
+        if (i <= fork)
+        {
+            entry->snapshots[i] = (parent != nullptr) ? parent->snapshots[i] : start;
+        }
+        else
+        {
+            // The worker takes new ones next time
+            entry->snapshots[i] = std::move(w.fresh[i]);
+            w.fresh[i] = nullptr;
+        }
+    }
+    corpus.push_back(std::move(entry));
+}
+
+void Fuzzer::Mutate(Worker &w, std::vector<uint8_t> &input, uint32_t fork)
+{
+    const uint32_t from = fork * config.snapshotEvery;
+    const uint32_t span = config.frames - from;
+    // Stacked like AFL's havoc stage, a few changes at once
+    int n = 1 << w.Below(3);
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t f = from + w.Below(span);
+        uint32_t len = std::min(1 + w.Below(16), config.frames - f);
+        switch (w.Below(5))
+        {
+        case 0: // Flip one button
+            input[f] ^= (uint8_t)(1 << w.Below(8));
+            break;
+        case 1: // Press one button alone
+            input[f] = (uint8_t)(1 << w.Below(8));
+            break;
+        case 2: // Anything
+            input[f] = (uint8_t)w.Next();
+            break;
+        case 3: // Let go for a while
+            std::fill(input.begin() + f, input.begin() + f + len, 0x00);
+            break;
+        case 4: // Hold one button for a while, games mostly look at held buttons
+            std::fill(input.begin() + f, input.begin() + f + len, (uint8_t)(1 << w.Below(8)));
+            break;
+        }
+    }
+}
+
+void Fuzzer::Work(Worker &w)
+{
+    std::vector<uint8_t> input;
+    while (!bStop.load(std::memory_order_relaxed))
+    {
+        std::shared_ptr<const Entry> parent;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            parent = corpus[w.Below((uint32_t)corpus.size())];
+        }
+        uint32_t fork = w.Below(snapshots);
+        input = parent->input;
+        Mutate(w, input, fork);
+        Execute(w, input, *parent->snapshots[fork], fork);
+        Merge(w, input, parent.get(), fork);
+    }
+}
+
+double Fuzzer::Now() const
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - runStart;
+    return elapsed + d.count();
+}
+
+void Fuzzer::Run(double seconds, Progress progress, double interval)
+{
+    int threads = config.threads;
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        auto w = std::make_unique<Worker>();
+        w->bus = std::make_unique<Bus>(variant);
+        w->trace.assign(MAP_SIZE, 0);
+        w->fresh.resize(snapshots);
+        w->rng = (config.seed + (uint64_t)(t + 1) * 0x9E3779B97F4A7C15ULL) | 1;
+        workers.push_back(std::move(w));
+    }
+    runStart = std::chrono::steady_clock::now();
+
+    // The seeds, or no buttons at all, go in whether or not they find anything
+    if (corpus.empty())
+    {
+        if (seeds.empty()) seeds.push_back(std::vector<uint8_t>(config.frames, 0x00));
+        Worker &w = *workers[0];
+        w.virgin = virgin;
+        for (auto &seed : seeds)
+        {
+            Execute(w, seed, *start, 0);
+            if (Merge(w, seed, nullptr, 0)) continue;
+            // Nothing new, kept to mutate from with the snapshots this run took, so a fork past frame 0 starts from them
+            std::lock_guard<std::mutex> guard(lock);
+            Add(w, seed, nullptr, 0);
+        }
+        seeds.clear();
+    }
+
+    for (auto &w : workers) w->virgin = virgin;
+    bStop = false;
+    std::vector<std::thread> pool;
+    for (auto &w : workers) pool.emplace_back([this, &w] { Work(*w); });
+
+    // The calling thread reports progress until the time is up
+    auto end = runStart + std::chrono::duration<double>(seconds);
+    auto next = runStart + std::chrono::duration<double>(interval);
+    while (true)
+    {
+        auto until = std::min(end, next);
+        std::this_thread::sleep_until(until);
+        if (until == end) break;
+        next += std::chrono::duration<double>(interval);
+        if (progress != nullptr)
+        {
+            Stats s;
+            s.seconds = Now();
+            s.execs = execs;
+            s.frames = frames;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                s.edges = edges;
+                s.corpus = (uint32_t)corpus.size();
+            }
+            progress(s);
+        }
+    }
+    bStop = true;
+    for (auto &t : pool) t.join();
+    elapsed = Now();
+}
+
+Fuzzer::Stats Fuzzer::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Stats s;
+    s.seconds = elapsed;
+    s.execs = execs;
+    s.frames = frames;
+    s.edges = edges;
+    s.corpus = (uint32_t)corpus.size();
+    return s;
+}
+
+std::vector<Fuzzer::Growth> Fuzzer::GetGrowth() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return growth;
+}
+
+std::vector<std::vector<uint8_t>> Fuzzer::GetCorpus() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<std::vector<uint8_t>> inputs;
+    for (auto &e : corpus) inputs.push_back(e->input);
+    return inputs;
+}
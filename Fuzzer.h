@@ -0,0 +1,112 @@
+// Fuzzer header file to define the coverage-guided input fuzzer
+// An input is one byte of controller 1 buttons per frame. Inputs run with the CPU recording guest edges into a 64KB
+// AFL-style map (cpu6502::coverage), and an input that reaches an edge or a hit count bucket nobody reached before
+// joins the corpus. New inputs are mutated from corpus entries past a fork frame: the parent's state at that frame
+// is restored from a snapshot instead of replaying the prefix, so an execution only pays for the frames it changed.
+// Workers, one per core by default, each run their own bus and merge new coverage into the shared map under a lock.
+// https://lcamtuf.coredump.cx/afl/technical_details.txt
+
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Bus.h"
+
+class Fuzzer
+{
+    public:
+        struct Config
+        {
+            uint32_t frames = 120; // Length of every input
+            uint32_t snapshotEvery = 10; // Frames between snapshots, 0 replays every input from the start
+            int threads = 0; // 0 for one per core
+            uint64_t seed = 1;
+        };
+
+        // Constructor and Destructor, from a bus with the cartridge inserted and the CPU reset, the PRG-ROM image is
+        // shared and must outlive the fuzzer
+        Fuzzer(const Bus &start, const Config &config);
+        ~Fuzzer();
+
+        Fuzzer(const Fuzzer &) = delete;
+        Fuzzer &operator=(const Fuzzer &) = delete;
+
+        // Inputs to start from, padded or cut to Config::frames, every seed joins the corpus whether it finds anything or
+        // not. Without seeds an empty corpus starts from no buttons at all.
+        void AddSeed(const std::vector<uint8_t> &input);
+
+        struct Stats
+        {
+            double seconds = 0.0;
+            uint64_t execs = 0;
+            uint64_t frames = 0; // Frames emulated, fewer than execs * Config::frames when forking
+            uint32_t edges = 0; // Map entries ever hit
+            uint32_t corpus = 0;
+        };
+        using Progress = std::function<void(const Stats &)>;
+        // Fuzz for the given time, progress is called from the calling thread every interval seconds
+        void Run(double seconds, Progress progress = nullptr, double interval = 1.0);
+        // Totals as of the end of the last Run()
+        Stats GetStats() const;
+
+        // Edge count over time, a point whenever an input found something new, seconds since the first Run()
+        struct Growth
+        {
+            double seconds;
+            uint64_t execs;
+            uint32_t edges;
+        };
+        std::vector<Growth> GetGrowth() const;
+        // Inputs of the corpus, in the order they were found
+        std::vector<std::vector<uint8_t>> GetCorpus() const;
+
+        // AFL hit count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+ as one bit each
+        static void Classify(uint8_t *map);
+
+    private:
+        static constexpr size_t MAP_SIZE = 65536;
+
+        Config config;
+        cpu6502::VARIANT variant;
+        uint32_t snapshots; // Per input, 1 when every input replays from the start
+        std::shared_ptr<const Bus> start;
+
+        // An input and its state every snapshotEvery frames, never changed once added
+        struct Entry
+        {
+            std::vector<uint8_t> input;
+            std::vector<std::shared_ptr<const Bus>> snapshots; // Shared with the parent before the fork, snapshots[i] is the state before frame i * snapshotEvery
+        };
+        // Corpus, virgin map and growth, shared between workers
+        mutable std::mutex lock;
+        std::vector<std::shared_ptr<const Entry>> corpus;
+        std::vector<uint8_t> virgin; // Bits not reached yet, all set at first
+        uint32_t edges = 0;
+        std::vector<Growth> growth;
+        std::vector<std::vector<uint8_t>> seeds;
+
+        std::atomic<uint64_t> execs{ 0 };
+        std::atomic<uint64_t> frames{ 0 };
+        std::atomic<bool> bStop{ false };
+        double elapsed = 0.0; // Seconds of earlier Run() calls
+        std::chrono::steady_clock::time_point runStart;
+
+        struct Worker;
+        void Work(Worker &w);
+        // Run frames [fork * snapshotEvery, Config::frames) of input from the state before the first of them,
+        // taking snapshots on the way, the worker's map holds the classified hit counts of these frames only
+        void Execute(Worker &w, const std::vector<uint8_t> &input, const Bus &state, uint32_t fork);
+        // Merge the worker's map, true if the input found something and was added to the corpus, sharing the
+        // parent's snapshots up to the fork
+        bool Merge(Worker &w, const std::vector<uint8_t> &input, const Entry *parent, uint32_t fork);
+        // Add the input to the corpus with the parent's snapshots up to the fork (the start state without a parent) and
+        // the ones the worker took after it, called with the lock held
+        void Add(Worker &w, const std::vector<uint8_t> &input, const Entry *parent, uint32_t fork);
+        // Stacked mutations of the frames from the fork on
+        void Mutate(Worker &w, std::vector<uint8_t> &input, uint32_t fork);
+        double Now() const;
+};
@@ -0,0 +1,180 @@
+// Hooks file for scripting hooks with batched event delivery
+#include "Hooks.h"
+#include "Bus.h"
+#include <algorithm>
+
+// Constructor
+Hooks::Hooks(uint32_t capacity) : buffer(capacity == 0 ? 1 : capacity)
+{
+    writeBitmap.fill(0);
+    execBitmap.fill(0);
+}
+
+// Destructor
+Hooks::~Hooks()
+{
+    Detach();
+}
+
+// Attach to a bus
+void Hooks::Attach(Bus *n)
+{
+    Detach();
+    bus = n;
+    bus->hooks = this;
+    Rebuild();
+}
+
+// Detach from the bus and clear its HOOK page flags, events still buffered are delivered first
+void Hooks::Detach()
+{
+    if (bus != nullptr)
+    {
+        Flush();
+        for (auto &p : bus->pageWatch) p &= ~(HOOK_WRITE | HOOK_EXEC);
+        bus->mapDirectPages();
+        bus->hooks = nullptr;
+        bus = nullptr;
+    }
+}
+
+int Hooks::AddWrite(uint16_t start, uint16_t end, Callback sync)
+{
+    if (end < start) return -1;
+    hooks.push_back({ nextId, EVENT_WRITE, start, end, sync });
+    Rebuild();
+    return nextId++;
+}
+
+int Hooks::AddExec(uint16_t addr, Callback sync)
+{
+    hooks.push_back({ nextId, EVENT_EXEC, addr, addr, sync });
+    Rebuild();
+    return nextId++;
+}
+
+int Hooks::AddFrame(Callback sync)
+{
+    hooks.push_back({ nextId, EVENT_FRAME, 0, 0, sync });
+    return nextId++;
+}
+
+bool Hooks::Remove(int id)
+{
+    for (size_t i = 0; i < hooks.size(); i++)
+    {
+        if (hooks[i].id == id)
+        {
+            hooks.erase(hooks.begin() + i);
+            Rebuild();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Hooks::Clear()
+{
+    hooks.clear();
+    Rebuild();
+}
+
+void Hooks::SetBatchHandler(BatchHandler h)
+{
+    handler = h;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Events
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Hooks::Flush()
+{
+    if (count == 0 || handler == nullptr) return;
+    // The handler may add or remove hooks, events it causes start a new batch
+    uint32_t n = count;
+    count = 0;
+    batches++;
+    handler(buffer.data(), n);
+}
+
+void Hooks::Deliver(const Hook &h, const Event &e)
+{
+    events++;
+    if (h.sync != nullptr)
+    {
+        h.sync(e);
+        return;
+    }
+
+    // Full, deliver early, or drop the oldest half when there is nobody to deliver to
+    if (count == buffer.size())
+    {
+        if (handler != nullptr)
+        {
+            Flush();
+        }
+        else
+        {
+            uint32_t half = count / 2;
+            std::copy(buffer.begin() + half, buffer.begin() + count, buffer.begin());
+            count -= half;
+        }
+    }
+    buffer[count++] = e;
+}
+
+void Hooks::Match(uint8_t type, uint16_t addr, uint8_t data)
+{
+    if (type == EVENT_EXEC) data = bus->read(addr, true);
+    Event e = { bus->cpu.clock_count, addr, data, type, 0 };
+    // Indexed, a batch delivered early because the buffer filled may add or remove hooks
+    for (size_t i = 0; i < hooks.size(); i++)
+    {
+        const Hook &h = hooks[i];
+        if (h.type != type || addr < h.start || addr > h.end) continue;
+        e.hook = h.id;
+        Deliver(h, e);
+    }
+}
+
+void Hooks::OnFrame()
+{
+    Event e = { bus->cpu.clock_count, (uint16_t)bus->ppu.frameCount, 0x00, EVENT_FRAME, 0 };
+    for (size_t i = 0; i < hooks.size(); i++)
+    {
+        if (hooks[i].type != EVENT_FRAME) continue;
+        e.hook = hooks[i].id;
+        Deliver(hooks[i], e);
+    }
+    Flush();
+}
+
+// Rebuild the HOOK page flags on the bus and the bitmaps, the debugger's flags on the same pages are kept
+void Hooks::Rebuild()
+{
+    writeBitmap.fill(0);
+    execBitmap.fill(0);
+    for (auto &h : hooks)
+    {
+        if (h.type == EVENT_FRAME) continue;
+        auto &bitmap = (h.type == EVENT_WRITE) ? writeBitmap : execBitmap;
+        for (uint32_t addr = h.start; addr <= h.end; addr++)
+        {
+            bitmap[addr >> 6] |= 1ULL << (addr & 0x3F);
+        }
+    }
+
+    if (bus == nullptr) return;
+    for (int page = 0; page < 256; page++)
+    {
+        uint8_t flags = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (writeBitmap[page * 4 + i] != 0) flags |= HOOK_WRITE;
+            if (execBitmap[page * 4 + i] != 0) flags |= HOOK_EXEC;
+        }
+        bus->pageWatch[page] = (bus->pageWatch[page] & ~(HOOK_WRITE | HOOK_EXEC)) | flags;
+    }
+    bus->mapDirectPages();
+}
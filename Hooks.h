@@ -0,0 +1,116 @@
+// Hooks header file to define the scripting hook API
+// Subscriptions to memory writes, PC hits and frame ends are compiled into the same per-page flags the debugger uses
+// (Bus::pageWatch) and into one bit per address, so code and memory nobody hooked costs a single page flag load.
+// A matching event is appended to a preallocated buffer and handed to the script in one batch at frame end or when the
+// buffer fills, so a script pays one call per batch instead of one per event. Hooks that have to modify state as the
+// event happens (patch a register, poke memory before the instruction) are synchronous and called on the spot.
+// The hooks share the debugger's call sites, NES_NO_DEBUGGER compiles them out as well.
+
+#pragma once
+#include <cstdint>
+#include <array>
+#include <functional>
+#include <vector>
+
+class Bus;
+
+class Hooks
+{
+    public:
+        // Constructor and Destructor, capacity is the number of events buffered before a batch is delivered early
+        Hooks(uint32_t capacity = 4096);
+        ~Hooks();
+
+        // Page flags, stored per page in Bus::pageWatch next to the Debugger::WATCH flags
+        enum HOOK
+        {
+            HOOK_WRITE = (1 << 3),
+            HOOK_EXEC = (1 << 4),
+        };
+
+        enum EVENT
+        {
+            EVENT_WRITE,
+            EVENT_EXEC,
+            EVENT_FRAME,
+        };
+
+        struct Event
+        {
+            uint64_t clock; // CPU cycle of the event
+            uint16_t addr; // Written address, PC, or the low bits of the frame number
+            uint8_t data; // Written value, opcode about to run, 0 for frames
+            uint8_t type; // EVENT
+            int32_t hook; // Id of the hook that matched
+        };
+
+        // Synchronous hooks are called as the event happens, from inside the emulation, they must not add or remove hooks
+        using Callback = std::function<void(const Event &)>;
+        // Batched hooks are delivered here, in the order they happened
+        using BatchHandler = std::function<void(const Event *events, size_t count)>;
+
+        // Attach to a bus, the bus and CPU start calling into the hooks for flagged pages
+        void Attach(Bus *n);
+        void Detach();
+
+        // Add a hook, returns its id. Without a callback the events are batched, with one the hook is synchronous.
+        int AddWrite(uint16_t start, uint16_t end, Callback sync = nullptr);
+        int AddExec(uint16_t addr, Callback sync = nullptr);
+        int AddFrame(Callback sync = nullptr);
+        bool Remove(int id);
+        void Clear();
+
+        // Receives the batched events, events pile up in the buffer until a handler is set
+        void SetBatchHandler(BatchHandler handler);
+        // Deliver what is buffered now
+        void Flush();
+
+        // Statistics
+        uint64_t Events() const { return events; }
+        uint64_t Batches() const { return batches; }
+
+        // Called from the bus and CPU for flagged pages only
+        void OnWrite(uint16_t addr, uint8_t data)
+        {
+            if (writeBitmap[addr >> 6] & (1ULL << (addr & 0x3F))) Match(EVENT_WRITE, addr, data);
+        }
+        void OnExecute(uint16_t addr)
+        {
+            if (execBitmap[addr >> 6] & (1ULL << (addr & 0x3F))) Match(EVENT_EXEC, addr, 0x00);
+        }
+        // Called by Bus::frame() when a frame completes, delivers the batch
+        void OnFrame();
+
+    private:
+        // Pointer to the bus
+        Bus *bus = nullptr;
+
+        struct Hook
+        {
+            int id;
+            uint8_t type; // EVENT
+            uint16_t start;
+            uint16_t end;
+            Callback sync;
+        };
+        int nextId = 1;
+        std::vector<Hook> hooks;
+
+        // One bit per address with a hook
+        std::array<uint64_t, 1024> writeBitmap;
+        std::array<uint64_t, 1024> execBitmap;
+
+        // Preallocated event buffer
+        std::vector<Event> buffer;
+        uint32_t count = 0;
+        BatchHandler handler = nullptr;
+
+        uint64_t events = 0;
+        uint64_t batches = 0;
+
+        // Rebuild the HOOK page flags and the bitmaps from the hook list
+        void Rebuild();
+        // Deliver an event to every hook it matches
+        void Match(uint8_t type, uint16_t addr, uint8_t data);
+        void Deliver(const Hook &h, const Event &e);
+};
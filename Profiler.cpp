@@ -0,0 +1,230 @@
+// File that samples guest code into folded call stacks
+#include "Profiler.h"
+#include "Bus.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+// Constructor
+Profiler::Profiler(uint32_t p) : period(p == 0 ? 1 : p)
+{
+
+}
+
+// Destructor
+Profiler::~Profiler()
+{
+    Detach();
+}
+
+// Attach to a bus
+void Profiler::Attach(Bus *n)
+{
+    Detach();
+    bus = n;
+    bus->profiler = this;
+    depth = 0;
+    nextSample = bus->cpu.clock_count + period;
+}
+
+void Profiler::Detach()
+{
+    if (bus != nullptr)
+    {
+        bus->profiler = nullptr;
+        bus = nullptr;
+    }
+    nextSample = ~0ULL;
+}
+
+void Profiler::SetPeriod(uint32_t cycles)
+{
+    period = cycles == 0 ? 1 : cycles;
+    if (bus != nullptr) nextSample = bus->cpu.clock_count + period;
+}
+
+void Profiler::Clear()
+{
+    stacks.clear();
+    index.clear();
+    samples = 0;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Shadow call stack
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// The shadow stack is full, deep recursion loses its outermost frames rather than its innermost ones
+void Profiler::DropOutermost()
+{
+    memmove(&frames[0], &frames[1], sizeof(Frame) * (MAX_DEPTH - 1));
+    depth--;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Samples
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Profiler::Sample(uint16_t pc, uint64_t clock)
+{
+    // A long instruction or DMA stall can span several periods, each one is a sample
+    uint64_t n = (clock - nextSample) / period + 1;
+    nextSample += n * period;
+    samples += n;
+
+    // FNV-1a over the frames and the PC, collisions are resolved by probing the next key
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < depth; i++)
+    {
+        h ^= frames[i].addr | ((uint32_t)frames[i].kind << 16);
+        h *= 1099511628211ULL;
+    }
+    h ^= pc | (1ULL << 32);
+    h *= 1099511628211ULL;
+
+    auto same = [&](const Stack &s)
+    {
+        if (s.pc != pc || (int)s.frames.size() != depth) return false;
+        for (int i = 0; i < depth; i++)
+        {
+            if (s.frames[i] != (frames[i].addr | ((uint32_t)frames[i].kind << 16))) return false;
+        }
+        return true;
+    };
+    for (;; h++)
+    {
+        auto it = index.find(h);
+        if (it == index.end()) break;
+        if (same(stacks[it->second]))
+        {
+            stacks[it->second].count += n;
+            return;
+        }
+    }
+
+    Stack s;
+    s.frames.resize(depth);
+    for (int i = 0; i < depth; i++) s.frames[i] = frames[i].addr | ((uint32_t)frames[i].kind << 16);
+    s.pc = pc;
+    s.count = n;
+    index[h] = (uint32_t)stacks.size();
+    stacks.push_back(std::move(s));
+}
+
+// Folded stacks, the root is the reset path, interrupt frames are prefixed with their kind
+// With symbols the routine the PC is in is added as the leaf when it is not the innermost frame (code reached by JMP)
+std::string Profiler::Folded() const
+{
+    static const char *prefix[] = { "", "irq:", "nmi:", "brk:" };
+    std::map<std::string, uint64_t> folded;
+    for (auto &s : stacks)
+    {
+        std::string line = "reset";
+        std::string last = "reset";
+        for (uint32_t f : s.frames)
+        {
+            last = Name(f & 0xFFFF);
+            line += ";";
+            line += prefix[(f >> 16) & 3];
+            line += last;
+        }
+        const auto *leaf = Containing(s.pc);
+        if (leaf != nullptr && leaf->second != last)
+        {
+            line += ";";
+            line += leaf->second;
+        }
+        folded[line] += s.count;
+    }
+
+    std::string out;
+    for (auto &f : folded)
+    {
+        out += f.first;
+        out += " ";
+        out += std::to_string(f.second);
+        out += "\n";
+    }
+    return out;
+}
+
+bool Profiler::WriteFolded(const std::string &path) const
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (f == nullptr) return false;
+    std::string folded = Folded();
+    bool bOk = fwrite(folded.data(), 1, folded.size(), f) == folded.size();
+    return (fclose(f) == 0) && bOk;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Symbols
+// https://cc65.github.io/doc/ld65.html#ss5.2 (debug file) and #ss5.3 (VICE labels)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// ld65 debug file:  sym	id=3,name="update",addrsize=absolute,scope=0,def=12,val=0x8040,seg=0,type=lab
+// VICE label file:  al 008040 .update
+bool Profiler::LoadSymbols(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr) return false;
+
+    size_t before = symbols.size();
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != nullptr)
+    {
+        if (strncmp(line, "sym", 3) == 0 && (line[3] == '\t' || line[3] == ' '))
+        {
+            // Only labels, equates are constants rather than addresses
+            if (strstr(line, "type=lab") == nullptr) continue;
+            const char *name = strstr(line, "name=\"");
+            const char *val = strstr(line, "val=");
+            if (name == nullptr || val == nullptr) continue;
+            name += 6;
+            std::string n(name, strcspn(name, "\""));
+            symbols.push_back({ (uint16_t)strtoul(val + 4, nullptr, 0), n });
+        }
+        else if (strncmp(line, "al ", 3) == 0)
+        {
+            char *end = nullptr;
+            unsigned long addr = strtoul(line + 3, &end, 16);
+            if (end == nullptr) continue;
+            while (*end == ' ' || *end == '.') end++;
+            std::string n(end, strcspn(end, " \r\n"));
+            if (!n.empty()) symbols.push_back({ (uint16_t)addr, n });
+        }
+    }
+    fclose(f);
+
+    // Sorted by address, at equal addresses a global name sorts before a cheap local (@name)
+    std::stable_sort(symbols.begin(), symbols.end(), [](const auto &a, const auto &b)
+    {
+        if (a.first != b.first) return a.first < b.first;
+        return (a.second[0] != '@') && (b.second[0] == '@');
+    });
+    return symbols.size() > before;
+}
+
+const std::pair<uint16_t, std::string> *Profiler::Containing(uint16_t addr) const
+{
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+        [](uint16_t a, const std::pair<uint16_t, std::string> &s) { return a < s.first; });
+    // Cheap locals belong to the routine before them
+    while (it != symbols.begin() && (it - 1)->second[0] == '@') it--;
+    if (it == symbols.begin()) return nullptr;
+    uint16_t at = (it - 1)->first;
+    while (it != symbols.begin() && (it - 1)->first == at) it--;
+    return &*it;
+}
+
+std::string Profiler::Name(uint16_t addr) const
+{
+    auto it = std::lower_bound(symbols.begin(), symbols.end(), addr,
+        [](const std::pair<uint16_t, std::string> &s, uint16_t a) { return s.first < a; });
+    if (it != symbols.end() && it->first == addr) return it->second;
+    char buf[8];
+    snprintf(buf, sizeof(buf), "$%04X", addr);
+    return buf;
+}
@@ -0,0 +1,113 @@
+// Profiler header file to define the guest code sampling profiler
+// Every period emulated cycles the CPU hands the profiler its PC at the next instruction boundary, and the sample is
+// counted against the current shadow call stack. The shadow stack is kept by hooks on JSR, RTS, BRK, RTI and the
+// IRQ / NMI sequence, and resynchronised from the stack pointer on every call and return, so code that pops return
+// addresses or returns through pushed addresses (jump tables) does not leave it out of step.
+// Samples are aggregated per stack and written as folded stacks ("reset;main;update 42") for flamegraph.pl,
+// with routine names from an ld65 debug file (--dbgfile) or a VICE label file (-Ln) when one is loaded.
+// Define NES_NO_PROFILER to compile the hooks out of cpu6502 entirely.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class Bus;
+
+class Profiler
+{
+    public:
+        // Constructor and Destructor, one sample every period cycles
+        Profiler(uint32_t period = 1000);
+        ~Profiler();
+
+        // Attach to a bus, sampling starts one period later with an empty shadow stack
+        void Attach(Bus *n);
+        void Detach();
+
+        void SetPeriod(uint32_t cycles);
+        uint32_t GetPeriod() const { return period; }
+
+        // Routine names, from an ld65 debug file or a VICE label file, returns false if nothing could be read
+        bool LoadSymbols(const std::string &path);
+        // Name of an address, the symbol at it or "$XXXX"
+        std::string Name(uint16_t addr) const;
+
+        // Samples
+        void Clear();
+        uint64_t Samples() const { return samples; }
+        // Folded stacks, one "frame;frame;frame count" line per distinct stack
+        std::string Folded() const;
+        bool WriteFolded(const std::string &path) const;
+
+        // How a shadow stack frame was entered
+        enum FRAME
+        {
+            FRAME_JSR,
+            FRAME_IRQ,
+            FRAME_NMI,
+            FRAME_BRK,
+        };
+
+        // Hooks called from the CPU, inline as they run on every call and return while attached
+        // A routine was entered at addr, sp is the stack pointer before the return address was pushed
+        void OnCall(uint16_t addr, uint8_t sp, FRAME kind)
+        {
+            Unwind(sp);
+            if (depth == MAX_DEPTH) DropOutermost();
+            frames[depth++] = { addr, sp, (uint8_t)kind };
+        }
+        // A return pulled the stack pointer back up to sp
+        void OnReturn(uint8_t sp)
+        {
+            Unwind(sp);
+        }
+        // Take a sample when the cycle count has reached the next one, called at every instruction boundary
+        void OnBoundary(uint16_t pc, uint64_t clock)
+        {
+            if (clock >= nextSample) Sample(pc, clock);
+        }
+
+    private:
+        // Pointer to the bus
+        Bus *bus = nullptr;
+
+        uint32_t period = 1000;
+        uint64_t nextSample = ~0ULL;
+        uint64_t samples = 0;
+
+        // Shadow call stack, the outermost frame is dropped when it is full
+        struct Frame
+        {
+            uint16_t addr; // Routine entry
+            uint8_t sp; // Stack pointer before the call pushed anything
+            uint8_t kind; // FRAME
+        };
+        static constexpr int MAX_DEPTH = 64;
+        Frame frames[MAX_DEPTH];
+        int depth = 0;
+
+        // Aggregated samples, one entry per distinct shadow stack and PC
+        struct Stack
+        {
+            std::vector<uint32_t> frames; // addr | kind << 16, outermost first
+            uint16_t pc;
+            uint64_t count;
+        };
+        std::vector<Stack> stacks;
+        std::unordered_map<uint64_t, uint32_t> index; // Hash of a stack to its entry
+
+        // Symbols sorted by address
+        std::vector<std::pair<uint16_t, std::string>> symbols;
+        // Routine the address is in (the closest global symbol at or below it), nullptr if none
+        const std::pair<uint16_t, std::string> *Containing(uint16_t addr) const;
+
+        void Sample(uint16_t pc, uint64_t clock);
+        void DropOutermost();
+        // Drop frames whose base is at or above the stack pointer, they have returned or their return address was popped
+        void Unwind(uint8_t sp)
+        {
+            while (depth > 0 && frames[depth - 1].sp <= sp) depth--;
+        }
+};
@@ -0,0 +1,61 @@
+# Environment steps per second of nesemu.Batch, one step is one frame of every instance
+#   python3 bench.py [instances] [threads]
+import sys
+import time
+
+import nesemu
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+# Strobes controller 1, shifts the 8 buttons into $00 (A ends up in bit 7), copies them to $03 and counts loops in $01/$02
+#   $8000 LDA #$01, STA $4016, LDA #$00, STA $4016, LDX #$08
+#   $800C LDA $4016, LSR A, ROL $00, DEX, BNE $800C
+#   $8015 LDA $00, STA $03
+#   $8019 INC $01, BNE $801F, INC $02
+#   $801F JMP $8000
+PROGRAM = bytes([
+    0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40, 0xA2, 0x08,
+    0xAD, 0x16, 0x40, 0x4A, 0x26, 0x00, 0xCA, 0xD0, 0xF7,
+    0xA5, 0x00, 0x85, 0x03,
+    0xE6, 0x01, 0xD0, 0x02, 0xE6, 0x02, 0x4C, 0x00, 0x80,
+])
+
+
+def main():
+    instances = int(sys.argv[1]) if len(sys.argv) > 1 else 256
+    threads = int(sys.argv[2]) if len(sys.argv) > 2 else 0
+    frames = 60
+
+    prg = bytearray(32 * 1024)
+    prg[:len(PROGRAM)] = PROGRAM
+    prg[0x7FFC] = 0x00
+    prg[0x7FFD] = 0x80
+    batch = nesemu.Batch(instances, bytes(prg), threads=threads)
+
+    if np is not None:
+        obs = np.asarray(batch.obs)
+        actions = np.full(instances, nesemu.BUTTON_A, dtype=np.uint8)
+    else:
+        obs = batch.obs
+        actions = bytes([nesemu.BUTTON_A]) * instances
+
+    start = time.perf_counter()
+    for _ in range(frames):
+        batch.step(actions)
+    elapsed = time.perf_counter() - start
+
+    # The observation tensor and the RAM view share memory with the instances
+    assert obs[0, 3] == 0x80
+    assert batch.ram(0)[3] == 0x80
+
+    steps = instances * frames
+    print(f"instances           {instances}")
+    print(f"environment steps   {steps / elapsed:,.0f} per second")
+    print(f"emulated            {steps * nesemu.CYCLES_PER_FRAME / elapsed / 1e6:,.1f} MHz")
+
+
+if __name__ == "__main__":
+    main()
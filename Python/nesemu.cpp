@@ -0,0 +1,405 @@
+// Python extension module that drives batches of emulators from NumPy without copies
+// RAM, the observation tensor and the frames the PPU renders are exported through the buffer protocol, so np.asarray()
+// shares their memory. Batch.step() releases the GIL and runs the instances on native threads, one frame each.
+//   g++ -std=c++20 -O2 -shared -fPIC -pthread $(python3-config --includes) -I.. nesemu.cpp ../BusPool.cpp ../Bus.cpp ../ppu2C02.cpp ../cpu6502.cpp ../Debugger.cpp ../Profiler.cpp ../Hooks.cpp ../Tracer.cpp -o nesemu$(python3-config --extension-suffix)
+//
+//   batch = nesemu.Batch(64, prg, chr=chr)   # prg and chr are bytes objects, shared by all instances
+//   obs = np.asarray(batch.obs)              # (64, 2048) uint8, the RAM after every step, rewritten in place
+//   frames = np.asarray(batch.frames)        # (64, 240, 256) uint8 palette indices, rendered into by every step
+//   ram = np.asarray(batch.ram(0))           # (2048,) uint8, the RAM of instance 0 itself
+//   batch.step(np.zeros(64, np.uint8))       # controller 1 BUTTON bits per instance
+// Without chr the cartridge has 8KB of CHR-RAM. render_every=n renders one frame in n and leaves frames alone for the
+// others, 0 never renders. Instances cannot be reset or looked at while step() runs them.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "BusPool.h"
+#include <algorithm>
+#include <initializer_list>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+//~~~~~~~~~~~~~~~
+// View, a buffer over memory owned by a Batch
+//~~~~~~~~~~~~~~~
+struct ViewObject
+{
+    PyObject_HEAD
+    PyObject *owner; // Keeps the memory alive
+    uint8_t *data;
+    int ndim;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+};
+
+static void View_dealloc(ViewObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    Py_XDECREF(self->owner);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static int View_getbuffer(ViewObject *self, Py_buffer *view, int flags)
+{
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->buf = self->data;
+    view->len = self->shape[0] * self->strides[0];
+    view->readonly = 0;
+    view->itemsize = 1;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)"B" : nullptr;
+    view->ndim = self->ndim;
+    view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+static PyType_Slot View_slots[] =
+{
+    { Py_tp_dealloc, (void *)View_dealloc },
+    { Py_bf_getbuffer, (void *)View_getbuffer },
+    { 0, nullptr },
+};
+
+static PyType_Spec View_spec = { "nesemu.View", sizeof(ViewObject), 0, Py_TPFLAGS_DEFAULT, View_slots };
+
+static PyTypeObject *ViewType = nullptr;
+
+// Memoryview over C contiguous data of up to 3 dimensions, the view holds a reference to owner
+static PyObject *MakeView(PyObject *owner, uint8_t *data, std::initializer_list<Py_ssize_t> shape)
+{
+    ViewObject *view = PyObject_New(ViewObject, ViewType);
+    if (view == nullptr) return nullptr;
+    Py_INCREF(owner);
+    view->owner = owner;
+    view->data = data;
+    view->ndim = (int)shape.size();
+    std::copy(shape.begin(), shape.end(), view->shape);
+    Py_ssize_t stride = 1;
+    for (int d = view->ndim - 1; d >= 0; d--)
+    {
+        view->strides[d] = stride;
+        stride *= view->shape[d];
+    }
+    PyObject *mv = PyMemoryView_FromObject((PyObject *)view);
+    Py_DECREF(view);
+    return mv;
+}
+
+//~~~~~~~~~~~~~~~
+// Batch, N instances from one pool stepped together
+//~~~~~~~~~~~~~~~
+static const Py_ssize_t OBS_SIZE = 2 * 1024;
+static const Py_ssize_t FRAME_SIZE = ppu2C02::WIDTH * ppu2C02::HEIGHT;
+
+struct BatchObject
+{
+    PyObject_HEAD
+    BusPool *pool;
+    Bus **instances;
+    uint8_t *obs; // count x OBS_SIZE, contiguous
+    uint8_t *frames; // count x FRAME_SIZE, contiguous, the frame buffer of every instance's PPU
+    Py_ssize_t count;
+    int threads;
+    PyObject *prg; // bytes object the instances map as PRG-ROM
+    PyObject *chr; // bytes object the instances map as CHR-ROM, nullptr for CHR-RAM
+    bool bRunning;
+};
+
+static int Batch_init(BatchObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = { "count", "prg", "variant", "threads", "prg_ram", "chr", "mirror", "render_every", nullptr };
+    Py_ssize_t count = 0;
+    PyObject *prg = nullptr;
+    int variant = cpu6502::VARIANT_2A03;
+    int threads = 0;
+    int bPrgRam = 0;
+    PyObject *chr = Py_None;
+    int mirror = ppu2C02::MIRROR_HORIZONTAL;
+    unsigned int renderEvery = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nS|iipOiI", (char **)kwlist, &count, &prg, &variant, &threads, &bPrgRam,
+        &chr, &mirror, &renderEvery)) return -1;
+
+    if (self->pool != nullptr)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Batch is already initialised");
+        return -1;
+    }
+    if (count <= 0 || count >= 0xFFFFFFFF)
+    {
+        PyErr_SetString(PyExc_ValueError, "count must be positive");
+        return -1;
+    }
+    Py_ssize_t size = PyBytes_GET_SIZE(prg);
+    if (size < 0x4000 || (size % 0x4000) != 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "prg must be a multiple of 16KB");
+        return -1;
+    }
+    if (variant < cpu6502::VARIANT_NMOS || variant > cpu6502::VARIANT_65C02)
+    {
+        PyErr_SetString(PyExc_ValueError, "unknown variant");
+        return -1;
+    }
+    if (chr != Py_None && (!PyBytes_Check(chr) || PyBytes_GET_SIZE(chr) != 0x2000))
+    {
+        PyErr_SetString(PyExc_ValueError, "chr must be 8KB of bytes or None");
+        return -1;
+    }
+    if (mirror != ppu2C02::MIRROR_HORIZONTAL && mirror != ppu2C02::MIRROR_VERTICAL)
+    {
+        PyErr_SetString(PyExc_ValueError, "unknown mirror");
+        return -1;
+    }
+
+    self->pool = new BusPool((uint32_t)count);
+    if (!self->pool->Valid())
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    Py_INCREF(prg);
+    self->prg = prg;
+    if (chr != Py_None)
+    {
+        Py_INCREF(chr);
+        self->chr = chr;
+    }
+
+    // Template state, the cartridge inserted and the CPU reset
+    Bus templ((cpu6502::VARIANT)variant);
+    templ.InsertPRG((const uint8_t *)PyBytes_AS_STRING(prg), size, bPrgRam);
+    templ.InsertCHR(self->chr != nullptr ? (const uint8_t *)PyBytes_AS_STRING(self->chr) : nullptr, 0x2000, (ppu2C02::MIRROR)mirror);
+    templ.cpu.reset();
+    self->pool->Capture(templ);
+
+    // The frame buffers are attachments, resetting an instance to the template keeps them
+    self->count = count;
+    self->instances = new Bus *[count];
+    self->frames = new uint8_t[count * FRAME_SIZE]();
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        self->instances[i] = self->pool->Acquire();
+        self->instances[i]->ppu.frameBuffer = self->frames + i * FRAME_SIZE;
+        self->instances[i]->ppu.renderEvery = renderEvery;
+    }
+    self->obs = new uint8_t[count * OBS_SIZE]();
+    self->threads = (threads > 0) ? threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    return 0;
+}
+
+static void Batch_dealloc(BatchObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete[] self->obs;
+    delete[] self->frames;
+    delete[] self->instances;
+    delete self->pool;
+    Py_XDECREF(self->prg);
+    Py_XDECREF(self->chr);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static bool Batch_check(BatchObject *self)
+{
+    if (self->pool != nullptr) return true;
+    PyErr_SetString(PyExc_RuntimeError, "Batch is not initialised");
+    return false;
+}
+
+// step() runs the instances on other threads with the GIL released, nothing else may touch them meanwhile
+static bool Batch_idle(BatchObject *self)
+{
+    if (!Batch_check(self)) return false;
+    if (!self->bRunning) return true;
+    PyErr_SetString(PyExc_RuntimeError, "step() is running on this batch");
+    return false;
+}
+
+// step(actions=None), one frame per instance
+static PyObject *Batch_step(BatchObject *self, PyObject *args)
+{
+    PyObject *actions = Py_None;
+    if (!PyArg_ParseTuple(args, "|O", &actions) || !Batch_idle(self)) return nullptr;
+
+    Py_buffer act = {};
+    const uint8_t *buttons = nullptr;
+    if (actions != Py_None)
+    {
+        if (PyObject_GetBuffer(actions, &act, PyBUF_C_CONTIGUOUS) < 0) return nullptr;
+        if (act.itemsize != 1 || act.len < self->count)
+        {
+            PyBuffer_Release(&act);
+            PyErr_SetString(PyExc_ValueError, "actions must hold one byte per instance");
+            return nullptr;
+        }
+        buttons = (const uint8_t *)act.buf;
+    }
+
+    self->bRunning = true;
+    Bus **instances = self->instances;
+    uint8_t *obs = self->obs;
+    auto run = [instances, obs, buttons](Py_ssize_t first, Py_ssize_t last)
+    {
+        for (Py_ssize_t i = first; i < last; i++)
+        {
+            Bus *bus = instances[i];
+            if (buttons != nullptr) bus->controller[0] = buttons[i];
+            bus->frame();
+            memcpy(obs + i * OBS_SIZE, bus->ram.data(), OBS_SIZE);
+        }
+    };
+
+    Py_BEGIN_ALLOW_THREADS
+    Py_ssize_t workers = std::min<Py_ssize_t>(self->threads, self->count);
+    Py_ssize_t chunk = (self->count + workers - 1) / workers;
+    std::vector<std::thread> pool;
+    for (Py_ssize_t w = 1; w < workers; w++)
+    {
+        Py_ssize_t first = w * chunk;
+        if (first < self->count) pool.emplace_back(run, first, std::min(first + chunk, self->count));
+    }
+    run(0, std::min(chunk, self->count));
+    for (auto &t : pool) t.join();
+    Py_END_ALLOW_THREADS
+
+    self->bRunning = false;
+    if (buttons != nullptr) PyBuffer_Release(&act);
+    Py_RETURN_NONE;
+}
+
+// reset(), every instance back to the template
+static PyObject *Batch_reset(BatchObject *self, PyObject *)
+{
+    if (!Batch_idle(self)) return nullptr;
+    for (Py_ssize_t i = 0; i < self->count; i++)
+    {
+        self->pool->Reset(self->instances[i]);
+    }
+    memset(self->obs, 0, self->count * OBS_SIZE);
+    Py_RETURN_NONE;
+}
+
+// ram(i), memoryview of the RAM of one instance
+static PyObject *Batch_ram(BatchObject *self, PyObject *args)
+{
+    Py_ssize_t i = 0;
+    if (!PyArg_ParseTuple(args, "n", &i) || !Batch_idle(self)) return nullptr;
+    if (i < 0 || i >= self->count)
+    {
+        PyErr_SetString(PyExc_IndexError, "instance out of range");
+        return nullptr;
+    }
+    return MakeView((PyObject *)self, self->instances[i]->ram.data(), { OBS_SIZE });
+}
+
+// cpu(i), registers of one instance as a dict
+static PyObject *Batch_cpu(BatchObject *self, PyObject *args)
+{
+    Py_ssize_t i = 0;
+    if (!PyArg_ParseTuple(args, "n", &i) || !Batch_idle(self)) return nullptr;
+    if (i < 0 || i >= self->count)
+    {
+        PyErr_SetString(PyExc_IndexError, "instance out of range");
+        return nullptr;
+    }
+    const cpu6502 &cpu = self->instances[i]->cpu;
+    return Py_BuildValue("{s:i,s:i,s:i,s:i,s:i,s:i,s:K}", "a", cpu.a, "x", cpu.x, "y", cpu.y, "pc", cpu.pc,
+        "s", cpu.stkp, "p", cpu.status, "cycles", (unsigned long long)cpu.clock_count);
+}
+
+static PyObject *Batch_obs(BatchObject *self, void *)
+{
+    if (!Batch_check(self)) return nullptr;
+    return MakeView((PyObject *)self, self->obs, { self->count, OBS_SIZE });
+}
+
+static PyObject *Batch_frames(BatchObject *self, void *)
+{
+    if (!Batch_check(self)) return nullptr;
+    return MakeView((PyObject *)self, self->frames, { self->count, ppu2C02::HEIGHT, ppu2C02::WIDTH });
+}
+
+static Py_ssize_t Batch_len(BatchObject *self)
+{
+    return self->count;
+}
+
+static PyMethodDef Batch_methods[] =
+{
+    { "step", (PyCFunction)Batch_step, METH_VARARGS, "step(actions=None): run one frame on every instance, actions holds controller 1 buttons per instance" },
+    { "reset", (PyCFunction)Batch_reset, METH_NOARGS, "reset(): return every instance to the power on template" },
+    { "ram", (PyCFunction)Batch_ram, METH_VARARGS, "ram(i): writable view of the 2KB RAM of instance i" },
+    { "cpu", (PyCFunction)Batch_cpu, METH_VARARGS, "cpu(i): registers of instance i" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+static PyGetSetDef Batch_getset[] =
+{
+    { "obs", (getter)Batch_obs, nullptr, "observations, (count, 2048) uint8 written by step()", nullptr },
+    { "frames", (getter)Batch_frames, nullptr, "frames, (count, 240, 256) uint8 palette indices rendered by step()", nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr },
+};
+
+static PyType_Slot Batch_slots[] =
+{
+    { Py_tp_doc, (void *)"Batch(count, prg, variant=VARIANT_2A03, threads=0, prg_ram=False, chr=None, mirror=MIRROR_HORIZONTAL, render_every=1)" },
+    { Py_tp_dealloc, (void *)Batch_dealloc },
+    { Py_tp_init, (void *)Batch_init },
+    { Py_tp_new, (void *)PyType_GenericNew },
+    { Py_tp_methods, Batch_methods },
+    { Py_tp_getset, Batch_getset },
+    { Py_sq_length, (void *)Batch_len },
+    { 0, nullptr },
+};
+
+static PyType_Spec Batch_spec = { "nesemu.Batch", sizeof(BatchObject), 0, Py_TPFLAGS_DEFAULT, Batch_slots };
+
+//~~~~~~~~~~~~~~~
+// Module
+//~~~~~~~~~~~~~~~
+static PyModuleDef nesemuModule =
+{
+    .m_base = PyModuleDef_HEAD_INIT,
+    .m_name = "nesemu",
+    .m_doc = "Batched NES emulation with zero-copy NumPy views",
+    .m_size = -1,
+    .m_methods = nullptr,
+    .m_slots = nullptr,
+    .m_traverse = nullptr,
+    .m_clear = nullptr,
+    .m_free = nullptr,
+};
+
+PyMODINIT_FUNC PyInit_nesemu(void)
+{
+    ViewType = (PyTypeObject *)PyType_FromSpec(&View_spec);
+    if (ViewType == nullptr) return nullptr;
+    PyObject *batchType = PyType_FromSpec(&Batch_spec);
+    if (batchType == nullptr) return nullptr;
+
+    PyObject *m = PyModule_Create(&nesemuModule);
+    if (m == nullptr) return nullptr;
+    PyModule_AddObject(m, "Batch", batchType);
+
+    PyModule_AddIntConstant(m, "VARIANT_NMOS", cpu6502::VARIANT_NMOS);
+    PyModule_AddIntConstant(m, "VARIANT_2A03", cpu6502::VARIANT_2A03);
+    PyModule_AddIntConstant(m, "VARIANT_65C02", cpu6502::VARIANT_65C02);
+    PyModule_AddIntConstant(m, "MIRROR_HORIZONTAL", ppu2C02::MIRROR_HORIZONTAL);
+    PyModule_AddIntConstant(m, "MIRROR_VERTICAL", ppu2C02::MIRROR_VERTICAL);
+    PyModule_AddIntConstant(m, "BUTTON_A", Bus::BUTTON_A);
+    PyModule_AddIntConstant(m, "BUTTON_B", Bus::BUTTON_B);
+    PyModule_AddIntConstant(m, "BUTTON_SELECT", Bus::BUTTON_SELECT);
+    PyModule_AddIntConstant(m, "BUTTON_START", Bus::BUTTON_START);
+    PyModule_AddIntConstant(m, "BUTTON_UP", Bus::BUTTON_UP);
+    PyModule_AddIntConstant(m, "BUTTON_DOWN", Bus::BUTTON_DOWN);
+    PyModule_AddIntConstant(m, "BUTTON_LEFT", Bus::BUTTON_LEFT);
+    PyModule_AddIntConstant(m, "BUTTON_RIGHT", Bus::BUTTON_RIGHT);
+    PyModule_AddIntConstant(m, "CYCLES_PER_FRAME", Bus::CYCLES_PER_FRAME);
+    return m;
+}
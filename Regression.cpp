@@ -0,0 +1,532 @@
+// File that runs a ROM corpus against golden frames and RAM
+#include "Regression.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__) && !defined(NES_NO_SIMD)
+#include <emmintrin.h>
+#define REGRESSION_SSE2
+#endif
+
+static constexpr size_t FRAME_SIZE = ppu2C02::WIDTH * ppu2C02::HEIGHT;
+static constexpr size_t RAM_SIZE = 2 * 1024;
+
+// Constructor
+Regression::Regression(const std::string &p) : path(p)
+{
+    Open();
+}
+
+// Destructor
+Regression::~Regression()
+{
+    Close();
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Hashing
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static constexpr uint64_t PRIME32_1 = 0x9E3779B1ULL;
+static constexpr uint64_t PRIME32_2 = 0x85EBCA77ULL;
+static constexpr uint64_t PRIME32_3 = 0xC2B2AE3DULL;
+static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// 16 stripes per block, stripe s uses the key at secret[s], the block scramble uses secret[16]
+static constexpr int STRIPES = 16;
+struct Secret
+{
+    alignas(16) uint64_t key[STRIPES + 8];
+};
+static constexpr Secret MakeSecret()
+{
+    // splitmix64
+    Secret s = {};
+    uint64_t x = PRIME64_1;
+    for (auto &k : s.key)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        k = z ^ (z >> 31);
+    }
+    return s;
+}
+static constexpr Secret secret = MakeSecret();
+
+// One 64 byte stripe into the 8 accumulators
+static inline void Accumulate(uint64_t *acc, const uint8_t *p, const uint64_t *key)
+{
+#ifdef REGRESSION_SSE2
+    __m128i *a = reinterpret_cast<__m128i *>(acc);
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p) + i);
+        __m128i k = _mm_xor_si128(d, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key) + i));
+        // Low 32 bits times high 32 bits of each lane, plus the neighbouring lane's data
+        __m128i product = _mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+    }
+#else
+    for (int i = 0; i < 8; i++)
+    {
+        uint64_t d;
+        memcpy(&d, p + i * 8, 8);
+        uint64_t k = d ^ key[i];
+        acc[i ^ 1] += d;
+        acc[i] += (k & 0xFFFFFFFF) * (k >> 32);
+    }
+#endif
+}
+
+// Mix the accumulators after every block
+static inline void Scramble(uint64_t *acc, const uint64_t *key)
+{
+#ifdef REGRESSION_SSE2
+    __m128i *a = reinterpret_cast<__m128i *>(acc);
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i x = _mm_xor_si128(a[i], _mm_srli_epi64(a[i], 47));
+        x = _mm_xor_si128(x, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key) + i));
+        __m128i lo = _mm_mul_epu32(x, prime);
+        __m128i hi = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+        a[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+    }
+#else
+    for (int i = 0; i < 8; i++)
+    {
+        uint64_t x = acc[i];
+        x ^= x >> 47;
+        x ^= key[i];
+        acc[i] = x * PRIME32_1;
+    }
+#endif
+}
+
+static inline uint64_t MulFold(uint64_t a, uint64_t b)
+{
+    unsigned __int128 r = (unsigned __int128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+uint64_t Regression::Hash64(const void *data, size_t size)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    alignas(16) uint64_t acc[8] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+
+    // Whole blocks
+    size_t stripes = size / 64;
+    size_t s = 0;
+    for (; s + STRIPES <= stripes; s += STRIPES)
+    {
+        for (int i = 0; i < STRIPES; i++) Accumulate(acc, p + (s + i) * 64, &secret.key[i]);
+        Scramble(acc, &secret.key[STRIPES]);
+    }
+    // Whole stripes of the last block
+    for (; s < stripes; s++) Accumulate(acc, p + s * 64, &secret.key[s % STRIPES]);
+    // Zero padded tail
+    size_t tail = size - stripes * 64;
+    if (tail > 0)
+    {
+        alignas(16) uint8_t last[64] = {};
+        memcpy(last, p + stripes * 64, tail);
+        Accumulate(acc, last, &secret.key[stripes % STRIPES]);
+    }
+
+    // Merge and avalanche
+    uint64_t h = size * PRIME64_1;
+    for (int i = 0; i < 4; i++) h += MulFold(acc[2 * i] ^ secret.key[2 * i], acc[2 * i + 1] ^ secret.key[2 * i + 1]);
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Diffs
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Regression::DiffFrame(const uint8_t *a, const uint8_t *b, Diff &diff)
+{
+    diff.pixels = 0;
+    diff.left = diff.top = diff.right = diff.bottom = -1;
+    for (int y = 0; y < ppu2C02::HEIGHT; y++)
+    {
+        const uint8_t *ra = a + y * ppu2C02::WIDTH;
+        const uint8_t *rb = b + y * ppu2C02::WIDTH;
+        int first = -1, last = -1;
+        for (int x = 0; x < ppu2C02::WIDTH; x += 16)
+        {
+            // One bit per differing pixel of the 16
+#ifdef REGRESSION_SSE2
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ra + x)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(rb + x)));
+            uint32_t bits = ~(uint32_t)_mm_movemask_epi8(eq) & 0xFFFF;
+#else
+            uint32_t bits = 0;
+            for (int i = 0; i < 16; i++) bits |= (uint32_t)(ra[x + i] != rb[x + i]) << i;
+#endif
+            if (bits == 0) continue;
+            diff.pixels += __builtin_popcount(bits);
+            if (first < 0) first = x + __builtin_ctz(bits);
+            last = x + 31 - __builtin_clz(bits);
+        }
+        if (first < 0) continue;
+
+        if (diff.top < 0) diff.top = y;
+        diff.bottom = y;
+        if (diff.left < 0 || first < diff.left) diff.left = first;
+        if (last > diff.right) diff.right = last;
+    }
+}
+
+void Regression::DiffRam(const uint8_t *a, const uint8_t *b, size_t size, Diff &diff)
+{
+    diff.ramBytes = 0;
+    diff.firstRam = -1;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (a[i] == b[i]) continue;
+        if (diff.firstRam < 0) diff.firstRam = (int32_t)i;
+        diff.ramBytes++;
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Golden database
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static const char MAGIC[8] = { 'N', 'E', 'S', 'G', 'O', 'L', 'D', 0 };
+
+// Map the database read-only, a missing or malformed file is an empty database
+bool Regression::Open()
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool bOk = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header);
+    if (bOk)
+    {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            map = static_cast<const uint8_t *>(p);
+            mapSize = st.st_size;
+        }
+    }
+    close(fd);
+    if (map == nullptr) return false;
+
+    const Header *h = reinterpret_cast<const Header *>(map);
+    if (memcmp(h->magic, MAGIC, 8) != 0 || h->version != VERSION || sizeof(Header) + (size_t)h->count * sizeof(Record) > mapSize)
+    {
+        Close();
+        return false;
+    }
+    // The index is looked up on every checkpoint, the frames only on a mismatch
+    madvise(const_cast<uint8_t *>(map), sizeof(Header) + h->count * sizeof(Record), MADV_WILLNEED);
+    return true;
+}
+
+void Regression::Close()
+{
+    if (map != nullptr) munmap(const_cast<uint8_t *>(map), mapSize);
+    map = nullptr;
+    mapSize = 0;
+}
+
+uint32_t Regression::Records() const
+{
+    return (map != nullptr) ? reinterpret_cast<const Header *>(map)->count : 0;
+}
+
+// Binary search of the index
+const Regression::Record *Regression::Find(uint64_t rom, uint32_t checkpoint) const
+{
+    if (map == nullptr) return nullptr;
+    const Record *begin = reinterpret_cast<const Record *>(map + sizeof(Header));
+    const Record *end = begin + Records();
+    const Record *r = std::lower_bound(begin, end, std::make_pair(rom, checkpoint),
+        [](const Record &a, const std::pair<uint64_t, uint32_t> &key) { return a.rom < key.first || (a.rom == key.first && a.checkpoint < key.second); });
+    if (r == end || r->rom != rom || r->checkpoint != checkpoint) return nullptr;
+    return r;
+}
+
+// Write the merged database next to the old one and swap it in
+bool Regression::Write(std::vector<Pending> &pending)
+{
+    // Every record to write, pending ones replace mapped ones with the same key
+    struct Entry
+    {
+        Record record;
+        const uint8_t *frame;
+        const uint8_t *ram;
+    };
+    std::vector<Entry> entries;
+    for (auto &p : pending)
+    {
+        entries.push_back({ p.record, p.frame.empty() ? nullptr : p.frame.data(), p.ram.data() });
+    }
+    auto key = [](const Record &r) { return std::make_pair(r.rom, r.checkpoint); };
+    std::sort(entries.begin(), entries.end(), [&](const Entry &a, const Entry &b) { return key(a.record) < key(b.record); });
+    size_t fresh = entries.size();
+    if (map != nullptr)
+    {
+        const Record *old = reinterpret_cast<const Record *>(map + sizeof(Header));
+        for (uint32_t i = 0; i < Records(); i++)
+        {
+            auto found = std::lower_bound(entries.begin(), entries.begin() + fresh, old[i],
+                [&](const Entry &a, const Record &b) { return key(a.record) < key(b); });
+            if (found != entries.begin() + fresh && key(found->record) == key(old[i])) continue;
+            bool bFrame = old[i].frameOffset != 0 && old[i].frameOffset + FRAME_SIZE <= mapSize;
+            bool bRam = old[i].ramOffset + RAM_SIZE <= mapSize;
+            if (!bRam) continue;
+            entries.push_back({ old[i], bFrame ? map + old[i].frameOffset : nullptr, map + old[i].ramOffset });
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [&](const Entry &a, const Entry &b) { return key(a.record) < key(b.record); });
+
+    // Header, index, then the frames and RAM
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == nullptr) return false;
+
+    Header h = {};
+    memcpy(h.magic, MAGIC, 8);
+    h.version = VERSION;
+    h.count = (uint32_t)entries.size();
+    uint64_t offset = sizeof(Header) + entries.size() * sizeof(Record);
+    for (auto &e : entries)
+    {
+        e.record.frameOffset = 0;
+        if (e.frame != nullptr)
+        {
+            e.record.frameOffset = offset;
+            offset += FRAME_SIZE;
+        }
+        e.record.ramOffset = offset;
+        offset += RAM_SIZE;
+    }
+
+    bool bOk = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (auto &e : entries) bOk = bOk && fwrite(&e.record, sizeof(Record), 1, f) == 1;
+    for (auto &e : entries)
+    {
+        if (e.frame != nullptr) bOk = bOk && fwrite(e.frame, FRAME_SIZE, 1, f) == 1;
+        bOk = bOk && fwrite(e.ram, RAM_SIZE, 1, f) == 1;
+    }
+    bOk = (fclose(f) == 0) && bOk;
+    if (!bOk || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    Close();
+    return Open();
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Running
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool Regression::Run(const std::vector<Rom> &corpus, MODE mode, Callback callback, int threads)
+{
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<int>(threads, std::max<size_t>(1, corpus.size()));
+    stats = Stats();
+
+    // Workers claim entries in order until the corpus runs out
+    std::vector<Pending> pending;
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&]()
+    {
+        Stats local;
+        std::vector<uint8_t> pixels(FRAME_SIZE);
+        for (size_t i = next++; i < corpus.size(); i = next++)
+        {
+            // A fresh instance per entry, so results do not depend on which worker ran what before
+            auto bus = std::make_unique<Bus>();
+            RunRom(*bus, pixels.data(), corpus[i], mode, callback, pending, local);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        stats.checkpoints += local.checkpoints;
+        stats.passed += local.passed;
+        stats.failed += local.failed;
+        stats.added += local.added;
+        stats.missing += local.missing;
+        stats.emulateSeconds += local.emulateSeconds;
+        stats.compareSeconds += local.compareSeconds;
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+
+    if (mode == MODE_RECORD && !pending.empty()) return Write(pending);
+    return true;
+}
+
+void Regression::RunRom(Bus &bus, uint8_t *pixels, const Rom &rom, MODE mode, const Callback &callback,
+    std::vector<Pending> &pending, Stats &local)
+{
+    auto start = std::chrono::steady_clock::now();
+    double compare = 0.0;
+
+    bus.InsertPRG(rom.prg, rom.prgSize, rom.bPrgRam);
+    bus.InsertCHR(rom.chr, rom.chrSize, rom.mirror);
+    bus.cpu.reset();
+    memset(pixels, 0, FRAME_SIZE);
+
+    // Only frames that are compared are rendered
+    bus.ppu.renderEvery = 1;
+    bus.ppu.frameBuffer = nullptr;
+
+    // PC checkpoints halt on a breakpoint, only the next one is armed
+    Debugger debugger;
+    uint32_t next = 0;
+    uint32_t hits = 0;
+    auto arm = [&]()
+    {
+        debugger.Clear();
+        hits = 0;
+        if (next < rom.checkpoints.size() && rom.checkpoints[next].kind == Checkpoint::KIND_PC)
+        {
+            debugger.AddBreakpoint((uint16_t)rom.checkpoints[next].value);
+        }
+    };
+    for (auto &c : rom.checkpoints)
+    {
+        if (c.kind == Checkpoint::KIND_PC)
+        {
+            debugger.Attach(&bus);
+            break;
+        }
+    }
+    arm();
+
+    uint64_t key = Hash64(rom.name.data(), rom.name.size());
+    auto take = [&](bool bFrame)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        Result r;
+        r.rom = &rom;
+        r.checkpoint = next;
+        r.frame = bus.ppu.frameCount;
+        r.frameHash = bFrame ? Hash64(pixels, FRAME_SIZE) : 0;
+        r.ramHash = Hash64(bus.ram.data(), RAM_SIZE);
+
+        const Record *golden = Find(key, next);
+        if (golden == nullptr)
+        {
+            r.status = STATUS_NEW;
+        }
+        else if (golden->frameHash == r.frameHash && golden->ramHash == r.ramHash)
+        {
+            r.status = STATUS_PASS;
+        }
+        else
+        {
+            // Only a mismatch reads the golden frame and RAM
+            r.status = STATUS_FAIL;
+            if (bFrame && golden->frameOffset != 0 && golden->frameOffset + FRAME_SIZE <= mapSize)
+            {
+                DiffFrame(pixels, map + golden->frameOffset, r.diff);
+            }
+            if (golden->ramOffset + RAM_SIZE <= mapSize) DiffRam(bus.ram.data(), map + golden->ramOffset, RAM_SIZE, r.diff);
+        }
+        local.checkpoints++;
+        local.passed += r.status == STATUS_PASS;
+        local.failed += r.status == STATUS_FAIL;
+        local.added += r.status == STATUS_NEW;
+
+        Pending p;
+        if (mode == MODE_RECORD)
+        {
+            p.record = { key, next, 0, r.frameHash, r.ramHash, 0, 0 };
+            if (bFrame) p.frame.assign(pixels, pixels + FRAME_SIZE);
+            p.ram.assign(bus.ram.begin(), bus.ram.end());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+        compare += elapsed.count();
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (mode == MODE_RECORD) pending.push_back(std::move(p));
+        if (callback) callback(r);
+    };
+
+    while (next < rom.checkpoints.size())
+    {
+        const Checkpoint &c = rom.checkpoints[next];
+        uint64_t frames = bus.ppu.frameCount;
+        if (c.kind == Checkpoint::KIND_FRAME && frames >= c.value)
+        {
+            take(true);
+            next++;
+            arm();
+            continue;
+        }
+        if (frames >= rom.maxFrames) break;
+
+        // Render the coming frame if a frame checkpoint wants it
+        bool bRender = false;
+        for (size_t i = next; i < rom.checkpoints.size(); i++)
+        {
+            bRender |= rom.checkpoints[i].kind == Checkpoint::KIND_FRAME && rom.checkpoints[i].value == frames + 1;
+        }
+        bus.ppu.frameBuffer = bRender ? pixels : nullptr;
+        bus.controller[0] = (frames < rom.input.size()) ? rom.input[frames] : 0;
+
+        bus.frame();
+        if (bus.ppu.frameCount != frames) continue;
+
+        // Stopped inside the frame, on the armed breakpoint or because the CPU cannot go on
+        if (!debugger.bBreak) break;
+        if (++hits == c.count)
+        {
+            take(false);
+            next++;
+            arm();
+        }
+        debugger.Continue();
+    }
+    debugger.Detach();
+    bus.ppu.frameBuffer = nullptr;
+
+    // Checkpoints never reached
+    for (; next < rom.checkpoints.size(); next++)
+    {
+        Result r;
+        r.rom = &rom;
+        r.checkpoint = next;
+        r.status = STATUS_MISSING;
+        r.frame = bus.ppu.frameCount;
+        local.checkpoints++;
+        local.missing++;
+        std::lock_guard<std::mutex> guard(lock);
+        if (callback) callback(r);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    local.emulateSeconds += elapsed.count() - compare;
+    local.compareSeconds += compare;
+}
@@ -0,0 +1,165 @@
+// Regression header file to define the golden-frame regression runner
+// Each ROM of a corpus runs to its checkpoints (a frame number or the n-th time the CPU reaches a PC), where the
+// frame buffer and internal RAM are hashed and looked up in a golden database. Only a hash mismatch touches the
+// stored golden frame and RAM, to produce a pixel diff with a bounding box and a RAM diff.
+// The golden database is one file mapped read-only: a sorted index of records followed by the golden frames and RAM.
+// The corpus runs on worker threads and every checkpoint result is passed to a callback as soon as it is known.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include "Bus.h"
+
+class Regression
+{
+    public:
+        // Constructor and Destructor, maps the golden database at path if it exists
+        Regression(const std::string &path);
+        ~Regression();
+
+        Regression(const Regression &) = delete;
+        Regression &operator=(const Regression &) = delete;
+
+        // Where to stop and compare
+        struct Checkpoint
+        {
+            enum KIND
+            {
+                KIND_FRAME, // After value frames, compares the frame buffer and RAM
+                KIND_PC, // The count-th time the CPU is about to run the instruction at value, compares RAM only (the frame is partial)
+            };
+            KIND kind = KIND_FRAME;
+            uint32_t value = 0;
+            uint32_t count = 1;
+        };
+
+        // One corpus entry, the images are shared and must outlive Run()
+        struct Rom
+        {
+            std::string name; // Identifies the entry in the golden database
+            const uint8_t *prg = nullptr;
+            size_t prgSize = 0;
+            const uint8_t *chr = nullptr; // nullptr for CHR-RAM
+            size_t chrSize = 0;
+            ppu2C02::MIRROR mirror = ppu2C02::MIRROR_HORIZONTAL;
+            bool bPrgRam = false;
+            std::vector<uint8_t> input; // Controller 1 buttons for each frame, 0 past the end
+            std::vector<Checkpoint> checkpoints; // In the order they are reached
+            uint32_t maxFrames = 3600; // Checkpoints not reached by then are missing
+        };
+
+        enum STATUS
+        {
+            STATUS_PASS, // Hashes match the golden record
+            STATUS_FAIL, // Hashes differ, see the diff
+            STATUS_NEW, // No golden record, recorded when recording
+            STATUS_MISSING, // Checkpoint never reached
+        };
+
+        // Pixel and RAM difference against the golden record, only filled on STATUS_FAIL
+        struct Diff
+        {
+            uint32_t pixels = 0; // Pixels that differ
+            int16_t left = -1, top = -1, right = -1, bottom = -1; // Inclusive bounding box of them, -1 if none
+            uint32_t ramBytes = 0; // RAM bytes that differ
+            int32_t firstRam = -1; // Address of the first one, -1 if none
+        };
+
+        struct Result
+        {
+            const Rom *rom = nullptr;
+            uint32_t checkpoint = 0; // Index into rom->checkpoints
+            STATUS status = STATUS_PASS;
+            uint64_t frame = 0; // Frames completed when the checkpoint was taken
+            uint64_t frameHash = 0; // 0 for PC checkpoints
+            uint64_t ramHash = 0;
+            Diff diff;
+        };
+        using Callback = std::function<void(const Result &)>;
+
+        enum MODE
+        {
+            MODE_COMPARE, // Compare against the database
+            MODE_RECORD, // Compare, then write every result as the new golden record
+        };
+
+        // Run the corpus on threads workers (0 for one per core), callback is called from the workers one at a time
+        // Returns false if recording could not write the database
+        bool Run(const std::vector<Rom> &corpus, MODE mode, Callback callback, int threads = 0);
+
+        struct Stats
+        {
+            uint64_t checkpoints = 0;
+            uint64_t passed = 0;
+            uint64_t failed = 0;
+            uint64_t added = 0;
+            uint64_t missing = 0;
+            double emulateSeconds = 0.0; // Summed over the workers
+            double compareSeconds = 0.0; // Hashing, lookups and diffs, summed over the workers
+        };
+        const Stats &GetStats() const { return stats; }
+        // Records in the mapped database
+        uint32_t Records() const;
+
+        //~~~~~~~~~~~~~~~
+        // Building blocks
+        //~~~~~~~~~~~~~~~
+        // 64-bit hash in the style of XXH3: 64 byte stripes over 8 lanes of multiply-accumulate, SSE2 when available.
+        // Not bit compatible with XXH3. Define NES_NO_SIMD for the scalar version, which gives the same hashes.
+        static uint64_t Hash64(const void *data, size_t size);
+        // Difference between two WIDTH x HEIGHT frames, 16 pixels compared at a time
+        static void DiffFrame(const uint8_t *a, const uint8_t *b, Diff &diff);
+        // Difference between two RAM images
+        static void DiffRam(const uint8_t *a, const uint8_t *b, size_t size, Diff &diff);
+
+    private:
+        std::string path;
+        Stats stats;
+        // Serialises the callback, the pending records and the stats between workers
+        std::mutex lock;
+
+        // Database file
+        // https://man7.org/linux/man-pages/man2/mmap.2.html
+        struct Header
+        {
+            char magic[8]; // "NESGOLD"
+            uint32_t version;
+            uint32_t count; // Records, sorted by rom then checkpoint
+        };
+        struct Record
+        {
+            uint64_t rom; // Hash64 of the name
+            uint32_t checkpoint;
+            uint32_t reserved;
+            uint64_t frameHash;
+            uint64_t ramHash;
+            uint64_t frameOffset; // File offset of the golden frame, 0 if none
+            uint64_t ramOffset; // File offset of the golden RAM
+        };
+        static constexpr uint32_t VERSION = 1;
+
+        const uint8_t *map = nullptr;
+        size_t mapSize = 0;
+        bool Open();
+        void Close();
+        // Golden record, nullptr if none
+        const Record *Find(uint64_t rom, uint32_t checkpoint) const;
+
+        // Results being recorded, with their frame and RAM
+        struct Pending
+        {
+            Record record;
+            std::vector<uint8_t> frame;
+            std::vector<uint8_t> ram;
+        };
+        // Write the mapped records merged with the pending ones to a new file and map it
+        bool Write(std::vector<Pending> &pending);
+
+        // Run one entry on a bus
+        void RunRom(Bus &bus, uint8_t *pixels, const Rom &rom, MODE mode, const Callback &callback,
+            std::vector<Pending> &pending, Stats &local);
+};
@@ -0,0 +1,139 @@
+// File that runs the emulation ahead of the host to hide input lag
+#include "RunAhead.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+namespace
+{
+    // What is attached to the primary, MODE_SINGLE detaches it for the frames it throws away
+    struct ATTACHED
+    {
+        Debugger *debugger;
+        Hooks *hooks;
+        Profiler *profiler;
+        uint8_t *coverage;
+        std::array<uint8_t, 256> pageWatch;
+    };
+
+    ATTACHED Detach(Bus &bus)
+    {
+        ATTACHED a = { bus.debugger, bus.hooks, bus.profiler, bus.cpu.coverage, bus.pageWatch };
+        bus.debugger = nullptr;
+        bus.hooks = nullptr;
+        bus.profiler = nullptr;
+        bus.cpu.coverage = nullptr;
+        bus.pageWatch.fill(0);
+        bus.mapDirectPages();
+        return a;
+    }
+
+    void Reattach(Bus &bus, const ATTACHED &a)
+    {
+        bus.debugger = a.debugger;
+        bus.hooks = a.hooks;
+        bus.profiler = a.profiler;
+        bus.cpu.coverage = a.coverage;
+        bus.pageWatch = a.pageWatch;
+        bus.mapDirectPages();
+    }
+}
+
+// Constructor
+RunAhead::RunAhead(Bus &b, int n, MODE m) : bus(b), frames(n < 0 ? 0 : n), mode(m)
+{
+    spare = std::make_unique<Bus>(bus.cpu.GetVariant());
+    if (mode == MODE_SINGLE) shown = std::make_unique<Bus>(bus.cpu.GetVariant());
+    stats.effective = frames;
+}
+
+// Destructor
+RunAhead::~RunAhead()
+{
+
+}
+
+// Change the number of frames to run ahead
+void RunAhead::SetFrames(int n)
+{
+    frames = n < 0 ? 0 : n;
+    if (stats.effective > frames) stats.effective = frames;
+    fits = 0;
+}
+
+// One host frame
+const Bus &RunAhead::Frame(uint8_t buttons)
+{
+    auto start = std::chrono::steady_clock::now();
+    int n = stats.effective;
+
+    // Only the presented frame is rendered, every other frame skips its pixels
+    uint8_t *pixels = bus.ppu.frameBuffer;
+    if (n > 0) bus.ppu.frameBuffer = nullptr;
+
+    // The real frame, the only one that counts
+    bus.controller[0] = buttons;
+    bus.frame();
+
+    const Bus *present = &bus;
+    if (n > 0)
+    {
+        NES_TRACE_SCOPE("run ahead");
+        if (mode == MODE_SECONDARY)
+        {
+            // The primary never rewinds, the spare instance runs ahead from a copy of it
+            spare->copyState(bus);
+            for (int i = 0; i < n; i++)
+            {
+                spare->ppu.frameBuffer = (i == n - 1) ? pixels : nullptr;
+                spare->frame();
+            }
+            spare->ppu.frameBuffer = nullptr;
+            present = spare.get();
+        }
+        else
+        {
+            // Save, run ahead, keep the result and restore. Frames that are thrown away must not reach the debugger,
+            // hooks, profiler or coverage map, those only see the real frame.
+            spare->copyState(bus);
+            ATTACHED attached = Detach(bus);
+            for (int i = 0; i < n; i++)
+            {
+                if (i == n - 1) bus.ppu.frameBuffer = pixels;
+                bus.frame();
+            }
+            shown->copyState(bus);
+            bus.copyState(*spare);
+            Reattach(bus, attached);
+            present = shown.get();
+        }
+        bus.ppu.frameBuffer = pixels;
+    }
+
+    // Budget, drop straight to the depth the last frame says would fit, add one back only after a run of frames with room for it
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.last = elapsed.count();
+    stats.average = (stats.hostFrames == 0) ? stats.last : stats.average * 0.95 + stats.last * 0.05;
+    stats.hostFrames++;
+    if (stats.last > budget)
+    {
+        stats.overBudget++;
+        fits = 0;
+        int fit = (int)(budget / (stats.last / (n + 1))) - 1;
+        stats.effective = std::max(0, std::min(n - 1, fit));
+    }
+    else if (stats.effective < frames && stats.last * (n + 2) / (n + 1) < budget)
+    {
+        if (++fits >= 30)
+        {
+            stats.effective++;
+            fits = 0;
+        }
+    }
+    else
+    {
+        fits = 0;
+    }
+    return *present;
+}
@@ -0,0 +1,62 @@
+// RunAhead header file to define the run-ahead input latency reduction
+// Every host frame the real frame is run with the new input, then the state is copied and run N frames further
+// with the same input, and the state N frames ahead is what gets presented. Games that react to input a few frames
+// late then react on the next host frame.
+// MODE_SINGLE saves, runs ahead and restores the one instance, with its debugger, hooks, profiler and coverage map
+// detached while it runs ahead, MODE_SECONDARY copies the state into a second instance and runs ahead there, so the
+// primary only ever runs real frames and its audio never rewinds.
+// Only the presented frame is rendered, into the frame buffer attached to the primary's PPU, the others skip their pixels.
+// https://docs.libretro.com/guides/runahead/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include "Bus.h"
+
+class RunAhead
+{
+    public:
+        enum MODE
+        {
+            MODE_SINGLE, // Save, run ahead and restore the primary
+            MODE_SECONDARY, // Run ahead on a second instance
+        };
+
+        // Constructor and Destructor, the bus must outlive the run-ahead
+        RunAhead(Bus &bus, int frames, MODE mode = MODE_SECONDARY);
+        ~RunAhead();
+
+        // Run one host frame with controller 1 buttons, returns the state to present
+        const Bus &Frame(uint8_t buttons);
+
+        // Frames to run ahead, the effective count drops below this when the budget is exceeded
+        void SetFrames(int n);
+        int GetFrames() const { return frames; }
+        MODE GetMode() const { return mode; }
+
+        // Timing budget
+        // A host frame that takes longer than budget seconds lowers the effective frame count to what would have fit,
+        // and it climbs back by one towards GetFrames() after 30 host frames in a row with room for one more.
+        double budget = 0.8 / 60.0;
+        struct Stats
+        {
+            int effective = 0; // Frames run ahead on the last host frame
+            double last = 0.0; // Seconds the last host frame took
+            double average = 0.0; // Moving average of that
+            uint64_t overBudget = 0; // Host frames that went over the budget
+            uint64_t hostFrames = 0;
+        };
+        const Stats &GetStats() const { return stats; }
+
+    private:
+        Bus &bus;
+        int frames;
+        MODE mode;
+        Stats stats;
+        int fits = 0; // Consecutive host frames with room for one more run-ahead frame
+
+        // Saved state (MODE_SINGLE) or the run-ahead instance (MODE_SECONDARY)
+        std::unique_ptr<Bus> spare;
+        // State N frames ahead in MODE_SINGLE, the primary is restored after running ahead
+        std::unique_ptr<Bus> shown;
+};
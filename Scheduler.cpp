@@ -0,0 +1,178 @@
+// File that schedules session coroutines on a pool of workers
+#include "Scheduler.h"
+#include "Tracer.h"
+
+// Worker the calling thread runs as, nullptr on other threads
+static thread_local Scheduler *currentScheduler = nullptr;
+static thread_local int currentWorker = -1;
+
+// Constructor
+Scheduler::Scheduler(int count)
+{
+    if (count <= 0) count = (int)std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < count; i++)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < count; i++)
+    {
+        workers[i]->thread = std::thread(&Scheduler::Run, this, i);
+    }
+}
+
+// Destructor
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        bStop = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers)
+    {
+        w->thread.join();
+    }
+
+    // Sessions still queued are destroyed, ones waiting on an event belong to whoever holds the event
+    for (auto &w : workers)
+    {
+        for (auto h : w->queue) h.destroy();
+    }
+}
+
+// Start a session
+void Scheduler::Spawn(Task task)
+{
+    auto h = task.handle;
+    task.handle = nullptr;
+    h.promise().scheduler = this;
+    live.fetch_add(1, std::memory_order_relaxed);
+    Schedule(h);
+}
+
+// Queue a session
+void Scheduler::Schedule(std::coroutine_handle<> h)
+{
+    // Sessions stay on the worker that runs them, others are spread round robin
+    int index = (currentScheduler == this) ? currentWorker : (int)(nextInject.fetch_add(1, std::memory_order_relaxed) % workers.size());
+    {
+        std::lock_guard<std::mutex> guard(workers[index]->lock);
+        workers[index]->queue.push_back(h);
+    }
+    queued.fetch_add(1, std::memory_order_seq_cst);
+
+    // Only pay for the wake up when a worker is asleep
+    if (sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wake.notify_one();
+    }
+}
+
+// Take the next session for a worker
+std::coroutine_handle<> Scheduler::Take(int index)
+{
+    {
+        Worker &own = *workers[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.queue.empty())
+        {
+            auto h = own.queue.front();
+            own.queue.pop_front();
+            return h;
+        }
+    }
+
+    // Steal from the back of the first other queue that is not busy
+    int count = (int)workers.size();
+    for (int n = 1; n < count; n++)
+    {
+        Worker &other = *workers[(index + n) % count];
+        std::unique_lock<std::mutex> guard(other.lock, std::try_to_lock);
+        if (guard.owns_lock() && !other.queue.empty())
+        {
+            auto h = other.queue.back();
+            other.queue.pop_back();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return h;
+        }
+    }
+    return nullptr;
+}
+
+// Worker loop
+void Scheduler::Run(int index)
+{
+    currentScheduler = this;
+    currentWorker = index;
+
+    while (!bStop.load(std::memory_order_relaxed))
+    {
+        if (queued.load(std::memory_order_seq_cst) > 0)
+        {
+            auto h = Take(index);
+            if (h)
+            {
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                h.resume();
+            }
+            continue;
+        }
+
+        // Nothing queued anywhere, sleep until a session is scheduled
+        NES_TRACE_SCOPE("idle");
+        std::unique_lock<std::mutex> guard(sleepLock);
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        wake.wait(guard, [this]() { return bStop.load() || queued.load(std::memory_order_seq_cst) > 0; });
+        sleeping.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+// Called from the final suspend point of a session
+void Scheduler::Finished()
+{
+    if (live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::lock_guard<std::mutex> guard(doneLock);
+        done.notify_all();
+    }
+}
+
+// Wait for all sessions
+void Scheduler::Wait()
+{
+    std::unique_lock<std::mutex> guard(doneLock);
+    done.wait(guard, [this]() { return live.load(std::memory_order_acquire) == 0; });
+}
+
+// Wake the session waiting on the event, or remember the event for the next wait
+void Scheduler::Event::Set()
+{
+    std::coroutine_handle<> h = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (waiter)
+        {
+            h = waiter;
+            waiter = nullptr;
+        }
+        else
+        {
+            bSet = true;
+        }
+    }
+    if (h) scheduler.Schedule(h);
+}
+
+// Suspend unless the event is already set, which is consumed
+bool Scheduler::Event::await_suspend(std::coroutine_handle<> h)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (bSet)
+    {
+        bSet = false;
+        return false;
+    }
+    waiter = h;
+    return true;
+}
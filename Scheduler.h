@@ -0,0 +1,147 @@
+// Scheduler header file to define the cooperative session scheduler
+// Each emulation session is a C++20 coroutine that yields at frame boundaries or waits on an Event for input.
+// A few worker threads, one per core by default, run the sessions from per-worker queues and steal from each
+// other when their own queue runs dry, so tens of thousands of mostly idle sessions fit on a handful of threads.
+//
+//   Scheduler::Task Session(Scheduler &s, Bus &bus, Scheduler::Event &input)
+//   {
+//       for (;;)
+//       {
+//           co_await input; // Sleep until the client sends buttons
+//           bus.frame();
+//           co_await s.Yield(); // Let other sessions run
+//       }
+//   }
+//   scheduler.Spawn(Session(scheduler, bus, input));
+
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Scheduler
+{
+    public:
+        // Constructor and Destructor, 0 workers means one per hardware thread
+        // The destructor stops the workers, sessions that have not finished are destroyed where they are suspended
+        Scheduler(int workers = 0);
+        ~Scheduler();
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        // Coroutine type of a session, owns the frame until it is spawned
+        class Task
+        {
+            public:
+                struct promise_type
+                {
+                    Scheduler *scheduler = nullptr;
+
+                    Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+                    // Sessions start when they are spawned
+                    std::suspend_always initial_suspend() noexcept { return {}; }
+                    // A finished session frees its frame and tells the scheduler
+                    struct FinalAwaiter
+                    {
+                        bool await_ready() noexcept { return false; }
+                        void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                        {
+                            Scheduler *s = h.promise().scheduler;
+                            h.destroy();
+                            s->Finished();
+                        }
+                        void await_resume() noexcept {}
+                    };
+                    FinalAwaiter final_suspend() noexcept { return {}; }
+                    void return_void() {}
+                    void unhandled_exception() { std::terminate(); }
+                };
+
+                Task(Task &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+                Task &operator=(Task &&) = delete;
+                ~Task() { if (handle) handle.destroy(); }
+
+            private:
+                friend class Scheduler;
+                explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+                std::coroutine_handle<promise_type> handle;
+        };
+
+        // Auto-reset event a session waits on for external input, Set() may be called from any thread
+        // Only one session may wait on an event at a time
+        class Event
+        {
+            public:
+                Event(Scheduler &s) : scheduler(s) {}
+                void Set();
+
+                bool await_ready() noexcept { return false; }
+                bool await_suspend(std::coroutine_handle<> h);
+                void await_resume() noexcept {}
+
+            private:
+                Scheduler &scheduler;
+                std::mutex lock;
+                std::coroutine_handle<> waiter = nullptr;
+                bool bSet = false;
+        };
+
+        // Awaitable that puts the session at the back of the queue of the worker running it
+        struct YieldAwaiter
+        {
+            Scheduler *scheduler;
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { scheduler->Schedule(h); }
+            void await_resume() noexcept {}
+        };
+        YieldAwaiter Yield() { return { this }; }
+
+        // Start a session
+        void Spawn(Task task);
+        // Block until every spawned session has finished
+        void Wait();
+
+        // Sessions spawned and not yet finished
+        uint64_t Live() const { return live.load(std::memory_order_relaxed); }
+        // Sessions that were taken from another worker's queue
+        uint64_t Steals() const { return steals.load(std::memory_order_relaxed); }
+        int Workers() const { return (int)workers.size(); }
+
+        // Queue a suspended session, on the calling worker if it belongs to this scheduler
+        void Schedule(std::coroutine_handle<> h);
+
+    private:
+        struct alignas(64) Worker
+        {
+            std::mutex lock;
+            std::deque<std::coroutine_handle<>> queue;
+            std::thread thread;
+        };
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        // Sessions in queues, idle workers sleep on wake while it is zero
+        std::atomic<int64_t> queued{ 0 };
+        std::atomic<int> sleeping{ 0 };
+        std::mutex sleepLock;
+        std::condition_variable wake;
+        std::atomic<bool> bStop{ false };
+        std::atomic<uint32_t> nextInject{ 0 };
+
+        // Sessions alive, Wait() sleeps on done until it is zero
+        std::atomic<uint64_t> live{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::mutex doneLock;
+        std::condition_variable done;
+
+        void Run(int index);
+        // Take a session from the front of a worker's own queue, or steal from the back of another one
+        std::coroutine_handle<> Take(int index);
+        void Finished();
+};
@@ -0,0 +1,215 @@
+// File that publishes emulation state to observer threads through seqlock slots
+#include "StatePublisher.h"
+#include "Bus.h"
+#include <cstring>
+
+// Constructor
+StatePublisher::StatePublisher(uint32_t n) : count(n < 2 ? 2 : n), slots(new Slot[n < 2 ? 2 : n])
+{
+    for (auto &w : subscribed) w.store(0, std::memory_order_relaxed);
+    // Allocated up front, a reader may be copying out of any slot while the writer fills it
+    for (uint32_t i = 0; i < count; i++) slots[i].frameBuffer.resize(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+}
+
+// Destructor
+StatePublisher::~StatePublisher()
+{
+
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Subscriptions
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int StatePublisher::AddReader(bool bFrameBuffer)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        if (readers[i].bUsed) continue;
+        readers[i] = Reader();
+        readers[i].bUsed = true;
+        readers[i].bFrameBuffer = bFrameBuffer;
+        Rebuild();
+        return i;
+    }
+    return -1;
+}
+
+void StatePublisher::RemoveReader(int reader)
+{
+    if (reader < 0 || reader >= MAX_READERS) return;
+    std::lock_guard<std::mutex> guard(lock);
+    readers[reader].bUsed = false;
+    Rebuild();
+}
+
+bool StatePublisher::Subscribe(int reader, uint16_t addr, uint16_t length)
+{
+    if (reader < 0 || reader >= MAX_READERS || length == 0) return false;
+    uint32_t last = (uint32_t)addr + length - 1;
+
+    // Chunks of the range, internal RAM mirrors fold onto the 2KB
+    Mask add = {};
+    auto set = [&add](int chunk) { add[chunk / 64] |= 1ULL << (chunk % 64); };
+    if (last <= 0x1FFF)
+    {
+        if (length >= 0x0800)
+        {
+            for (int c = 0; c < RAM_CHUNKS; c++) set(c);
+        }
+        else
+        {
+            for (uint32_t a = addr; a <= last; a = (a | (CHUNK - 1)) + 1) set((a & 0x07FF) / CHUNK);
+        }
+    }
+    else if (addr >= 0x6000 && last <= 0x7FFF)
+    {
+        for (uint32_t a = addr; a <= last; a = (a | (CHUNK - 1)) + 1) set(RAM_CHUNKS + (a - 0x6000) / CHUNK);
+    }
+    else
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!readers[reader].bUsed) return false;
+    for (int w = 0; w < MASK_WORDS; w++) readers[reader].mask[w] |= add[w];
+    Rebuild();
+    return true;
+}
+
+// Union of every reader's subscription, called with the lock held
+void StatePublisher::Rebuild()
+{
+    Mask all = {};
+    uint32_t frames = 0;
+    for (auto &r : readers)
+    {
+        if (!r.bUsed) continue;
+        for (int w = 0; w < MASK_WORDS; w++) all[w] |= r.mask[w];
+        if (r.bFrameBuffer) frames++;
+    }
+    for (int w = 0; w < MASK_WORDS; w++) subscribed[w].store(all[w], std::memory_order_relaxed);
+    frameBufferReaders.store(frames, std::memory_order_relaxed);
+}
+
+uint64_t StatePublisher::Retries(int reader) const
+{
+    if (reader < 0 || reader >= MAX_READERS) return 0;
+    return readers[reader].retries;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Publishing
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+uint32_t StatePublisher::CopyChunks(const Mask &mask, uint8_t *ram, uint8_t *prgRam, const uint8_t *fromRam, const uint8_t *fromPrgRam)
+{
+    uint32_t bytes = 0;
+    for (int w = 0; w < MASK_WORDS; w++)
+    {
+        uint64_t bits = mask[w];
+        while (bits != 0)
+        {
+            // The lowest run of set chunks, cut where internal RAM ends and PRG-RAM starts
+            int b = __builtin_ctzll(bits);
+            uint64_t rest = ~(bits >> b);
+            int run = (rest != 0) ? __builtin_ctzll(rest) : 64 - b;
+            int c = w * 64 + b;
+            if (c < RAM_CHUNKS && c + run > RAM_CHUNKS) run = RAM_CHUNKS - c;
+            bits &= ~(((run == 64) ? ~0ULL : (1ULL << run) - 1) << b);
+
+            if (c < RAM_CHUNKS) memcpy(ram + c * CHUNK, fromRam + c * CHUNK, run * CHUNK);
+            else memcpy(prgRam + (c - RAM_CHUNKS) * CHUNK, fromPrgRam + (c - RAM_CHUNKS) * CHUNK, run * CHUNK);
+            bytes += run * CHUNK;
+        }
+    }
+    return bytes;
+}
+
+void StatePublisher::Publish(const Bus &bus)
+{
+    uint64_t n = latest.load(std::memory_order_relaxed) + 1;
+    Slot &s = slots[n % count];
+
+    // Odd sequence first, the fence keeps the copies below from moving above it
+    s.seq.store(n * 2 - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s.frame = bus.ppu.frameCount;
+    s.clock = bus.cpu.clock_count;
+    s.pc = bus.cpu.pc;
+    s.a = bus.cpu.a;
+    s.x = bus.cpu.x;
+    s.y = bus.cpu.y;
+    s.stkp = bus.cpu.stkp;
+    s.status = bus.cpu.status;
+
+    // Without PRG-RAM only the internal RAM chunks in the first word are copied
+    for (int w = 0; w < MASK_WORDS; w++) s.mask[w] = subscribed[w].load(std::memory_order_relaxed);
+    if (!bus.bPrgRam)
+    {
+        s.mask[0] &= (1ULL << RAM_CHUNKS) - 1;
+        for (int w = 1; w < MASK_WORDS; w++) s.mask[w] = 0;
+    }
+    publishBytes = CopyChunks(s.mask, s.ram.data(), s.prgRam.data(), bus.ram.data(), bus.prgRam.data());
+
+    s.bFrameBuffer = frameBufferReaders.load(std::memory_order_relaxed) != 0 && bus.ppu.frameBuffer != nullptr;
+    if (s.bFrameBuffer)
+    {
+        memcpy(s.frameBuffer.data(), bus.ppu.frameBuffer, s.frameBuffer.size());
+        publishBytes += (uint32_t)s.frameBuffer.size();
+    }
+
+    s.seq.store(n * 2, std::memory_order_release);
+    latest.store(n, std::memory_order_release);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Reading
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// The copy can overlap the writer starting on the same slot again, the sequence check afterwards throws such a copy away
+bool StatePublisher::Read(int reader, State &out)
+{
+    if (reader < 0 || reader >= MAX_READERS) return false;
+    Reader &r = readers[reader];
+    if (r.bFrameBuffer) out.frameBuffer.resize(ppu2C02::WIDTH * ppu2C02::HEIGHT);
+
+    for (;;)
+    {
+        uint64_t n = latest.load(std::memory_order_acquire);
+        if (n == 0) return false;
+        const Slot &s = slots[n % count];
+        uint64_t before = s.seq.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            r.retries++;
+            continue;
+        }
+
+        out.frame = s.frame;
+        out.clock = s.clock;
+        out.pc = s.pc;
+        out.a = s.a;
+        out.x = s.x;
+        out.y = s.y;
+        out.stkp = s.stkp;
+        out.status = s.status;
+        Mask mask;
+        for (int w = 0; w < MASK_WORDS; w++) mask[w] = s.mask[w] & r.mask[w];
+        CopyChunks(mask, out.ram.data(), out.prgRam.data(), s.ram.data(), s.prgRam.data());
+        bool bFrame = r.bFrameBuffer && s.bFrameBuffer;
+        if (bFrame) memcpy(out.frameBuffer.data(), s.frameBuffer.data(), out.frameBuffer.size());
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) == before)
+        {
+            out.sequence = before / 2;
+            if (!bFrame) out.frameBuffer.clear();
+            return true;
+        }
+        r.retries++;
+    }
+}
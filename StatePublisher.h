@@ -0,0 +1,109 @@
+// StatePublisher header file to define lock-free publishing of emulation state to observer threads
+// The emulation thread calls Publish() at frame or batch boundaries, which copies the CPU registers, the RAM ranges
+// readers subscribed to and, if one asked for it, the frame buffer into the next slot of a small ring. Every slot is a
+// seqlock: its sequence is odd while it is written and even once it is complete. Readers copy the newest slot and
+// check the sequence did not move, so they never take a lock and never make the emulation thread wait. A reader only
+// retries when the writer laps the whole ring during its copy, which takes slots publishes.
+// Publish() copies the union of the subscriptions in 64 byte chunks, so its cost is bounded by what is subscribed.
+// https://en.wikipedia.org/wiki/Seqlock
+
+#pragma once
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Bus;
+
+class StatePublisher
+{
+    public:
+        // A published snapshot as a reader sees it, only the subscribed ranges of ram and prgRam are filled in
+        struct State
+        {
+            uint64_t sequence = 0; // Publish count, 0 before the first one
+            uint64_t frame = 0; // PPU frames completed
+            uint64_t clock = 0; // CPU cycles
+            uint16_t pc = 0x0000;
+            uint8_t a = 0x00;
+            uint8_t x = 0x00;
+            uint8_t y = 0x00;
+            uint8_t stkp = 0x00;
+            uint8_t status = 0x00;
+            std::array<uint8_t, 2 * 1024> ram;
+            std::array<uint8_t, 8 * 1024> prgRam;
+            std::vector<uint8_t> frameBuffer; // ppu2C02::WIDTH x HEIGHT when subscribed, empty otherwise
+        };
+
+        // Constructor and Destructor, slots is the depth of the ring (at least 2)
+        StatePublisher(uint32_t slots = 4);
+        ~StatePublisher();
+
+        StatePublisher(const StatePublisher &) = delete;
+        StatePublisher &operator=(const StatePublisher &) = delete;
+
+        // Readers, from any thread, a reader id is then used by one thread at a time
+        static constexpr int MAX_READERS = 16;
+        // Returns the reader id, -1 when all are taken
+        int AddReader(bool bFrameBuffer = false);
+        void RemoveReader(int reader);
+        // Subscribe a reader to CPU addresses, internal RAM ($0000-$1FFF, mirrors fold) and PRG-RAM ($6000-$7FFF)
+        // Returns false if the range touches anything else, nothing is subscribed then
+        bool Subscribe(int reader, uint16_t addr, uint16_t length);
+
+        // Writer side, called from the emulation thread only
+        void Publish(const Bus &bus);
+        uint64_t Published() const { return latest.load(std::memory_order_relaxed); }
+        // Bytes of RAM and frame buffer the last Publish() copied
+        uint32_t PublishBytes() const { return publishBytes; }
+
+        // Reader side, copies the newest snapshot, returns false if nothing was published yet
+        bool Read(int reader, State &out);
+        // Copies that were overwritten while the reader was copying and had to start again, read it from the reader's thread
+        uint64_t Retries(int reader) const;
+
+    private:
+        // 2KB internal RAM and 8KB PRG-RAM in 64 byte chunks, internal RAM first
+        static constexpr int CHUNK = 64;
+        static constexpr int RAM_CHUNKS = 2 * 1024 / CHUNK;
+        static constexpr int CHUNKS = RAM_CHUNKS + 8 * 1024 / CHUNK;
+        static constexpr int MASK_WORDS = (CHUNKS + 63) / 64;
+        using Mask = std::array<uint64_t, MASK_WORDS>;
+
+        struct Slot
+        {
+            std::atomic<uint64_t> seq{ 0 }; // Odd while the writer is in it
+            uint64_t frame = 0;
+            uint64_t clock = 0;
+            uint16_t pc = 0x0000;
+            uint8_t a = 0x00, x = 0x00, y = 0x00, stkp = 0x00, status = 0x00;
+            Mask mask = {}; // Chunks copied into this slot
+            bool bFrameBuffer = false;
+            std::array<uint8_t, 2 * 1024> ram;
+            std::array<uint8_t, 8 * 1024> prgRam;
+            std::vector<uint8_t> frameBuffer;
+        };
+        uint32_t count;
+        std::unique_ptr<Slot[]> slots;
+        alignas(64) std::atomic<uint64_t> latest{ 0 }; // Newest complete publish
+        uint32_t publishBytes = 0;
+
+        struct Reader
+        {
+            bool bUsed = false;
+            bool bFrameBuffer = false;
+            Mask mask = {};
+            alignas(64) uint64_t retries = 0;
+        };
+        std::array<Reader, MAX_READERS> readers;
+        // Union of the subscriptions, rebuilt under the lock whenever they change, loaded by Publish()
+        std::mutex lock;
+        alignas(64) std::array<std::atomic<uint64_t>, MASK_WORDS> subscribed;
+        std::atomic<uint32_t> frameBufferReaders{ 0 };
+        void Rebuild();
+
+        // Copy the chunks set in mask from RAM and PRG-RAM images, merging runs of chunks into one copy
+        static uint32_t CopyChunks(const Mask &mask, uint8_t *ram, uint8_t *prgRam, const uint8_t *fromRam, const uint8_t *fromPrgRam);
+};
@@ -0,0 +1,200 @@
+// File that records host side spans and writes them as a Chrome / Perfetto trace
+#include "Tracer.h"
+
+static std::atomic<uint64_t> starts{ 0 };
+
+// Constructor
+Tracer::Tracer()
+{
+
+}
+
+// Destructor
+Tracer::~Tracer()
+{
+    Stop();
+}
+
+bool Tracer::Start(const std::string &path, uint32_t capacity, std::chrono::milliseconds p)
+{
+    if (file != nullptr) return false;
+    FILE *f = fopen(path.c_str(), "w");
+    if (f == nullptr) return false;
+
+    uint64_t size = 16;
+    while (size < capacity) size <<= 1;
+    mask = size - 1;
+    rings.clear();
+    file = f;
+    bFirst = true;
+    written.store(0, std::memory_order_relaxed);
+    period = p;
+    bStop = false;
+    generation = starts.fetch_add(1, std::memory_order_relaxed) + 1;
+    tick0 = Now();
+    time0 = std::chrono::steady_clock::now();
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+
+    // Only one tracer records at a time
+    Tracer *none = nullptr;
+    if (!active.compare_exchange_strong(none, this, std::memory_order_acq_rel))
+    {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    thread = std::thread(&Tracer::Run, this);
+    return true;
+}
+
+void Tracer::Stop()
+{
+    if (file == nullptr) return;
+    Tracer *self = this;
+    active.compare_exchange_strong(self, nullptr, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> guard(stopLock);
+        bStop = true;
+    }
+    wake.notify_all();
+    thread.join();
+
+    // Last spans, then the thread names
+    Drain();
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &r : rings)
+    {
+        if (r->name.empty()) continue;
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", bFirst ? "" : ",\n",
+            r->tid, r->name.c_str());
+        bFirst = false;
+    }
+    fputs("\n]}\n", file);
+    fclose(file);
+    file = nullptr;
+}
+
+uint64_t Tracer::Dropped() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t n = 0;
+    for (auto &r : rings) n += r->dropped.load(std::memory_order_relaxed);
+    return n;
+}
+
+void Tracer::NameThread(const std::string &name)
+{
+    Tracer *t = active.load(std::memory_order_acquire);
+    if (t == nullptr) return;
+    Ring *r = (local.tracer == t && local.generation == t->generation) ? local.ring : t->Register();
+    if (r == nullptr) return;
+    std::lock_guard<std::mutex> guard(t->lock);
+    r->name = name;
+}
+
+Tracer::Ring *Tracer::Register()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (active.load(std::memory_order_acquire) != this) return nullptr;
+    auto r = std::make_unique<Ring>();
+    r->events.resize(mask + 1);
+    r->limit = mask + 1;
+    r->tid = (uint32_t)rings.size() + 1;
+    local = { this, generation, r.get() };
+    rings.push_back(std::move(r));
+    return local.ring;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Flusher
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Tracer::Run()
+{
+    std::unique_lock<std::mutex> guard(stopLock);
+    while (!bStop)
+    {
+        wake.wait_for(guard, period, [this]() { return bStop; });
+        guard.unlock();
+        Drain();
+        guard.lock();
+    }
+}
+
+void Tracer::Drain()
+{
+    // Nanoseconds per tick over everything since Start(), steady_clock nanoseconds need no measuring
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t ticks = Now() - tick0;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - time0).count();
+    double perTick = (ns > 0.0 && ticks > 0) ? ns / ticks : 1.0;
+#else
+    double perTick = 1.0;
+#endif
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &r : rings)
+    {
+        uint64_t t = r->tail.load(std::memory_order_relaxed);
+        uint64_t h = r->head.load(std::memory_order_acquire);
+        written.fetch_add(h - t, std::memory_order_relaxed);
+        for (; t != h; t++)
+        {
+            const Event &e = r->events[t & mask];
+            // Cores' counters can be a few ticks apart, a span starting just before tick0 is clamped to it
+            uint64_t start = (e.start > tick0) ? (uint64_t)((e.start - tick0) * perTick) : 0;
+            uint64_t length = (e.end > e.start) ? (uint64_t)((e.end - e.start) * perTick) : 0;
+            Write(e.name, r->tid, start, length);
+        }
+        r->tail.store(t, std::memory_order_release);
+    }
+}
+
+// Decimal digits of v
+static char *Put(char *p, uint64_t v)
+{
+    char digits[20];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) *p++ = digits[--n];
+    return p;
+}
+
+// Nanoseconds as microseconds with three decimals
+static char *PutMicros(char *p, uint64_t ns)
+{
+    p = Put(p, ns / 1000);
+    uint32_t frac = ns % 1000;
+    *p++ = '.';
+    *p++ = '0' + frac / 100;
+    *p++ = '0' + frac / 10 % 10;
+    *p++ = '0' + frac % 10;
+    return p;
+}
+
+// One complete event, formatted by hand as printf of two doubles is most of the flusher's time
+void Tracer::Write(const char *name, uint32_t tid, uint64_t start, uint64_t length)
+{
+    char line[256];
+    char *p = line;
+    auto text = [&](const char *s)
+    {
+        while (*s != 0 && p < line + 160) *p++ = *s++;
+    };
+    if (!bFirst) text(",\n");
+    bFirst = false;
+    text("{\"name\":\"");
+    text(name);
+    text("\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+    p = Put(p, tid);
+    text(",\"ts\":");
+    p = PutMicros(p, start);
+    text(",\"dur\":");
+    p = PutMicros(p, length);
+    *p++ = '}';
+    fwrite(line, 1, p - line, file);
+}
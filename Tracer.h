@@ -0,0 +1,174 @@
+// Tracer header file to define host side timeline tracing
+// Where host time goes per frame: emulation, PPU rendering, DMA, snapshots and waiting on schedulers. Instrumented code
+// opens scoped spans with NES_TRACE_SCOPE("name"). A finished span is one store into a ring owned by its thread, so the
+// hot path takes no lock and does no atomic read-modify-write. A flusher thread drains every ring each period and
+// writes the spans as Chrome trace event JSON, which ui.perfetto.dev and chrome://tracing open.
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+// Timestamps are rdtsc ticks on x86-64, converted by the flusher with a rate measured against steady_clock since
+// Start(), and steady_clock nanoseconds elsewhere.
+// With no tracer started a span costs a load and a branch. Define NES_NO_TRACE to compile every span out.
+//
+//     Tracer tracer;
+//     tracer.Start("trace.json");
+//     Tracer::NameThread("emulation");
+//     for (...) bus.frame(); // Spans "frame", "ppu line", "oam dma", ...
+//     tracer.Stop();
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+class Tracer
+{
+    public:
+        // Constructor and Destructor, the destructor stops a started tracer
+        // Destroy it only once no thread can still be inside a span it recorded
+        Tracer();
+        ~Tracer();
+
+        Tracer(const Tracer &) = delete;
+        Tracer &operator=(const Tracer &) = delete;
+
+        // Start tracing into a JSON file, one tracer at a time, returns false if one is already started or the file
+        // cannot be opened. Every thread gets a ring of capacity spans (rounded up to a power of two) the first time it
+        // records one, and spans that find their ring full are dropped rather than waited for.
+        // Start again after Stop() only once the threads traced before are out of their spans, their rings are freed.
+        bool Start(const std::string &path, uint32_t capacity = 1 << 16, std::chrono::milliseconds period = std::chrono::milliseconds(1));
+        // Stop tracing, drain the rings and finish the file. Spans still open on other threads are lost, never waited for.
+        void Stop();
+        bool IsStarted() const { return file != nullptr; }
+
+        // Statistics
+        uint64_t Spans() const { return written.load(std::memory_order_relaxed); } // Spans written to the file
+        uint64_t Dropped() const; // Spans lost to full rings
+
+        // Name the calling thread in the trace of the started tracer
+        static void NameThread(const std::string &name);
+
+        // A span, recorded when it goes out of scope, name must be a string literal
+        class Scope
+        {
+            public:
+                explicit Scope(const char *n) : tracer(active.load(std::memory_order_acquire))
+                {
+                    if (tracer != nullptr)
+                    {
+                        name = n;
+                        start = Now();
+                    }
+                }
+                ~Scope()
+                {
+                    if (tracer != nullptr) tracer->Record(name, start, Now());
+                }
+
+                Scope(const Scope &) = delete;
+                Scope &operator=(const Scope &) = delete;
+
+            private:
+                Tracer *tracer;
+                const char *name = nullptr;
+                uint64_t start = 0;
+        };
+
+        // Tick counter of the timestamps
+        static uint64_t Now()
+        {
+#if defined(__x86_64__) || defined(_M_X64)
+            return __rdtsc();
+#else
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+    private:
+        struct Event
+        {
+            const char *name;
+            uint64_t start;
+            uint64_t end;
+        };
+        // One thread's ring, written by that thread and drained by the flusher
+        struct Ring
+        {
+            std::vector<Event> events;
+            uint32_t tid = 0;
+            std::string name;
+            alignas(64) std::atomic<uint64_t> head{ 0 }; // Next span to write, owned by the thread
+            uint64_t limit = 0; // head may go up to this without looking at tail
+            std::atomic<uint64_t> dropped{ 0 };
+            alignas(64) std::atomic<uint64_t> tail{ 0 }; // Next span to write out, owned by the flusher
+        };
+        // The calling thread's ring, valid while tracer and generation match the started tracer, zero to begin with
+        struct Local
+        {
+            Tracer *tracer;
+            uint64_t generation;
+            Ring *ring;
+        };
+        inline static thread_local Local local;
+        // The started tracer, nullptr while none is
+        inline static std::atomic<Tracer *> active{ nullptr };
+
+        void Record(const char *name, uint64_t start, uint64_t end)
+        {
+            Ring *r = (local.tracer == this && local.generation == generation) ? local.ring : Register();
+            if (r == nullptr) return;
+            uint64_t h = r->head.load(std::memory_order_relaxed);
+            if (h == r->limit)
+            {
+                // Only a ring that looked full reads the flusher's position
+                r->limit = r->tail.load(std::memory_order_acquire) + mask + 1;
+                if (h == r->limit)
+                {
+                    r->dropped.store(r->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            r->events[h & mask] = { name, start, end };
+            r->head.store(h + 1, std::memory_order_release);
+        }
+        // First span of a thread, gives it a ring, nullptr once stopped
+        Ring *Register();
+
+        uint64_t generation = 0; // Start() count, so a ring of an earlier run is not written to
+        uint64_t mask = 0;
+        mutable std::mutex lock; // Guards rings
+        std::vector<std::unique_ptr<Ring>> rings;
+
+        // Flusher
+        FILE *file = nullptr;
+        bool bFirst = true;
+        std::atomic<uint64_t> written{ 0 };
+        uint64_t tick0 = 0; // Now() and steady_clock at Start(), the tick rate is measured from them
+        std::chrono::steady_clock::time_point time0;
+        std::chrono::milliseconds period{ 1 };
+        bool bStop = false;
+        std::mutex stopLock;
+        std::condition_variable wake;
+        std::thread thread;
+        void Run();
+        // Write out everything the rings hold
+        void Drain();
+        void Write(const char *name, uint32_t tid, uint64_t start, uint64_t length);
+};
+
+// A span over the rest of the enclosing scope
+#ifndef NES_NO_TRACE
+#define NES_TRACE_CONCAT2(a, b) a##b
+#define NES_TRACE_CONCAT(a, b) NES_TRACE_CONCAT2(a, b)
+#define NES_TRACE_SCOPE(name) Tracer::Scope NES_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define NES_TRACE_SCOPE(name)
+#endif
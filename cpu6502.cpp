@@ -1,34 +1,120 @@
 // CPU 6502 file
 #include "cpu6502.h"
 #include "Bus.h"
+#include <initializer_list>
+#include <cstring>
+
+// Instruction table
+// https://www.princeton.edu/~mae412/HANDOUTS/Datasheets/6502.pdf (Page 22,23)
+// https://web.archive.org/web/20221112231348if_/http://archive.6502.org/datasheets/rockwell_r650x_r651x.pdf (Page 10)
+// { "Instruction", &cpu6502::Opcode, &cpu6502::AddressingMode, Cycles}
+// "&cpu6502::Opcode" a pointer to the opcode in the CPU 6502 class.
+std::vector<cpu6502::INSTRUCTION> cpu6502::BaseLookup()
+{
+    return
+    {
+        { "BRK", &cpu6502::BRK, &cpu6502::IMM, 7 },{ "ORA", &cpu6502::ORA, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 3 },{ "ORA", &cpu6502::ORA, &cpu6502::ZP0, 3 },{ "ASL", &cpu6502::ASL, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PHP", &cpu6502::PHP, &cpu6502::IMP, 3 },{ "ORA", &cpu6502::ORA, &cpu6502::IMM, 2 },{ "ASL", &cpu6502::ASL, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ORA", &cpu6502::ORA, &cpu6502::ABS, 4 },{ "ASL", &cpu6502::ASL, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
+        { "BPL", &cpu6502::BPL, &cpu6502::REL, 2 },{ "ORA", &cpu6502::ORA, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ORA", &cpu6502::ORA, &cpu6502::ZPX, 4 },{ "ASL", &cpu6502::ASL, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "CLC", &cpu6502::CLC, &cpu6502::IMP, 2 },{ "ORA", &cpu6502::ORA, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ORA", &cpu6502::ORA, &cpu6502::ABX, 4 },{ "ASL", &cpu6502::ASL, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
+        { "JSR", &cpu6502::JSR, &cpu6502::ABS, 6 },{ "AND", &cpu6502::AND, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "BIT", &cpu6502::BIT, &cpu6502::ZP0, 3 },{ "AND", &cpu6502::AND, &cpu6502::ZP0, 3 },{ "ROL", &cpu6502::ROL, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PLP", &cpu6502::PLP, &cpu6502::IMP, 4 },{ "AND", &cpu6502::AND, &cpu6502::IMM, 2 },{ "ROL", &cpu6502::ROL, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "BIT", &cpu6502::BIT, &cpu6502::ABS, 4 },{ "AND", &cpu6502::AND, &cpu6502::ABS, 4 },{ "ROL", &cpu6502::ROL, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
+        { "BMI", &cpu6502::BMI, &cpu6502::REL, 2 },{ "AND", &cpu6502::AND, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "AND", &cpu6502::AND, &cpu6502::ZPX, 4 },{ "ROL", &cpu6502::ROL, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "SEC", &cpu6502::SEC, &cpu6502::IMP, 2 },{ "AND", &cpu6502::AND, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "AND", &cpu6502::AND, &cpu6502::ABX, 4 },{ "ROL", &cpu6502::ROL, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
+        { "RTI", &cpu6502::RTI, &cpu6502::IMP, 6 },{ "EOR", &cpu6502::EOR, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 3 },{ "EOR", &cpu6502::EOR, &cpu6502::ZP0, 3 },{ "LSR", &cpu6502::LSR, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PHA", &cpu6502::PHA, &cpu6502::IMP, 3 },{ "EOR", &cpu6502::EOR, &cpu6502::IMM, 2 },{ "LSR", &cpu6502::LSR, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "JMP", &cpu6502::JMP, &cpu6502::ABS, 3 },{ "EOR", &cpu6502::EOR, &cpu6502::ABS, 4 },{ "LSR", &cpu6502::LSR, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
+        { "BVC", &cpu6502::BVC, &cpu6502::REL, 2 },{ "EOR", &cpu6502::EOR, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "EOR", &cpu6502::EOR, &cpu6502::ZPX, 4 },{ "LSR", &cpu6502::LSR, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "CLI", &cpu6502::CLI, &cpu6502::IMP, 2 },{ "EOR", &cpu6502::EOR, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "EOR", &cpu6502::EOR, &cpu6502::ABX, 4 },{ "LSR", &cpu6502::LSR, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
+        { "RTS", &cpu6502::RTS, &cpu6502::IMP, 6 },{ "ADC", &cpu6502::ADC, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 3 },{ "ADC", &cpu6502::ADC, &cpu6502::ZP0, 3 },{ "ROR", &cpu6502::ROR, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PLA", &cpu6502::PLA, &cpu6502::IMP, 4 },{ "ADC", &cpu6502::ADC, &cpu6502::IMM, 2 },{ "ROR", &cpu6502::ROR, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "JMP", &cpu6502::JMP, &cpu6502::IND, 5 },{ "ADC", &cpu6502::ADC, &cpu6502::ABS, 4 },{ "ROR", &cpu6502::ROR, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
+        { "BVS", &cpu6502::BVS, &cpu6502::REL, 2 },{ "ADC", &cpu6502::ADC, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ADC", &cpu6502::ADC, &cpu6502::ZPX, 4 },{ "ROR", &cpu6502::ROR, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "SEI", &cpu6502::SEI, &cpu6502::IMP, 2 },{ "ADC", &cpu6502::ADC, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ADC", &cpu6502::ADC, &cpu6502::ABX, 4 },{ "ROR", &cpu6502::ROR, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
+        { "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "STA", &cpu6502::STA, &cpu6502::IZX, 6 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "STY", &cpu6502::STY, &cpu6502::ZP0, 3 },{ "STA", &cpu6502::STA, &cpu6502::ZP0, 3 },{ "STX", &cpu6502::STX, &cpu6502::ZP0, 3 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 3 },{ "DEY", &cpu6502::DEY, &cpu6502::IMP, 2 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "TXA", &cpu6502::TXA, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "STY", &cpu6502::STY, &cpu6502::ABS, 4 },{ "STA", &cpu6502::STA, &cpu6502::ABS, 4 },{ "STX", &cpu6502::STX, &cpu6502::ABS, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },
+        { "BCC", &cpu6502::BCC, &cpu6502::REL, 2 },{ "STA", &cpu6502::STA, &cpu6502::IZY, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "STY", &cpu6502::STY, &cpu6502::ZPX, 4 },{ "STA", &cpu6502::STA, &cpu6502::ZPX, 4 },{ "STX", &cpu6502::STX, &cpu6502::ZPY, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },{ "TYA", &cpu6502::TYA, &cpu6502::IMP, 2 },{ "STA", &cpu6502::STA, &cpu6502::ABY, 5 },{ "TXS", &cpu6502::TXS, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 5 },{ "STA", &cpu6502::STA, &cpu6502::ABX, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },
+        { "LDY", &cpu6502::LDY, &cpu6502::IMM, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::IZX, 6 },{ "LDX", &cpu6502::LDX, &cpu6502::IMM, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "LDY", &cpu6502::LDY, &cpu6502::ZP0, 3 },{ "LDA", &cpu6502::LDA, &cpu6502::ZP0, 3 },{ "LDX", &cpu6502::LDX, &cpu6502::ZP0, 3 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 3 },{ "TAY", &cpu6502::TAY, &cpu6502::IMP, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::IMM, 2 },{ "TAX", &cpu6502::TAX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "LDY", &cpu6502::LDY, &cpu6502::ABS, 4 },{ "LDA", &cpu6502::LDA, &cpu6502::ABS, 4 },{ "LDX", &cpu6502::LDX, &cpu6502::ABS, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },
+        { "BCS", &cpu6502::BCS, &cpu6502::REL, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "LDY", &cpu6502::LDY, &cpu6502::ZPX, 4 },{ "LDA", &cpu6502::LDA, &cpu6502::ZPX, 4 },{ "LDX", &cpu6502::LDX, &cpu6502::ZPY, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },{ "CLV", &cpu6502::CLV, &cpu6502::IMP, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::ABY, 4 },{ "TSX", &cpu6502::TSX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },{ "LDY", &cpu6502::LDY, &cpu6502::ABX, 4 },{ "LDA", &cpu6502::LDA, &cpu6502::ABX, 4 },{ "LDX", &cpu6502::LDX, &cpu6502::ABY, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },
+        { "CPY", &cpu6502::CPY, &cpu6502::IMM, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::IZX, 6 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "CPY", &cpu6502::CPY, &cpu6502::ZP0, 3 },{ "CMP", &cpu6502::CMP, &cpu6502::ZP0, 3 },{ "DEC", &cpu6502::DEC, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "INY", &cpu6502::INY, &cpu6502::IMP, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::IMM, 2 },{ "DEX", &cpu6502::DEX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "CPY", &cpu6502::CPY, &cpu6502::ABS, 4 },{ "CMP", &cpu6502::CMP, &cpu6502::ABS, 4 },{ "DEC", &cpu6502::DEC, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
+        { "BNE", &cpu6502::BNE, &cpu6502::REL, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "CMP", &cpu6502::CMP, &cpu6502::ZPX, 4 },{ "DEC", &cpu6502::DEC, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "CLD", &cpu6502::CLD, &cpu6502::IMP, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::ABY, 4 },{ "NOP", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "CMP", &cpu6502::CMP, &cpu6502::ABX, 4 },{ "DEC", &cpu6502::DEC, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
+        { "CPX", &cpu6502::CPX, &cpu6502::IMM, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::IZX, 6 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "CPX", &cpu6502::CPX, &cpu6502::ZP0, 3 },{ "SBC", &cpu6502::SBC, &cpu6502::ZP0, 3 },{ "INC", &cpu6502::INC, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "INX", &cpu6502::INX, &cpu6502::IMP, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::IMM, 2 },{ "NOP", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::SBC, &cpu6502::IMP, 2 },{ "CPX", &cpu6502::CPX, &cpu6502::ABS, 4 },{ "SBC", &cpu6502::SBC, &cpu6502::ABS, 4 },{ "INC", &cpu6502::INC, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
+        { "BEQ", &cpu6502::BEQ, &cpu6502::REL, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "SBC", &cpu6502::SBC, &cpu6502::ZPX, 4 },{ "INC", &cpu6502::INC, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "SED", &cpu6502::SED, &cpu6502::IMP, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::ABY, 4 },{ "NOP", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "SBC", &cpu6502::SBC, &cpu6502::ABX, 4 },{ "INC", &cpu6502::INC, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
+    };
+}
+
+// Opcode table of a variant policy
+// 2A03: the NMOS table as is, ADC and SBC are binary only
+// NMOS: ADC and SBC (and the SBC alias at $EB) get decimal mode
+// 65C02: decimal mode with valid N and Z, BRK clears D, the CMOS opcodes replace the illegal ones and JMP indirect is fixed
+template <class P>
+const cpu6502::INSTRUCTION *cpu6502::Lookup()
+{
+    static const std::vector<INSTRUCTION> table = []()
+    {
+        std::vector<INSTRUCTION> t = BaseLookup();
+        for (auto &op : t)
+        {
+            if constexpr (P::bDecimal)
+            {
+                if (op.operate == &cpu6502::ADC) op.operate = &cpu6502::ADCD<P::bCMOS>;
+                if (op.operate == &cpu6502::SBC) op.operate = &cpu6502::SBCD<P::bCMOS>;
+            }
+            if constexpr (P::bCMOS)
+            {
+                // Undefined opcodes are NOPs on the 65C02, one byte and one cycle unless set below
+                if (op.name == "???") op = { "???", &cpu6502::XXX, &cpu6502::IMP, 1 };
+            }
+        }
+        if constexpr (P::bCMOS)
+        {
+            t[0x00].operate = &cpu6502::BRKC;
+            t[0x6C] = { "JMP", &cpu6502::JMP, &cpu6502::INDC, 6 };
+            t[0x80] = { "BRA", &cpu6502::BRA, &cpu6502::REL, 2 };
+            t[0x5A] = { "PHY", &cpu6502::PHY, &cpu6502::IMP, 3 };
+            t[0x7A] = { "PLY", &cpu6502::PLY, &cpu6502::IMP, 4 };
+            t[0xDA] = { "PHX", &cpu6502::PHX, &cpu6502::IMP, 3 };
+            t[0xFA] = { "PLX", &cpu6502::PLX, &cpu6502::IMP, 4 };
+            t[0x64] = { "STZ", &cpu6502::STZ, &cpu6502::ZP0, 3 };
+            t[0x74] = { "STZ", &cpu6502::STZ, &cpu6502::ZPX, 4 };
+            t[0x9C] = { "STZ", &cpu6502::STZ, &cpu6502::ABS, 4 };
+            t[0x9E] = { "STZ", &cpu6502::STZ, &cpu6502::ABX, 5 };
+            t[0x04] = { "TSB", &cpu6502::TSB, &cpu6502::ZP0, 5 };
+            t[0x0C] = { "TSB", &cpu6502::TSB, &cpu6502::ABS, 6 };
+            t[0x14] = { "TRB", &cpu6502::TRB, &cpu6502::ZP0, 5 };
+            t[0x1C] = { "TRB", &cpu6502::TRB, &cpu6502::ABS, 6 };
+            t[0x89] = { "BIT", &cpu6502::BITI, &cpu6502::IMM, 2 };
+            t[0x34] = { "BIT", &cpu6502::BIT, &cpu6502::ZPX, 4 };
+            t[0x3C] = { "BIT", &cpu6502::BIT, &cpu6502::ABX, 4 };
+            t[0x1A] = { "INC", &cpu6502::INA, &cpu6502::IMP, 2 };
+            t[0x3A] = { "DEC", &cpu6502::DEA, &cpu6502::IMP, 2 };
+            t[0x7C] = { "JMP", &cpu6502::JMP, &cpu6502::IAX, 6 };
+            t[0x12] = { "ORA", &cpu6502::ORA, &cpu6502::ZPI, 5 };
+            t[0x32] = { "AND", &cpu6502::AND, &cpu6502::ZPI, 5 };
+            t[0x52] = { "EOR", &cpu6502::EOR, &cpu6502::ZPI, 5 };
+            t[0x72] = { "ADC", &cpu6502::ADCD<true>, &cpu6502::ZPI, 5 };
+            t[0x92] = { "STA", &cpu6502::STA, &cpu6502::ZPI, 5 };
+            t[0xB2] = { "LDA", &cpu6502::LDA, &cpu6502::ZPI, 5 };
+            t[0xD2] = { "CMP", &cpu6502::CMP, &cpu6502::ZPI, 5 };
+            t[0xF2] = { "SBC", &cpu6502::SBCD<true>, &cpu6502::ZPI, 5 };
+
+            // Undefined opcodes that take operands, they are skipped over like the instructions they decode as
+            // http://www.6502.org/tutorials/65c02opcodes.html
+            for (uint8_t op : { 0x02, 0x22, 0x42, 0x62, 0x82, 0xC2, 0xE2 }) t[op] = { "???", &cpu6502::XXX, &cpu6502::IMM, 2 };
+            t[0x44] = { "???", &cpu6502::XXX, &cpu6502::ZP0, 3 };
+            for (uint8_t op : { 0x54, 0xD4, 0xF4 }) t[op] = { "???", &cpu6502::XXX, &cpu6502::ZPX, 4 };
+            t[0x5C] = { "???", &cpu6502::XXX, &cpu6502::ABS, 8 };
+            for (uint8_t op : { 0xDC, 0xFC }) t[op] = { "???", &cpu6502::XXX, &cpu6502::ABS, 4 };
+        }
+        return t;
+    }();
+    return table.data();
+}
 
 // Constructor
-cpu6502::cpu6502()
-{
-    // Instruction table
-    // https://www.princeton.edu/~mae412/HANDOUTS/Datasheets/6502.pdf (Page 22,23)
-    // https://web.archive.org/web/20221112231348if_/http://archive.6502.org/datasheets/rockwell_r650x_r651x.pdf (Page 10)
-    // { "Instruction", &cpu6502::Opcode, &cpu6502::AddressingMode, Cycles}
-    // "&cpu6502::Opcode" a pointer to the opcode in the CPU 6502 class.
-    lookup =
-    {
-		{ "BRK", &cpu6502::BRK, &cpu6502::IMM, 7 },{ "ORA", &cpu6502::ORA, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 3 },{ "ORA", &cpu6502::ORA, &cpu6502::ZP0, 3 },{ "ASL", &cpu6502::ASL, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PHP", &cpu6502::PHP, &cpu6502::IMP, 3 },{ "ORA", &cpu6502::ORA, &cpu6502::IMM, 2 },{ "ASL", &cpu6502::ASL, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ORA", &cpu6502::ORA, &cpu6502::ABS, 4 },{ "ASL", &cpu6502::ASL, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
-		{ "BPL", &cpu6502::BPL, &cpu6502::REL, 2 },{ "ORA", &cpu6502::ORA, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ORA", &cpu6502::ORA, &cpu6502::ZPX, 4 },{ "ASL", &cpu6502::ASL, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "CLC", &cpu6502::CLC, &cpu6502::IMP, 2 },{ "ORA", &cpu6502::ORA, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ORA", &cpu6502::ORA, &cpu6502::ABX, 4 },{ "ASL", &cpu6502::ASL, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
-		{ "JSR", &cpu6502::JSR, &cpu6502::ABS, 6 },{ "AND", &cpu6502::AND, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "BIT", &cpu6502::BIT, &cpu6502::ZP0, 3 },{ "AND", &cpu6502::AND, &cpu6502::ZP0, 3 },{ "ROL", &cpu6502::ROL, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PLP", &cpu6502::PLP, &cpu6502::IMP, 4 },{ "AND", &cpu6502::AND, &cpu6502::IMM, 2 },{ "ROL", &cpu6502::ROL, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "BIT", &cpu6502::BIT, &cpu6502::ABS, 4 },{ "AND", &cpu6502::AND, &cpu6502::ABS, 4 },{ "ROL", &cpu6502::ROL, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
-		{ "BMI", &cpu6502::BMI, &cpu6502::REL, 2 },{ "AND", &cpu6502::AND, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "AND", &cpu6502::AND, &cpu6502::ZPX, 4 },{ "ROL", &cpu6502::ROL, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "SEC", &cpu6502::SEC, &cpu6502::IMP, 2 },{ "AND", &cpu6502::AND, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "AND", &cpu6502::AND, &cpu6502::ABX, 4 },{ "ROL", &cpu6502::ROL, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
-		{ "RTI", &cpu6502::RTI, &cpu6502::IMP, 6 },{ "EOR", &cpu6502::EOR, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 3 },{ "EOR", &cpu6502::EOR, &cpu6502::ZP0, 3 },{ "LSR", &cpu6502::LSR, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PHA", &cpu6502::PHA, &cpu6502::IMP, 3 },{ "EOR", &cpu6502::EOR, &cpu6502::IMM, 2 },{ "LSR", &cpu6502::LSR, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "JMP", &cpu6502::JMP, &cpu6502::ABS, 3 },{ "EOR", &cpu6502::EOR, &cpu6502::ABS, 4 },{ "LSR", &cpu6502::LSR, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
-		{ "BVC", &cpu6502::BVC, &cpu6502::REL, 2 },{ "EOR", &cpu6502::EOR, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "EOR", &cpu6502::EOR, &cpu6502::ZPX, 4 },{ "LSR", &cpu6502::LSR, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "CLI", &cpu6502::CLI, &cpu6502::IMP, 2 },{ "EOR", &cpu6502::EOR, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "EOR", &cpu6502::EOR, &cpu6502::ABX, 4 },{ "LSR", &cpu6502::LSR, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
-		{ "RTS", &cpu6502::RTS, &cpu6502::IMP, 6 },{ "ADC", &cpu6502::ADC, &cpu6502::IZX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 3 },{ "ADC", &cpu6502::ADC, &cpu6502::ZP0, 3 },{ "ROR", &cpu6502::ROR, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "PLA", &cpu6502::PLA, &cpu6502::IMP, 4 },{ "ADC", &cpu6502::ADC, &cpu6502::IMM, 2 },{ "ROR", &cpu6502::ROR, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "JMP", &cpu6502::JMP, &cpu6502::IND, 5 },{ "ADC", &cpu6502::ADC, &cpu6502::ABS, 4 },{ "ROR", &cpu6502::ROR, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
-		{ "BVS", &cpu6502::BVS, &cpu6502::REL, 2 },{ "ADC", &cpu6502::ADC, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ADC", &cpu6502::ADC, &cpu6502::ZPX, 4 },{ "ROR", &cpu6502::ROR, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "SEI", &cpu6502::SEI, &cpu6502::IMP, 2 },{ "ADC", &cpu6502::ADC, &cpu6502::ABY, 4 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "ADC", &cpu6502::ADC, &cpu6502::ABX, 4 },{ "ROR", &cpu6502::ROR, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
-		{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "STA", &cpu6502::STA, &cpu6502::IZX, 6 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "STY", &cpu6502::STY, &cpu6502::ZP0, 3 },{ "STA", &cpu6502::STA, &cpu6502::ZP0, 3 },{ "STX", &cpu6502::STX, &cpu6502::ZP0, 3 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 3 },{ "DEY", &cpu6502::DEY, &cpu6502::IMP, 2 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "TXA", &cpu6502::TXA, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "STY", &cpu6502::STY, &cpu6502::ABS, 4 },{ "STA", &cpu6502::STA, &cpu6502::ABS, 4 },{ "STX", &cpu6502::STX, &cpu6502::ABS, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },
-		{ "BCC", &cpu6502::BCC, &cpu6502::REL, 2 },{ "STA", &cpu6502::STA, &cpu6502::IZY, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "STY", &cpu6502::STY, &cpu6502::ZPX, 4 },{ "STA", &cpu6502::STA, &cpu6502::ZPX, 4 },{ "STX", &cpu6502::STX, &cpu6502::ZPY, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },{ "TYA", &cpu6502::TYA, &cpu6502::IMP, 2 },{ "STA", &cpu6502::STA, &cpu6502::ABY, 5 },{ "TXS", &cpu6502::TXS, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 5 },{ "STA", &cpu6502::STA, &cpu6502::ABX, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },
-		{ "LDY", &cpu6502::LDY, &cpu6502::IMM, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::IZX, 6 },{ "LDX", &cpu6502::LDX, &cpu6502::IMM, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "LDY", &cpu6502::LDY, &cpu6502::ZP0, 3 },{ "LDA", &cpu6502::LDA, &cpu6502::ZP0, 3 },{ "LDX", &cpu6502::LDX, &cpu6502::ZP0, 3 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 3 },{ "TAY", &cpu6502::TAY, &cpu6502::IMP, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::IMM, 2 },{ "TAX", &cpu6502::TAX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "LDY", &cpu6502::LDY, &cpu6502::ABS, 4 },{ "LDA", &cpu6502::LDA, &cpu6502::ABS, 4 },{ "LDX", &cpu6502::LDX, &cpu6502::ABS, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },
-		{ "BCS", &cpu6502::BCS, &cpu6502::REL, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "LDY", &cpu6502::LDY, &cpu6502::ZPX, 4 },{ "LDA", &cpu6502::LDA, &cpu6502::ZPX, 4 },{ "LDX", &cpu6502::LDX, &cpu6502::ZPY, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },{ "CLV", &cpu6502::CLV, &cpu6502::IMP, 2 },{ "LDA", &cpu6502::LDA, &cpu6502::ABY, 4 },{ "TSX", &cpu6502::TSX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },{ "LDY", &cpu6502::LDY, &cpu6502::ABX, 4 },{ "LDA", &cpu6502::LDA, &cpu6502::ABX, 4 },{ "LDX", &cpu6502::LDX, &cpu6502::ABY, 4 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 4 },
-		{ "CPY", &cpu6502::CPY, &cpu6502::IMM, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::IZX, 6 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "CPY", &cpu6502::CPY, &cpu6502::ZP0, 3 },{ "CMP", &cpu6502::CMP, &cpu6502::ZP0, 3 },{ "DEC", &cpu6502::DEC, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "INY", &cpu6502::INY, &cpu6502::IMP, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::IMM, 2 },{ "DEX", &cpu6502::DEX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "CPY", &cpu6502::CPY, &cpu6502::ABS, 4 },{ "CMP", &cpu6502::CMP, &cpu6502::ABS, 4 },{ "DEC", &cpu6502::DEC, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
-		{ "BNE", &cpu6502::BNE, &cpu6502::REL, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "CMP", &cpu6502::CMP, &cpu6502::ZPX, 4 },{ "DEC", &cpu6502::DEC, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "CLD", &cpu6502::CLD, &cpu6502::IMP, 2 },{ "CMP", &cpu6502::CMP, &cpu6502::ABY, 4 },{ "NOP", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "CMP", &cpu6502::CMP, &cpu6502::ABX, 4 },{ "DEC", &cpu6502::DEC, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
-		{ "CPX", &cpu6502::CPX, &cpu6502::IMM, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::IZX, 6 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "CPX", &cpu6502::CPX, &cpu6502::ZP0, 3 },{ "SBC", &cpu6502::SBC, &cpu6502::ZP0, 3 },{ "INC", &cpu6502::INC, &cpu6502::ZP0, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 5 },{ "INX", &cpu6502::INX, &cpu6502::IMP, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::IMM, 2 },{ "NOP", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::SBC, &cpu6502::IMP, 2 },{ "CPX", &cpu6502::CPX, &cpu6502::ABS, 4 },{ "SBC", &cpu6502::SBC, &cpu6502::ABS, 4 },{ "INC", &cpu6502::INC, &cpu6502::ABS, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },
-		{ "BEQ", &cpu6502::BEQ, &cpu6502::REL, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::IZY, 5 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 8 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "SBC", &cpu6502::SBC, &cpu6502::ZPX, 4 },{ "INC", &cpu6502::INC, &cpu6502::ZPX, 6 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 6 },{ "SED", &cpu6502::SED, &cpu6502::IMP, 2 },{ "SBC", &cpu6502::SBC, &cpu6502::ABY, 4 },{ "NOP", &cpu6502::NOP, &cpu6502::IMP, 2 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },{ "???", &cpu6502::NOP, &cpu6502::IMP, 4 },{ "SBC", &cpu6502::SBC, &cpu6502::ABX, 4 },{ "INC", &cpu6502::INC, &cpu6502::ABX, 7 },{ "???", &cpu6502::XXX, &cpu6502::IMP, 7 },
-	};
+cpu6502::cpu6502(VARIANT v) : variant(v)
+{
+    switch (v)
+    {
+        case VARIANT_NMOS:
+            lookup = Lookup<PolicyNMOS>();
+            break;
+        case VARIANT_65C02:
+            lookup = Lookup<Policy65C02>();
+            break;
+        default:
+            lookup = Lookup<Policy2A03>();
+            break;
+    }
 }
 
 // Destructor
@@ -37,48 +123,206 @@ cpu6502::~cpu6502()
     
 }
 
-// Read function to CPU 6502 that returns 8-bit data, takes a 16-bit address.
-uint8_t cpu6502::read(uint16_t addr)
+// Addressing mode of an opcode, found by comparing the function pointer in the lookup table.
+cpu6502::ADDRMODE cpu6502::GetAddrMode(uint8_t op) const
+{
+    return GetAddrMode(lookup[op].addrmode);
+}
+
+cpu6502::ADDRMODE cpu6502::GetAddrMode(uint8_t(cpu6502::*mode)(void))
+{
+    if (mode == &cpu6502::IMM) return AM_IMM;
+    if (mode == &cpu6502::ZP0) return AM_ZP0;
+    if (mode == &cpu6502::ZPX) return AM_ZPX;
+    if (mode == &cpu6502::ZPY) return AM_ZPY;
+    if (mode == &cpu6502::REL) return AM_REL;
+    if (mode == &cpu6502::ABS) return AM_ABS;
+    if (mode == &cpu6502::ABX) return AM_ABX;
+    if (mode == &cpu6502::ABY) return AM_ABY;
+    if (mode == &cpu6502::IND || mode == &cpu6502::INDC) return AM_IND;
+    if (mode == &cpu6502::IZX) return AM_IZX;
+    if (mode == &cpu6502::IZY) return AM_IZY;
+    if (mode == &cpu6502::ZPI) return AM_ZPI;
+    if (mode == &cpu6502::IAX) return AM_IAX;
+    return AM_IMP;
+}
+
+// Name of an opcode, "???" for illegal opcodes.
+const std::string &cpu6502::GetName(uint8_t op) const
+{
+    return lookup[op].name;
+}
+
+// Legal opcodes are the ones with a name in the lookup table.
+bool cpu6502::IsLegal(uint8_t op) const
+{
+    return lookup[op].name != "???";
+}
+
+// Instruction length for an addressing mode.
+uint8_t cpu6502::GetLength(ADDRMODE mode)
+{
+    switch (mode)
+    {
+        case AM_IMP:
+            return 1;
+        case AM_ABS:
+        case AM_ABX:
+        case AM_ABY:
+        case AM_IND:
+        case AM_IAX:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+// Read through the bus, everything but the zero page and stack fast paths
+uint8_t cpu6502::busRead(uint16_t addr)
 {
     return bus->read(addr, false);
 }
 
-// Write function to CPU 6502 that does not return anything, takes a 16-bit address and 8-bit data.
-void cpu6502::write(uint16_t addr, uint8_t data)
+// Write through the bus
+void cpu6502::busWrite(uint16_t addr, uint8_t data)
 {
     bus->write(addr, data);
 }
 
-// TO DO:
-// Implement set flag function and get flag function
+// Write hooks on a direct page, the flag is only set while hooks are attached
+void cpu6502::hookWrite(uint16_t addr, uint8_t data)
+{
+#ifndef NES_NO_DEBUGGER
+    bus->hooks->OnWrite(addr, data);
+#else
+    (void)addr;
+    (void)data;
+#endif
+}
+
+// Get flag function that returns 1 if the flag is set in the status register, 0 otherwise.
+uint8_t cpu6502::GetFlag(FLAGS6502 f)
+{
+    return ((status & f) > 0) ? 1 : 0;
+}
+
+// Set flag function that sets or clears a flag in the status register.
+void cpu6502::SetFlag(FLAGS6502 f, bool v)
+{
+    if (v)
+    {
+        status |= f;
+    }
+    else
+    {
+        status &= ~f;
+    }
+}
 
 // Clock function to CPU 6502 that does not return anything.
 void cpu6502::clock()
 {
+    // Cycle accurate tier
+    if (accuracy == ACCURACY_CYCLE)
+    {
+        clockCycle();
+        return;
+    }
+
     // Only excute if cycles is 0
     if (cycles == 0)
     {
-        // Set unused flag bit to 1
-        SetFlag(U, true);
+        // Halted by the debugger, do not count the cycle
+        if (!begin()) return;
+    }
 
-        // Get the opcode and increment the program counter
-        opcode = read(pc);
-        pc++;
+    cycles--;
+    clock_count++;
+}
 
-        // Get required cycles for instruction
-        cycles = lookup[opcode].cycles;
+// Step function that runs whole instructions without a call per cycle.
+uint32_t cpu6502::step()
+{
+    // Cycle accurate tier, clock micro-ops until the next boundary
+    if (accuracy == ACCURACY_CYCLE)
+    {
+        uint64_t start = clock_count;
+        while (mstep != mcount || cycles > 0) clockCycle();
 
-        // Get cycles for the addressing mode
-        uint8_t additional_cycle1 = (this->*lookup[opcode].addrmode)();
+        // Stop if the debugger halts on the next instruction
+        uint64_t before = clock_count;
+        clockCycle();
+        if (clock_count != before)
+        {
+            while (mstep != mcount || cycles > 0) clockCycle();
+        }
+        return (uint32_t)(clock_count - start);
+    }
 
-        // Get cycles for the operation and perform the operation
-        uint8_t additional_cycle2 = (this->*lookup[opcode].operate)();
+    // Finish the instruction in progress
+    uint32_t total = cycles;
+    clock_count += cycles;
+    cycles = 0;
 
-        // Add the cycles
-        cycles += (additional_cycle1 & additional_cycle2);
+    // Run the next one
+    if (begin())
+    {
+        total += cycles;
+        clock_count += cycles;
+        cycles = 0;
     }
+    return total;
+}
 
-    cycles--;
+// Begin the next instruction at an instruction boundary.
+bool cpu6502::begin()
+{
+#ifndef NES_NO_PROFILER
+    // Sampling, a single pointer test unless a profiler is attached
+    if (bus->profiler != nullptr) bus->profiler->OnBoundary(pc, clock_count);
+#endif
+
+    // Interrupt lines, a single branch that is not taken unless a device asserts a line
+    if (nmiPending | (irqLines != 0))
+    {
+        uint16_t vector = poll();
+        if (vector != 0)
+        {
+            interrupt(vector);
+            return true;
+        }
+    }
+
+#ifndef NES_NO_DEBUGGER
+    // Breakpoints and hooks, a single page flag load unless the page is watched or hooked
+    uint8_t watch = bus->pageWatch[pc >> 8];
+    if (watch != 0)
+    {
+        // Halted, do not execute until Debugger::Continue()
+        if ((watch & Debugger::WATCH_EXEC) && bus->debugger->OnExecute(pc)) return false;
+        if (watch & Hooks::HOOK_EXEC) bus->hooks->OnExecute(pc);
+    }
+#endif
+
+    // Set unused flag bit to 1
+    SetFlag(U, true);
+
+    // Get the opcode and increment the program counter
+    opcode = read(pc);
+    pc++;
+
+    // Get required cycles for instruction
+    cycles = lookup[opcode].cycles;
+
+    // Get cycles for the addressing mode
+    uint8_t additional_cycle1 = (this->*lookup[opcode].addrmode)();
+
+    // Get cycles for the operation and perform the operation
+    uint8_t additional_cycle2 = (this->*lookup[opcode].operate)();
+
+    // Add the cycles
+    cycles += (additional_cycle1 & additional_cycle2);
+    return true;
 }
 
 // Reset function to CPU 6502 that does not return anything.
@@ -104,64 +348,155 @@ void cpu6502::reset()
     addr_abs = 0x0000;
     fetched = 0x00;
 
+    // Abandon a micro-op sequence in progress
+    mstep = 0;
+    mcount = 0;
+
+    // Drop latched interrupts, device lines stay as they are
+    nmiPending = false;
+    irqLines &= ~IRQ_EXTERNAL;
+    iDelayCycle = ~0ULL;
+
     // Set cycles required for reset
     cycles = 8;
 }
 
 // Interrupt Request
+// Asserts the external IRQ source, the interrupt is taken at the next instruction boundary where I is clear
 void cpu6502::irq()
 {
-    // If the interrupt flag is set
-    if (GetFlag(I) == 0)
-    {
-        // Push the program counter to the stack
-        write(0x0100 + stkp, (pc >> 8) & 0x00FF);
-        stkp--;
-        write(0x0100 + stkp, pc & 0x00FF);
-        stkp--;
-
-        // Push the status register to the stack
-        SetFlag(B, 0);
-        SetFlag(U, 1);
-        SetFlag(I, 1);
-        write(0x0100 + stkp, status);
-        stkp--;
-
-        // Get the address to jump to
-        addr_abs = 0xFFFE;
-        uint16_t lo = read(addr_abs + 0);
-        uint16_t hi = read(addr_abs + 1);
-        pc = (hi << 8) | lo;
-
-        // Set cycles required for interrupt
-        cycles = 7;
-    }
+    SetIRQ(IRQ_EXTERNAL, true);
 }
 
 // Non-Maskable Interrupt Request
+// Latches an NMI edge, the interrupt is taken at the next instruction boundary
 void cpu6502::nmi()
+{
+    nmiPending = true;
+    nmiCycle = clock_count;
+}
+
+// Set the level of the NMI line, only a rising edge latches an NMI, on the cycle it happened
+void cpu6502::SetNMI(bool bAsserted, uint64_t cycle)
+{
+    if (bAsserted && !nmiLine)
+    {
+        nmiPending = true;
+        nmiCycle = cycle;
+    }
+    nmiLine = bAsserted;
+}
+
+// Assert or release one IRQ source
+void cpu6502::SetIRQ(uint8_t source, bool bAsserted)
+{
+    uint8_t old = irqLines;
+    if (bAsserted)
+    {
+        irqLines |= source;
+    }
+    else
+    {
+        irqLines &= ~source;
+    }
+
+    // Remember when the line went active
+    if (old == 0 && irqLines != 0)
+    {
+        irqCycle = clock_count;
+    }
+}
+
+// Cycle count of the next instruction boundary, used by effects that start after the current instruction
+uint64_t cpu6502::boundary() const
+{
+    if (accuracy == ACCURACY_CYCLE)
+    {
+        // Called from a micro-op, so the current cycle has not been counted yet
+        return clock_count + 1 + (mcount - mstep) + cycles;
+    }
+    return clock_count + cycles;
+}
+
+// Switch accuracy tier
+bool cpu6502::SetAccuracy(ACCURACY a)
+{
+    if (variant == VARIANT_65C02) return a == ACCURACY_INSTRUCTION;
+
+    // Finish a micro-op sequence in progress, the instruction tier cannot resume one
+    while (accuracy == ACCURACY_CYCLE && mstep != mcount)
+    {
+        clockCycle();
+    }
+    accuracy = a;
+    return true;
+}
+
+// Stall the CPU for a DMA, the cycles are added to the instruction in progress as one credit
+void cpu6502::stall(uint16_t n, bool bAlign)
+{
+    // The DMA starts on the cycle after the current instruction
+    if (bAlign && (boundary() & 1))
+    {
+        n++;
+    }
+    cycles += n;
+}
+
+// Poll the interrupt lines at an instruction boundary, returns the vector to take or 0
+uint16_t cpu6502::poll()
+{
+    // The hardware polls before the last cycle of an instruction,
+    // so a line asserted on that last cycle waits until after the next instruction
+    if (nmiPending && nmiCycle + 1 < clock_count)
+    {
+        nmiPending = false;
+        return 0xFFFA;
+    }
+
+    if (irqLines != 0 && irqCycle + 1 < clock_count)
+    {
+        // CLI, SEI and PLP change I after the poll, so the boundary right after them uses the old value
+        uint8_t masked = (clock_count == iDelayCycle) ? iDelayOld : GetFlag(I);
+        if (masked == 0)
+        {
+            irqLines &= ~IRQ_EXTERNAL;
+            return 0xFFFE;
+        }
+    }
+    return 0;
+}
+
+// Interrupt sequence shared by IRQ and NMI
+void cpu6502::interrupt(uint16_t vector)
 {
     // Push the program counter to the stack
-    write(0x0100 + stkp, (pc >> 8) & 0x00FF);
+    writeStack((pc >> 8) & 0x00FF);
     stkp--;
-    write(0x0100 + stkp, pc & 0x00FF);
+    writeStack(pc & 0x00FF);
     stkp--;
 
-    // Push the status register to the stack
+    // Push the status register to the stack, I is set after the push so RTI restores the old mask
     SetFlag(B, 0);
     SetFlag(U, 1);
-    SetFlag(I, 1);
-    write(0x0100 + stkp, status);
+    writeStack(status);
     stkp--;
+    SetFlag(I, 1);
+    if (variant == VARIANT_65C02) SetFlag(D, 0); // The 65C02 also leaves decimal mode
 
     // Get the address to jump to
-    addr_abs = 0xFFFA;
+    addr_abs = vector;
     uint16_t lo = read(addr_abs + 0);
     uint16_t hi = read(addr_abs + 1);
     pc = (hi << 8) | lo;
+    edge();
 
-    // Set cycles required for non-maskable interrupt
-    cycles = 8;
+#ifndef NES_NO_PROFILER
+    if (bus->profiler != nullptr) bus->profiler->OnCall(pc, stkp + 3, vector == 0xFFFA ? Profiler::FRAME_NMI : Profiler::FRAME_IRQ);
+#endif
+
+    // Set cycles required for the interrupt sequence
+    cycles = 7;
 }
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -298,6 +633,20 @@ uint8_t cpu6502::IND()
     return 0;
 }
 
+// Indirect on the 65C02, the page wrap bug is fixed at the cost of one cycle (in the table)
+uint8_t cpu6502::INDC()
+{
+    uint16_t ptr_lo = read(pc); // Get low byte of pointer
+    pc++;
+    uint16_t ptr_hi = read(pc); // Get high byte of pointer
+    pc++;
+
+    uint16_t ptr = (ptr_hi << 8) | ptr_lo;
+    addr_abs = (read(ptr + 1) << 8) | read(ptr + 0); // High byte always from the next address
+
+    return 0;
+}
+
 // Indirect X
 uint8_t cpu6502::IZX()
 {
@@ -334,6 +683,34 @@ uint8_t cpu6502::IZY()
     }
 }
 
+// Zero page indirect on the 65C02, the pointer is read like Indirect X without the index
+uint8_t cpu6502::ZPI()
+{
+    uint16_t t = read(pc);
+    pc++;
+
+    uint16_t lo = read(t & 0x00FF);
+    uint16_t hi = read((t + 1) & 0x00FF);
+
+    addr_abs = (hi << 8) | lo;
+
+    return 0;
+}
+
+// Indexed absolute indirect on the 65C02, JMP (abs,X)
+uint8_t cpu6502::IAX()
+{
+    uint16_t ptr_lo = read(pc); // Get low byte of pointer
+    pc++;
+    uint16_t ptr_hi = read(pc); // Get high byte of pointer
+    pc++;
+
+    uint16_t ptr = ((ptr_hi << 8) | ptr_lo) + x;
+    addr_abs = (read(ptr + 1) << 8) | read(ptr + 0);
+
+    return 0;
+}
+
 // Relative
 // Used for branching instructions with addresses -128 to +127 bytes away from the program counter
 uint8_t cpu6502::REL()
@@ -371,6 +748,8 @@ uint8_t cpu6502::ADC()
     SetFlag(V, (~(uint16_t)a ^ (uint16_t)fetched) & ((uint16_t)a ^ (uint16_t)temp) & 0x0080); // Set overflow flag
     SetFlag(Z, (temp & 0x00FF) == 0); // Set zero flag
     SetFlag(C, temp > 255); // Set carry flag
+    a = temp & 0x00FF; // Set accumulator to temp
+    return 1; // Return 1 cycle
 }
 
 // "AND" Memory with Accumulator
@@ -417,6 +796,7 @@ uint8_t cpu6502::BCC()
         }
 
         pc = addr_abs;
+        edge();
     }
     return 0;
 }
@@ -435,6 +815,7 @@ uint8_t cpu6502::BCS()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
@@ -453,6 +834,7 @@ uint8_t cpu6502::BEQ()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
@@ -468,6 +850,14 @@ uint8_t cpu6502::BIT()
     SetFlag(V, fetched & (1 << 6)); // Set overflow flag
     SetFlag(Z, (temp & 0x00FF) == 0x00); // Set zero flag
 
+    return 1; // Page crossing cycle of the 65C02's BIT abs,X, the NMOS modes are not indexed
+}
+
+// Test Bits in Memory with Accumulator, immediate (65C02)
+uint8_t cpu6502::BITI()
+{
+    fetch(); // Fetch data
+    SetFlag(Z, (a & fetched) == 0x00); // Set zero flag, N and V are left alone
     return 0; // Return 0 cycles
 }
 
@@ -485,6 +875,7 @@ uint8_t cpu6502::BMI()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
@@ -503,6 +894,7 @@ uint8_t cpu6502::BNE()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
@@ -521,37 +913,47 @@ uint8_t cpu6502::BPL()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
 
-/* BRA - Branch Always (Not Implemented)
+// Branch Always (65C02)
 uint8_t cpu6502::BRA()
 {
+    cycles++;
     addr_abs = pc + addr_rel; // Set the address to the program counter plus offset
+
+    if ((addr_abs & 0xFF00) != (pc & 0xFF00)) // If you have to cross a page boundary, add an extra cycle
+    {
+        cycles++;
+    }
+
     pc = addr_abs; // Set the program counter to the address
+    edge();
     return 0; // Return 0 cycles
 }
-*/
-
 // Force Break
 uint8_t cpu6502::BRK()
 {
-    pc++; // Increment the program counter
-    SetFlag(I, true); // Set interrupt flag
-    write(0x0100 + stkp, (pc >> 8) & 0x00FF); // Write the program counter to the stack
+    // IMM already stepped over the padding byte, so PC is the return address
+    writeStack((pc >> 8) & 0x00FF); // Write the program counter to the stack
     stkp--; // Decrement the stack pointer
-    write(0x0100 + stkp, pc & 0x00FF); // Write the program counter to the stack
+    writeStack(pc & 0x00FF); // Write the program counter to the stack
     stkp--; // Decrement the stack pointer
 
     SetFlag(B, true); // Set break flag
-    write(0x0100 + stkp, status); // Write the status register to the stack
+    writeStack(status); // Write the status register to the stack
     stkp--; // Decrement the stack pointer
     SetFlag(B, false); // Clear break flag
     SetFlag(U, true); // Set unused flag
     SetFlag(I, true); // Set interrupt flag
 
     pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8); // Set the program counter to the interrupt vector
+    edge();
+#ifndef NES_NO_PROFILER
+    if (bus->profiler != nullptr) bus->profiler->OnCall(pc, stkp + 3, Profiler::FRAME_BRK);
+#endif
     return 0; // Return 0 cycles
 }
 
@@ -569,6 +971,7 @@ uint8_t cpu6502::BVC()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
@@ -587,6 +990,7 @@ uint8_t cpu6502::BVS()
         }
 
         pc = addr_abs; // Set the program counter to the address
+        edge();
     }
     return 0;
 }
@@ -608,6 +1012,8 @@ uint8_t cpu6502::CLD()
 // Clear Interrupt Disable Bit
 uint8_t cpu6502::CLI()
 {
+    iDelayOld = GetFlag(I); // The next poll still sees the old flag
+    iDelayCycle = boundary();
     SetFlag(I, false); // Clear interrupt flag
     return 0; // Return 0 cycles
 }
@@ -652,7 +1058,16 @@ uint8_t cpu6502::CPY()
     return 0; // Return 0 cycles
 }
 
-// Decrement by One
+// Decrement Accumulator by One (65C02)
+uint8_t cpu6502::DEA()
+{
+    a--; // Decrement by 1
+    SetFlag(N, a & 0x80); // Set negative flag
+    SetFlag(Z, a == 0x00); // Set zero flag
+    return 0; // Return 0 cycles
+}
+
+// Decrement Memory by One
 uint8_t cpu6502::DEC()
 {
     fetch(); // Fetch data
@@ -691,6 +1106,15 @@ uint8_t cpu6502::EOR()
     return 1; // Return 1 cycle
 }
 
+// Increment Accumulator by One (65C02)
+uint8_t cpu6502::INA()
+{
+    a++; // Increment by 1
+    SetFlag(N, a & 0x80); // Set negative flag
+    SetFlag(Z, a == 0x00); // Set zero flag
+    return 0; // Return 0 cycles
+}
+
 // Increment Memory by One
 uint8_t cpu6502::INC()
 {
@@ -724,6 +1148,7 @@ uint8_t cpu6502::INY()
 uint8_t cpu6502::JMP()
 {
     pc = addr_abs; // Set the program counter to the address
+    edge();
     return 0; // Return 0 cycles
 }
 
@@ -731,12 +1156,16 @@ uint8_t cpu6502::JMP()
 uint8_t cpu6502::JSR()
 {
     pc--; // Decrement the program counter
-    write(0x0100 + stkp, (pc >> 8) & 0x00FF); // Write the program counter to the stack
+    writeStack((pc >> 8) & 0x00FF); // Write the program counter to the stack
     stkp--; // Decrement the stack pointer
-    write(0x0100 + stkp, pc & 0x00FF); // Write the program counter to the stack
+    writeStack(pc & 0x00FF); // Write the program counter to the stack
     stkp--; // Decrement the stack pointer
 
     pc = addr_abs; // Set the program counter to the address
+    edge();
+#ifndef NES_NO_PROFILER
+    if (bus->profiler != nullptr) bus->profiler->OnCall(pc, stkp + 2, Profiler::FRAME_JSR);
+#endif
     return 0; // Return 0 cycles
 }
 
@@ -820,7 +1249,7 @@ uint8_t cpu6502::ORA()
 // Push Accumulator on Stack
 uint8_t cpu6502::PHA()
 {
-    write(0x0100 + stkp, a); // Write accumulator to the stack
+    writeStack(a); // Write accumulator to the stack
     stkp--; // Decrement the stack pointer
     return 0; // Return 0 cycles
 }
@@ -828,37 +1257,33 @@ uint8_t cpu6502::PHA()
 // Push Processor Status on Stack
 uint8_t cpu6502::PHP()
 {
-    write(0x0100 + stkp, status | B | U); // Write the status register to the stack
+    writeStack(status | B | U); // Write the status register to the stack
     SetFlag(B, false); // Clear break flag
     SetFlag(U, true); // Set unused flag
     stkp--; // Decrement the stack pointer
     return 0; // Return 0 cycles
 }
 
-/* PHX - Push Index X on Stack (Not Implemented)
+// Push Index X on Stack (65C02)
 uint8_t cpu6502::PHX()
 {
-    write(0x0100 + stkp, x); // Write index X to the stack
+    writeStack(x); // Write index X to the stack
     stkp--; // Decrement the stack pointer
     return 0; // Return 0 cycles
 }
-*/
-
 
-/* PHY - Push Index Y on Stack (Not Implemented)
+// Push Index Y on Stack (65C02)
 uint8_t cpu6502::PHY()
 {
-    write(0x0100 + stkp, y); // Write index Y to the stack
+    writeStack(y); // Write index Y to the stack
     stkp--; // Decrement the stack pointer
     return 0; // Return 0 cycles
 }
-*/
-
 // Pull Accumulator from Stack
 uint8_t cpu6502::PLA()
 {
     stkp++; // Increment the stack pointer
-    a = read(0x0100 + stkp); // Read the accumulator from the stack
+    a = readStack(); // Read the accumulator from the stack
     SetFlag(N, a & 0x80); // Set negative flag
     SetFlag(Z, a == 0x00); // Set zero flag
     return 0; // Return 0 cycles
@@ -867,34 +1292,32 @@ uint8_t cpu6502::PLA()
 // Pull Processor Status from Stack
 uint8_t cpu6502::PLP()
 {
+    iDelayOld = GetFlag(I); // The next poll still sees the old flag
+    iDelayCycle = boundary();
     stkp++; // Increment the stack pointer
-    status = read(0x0100 + stkp); // Read the status register from the stack
+    status = readStack(); // Read the status register from the stack
     SetFlag(U, true); // Set unused flag
     return 0; // Return 0 cycles
 }
 
-/* PLX - Pull Index X from Stack (Not Implemented)
+// Pull Index X from Stack (65C02)
 uint8_t cpu6502::PLX()
 {
     stkp++; // Increment the stack pointer
-    x = read(0x0100 + stkp); // Read index X from the stack
+    x = readStack(); // Read index X from the stack
     SetFlag(N, x & 0x80); // Set negative flag
     SetFlag(Z, x == 0x00); // Set zero flag
     return 0; // Return 0 cycles
 }
-*/
-
-/* PLY - Pull Index Y from Stack (Not Implemented)
+// Pull Index Y from Stack (65C02)
 uint8_t cpu6502::PLY()
 {
     stkp++; // Increment the stack pointer
-    y = read(0x0100 + stkp); // Read index Y from the stack
+    y = readStack(); // Read index Y from the stack
     SetFlag(N, y & 0x80); // Set negative flag
     SetFlag(Z, y == 0x00); // Set zero flag
     return 0; // Return 0 cycles
 }
-*/
-
 // Rotate One Bit Left
 uint8_t cpu6502::ROL()
 {
@@ -939,14 +1362,18 @@ uint8_t cpu6502::ROR()
 uint8_t cpu6502::RTI()
 {
     stkp++; // Increment the stack pointer
-    status = read(0x0100 + stkp); // Read the status register from the stack
+    status = readStack(); // Read the status register from the stack
     status &= ~B; // Clear break flag
     status &= ~U; // Clear unused flag
 
     stkp++; // Increment the stack pointer
-    pc = (uint16_t)read(0x0100 + stkp); // Read the program counter from the stack
+    pc = (uint16_t)readStack(); // Read the program counter from the stack
     stkp++; // Increment the stack pointer
-    pc |= (uint16_t)read(0x0100 + stkp) << 8; // Read the program counter from the stack
+    pc |= (uint16_t)readStack() << 8; // Read the program counter from the stack
+    edge();
+#ifndef NES_NO_PROFILER
+    if (bus->profiler != nullptr) bus->profiler->OnReturn(stkp);
+#endif
     return 0; // Return 0 cycles
 }
 
@@ -954,10 +1381,14 @@ uint8_t cpu6502::RTI()
 uint8_t cpu6502::RTS()
 {
     stkp++; // Increment the stack pointer
-    pc = (uint16_t)read(0x0100 + stkp); // Read the program counter from the stack
+    pc = (uint16_t)readStack(); // Read the program counter from the stack
     stkp++; // Increment the stack pointer
-    pc |= (uint16_t)read(0x0100 + stkp) << 8; // Read the program counter from the stack
+    pc |= (uint16_t)readStack() << 8; // Read the program counter from the stack
     pc++; // Increment the program counter
+    edge();
+#ifndef NES_NO_PROFILER
+    if (bus->profiler != nullptr) bus->profiler->OnReturn(stkp);
+#endif
     return 0; // Return 0 cycles
 }
 
@@ -972,7 +1403,7 @@ uint8_t cpu6502::SBC()
     SetFlag(N, temp & 0x80); // Set negative flag
     SetFlag(V, (~(uint16_t)a ^ value) & ((uint16_t)a ^ temp) & 0x0080); // Set overflow flag
     SetFlag(Z, (temp & 0x00FF) == 0); // Set zero flag
-    SetFlag(C, temp & 0x8000); // Set carry flag
+    SetFlag(C, temp & 0xFF00); // Set carry flag
 
     a = temp & 0x00FF; // Set accumulator to temp
     return 1; // Return 1 cycle
@@ -995,6 +1426,8 @@ uint8_t cpu6502::SED()
 // Set Interrupt Disable Bit
 uint8_t cpu6502::SEI()
 {
+    iDelayOld = GetFlag(I); // The next poll still sees the old flag
+    iDelayCycle = boundary();
     SetFlag(I, true); // Set interrupt flag
     return 0; // Return 0 cycles
 }
@@ -1020,14 +1453,12 @@ uint8_t cpu6502::STY()
     return 0; // Return 0 cycles
 }
 
-/* STZ - Store Zero in Memory (Not Implemented)
+// Store Zero in Memory (65C02)
 uint8_t cpu6502::STZ()
 {
     write(addr_abs, 0x00); // Write 0 to memory
     return 0; // Return 0 cycles
 }
-*/
-
 // Transfer Accumulator to Index X
 uint8_t cpu6502::TAX()
 {
@@ -1046,7 +1477,7 @@ uint8_t cpu6502::TAY()
     return 0; // Return 0 cycles
 }
 
-/* TRB - Test and Reset Memory Bits with Accumulator (Not Implemented)
+// Test and Reset Memory Bits with Accumulator (65C02)
 uint8_t cpu6502::TRB()
 {
     fetch(); // Fetch data
@@ -1055,9 +1486,7 @@ uint8_t cpu6502::TRB()
     write(addr_abs, fetched & ~a); // Write the bitwise NOT of the accumulator to memory
     return 0; // Return 0 cycles
 }
-*/
-
-/* TSB - Test and Set Memory Bits with Accumulator (Not Implemented)
+// Test and Set Memory Bits with Accumulator (65C02)
 uint8_t cpu6502::TSB()
 {
     fetch(); // Fetch data
@@ -1066,8 +1495,6 @@ uint8_t cpu6502::TSB()
     write(addr_abs, fetched | a); // Write the bitwise OR of the accumulator to memory
     return 0; // Return 0 cycles
 }
-*/
-
 // Transfer Stack Pointer to Index X
 uint8_t cpu6502::TSX()
 {
@@ -1106,4 +1533,671 @@ uint8_t cpu6502::TYA()
 uint8_t cpu6502::XXX()
 {
     return 0; // Return 0 cycles
-}
\ No newline at end of file
+}
+
+// Add Memory to Accumulator with Carry, with decimal mode
+// http://www.6502.org/tutorials/decimal_mode.html
+// On the NMOS 6502 Z comes from the binary sum and N and V from the high digit before it is adjusted,
+// the 65C02 sets N and Z from the result and takes one more cycle.
+template <bool bCMOS>
+uint8_t cpu6502::ADCD()
+{
+    if (!GetFlag(D)) return ADC();
+
+    fetch(); // Fetch data
+    uint16_t lo = (a & 0x0F) + (fetched & 0x0F) + GetFlag(C); // Add the low digits
+    if (lo > 0x09) lo += 0x06;
+    uint16_t hi = (a >> 4) + (fetched >> 4) + (lo > 0x0F); // Add the high digits with the carry from the low digit
+
+    SetFlag(Z, ((a + fetched + GetFlag(C)) & 0x00FF) == 0); // Set zero flag from the binary sum
+    SetFlag(N, hi & 0x08); // Set negative flag
+    SetFlag(V, (~(a ^ fetched) & (a ^ (hi << 4))) & 0x0080); // Set overflow flag
+    if (hi > 0x09) hi += 0x06;
+    SetFlag(C, hi > 0x0F); // Set carry flag
+
+    a = ((hi << 4) | (lo & 0x0F)) & 0x00FF; // Set accumulator to the adjusted digits
+    if constexpr (bCMOS)
+    {
+        SetFlag(N, a & 0x80);
+        SetFlag(Z, a == 0x00);
+        cycles++;
+    }
+    return 1; // Return 1 cycle
+}
+
+// Subtract Memory from Accumulator with Borrow, with decimal mode
+// The flags are those of the binary subtraction, except N and Z on the 65C02 which come from the result
+template <bool bCMOS>
+uint8_t cpu6502::SBCD()
+{
+    if (!GetFlag(D)) return SBC();
+
+    fetch(); // Fetch data
+    uint8_t borrow = 1 - GetFlag(C);
+    int16_t lo = (int16_t)(a & 0x0F) - (int16_t)(fetched & 0x0F) - borrow; // Subtract the low digits
+    int16_t result;
+
+    if constexpr (bCMOS)
+    {
+        result = (int16_t)a - (int16_t)fetched - borrow;
+        if (result < 0) result -= 0x60;
+        if (lo < 0) result -= 0x06;
+    }
+    else
+    {
+        int16_t hi = (int16_t)(a >> 4) - (int16_t)(fetched >> 4); // Subtract the high digits
+        if (lo < 0)
+        {
+            lo -= 0x06;
+            hi--;
+        }
+        if (hi < 0) hi -= 0x06;
+        result = (hi << 4) | (lo & 0x0F);
+    }
+
+    // Binary flags
+    uint16_t value = (uint16_t)fetched ^ 0x00FF;
+    uint16_t temp = (uint16_t)a + value + (uint16_t)GetFlag(C);
+    SetFlag(N, temp & 0x80); // Set negative flag
+    SetFlag(V, (~(uint16_t)a ^ value) & ((uint16_t)a ^ temp) & 0x0080); // Set overflow flag
+    SetFlag(Z, (temp & 0x00FF) == 0); // Set zero flag
+    SetFlag(C, temp & 0xFF00); // Set carry flag
+
+    a = result & 0x00FF; // Set accumulator to the adjusted digits
+    if constexpr (bCMOS)
+    {
+        SetFlag(N, a & 0x80);
+        SetFlag(Z, a == 0x00);
+        cycles++;
+    }
+    return 1; // Return 1 cycle
+}
+
+// Force Break on the 65C02, which clears decimal mode
+uint8_t cpu6502::BRKC()
+{
+    BRK();
+    SetFlag(D, false); // Clear decimal flag
+    return 0; // Return 0 cycles
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Cycle Accurate Core
+// https://www.nesdev.org/6502_cpu.txt
+// Each opcode is split into micro-ops, one bus access per cycle after the opcode fetch.
+// The tables are built at compile time from the addressing mode and access kind of each opcode.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+namespace
+{
+    enum MICROOP : uint8_t
+    {
+        MOP_IMPLIED, // Dummy read of PC, run the operation
+        MOP_IMMEDIATE, // Run the operation on the byte at PC
+        MOP_ZP, // Zero page address from PC
+        MOP_ZP_X, // Dummy read, add X within the zero page
+        MOP_ZP_Y, // Dummy read, add Y within the zero page
+        MOP_ABS_LO, // Low address byte from PC
+        MOP_ABS_HI, // High address byte from PC
+        MOP_ABS_HI_X, // High address byte from PC, add X
+        MOP_ABS_HI_Y, // High address byte from PC, add Y
+        MOP_PTR, // Zero page pointer from PC
+        MOP_PTR_X, // Dummy read of the pointer, add X
+        MOP_PTR_LO, // Low address byte from the pointer
+        MOP_PTR_HI, // High address byte from the pointer
+        MOP_PTR_HI_Y, // High address byte from the pointer, add Y
+        MOP_FIX_READ, // Read before the page carry, this is the real read unless a page was crossed
+        MOP_FIX, // Dummy read before the page carry
+        MOP_READ, // Run a read operation
+        MOP_WRITE, // Run a write operation
+        MOP_RMW_READ, // Read the value to modify
+        MOP_RMW_DUMMY, // Write the value back unmodified
+        MOP_RMW_WRITE, // Write the modified value
+        MOP_BRANCH, // Offset from PC, test the condition
+        MOP_BRANCH_TAKEN, // Dummy read while the offset is added to the low PC byte
+        MOP_BRANCH_FIX, // Dummy read while the high PC byte is fixed
+        MOP_JMP, // High address byte from PC, jump
+        MOP_IND_LO, // Low target byte from the pointer
+        MOP_IND_HI, // High target byte from the pointer, wrapping within its page
+        MOP_JSR, // High address byte from PC, jump
+        MOP_DUMMY_PC, // Dummy read of PC
+        MOP_DUMMY_STACK, // Dummy read of the stack
+        MOP_STACK_INC, // Dummy read of the stack, increment S
+        MOP_PUSH_PCH, // Push the high PC byte
+        MOP_PUSH_PCL, // Push the low PC byte
+        MOP_PUSH_P_BRK, // Push status with B set, set I
+        MOP_PUSH_P_IRQ, // Push status with B clear, set I
+        MOP_PULL_P, // Pull status, increment S
+        MOP_PULL_PCL, // Pull the low PC byte, increment S
+        MOP_PULL_PCH, // Pull the high PC byte
+        MOP_RTS_INC, // Dummy read of PC, increment PC
+        MOP_BRK_PAD, // Read the padding byte after BRK
+        MOP_VECTOR_LO, // Low vector byte
+        MOP_VECTOR_HI, // High vector byte, jump
+        MOP_STACK_OP, // Run PHA, PHP, PLA or PLP
+        MOP_ILLEGAL, // Dummy read of PC, repeated for the cycles in the lookup table, runs the operation once
+    };
+
+    struct MICROSEQ
+    {
+        uint8_t count = 0;
+        uint8_t ops[7] = {};
+    };
+
+    constexpr MICROSEQ Seq(std::initializer_list<uint8_t> ops)
+    {
+        MICROSEQ s;
+        for (uint8_t op : ops) s.ops[s.count++] = op;
+        return s;
+    }
+
+    // Addressing mode and access kind of every opcode, in the same layout as the lookup table
+    // Modes: i IMP, # IMM, z ZP0, x ZPX, y ZPY, r REL, a ABS, X ABX, Y ABY, n IND, I IZX, J IZY
+    // Kinds: R read, W write, M read-modify-write, i implied, B branch, j JMP, s JSR, t RTS, T RTI, b BRK, p push, P pull, ? illegal
+    constexpr const char microModes[] =
+        "#Iiiizzii#iiiaai" "rJiiixxiiYiiiXXi" "aIiizzzii#iiaaai" "rJiiixxiiYiiiXXi"
+        "iIiiizzii#iiaaai" "rJiiixxiiYiiiXXi" "iIiiizzii#iinaai" "rJiiixxiiYiiiXXi"
+        "iIiizzziiiiiaaai" "rJiixxyiiYiiiXii" "#I#izzzii#iiaaai" "rJiixxyiiYiiXXYi"
+        "#Iiizzzii#iiaaai" "rJiiixxiiYiiiXXi" "#Iiizzzii#iiaaai" "rJiiixxiiYiiiXXi";
+    constexpr const char microKinds[] =
+        "bR???RM?pRi??RM?" "BR???RM?iR???RM?" "sR??RRM?PRi?RRM?" "BR???RM?iR???RM?"
+        "TR???RM?pRi?jRM?" "BR???RM?iR???RM?" "tR???RM?PRi?jRM?" "BR???RM?iR???RM?"
+        "?W??WWW?i?i?WWW?" "BW??WWW?iWi??W??" "RRR?RRR?iRi?RRR?" "BR??RRR?iRi?RRR?"
+        "RR??RRM?iRi?RRM?" "BR???RM?iRi??RM?" "RR??RRM?iRi?RRM?" "BR???RM?iRi??RM?";
+
+    constexpr MICROSEQ Build(char mode, char kind)
+    {
+        switch (kind)
+        {
+            case 'i': return Seq({ MOP_IMPLIED });
+            case 'B': return Seq({ MOP_BRANCH, MOP_BRANCH_TAKEN, MOP_BRANCH_FIX });
+            case 'j': return (mode == 'a') ? Seq({ MOP_ABS_LO, MOP_JMP }) : Seq({ MOP_ABS_LO, MOP_ABS_HI, MOP_IND_LO, MOP_IND_HI });
+            case 's': return Seq({ MOP_ABS_LO, MOP_DUMMY_STACK, MOP_PUSH_PCH, MOP_PUSH_PCL, MOP_JSR });
+            case 't': return Seq({ MOP_DUMMY_PC, MOP_STACK_INC, MOP_PULL_PCL, MOP_PULL_PCH, MOP_RTS_INC });
+            case 'T': return Seq({ MOP_DUMMY_PC, MOP_STACK_INC, MOP_PULL_P, MOP_PULL_PCL, MOP_PULL_PCH });
+            case 'b': return Seq({ MOP_BRK_PAD, MOP_PUSH_PCH, MOP_PUSH_PCL, MOP_PUSH_P_BRK, MOP_VECTOR_LO, MOP_VECTOR_HI });
+            case 'p': return Seq({ MOP_DUMMY_PC, MOP_STACK_OP });
+            case 'P': return Seq({ MOP_DUMMY_PC, MOP_DUMMY_STACK, MOP_STACK_OP });
+            case '?': return Seq({ MOP_ILLEGAL });
+        }
+
+        // Memory instructions, the address cycles then the access cycles
+        MICROSEQ s;
+        switch (mode)
+        {
+            case '#': return Seq({ MOP_IMMEDIATE });
+            case 'z': s = Seq({ MOP_ZP }); break;
+            case 'x': s = Seq({ MOP_ZP, MOP_ZP_X }); break;
+            case 'y': s = Seq({ MOP_ZP, MOP_ZP_Y }); break;
+            case 'a': s = Seq({ MOP_ABS_LO, MOP_ABS_HI }); break;
+            case 'X': s = Seq({ MOP_ABS_LO, MOP_ABS_HI_X, (kind == 'R') ? MOP_FIX_READ : MOP_FIX }); break;
+            case 'Y': s = Seq({ MOP_ABS_LO, MOP_ABS_HI_Y, (kind == 'R') ? MOP_FIX_READ : MOP_FIX }); break;
+            case 'I': s = Seq({ MOP_PTR, MOP_PTR_X, MOP_PTR_LO, MOP_PTR_HI }); break;
+            case 'J': s = Seq({ MOP_PTR, MOP_PTR_LO, MOP_PTR_HI_Y, (kind == 'R') ? MOP_FIX_READ : MOP_FIX }); break;
+        }
+
+        if (kind == 'R')
+        {
+            s.ops[s.count++] = MOP_READ;
+        }
+        else if (kind == 'W')
+        {
+            s.ops[s.count++] = MOP_WRITE;
+        }
+        else
+        {
+            s.ops[s.count++] = MOP_RMW_READ;
+            s.ops[s.count++] = MOP_RMW_DUMMY;
+            s.ops[s.count++] = MOP_RMW_WRITE;
+        }
+        return s;
+    }
+
+    struct MICROTABLE
+    {
+        MICROSEQ seq[256];
+    };
+
+    constexpr MICROTABLE BuildTable()
+    {
+        MICROTABLE t;
+        for (int op = 0; op < 256; op++)
+        {
+            t.seq[op] = Build(microModes[op], microKinds[op]);
+        }
+        return t;
+    }
+
+    constexpr MICROTABLE microTable = BuildTable();
+
+    // IRQ and NMI, the opcode fetch cycle is a dummy read of PC
+    constexpr MICROSEQ microInterrupt = Seq({ MOP_DUMMY_PC, MOP_PUSH_PCH, MOP_PUSH_PCL, MOP_PUSH_P_IRQ, MOP_VECTOR_LO, MOP_VECTOR_HI });
+
+    // Spot checks against the cycle reference chart, the opcode fetch is one more cycle
+    static_assert(microTable.seq[0x00].count + 1 == 7, "BRK is 7 cycles");
+    static_assert(microTable.seq[0x20].count + 1 == 6, "JSR is 6 cycles");
+    static_assert(microTable.seq[0x6C].count + 1 == 5, "JMP (ind) is 5 cycles");
+    static_assert(microTable.seq[0x91].count + 1 == 6, "STA (zp),Y is 6 cycles");
+    static_assert(microTable.seq[0xFE].count + 1 == 7, "INC abs,X is 7 cycles");
+}
+
+// Clock one cycle of the cycle accurate tier
+void cpu6502::clockCycle()
+{
+    // Instruction boundary
+    if (mstep == mcount)
+    {
+        // DMA stalls and the reset sequence are idle cycles
+        if (cycles > 0)
+        {
+            cycles--;
+            clock_count++;
+            return;
+        }
+
+#ifndef NES_NO_PROFILER
+        if (bus->profiler != nullptr) bus->profiler->OnBoundary(pc, clock_count);
+#endif
+
+        // Interrupt lines, same single branch as the instruction tier
+        if (nmiPending | (irqLines != 0))
+        {
+            uint16_t vector = poll();
+            if (vector != 0)
+            {
+                read(pc); // The opcode fetch becomes a dummy read
+                addr_abs = vector;
+                mops = microInterrupt.ops;
+                mcount = microInterrupt.count;
+                mstep = 0;
+                clock_count++;
+                return;
+            }
+        }
+
+#ifndef NES_NO_DEBUGGER
+        uint8_t watch = bus->pageWatch[pc >> 8];
+        if (watch != 0)
+        {
+            if ((watch & Debugger::WATCH_EXEC) && bus->debugger->OnExecute(pc)) return;
+            if (watch & Hooks::HOOK_EXEC) bus->hooks->OnExecute(pc);
+        }
+#endif
+
+        // Cycle 1, opcode fetch
+        SetFlag(U, true);
+        opcode = read(pc);
+        pc++;
+        mops = microTable.seq[opcode].ops;
+        mcount = microTable.seq[opcode].count;
+        mstep = 0;
+        millegal = lookup[opcode].cycles - 1;
+        clock_count++;
+        return;
+    }
+
+    switch (mops[mstep++])
+    {
+        case MOP_IMPLIED:
+            read(pc);
+            fetched = a;
+            (this->*lookup[opcode].operate)();
+            break;
+        case MOP_IMMEDIATE:
+            addr_abs = pc++;
+            (this->*lookup[opcode].operate)();
+            break;
+        case MOP_ZP:
+            addr_abs = read(pc);
+            pc++;
+            break;
+        case MOP_ZP_X:
+            read(addr_abs);
+            addr_abs = (addr_abs + x) & 0x00FF;
+            break;
+        case MOP_ZP_Y:
+            read(addr_abs);
+            addr_abs = (addr_abs + y) & 0x00FF;
+            break;
+        case MOP_ABS_LO:
+            addr_abs = read(pc);
+            pc++;
+            break;
+        case MOP_ABS_HI:
+            addr_abs |= (uint16_t)read(pc) << 8;
+            pc++;
+            break;
+        case MOP_ABS_HI_X:
+        case MOP_ABS_HI_Y:
+        {
+            uint16_t base = addr_abs | ((uint16_t)read(pc) << 8);
+            pc++;
+            addr_abs = base + ((mops[mstep - 1] == MOP_ABS_HI_X) ? x : y);
+            mpartial = (base & 0xFF00) | (addr_abs & 0x00FF);
+            break;
+        }
+        case MOP_PTR:
+            mtemp = read(pc);
+            pc++;
+            break;
+        case MOP_PTR_X:
+            read(mtemp);
+            mtemp = (mtemp + x) & 0x00FF;
+            break;
+        case MOP_PTR_LO:
+            addr_abs = read(mtemp & 0x00FF);
+            break;
+        case MOP_PTR_HI:
+            addr_abs |= (uint16_t)read((mtemp + 1) & 0x00FF) << 8;
+            break;
+        case MOP_PTR_HI_Y:
+        {
+            uint16_t base = addr_abs | ((uint16_t)read((mtemp + 1) & 0x00FF) << 8);
+            addr_abs = base + y;
+            mpartial = (base & 0xFF00) | (addr_abs & 0x00FF);
+            break;
+        }
+        case MOP_FIX_READ:
+            if (mpartial == addr_abs)
+            {
+                // No page crossed, this is the real read and the instruction ends here
+                (this->*lookup[opcode].operate)();
+                mstep = mcount;
+            }
+            else
+            {
+                read(mpartial);
+            }
+            break;
+        case MOP_FIX:
+            read(mpartial);
+            break;
+        case MOP_READ:
+        case MOP_WRITE:
+        case MOP_STACK_OP:
+            (this->*lookup[opcode].operate)();
+            break;
+        case MOP_RMW_READ:
+            fetched = read(addr_abs);
+            break;
+        case MOP_RMW_DUMMY:
+            write(addr_abs, fetched);
+            break;
+        case MOP_RMW_WRITE:
+            rmw();
+            break;
+        case MOP_BRANCH:
+        {
+            REL();
+            mtemp = pc;
+
+            // The branch operations add their extra cycles to cycles, use that to pick the path
+            uint16_t before = cycles;
+            (this->*lookup[opcode].operate)();
+            uint16_t extra = cycles - before;
+            cycles = before;
+
+            if (extra == 0) mstep = mcount; // Not taken
+            else if (extra == 1) mcount = mstep + 1; // Taken in the same page
+            break;
+        }
+        case MOP_BRANCH_TAKEN:
+            read(mtemp);
+            break;
+        case MOP_BRANCH_FIX:
+            read((mtemp & 0xFF00) | (pc & 0x00FF));
+            break;
+        case MOP_JMP:
+            pc = addr_abs | ((uint16_t)read(pc) << 8);
+            edge();
+            break;
+        case MOP_JSR:
+            pc = addr_abs | ((uint16_t)read(pc) << 8);
+            edge();
+#ifndef NES_NO_PROFILER
+            if (bus->profiler != nullptr) bus->profiler->OnCall(pc, stkp + 2, Profiler::FRAME_JSR);
+#endif
+            break;
+        case MOP_IND_LO:
+            mtemp = read(addr_abs);
+            break;
+        case MOP_IND_HI:
+            pc = mtemp | ((uint16_t)read((addr_abs & 0xFF00) | ((addr_abs + 1) & 0x00FF)) << 8);
+            edge();
+            break;
+        case MOP_DUMMY_PC:
+            read(pc);
+            break;
+        case MOP_DUMMY_STACK:
+            readStack();
+            break;
+        case MOP_STACK_INC:
+            readStack();
+            stkp++;
+            break;
+        case MOP_PUSH_PCH:
+            writeStack((pc >> 8) & 0x00FF);
+            stkp--;
+            break;
+        case MOP_PUSH_PCL:
+            writeStack(pc & 0x00FF);
+            stkp--;
+            break;
+        case MOP_PUSH_P_BRK:
+            writeStack(status | B | U);
+            stkp--;
+            SetFlag(B, false);
+            SetFlag(I, true);
+            addr_abs = 0xFFFE;
+            break;
+        case MOP_PUSH_P_IRQ:
+            SetFlag(B, false);
+            SetFlag(U, true);
+            writeStack(status);
+            stkp--;
+            SetFlag(I, true);
+            break;
+        case MOP_PULL_P:
+            status = readStack();
+            status &= ~B;
+            status &= ~U;
+            stkp++;
+            break;
+        case MOP_PULL_PCL:
+            pc = (pc & 0xFF00) | readStack();
+            stkp++;
+            break;
+        case MOP_PULL_PCH:
+            pc = (pc & 0x00FF) | ((uint16_t)readStack() << 8);
+            if (mstep == mcount) edge(); // RTI, RTS still has to step over its return address
+#ifndef NES_NO_PROFILER
+            if (bus->profiler != nullptr) bus->profiler->OnReturn(stkp);
+#endif
+            break;
+        case MOP_RTS_INC:
+            read(pc);
+            pc++;
+            edge();
+            break;
+        case MOP_BRK_PAD:
+            read(pc);
+            pc++;
+            break;
+        case MOP_VECTOR_LO:
+            mtemp = read(addr_abs);
+            break;
+        case MOP_VECTOR_HI:
+            pc = mtemp | ((uint16_t)read(addr_abs + 1) << 8);
+            edge();
+#ifndef NES_NO_PROFILER
+            // Ends both BRK and the interrupt sequence, only the latter runs microInterrupt
+            if (bus->profiler != nullptr)
+            {
+                Profiler::FRAME kind = Profiler::FRAME_BRK;
+                if (mops == microInterrupt.ops) kind = (addr_abs == 0xFFFA) ? Profiler::FRAME_NMI : Profiler::FRAME_IRQ;
+                bus->profiler->OnCall(pc, stkp + 3, kind);
+            }
+#endif
+            break;
+        case MOP_ILLEGAL:
+            read(pc);
+            // The lookup table still gives illegal opcodes an operation, run it on the first cycle like the instruction tier
+            if (millegal == lookup[opcode].cycles - 1)
+            {
+                fetched = a;
+                (this->*lookup[opcode].operate)();
+            }
+            if (--millegal > 0) mstep--;
+            break;
+    }
+
+    clock_count++;
+}
+
+// Read-modify-write result, the operation is in the top three opcode bits
+void cpu6502::rmw()
+{
+    uint8_t value = fetched;
+    switch (opcode >> 5)
+    {
+        case 0: // ASL
+            SetFlag(C, value & 0x80);
+            value = value << 1;
+            break;
+        case 1: // ROL
+        {
+            uint8_t carry = GetFlag(C);
+            SetFlag(C, value & 0x80);
+            value = (value << 1) | carry;
+            break;
+        }
+        case 2: // LSR
+            SetFlag(C, value & 0x01);
+            value = value >> 1;
+            break;
+        case 3: // ROR
+        {
+            uint8_t carry = GetFlag(C) << 7;
+            SetFlag(C, value & 0x01);
+            value = (value >> 1) | carry;
+            break;
+        }
+        case 6: // DEC
+            value--;
+            break;
+        case 7: // INC
+            value++;
+            break;
+    }
+
+    SetFlag(Z, value == 0x00);
+    SetFlag(N, value & 0x80);
+    write(addr_abs, value);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Serialized state
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+namespace
+{
+    // The micro-op pointer is saved as the sequence it points into
+    enum SEQUENCE : uint8_t
+    {
+        SEQUENCE_NONE,
+        SEQUENCE_INTERRUPT,
+        SEQUENCE_OPCODE,
+    };
+
+    struct CPUSTATE
+    {
+        uint64_t clock_count;
+        uint64_t nmiCycle;
+        uint64_t irqCycle;
+        uint64_t iDelayCycle;
+        uint16_t pc;
+        uint16_t coveragePrev;
+        uint16_t addr_abs;
+        uint16_t addr_rel;
+        uint16_t cycles;
+        uint16_t mtemp;
+        uint16_t mpartial;
+        uint8_t a, x, y, stkp, status;
+        uint8_t fetched;
+        uint8_t opcode;
+        uint8_t nmiLine;
+        uint8_t nmiPending;
+        uint8_t irqLines;
+        uint8_t iDelayOld;
+        uint8_t accuracy;
+        uint8_t sequence;
+        uint8_t mcount, mstep, millegal;
+        uint8_t variant;
+    };
+}
+
+void cpu6502::SaveState(std::vector<uint8_t> &out) const
+{
+    // Zeroed first, so the padding is the same in every checkpoint
+    CPUSTATE s = {};
+    s.clock_count = clock_count;
+    s.nmiCycle = nmiCycle;
+    s.irqCycle = irqCycle;
+    s.iDelayCycle = iDelayCycle;
+    s.pc = pc;
+    s.coveragePrev = coveragePrev;
+    s.addr_abs = addr_abs;
+    s.addr_rel = addr_rel;
+    s.cycles = cycles;
+    s.mtemp = mtemp;
+    s.mpartial = mpartial;
+    s.a = a; s.x = x; s.y = y; s.stkp = stkp; s.status = status;
+    s.fetched = fetched;
+    s.opcode = opcode;
+    s.nmiLine = nmiLine;
+    s.nmiPending = nmiPending;
+    s.irqLines = irqLines;
+    s.iDelayOld = iDelayOld;
+    s.accuracy = accuracy;
+    s.sequence = (mops == nullptr) ? SEQUENCE_NONE : (mops == microInterrupt.ops) ? SEQUENCE_INTERRUPT : SEQUENCE_OPCODE;
+    s.mcount = mcount; s.mstep = mstep; s.millegal = millegal;
+    s.variant = variant;
+
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&s);
+    out.insert(out.end(), p, p + sizeof(s));
+}
+
+bool cpu6502::LoadState(const uint8_t *&data, const uint8_t *end)
+{
+    CPUSTATE s;
+    if (end - data < (ptrdiff_t)sizeof(s)) return false;
+    memcpy(&s, data, sizeof(s));
+    if (s.variant != variant || s.accuracy > ACCURACY_CYCLE || s.sequence > SEQUENCE_OPCODE) return false;
+    // A sequence in progress must be the one the opcode or interrupt has, a branch taken in the same page ends early
+    const MICROSEQ &seq = (s.sequence == SEQUENCE_INTERRUPT) ? microInterrupt : microTable.seq[s.opcode];
+    bool bBranch = (s.sequence == SEQUENCE_OPCODE && seq.ops[0] == MOP_BRANCH);
+    if (s.sequence != SEQUENCE_NONE && (s.mcount > seq.count || s.mstep > s.mcount || (!bBranch && s.mcount != seq.count))) return false;
+    data += sizeof(s);
+
+    clock_count = s.clock_count;
+    nmiCycle = s.nmiCycle;
+    irqCycle = s.irqCycle;
+    iDelayCycle = s.iDelayCycle;
+    pc = s.pc;
+    coveragePrev = s.coveragePrev;
+    addr_abs = s.addr_abs;
+    addr_rel = s.addr_rel;
+    cycles = s.cycles;
+    mtemp = s.mtemp;
+    mpartial = s.mpartial;
+    a = s.a; x = s.x; y = s.y; stkp = s.stkp; status = s.status;
+    fetched = s.fetched;
+    opcode = s.opcode;
+    nmiLine = s.nmiLine != 0;
+    nmiPending = s.nmiPending != 0;
+    irqLines = s.irqLines;
+    iDelayOld = s.iDelayOld;
+    accuracy = (ACCURACY)s.accuracy;
+    mops = (s.sequence == SEQUENCE_NONE) ? nullptr : seq.ops;
+    mcount = s.mcount; mstep = s.mstep; millegal = s.millegal;
+    return true;
+}
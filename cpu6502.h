@@ -11,10 +11,23 @@ class Bus;
 class cpu6502
 {
     public:
+        // CPU variants
+        // VARIANT_NMOS is the original 6502 with decimal mode, VARIANT_2A03 is the NES CPU without it and
+        // VARIANT_65C02 adds the CMOS opcodes and fixes the JMP indirect page wrap.
+        // Each variant has its own opcode table built at compile time, nothing on the hot path tests the variant.
+        enum VARIANT
+        {
+            VARIANT_NMOS,
+            VARIANT_2A03,
+            VARIANT_65C02,
+        };
+
         // Constructor and Destructor
-        cpu6502();
+        cpu6502(VARIANT v = VARIANT_2A03);
         ~cpu6502();
 
+        VARIANT GetVariant() const { return variant; }
+
         // Connect CPU to bus
         void ConnectBus(Bus *n) 
         { 
@@ -51,20 +64,120 @@ class cpu6502
         // Clock
         // https://www.nesdev.org/wiki/Cycle_reference_chart
         void clock();
+        // Run the rest of the current instruction and all of the next one, returns the cycles run
+        // Used by batched loops that do not need to interleave other devices every cycle
+        uint32_t step();
+        // Total cycles clocked since construction
+        uint64_t clock_count = 0;
+
+        // Accuracy tiers, selectable per instance
+        // ACCURACY_INSTRUCTION does all of an instruction's bus accesses on its first cycle and idles for the rest
+        // ACCURACY_CYCLE runs one micro-op per cycle, so every access, dummy reads included, happens on its real cycle
+        enum ACCURACY
+        {
+            ACCURACY_INSTRUCTION,
+            ACCURACY_CYCLE,
+        };
+        // Switch tier, a micro-op sequence in progress is finished first
+        // The cycle tier models the NMOS bus pattern only, returns false, leaving a 65C02 on the instruction tier, when
+        // asked to put a 65C02 on it
+        bool SetAccuracy(ACCURACY a);
+        ACCURACY GetAccuracy() const { return accuracy; }
 
         // CPU Interrupts
         // https://www.nesdev.org/wiki/CPU_interrupts
         void reset(); 
-        void irq(); // Interrupt Request
-        void nmi(); // Non-Maskable Interrupt
+        void irq(); // Interrupt Request, asserts IRQ_EXTERNAL until the interrupt is taken
+        void nmi(); // Non-Maskable Interrupt, latches an NMI edge
+
+        // Interrupt lines
+        // Devices on the bus assert the lines and the CPU polls them once per instruction boundary.
+        // Like the hardware, a line must be asserted before the last cycle of an instruction to be seen after it.
+        enum IRQSOURCE
+        {
+            IRQ_APU_FRAME = (1 << 0), // APU frame counter
+            IRQ_DMC = (1 << 1), // APU DMC channel
+            IRQ_MAPPER = (1 << 2), // Cartridge mapper
+            IRQ_EXTERNAL = (1 << 7), // irq(), released when the interrupt is taken
+        };
+        void SetNMI(bool bAsserted) { SetNMI(bAsserted, clock_count); } // Edge triggered, a rising edge latches an NMI
+        void SetNMI(bool bAsserted, uint64_t cycle); // Same, for a device that caught up late and knows the cycle the edge was on
+        void SetIRQ(uint8_t source, bool bAsserted); // Level triggered, taken while any source is asserted and I is clear
+
+        // Opcode information for tools (analyser, disassembler) that read the lookup table
+        enum ADDRMODE
+        {
+            AM_IMP, AM_IMM, AM_ZP0, AM_ZPX, AM_ZPY, AM_REL,
+            AM_ABS, AM_ABX, AM_ABY, AM_IND, AM_IZX, AM_IZY,
+            AM_ZPI, AM_IAX, // 65C02 (zp) and JMP (abs,X)
+        };
+        ADDRMODE GetAddrMode(uint8_t op) const;
+        static ADDRMODE GetAddrMode(uint8_t(cpu6502::*addrmode)(void));
+        const std::string &GetName(uint8_t op) const;
+        bool IsLegal(uint8_t op) const; // False for the "???" entries
+        static uint8_t GetLength(ADDRMODE mode); // Instruction length in bytes, opcode included
+
+        // DMA stall, the CPU is halted for n cycles once the current instruction finishes
+        // With bAlign one more cycle is added when the DMA would start on an odd cycle
+        void stall(uint16_t n, bool bAlign = false);
+
+        // Serialized state for checkpoints on disk, what Bus::copyState() copies of the CPU, host byte order
+        // LoadState() reads from data, moves it past the CPU and returns false, changing nothing, if the data is short or
+        // was saved by another variant
+        void SaveState(std::vector<uint8_t> &out) const;
+        bool LoadState(const uint8_t *&data, const uint8_t *end);
+
+        // Guest edge coverage for fuzzing, AFL style https://lcamtuf.coredump.cx/afl/technical_details.txt
+        // Every taken branch, jump, call, return and interrupt counts coverage[target ^ coveragePrev]++ and shifts the
+        // target into coveragePrev, so A -> B and B -> A land on different counters. The map is 64KB, one counter per
+        // 16 bit hash, owned by the fuzzer and left alone by Bus::copyState(). Define NES_NO_COVERAGE to compile it out.
+        uint8_t *coverage = nullptr;
+        uint16_t coveragePrev = 0x0000;
+        // Zero page ($0000-$00FF) and stack page ($0100-$01FF) in internal RAM, set by Bus::mapDirectPages(), reads and
+        // writes apart so a write watch only sends the writes through the bus. Accesses with a pointer set skip the bus,
+        // nullptr sends them through it like any other. A write hook on the page leaves the pointer set and the fast
+        // path hands the write to the hooks' bitmap after storing it, so only hooked addresses pay for a call.
+        uint8_t *zeroPageRead = nullptr;
+        uint8_t *zeroPageWrite = nullptr;
+        uint8_t *stackPageRead = nullptr;
+        uint8_t *stackPageWrite = nullptr;
+        bool bZeroPageHooked = false;
+        bool bStackPageHooked = false;
 
     private:
         // Pointer to the bus
         Bus *bus = nullptr;
 
-        // Read and Write functions
-        uint8_t read(uint16_t addr);
-        void write(uint16_t addr, uint8_t data);
+        // Read and Write functions, the zero page goes straight to RAM when the bus mapped it
+        uint8_t read(uint16_t addr)
+        {
+            if (addr < 0x0100 && zeroPageRead != nullptr) return zeroPageRead[addr];
+            return busRead(addr);
+        }
+        void write(uint16_t addr, uint8_t data)
+        {
+            if (addr < 0x0100 && zeroPageWrite != nullptr)
+            {
+                zeroPageWrite[addr] = data;
+                if (bZeroPageHooked) hookWrite(addr, data);
+            }
+            else busWrite(addr, data);
+        }
+        uint8_t busRead(uint16_t addr);
+        void busWrite(uint16_t addr, uint8_t data);
+        // Write hooks for a direct page write, what the bus would have called after the write
+        void hookWrite(uint16_t addr, uint8_t data);
+        // Stack at 0x0100 + stkp
+        uint8_t readStack() { return (stackPageRead != nullptr) ? stackPageRead[stkp] : busRead(0x0100 + stkp); }
+        void writeStack(uint8_t data)
+        {
+            if (stackPageWrite != nullptr)
+            {
+                stackPageWrite[stkp] = data;
+                if (bStackPageHooked) hookWrite(0x0100 + stkp, data);
+            }
+            else busWrite(0x0100 + stkp, data);
+        }
 
         // Access status register
         uint8_t GetFlag(FLAGS6502 f);
@@ -73,12 +186,54 @@ class cpu6502
         // Fetch data
         uint8_t fetch();
 
+        // Record the edge to the PC that was just set
+        void edge()
+        {
+#ifndef NES_NO_COVERAGE
+            if (coverage != nullptr)
+            {
+                coverage[pc ^ coveragePrev]++;
+                coveragePrev = pc >> 1;
+            }
+#endif
+        }
+
         // Variables
         uint8_t fetched = 0x00; // Fetched data
         uint16_t addr_abs = 0x0000; // Absolute address
         uint16_t addr_rel = 0x00; // Relative address
         uint8_t opcode = 0x00; // Opcode
-        uint8_t cycles = 0; // Cycles
+        uint16_t cycles = 0; // Cycles, 16 bits so a DMA stall fits
+
+        // Interrupt state
+        bool nmiLine = false; // Current level of the NMI line
+        bool nmiPending = false; // NMI edge latched and not yet taken
+        uint8_t irqLines = 0x00; // IRQSOURCE bits currently asserted
+        uint64_t nmiCycle = 0; // Cycle the NMI edge was latched on
+        uint64_t irqCycle = 0; // Cycle the IRQ line went from released to asserted
+        uint64_t iDelayCycle = ~0ULL; // CLI, SEI and PLP change I after the poll, this is the boundary that still sees the old value
+        uint8_t iDelayOld = 0; // The old I flag for that boundary
+
+        // Start the next instruction or interrupt sequence and set cycles, returns false if halted by the debugger
+        bool begin();
+        // Check the latched lines at an instruction boundary, returns the vector to take or 0
+        uint16_t poll();
+        // Push PC and status and jump through a vector
+        void interrupt(uint16_t vector);
+        // Cycle count of the next instruction boundary
+        uint64_t boundary() const;
+
+        // Cycle accurate tier
+        ACCURACY accuracy = ACCURACY_INSTRUCTION;
+        const uint8_t *mops = nullptr; // Micro-ops of the current instruction, one per cycle after the opcode fetch
+        uint8_t mcount = 0; // Number of micro-ops, the instruction is done when mstep reaches it
+        uint8_t mstep = 0; // Next micro-op
+        uint8_t millegal = 0; // Cycles left for an illegal opcode
+        uint16_t mtemp = 0x0000; // Pointer, saved PC or vector byte between micro-ops
+        uint16_t mpartial = 0x0000; // Indexed address before the carry into the high byte
+        void clockCycle();
+        // Read-modify-write result of ASL, ROL, LSR, ROR, DEC and INC from fetched
+        void rmw();
 
         // Opcode Translation Table
         struct INSTRUCTION
@@ -88,13 +243,27 @@ class cpu6502
             uint8_t(cpu6502::*addrmode)(void) = nullptr; // Function pointer to the addressing mode
             uint8_t cycles = 0; // Cycles instruction requires to execute
         };
-        std::vector<INSTRUCTION> lookup;
+        // Table of the variant, shared by every instance, so constructing or copying a CPU never touches the heap
+        const INSTRUCTION *lookup = nullptr;
+        VARIANT variant = VARIANT_2A03;
+
+        // Variant policies, one opcode table is built from each
+        struct PolicyNMOS { static constexpr bool bDecimal = true; static constexpr bool bCMOS = false; };
+        struct Policy2A03 { static constexpr bool bDecimal = false; static constexpr bool bCMOS = false; };
+        struct Policy65C02 { static constexpr bool bDecimal = true; static constexpr bool bCMOS = true; };
+        // The NMOS opcode table all variants start from
+        static std::vector<INSTRUCTION> BaseLookup();
+        // Table of a policy, built on first use
+        template <class P> static const INSTRUCTION *Lookup();
 
         // Addressing Modes
         // https://www.nesdev.org/obelisk-6502-guide/addressing.html
         uint8_t IMP(); uint8_t IMM(); uint8_t ZP0(); uint8_t ZPX(); 
         uint8_t ZPY(); uint8_t REL(); uint8_t ABS(); uint8_t ABX(); 
         uint8_t ABY(); uint8_t IND(); uint8_t IZX(); uint8_t IZY();
+        uint8_t INDC(); // 65C02 indirect, reads the high byte from the next page
+        uint8_t ZPI(); // 65C02 zero page indirect (zp), not indexed
+        uint8_t IAX(); // 65C02 JMP (abs,X), indexed absolute indirect
 
         // Opcodes
         // https://www.princeton.edu/~mae412/HANDOUTS/Datasheets/6502.pdf (Page 9)
@@ -110,4 +279,15 @@ class cpu6502
         uint8_t SEI(); uint8_t STA(); uint8_t STX(); uint8_t STY(); uint8_t TAX();
         uint8_t TAY(); uint8_t TSX(); uint8_t TXA(); uint8_t TXS(); uint8_t TYA();
         uint8_t XXX();
+
+        // Variant opcodes
+        // ADC and SBC above are binary only (2A03), the decimal versions fall back to them when D is clear
+        template <bool bCMOS> uint8_t ADCD(); template <bool bCMOS> uint8_t SBCD();
+        uint8_t BRKC(); // 65C02 BRK, also clears D
+        // 65C02 only
+        // http://www.6502.org/tutorials/65c02opcodes.html
+        uint8_t BRA(); uint8_t PHX(); uint8_t PHY(); uint8_t PLX(); uint8_t PLY();
+        uint8_t STZ(); uint8_t TRB(); uint8_t TSB();
+        uint8_t BITI(); // BIT #imm, sets Z only
+        uint8_t INA(); uint8_t DEA(); // INC A and DEC A
 };
\ No newline at end of file
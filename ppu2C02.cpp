@@ -0,0 +1,631 @@
+// PPU 2C02 file
+#include "ppu2C02.h"
+#include "Bus.h"
+#include "Tracer.h"
+#include <cstring>
+
+// Constructor
+ppu2C02::ppu2C02()
+{
+    chrRam.fill(0x00);
+    reset();
+}
+
+// Destructor
+ppu2C02::~ppu2C02()
+{
+
+}
+
+// Power on state
+void ppu2C02::reset()
+{
+    ctrl = 0x00;
+    mask = 0x00;
+    status = 0x00;
+    v = 0x0000;
+    t = 0x0000;
+    x = 0x00;
+    w = false;
+    readBuffer = 0x00;
+    openBus = 0x00;
+    nmiLine = false;
+    vram.fill(0x00);
+    palette.fill(0x00);
+    if (chrRom == nullptr) chrRam.fill(0x00);
+
+    scanline = 0;
+    dot = 0;
+    bOdd = false;
+    bRender = false;
+    hitDot = -1;
+    bOverflowLine = false;
+    lineCount = 0;
+}
+
+// Copy the state of another PPU
+void ppu2C02::copyState(const ppu2C02 &from)
+{
+    ctrl = from.ctrl;
+    mask = from.mask;
+    status = from.status;
+    v = from.v;
+    t = from.t;
+    x = from.x;
+    w = from.w;
+    readBuffer = from.readBuffer;
+    openBus = from.openBus;
+    nmiLine = from.nmiLine;
+    vram = from.vram;
+    palette = from.palette;
+    chrRom = from.chrRom;
+    if (chrRom == nullptr) chrRam = from.chrRam;
+    mirror = from.mirror;
+
+    scanline = from.scanline;
+    dot = from.dot;
+    dots = from.dots;
+    frameCount = from.frameCount;
+    bFrameRendered = from.bFrameRendered;
+    bOdd = from.bOdd;
+    bRender = from.bRender;
+    hitDot = from.hitDot;
+    bOverflowLine = from.bOverflowLine;
+    memcpy(lineSprites, from.lineSprites, sizeof(lineSprites));
+    lineCount = from.lineCount;
+}
+
+namespace
+{
+    struct PPUSTATE
+    {
+        uint64_t dots;
+        uint64_t frameCount;
+        uint16_t v, t;
+        int16_t scanline, dot, hitDot;
+        uint8_t ctrl, mask, status;
+        uint8_t x, w;
+        uint8_t readBuffer, openBus;
+        uint8_t nmiLine;
+        uint8_t mirror;
+        uint8_t bFrameRendered, bOdd, bRender, bOverflowLine;
+        uint8_t lineSprites[8];
+        uint8_t lineCount;
+        uint8_t bChrRam;
+    };
+}
+
+// The registers, then nametables, palette and CHR-RAM
+void ppu2C02::SaveState(std::vector<uint8_t> &out) const
+{
+    PPUSTATE s = {};
+    s.dots = dots;
+    s.frameCount = frameCount;
+    s.v = v;
+    s.t = t;
+    s.scanline = scanline;
+    s.dot = dot;
+    s.hitDot = hitDot;
+    s.ctrl = ctrl;
+    s.mask = mask;
+    s.status = status;
+    s.x = x;
+    s.w = w;
+    s.readBuffer = readBuffer;
+    s.openBus = openBus;
+    s.nmiLine = nmiLine;
+    s.mirror = mirror;
+    s.bFrameRendered = bFrameRendered;
+    s.bOdd = bOdd;
+    s.bRender = bRender;
+    s.bOverflowLine = bOverflowLine;
+    memcpy(s.lineSprites, lineSprites, sizeof(lineSprites));
+    s.lineCount = lineCount;
+    s.bChrRam = (chrRom == nullptr);
+
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&s);
+    out.insert(out.end(), p, p + sizeof(s));
+    out.insert(out.end(), vram.begin(), vram.end());
+    out.insert(out.end(), palette.begin(), palette.end());
+    if (chrRom == nullptr) out.insert(out.end(), chrRam.begin(), chrRam.end());
+}
+
+bool ppu2C02::LoadState(const uint8_t *&data, const uint8_t *end)
+{
+    PPUSTATE s;
+    if (end - data < (ptrdiff_t)sizeof(s)) return false;
+    memcpy(&s, data, sizeof(s));
+    const size_t size = sizeof(s) + vram.size() + palette.size() + (s.bChrRam ? chrRam.size() : 0);
+    if ((size_t)(end - data) < size || (s.bChrRam != 0) != (chrRom == nullptr) || s.mirror > MIRROR_VERTICAL || s.lineCount > 8) return false;
+    const uint8_t *p = data + sizeof(s);
+    data += size;
+
+    dots = s.dots;
+    frameCount = s.frameCount;
+    v = s.v;
+    t = s.t;
+    scanline = s.scanline;
+    dot = s.dot;
+    hitDot = s.hitDot;
+    ctrl = s.ctrl;
+    mask = s.mask;
+    status = s.status;
+    x = s.x;
+    w = s.w != 0;
+    readBuffer = s.readBuffer;
+    openBus = s.openBus;
+    nmiLine = s.nmiLine != 0;
+    mirror = (MIRROR)s.mirror;
+    bFrameRendered = s.bFrameRendered != 0;
+    bOdd = s.bOdd != 0;
+    bRender = s.bRender != 0;
+    bOverflowLine = s.bOverflowLine != 0;
+    memcpy(lineSprites, s.lineSprites, sizeof(lineSprites));
+    lineCount = s.lineCount;
+
+    memcpy(vram.data(), p, vram.size());
+    p += vram.size();
+    memcpy(palette.data(), p, palette.size());
+    p += palette.size();
+    if (s.bChrRam) memcpy(chrRam.data(), p, chrRam.size());
+    return true;
+}
+
+// Map the cartridge CHR
+void ppu2C02::InsertCHR(const uint8_t *data, size_t size, MIRROR m)
+{
+    chrRom = (data != nullptr && size >= 0x2000) ? data : nullptr;
+    if (chrRom == nullptr) chrRam.fill(0x00);
+    mirror = m;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Registers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Read a register, with bReadOnly nothing changes (no flag clears, no buffer or address updates)
+uint8_t ppu2C02::cpuRead(uint8_t reg, bool bReadOnly)
+{
+    uint8_t data = openBus;
+    switch (reg)
+    {
+        case 2: // Status, reading clears vblank and the write toggle
+            data = (status & 0xE0) | (openBus & 0x1F);
+            if (!bReadOnly)
+            {
+                status &= ~0x80;
+                w = false;
+                updateNMI();
+            }
+            break;
+        case 4: // OAM data
+            data = bus->oam[bus->oamAddr];
+            break;
+        case 7: // PPU data, delayed by the read buffer except for the palette
+        {
+            uint16_t addr = v & 0x3FFF;
+            data = readBuffer;
+            if (addr >= 0x3F00) data = (openBus & 0xC0) | (ppuRead(addr) & 0x3F);
+            if (!bReadOnly)
+            {
+                // The palette overlaps the nametables, the buffer gets the nametable byte under it
+                readBuffer = ppuRead(addr >= 0x3F00 ? addr - 0x1000 : addr);
+                v += (ctrl & 0x04) ? 32 : 1;
+            }
+            break;
+        }
+    }
+    return data;
+}
+
+// Write a register
+void ppu2C02::cpuWrite(uint8_t reg, uint8_t data)
+{
+    openBus = data;
+    switch (reg)
+    {
+        case 0: // Control, the nametable select goes into t
+            ctrl = data;
+            t = (t & 0xF3FF) | ((uint16_t)(data & 0x03) << 10);
+            updateNMI();
+            break;
+        case 1: // Mask
+            mask = data;
+            break;
+        case 3: // OAM address
+            bus->oamAddr = data;
+            break;
+        case 4: // OAM data
+            bus->oam[bus->oamAddr++] = data;
+            break;
+        case 5: // Scroll, X then Y
+            if (!w)
+            {
+                t = (t & 0xFFE0) | (data >> 3);
+                x = data & 0x07;
+            }
+            else
+            {
+                t = (t & 0x8C1F) | ((uint16_t)(data & 0xF8) << 2) | ((uint16_t)(data & 0x07) << 12);
+            }
+            w = !w;
+            break;
+        case 6: // Address, high byte then low byte
+            if (!w)
+            {
+                t = (t & 0x00FF) | ((uint16_t)(data & 0x3F) << 8);
+            }
+            else
+            {
+                t = (t & 0xFF00) | data;
+                v = t;
+            }
+            w = !w;
+            break;
+        case 7: // Data
+            ppuWrite(v & 0x3FFF, data);
+            v += (ctrl & 0x04) ? 32 : 1;
+            break;
+    }
+}
+
+// Drive the NMI line, an edge lands on the CPU cycle of the current dot even when the PPU catches up after it
+void ppu2C02::updateNMI()
+{
+    bool level = (status & 0x80) && (ctrl & 0x80);
+    if (level != nmiLine)
+    {
+        nmiLine = level;
+        bus->cpu.SetNMI(level, dots / 3);
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PPU address space
+// https://www.nesdev.org/wiki/PPU_memory_map
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Nametable address to an offset in the 2KB of VRAM
+uint16_t ppu2C02::mirrorAddr(uint16_t addr) const
+{
+    addr &= 0x0FFF;
+    if (mirror == MIRROR_VERTICAL) return addr & 0x07FF;
+    return ((addr >> 1) & 0x0400) | (addr & 0x03FF);
+}
+
+uint8_t ppu2C02::ppuRead(uint16_t addr) const
+{
+    addr &= 0x3FFF;
+    if (addr < 0x2000) return chr()[addr];
+    if (addr < 0x3F00) return vram[mirrorAddr(addr)];
+
+    // $3F10, $3F14, $3F18 and $3F1C mirror the backdrop entries
+    uint8_t i = addr & 0x1F;
+    if ((i & 0x13) == 0x10) i &= 0x0F;
+    return palette[i];
+}
+
+void ppu2C02::ppuWrite(uint16_t addr, uint8_t data)
+{
+    addr &= 0x3FFF;
+    if (addr < 0x2000)
+    {
+        if (chrRom == nullptr) chrRam[addr] = data;
+    }
+    else if (addr < 0x3F00)
+    {
+        vram[mirrorAddr(addr)] = data;
+    }
+    else
+    {
+        uint8_t i = addr & 0x1F;
+        if ((i & 0x13) == 0x10) i &= 0x0F;
+        palette[i] = data & 0x3F;
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Timing
+// https://www.nesdev.org/wiki/PPU_rendering
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Run to a dot count, one event at a time
+void ppu2C02::run(uint64_t target)
+{
+    while (dots < target)
+    {
+        int16_t next = nextEvent();
+        uint64_t left = target - dots;
+        if (left < (uint64_t)(next - dot))
+        {
+            dot += (int16_t)left;
+            dots = target;
+            return;
+        }
+        dots += next - dot;
+        dot = next;
+        event();
+    }
+}
+
+// Next dot of this line with something to do
+int16_t ppu2C02::nextEvent() const
+{
+    // The pre-render line is one dot shorter on odd frames while rendering
+    int16_t length = (scanline == 261 && bOdd && rendering()) ? 340 : 341;
+
+    if (scanline < 240)
+    {
+        if (dot < 1) return 1;
+        if (hitDot > dot) return hitDot;
+        if (dot < 257) return 257;
+    }
+    else if (scanline == 241)
+    {
+        if (dot < 1) return 1;
+    }
+    else if (scanline == 261)
+    {
+        if (dot < 1) return 1;
+        if (dot < 257) return 257;
+        if (dot < 280) return 280;
+    }
+    return (dot < length) ? length : dot;
+}
+
+// Event at the current dot
+void ppu2C02::event()
+{
+    if (dot >= 340 && dot == nextEvent())
+    {
+        // End of the line
+        dot = 0;
+        scanline++;
+        if (scanline == 262)
+        {
+            scanline = 0;
+            bOdd = !bOdd;
+        }
+        return;
+    }
+
+    if (scanline < 240)
+    {
+        if (dot == 1)
+        {
+            // Decide once per frame whether it produces pixels
+            if (scanline == 0) bRender = frameBuffer != nullptr && renderEvery != 0 && (frameCount % renderEvery) == 0;
+
+            hitDot = -1;
+            bOverflowLine = false;
+            lineCount = 0;
+            if (rendering()) evaluateLine();
+            if (bRender && frameBuffer != nullptr) renderLine();
+        }
+        else if (dot == hitDot)
+        {
+            status |= 0x40;
+        }
+        else if (dot == 257 && rendering())
+        {
+            if (bOverflowLine) status |= 0x20;
+            incrementY();
+            copyX();
+        }
+    }
+    else if (scanline == 241 && dot == 1)
+    {
+        // Vblank, the pixels of the frame are complete
+        status |= 0x80;
+        updateNMI();
+        bFrameRendered = bRender && frameBuffer != nullptr;
+        frameCount++;
+    }
+    else if (scanline == 261)
+    {
+        if (dot == 1)
+        {
+            // Pre-render, clear vblank, sprite 0 hit and overflow
+            status &= 0x1F;
+            updateNMI();
+        }
+        else if (dot == 257 && rendering())
+        {
+            copyX();
+        }
+        else if (dot == 280 && rendering())
+        {
+            copyY();
+        }
+    }
+}
+
+// Coarse and fine Y increment at the end of a visible line
+void ppu2C02::incrementY()
+{
+    if ((v & 0x7000) != 0x7000)
+    {
+        v += 0x1000;
+        return;
+    }
+    v &= ~0x7000;
+    uint16_t y = (v & 0x03E0) >> 5;
+    if (y == 29)
+    {
+        y = 0;
+        v ^= 0x0800;
+    }
+    else if (y == 31)
+    {
+        y = 0;
+    }
+    else
+    {
+        y++;
+    }
+    v = (v & ~0x03E0) | (y << 5);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Rendering
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// Background pattern row of the n-th tile of this line, low plane in the low byte and high plane in the high byte
+uint16_t ppu2C02::tileRow(int n, uint8_t *attribute) const
+{
+    uint16_t a = v;
+    int cx = (a & 0x001F) + n;
+    if ((cx >> 5) & 1) a ^= 0x0400; // Crossed into the next nametable
+    a = (a & ~0x001F) | (cx & 0x1F);
+
+    uint8_t tile = ppuRead(0x2000 | (a & 0x0FFF));
+    if (attribute != nullptr)
+    {
+        uint8_t at = ppuRead(0x23C0 | (a & 0x0C00) | ((a >> 4) & 0x38) | ((a >> 2) & 0x07));
+        *attribute = (at >> (((a >> 4) & 0x04) | (a & 0x02))) & 0x03;
+    }
+
+    uint16_t p = ((ctrl & 0x10) ? 0x1000 : 0x0000) + tile * 16 + ((a >> 12) & 0x07);
+    return (uint16_t)chr()[p] | ((uint16_t)chr()[p + 8] << 8);
+}
+
+// Sprite pattern row on this line
+bool ppu2C02::spriteRow(uint8_t i, uint8_t &lo, uint8_t &hi) const
+{
+    const uint8_t *s = &bus->oam[i * 4];
+    int height = (ctrl & 0x20) ? 16 : 8;
+    int row = scanline - s[0] - 1;
+    if (row < 0 || row >= height) return false;
+    if (s[2] & 0x80) row = height - 1 - row; // Vertical flip
+
+    uint16_t p;
+    if (height == 16)
+    {
+        // 8x16 sprites pick the table from bit 0 of the tile, the bottom half is the next tile
+        p = ((s[1] & 0x01) << 12) | ((s[1] & 0xFE) << 4) | ((row & 0x08) << 1) | (row & 0x07);
+    }
+    else
+    {
+        p = ((ctrl & 0x08) ? 0x1000 : 0x0000) | (s[1] << 4) | row;
+    }
+    lo = chr()[p];
+    hi = chr()[p + 8];
+
+    if (s[2] & 0x40)
+    {
+        // Horizontal flip, reverse the bits
+        auto reverse = [](uint8_t b)
+        {
+            b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+            b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+            return (uint8_t)((b & 0xAA) >> 1 | (b & 0x55) << 1);
+        };
+        lo = reverse(lo);
+        hi = reverse(hi);
+    }
+    return true;
+}
+
+// Sprites of the line and sprite 0 hit, this is all a skipped frame does per line
+void ppu2C02::evaluateLine()
+{
+    int height = (ctrl & 0x20) ? 16 : 8;
+    for (uint8_t i = 0; i < 64; i++)
+    {
+        int row = scanline - bus->oam[i * 4] - 1;
+        if (row < 0 || row >= height) continue;
+        if (lineCount == 8)
+        {
+            bOverflowLine = true;
+            break;
+        }
+        lineSprites[lineCount++] = i;
+    }
+
+    // Sprite 0 hit needs both layers, sprite 0 on the line and the flag still clear
+    if ((mask & 0x18) != 0x18 || (status & 0x40) || lineCount == 0 || lineSprites[0] != 0) return;
+
+    uint8_t lo, hi;
+    spriteRow(0, lo, hi);
+    uint8_t sprite = lo | hi; // Coverage of sprite 0, bit 7 is pixel sx
+    if (sprite == 0) return;
+
+    // Coverage of the background under it, from the two tiles the 8 pixels fall in
+    int sx = bus->oam[3];
+    int pos = sx + x;
+    uint16_t r0 = tileRow(pos >> 3, nullptr);
+    uint16_t r1 = tileRow((pos >> 3) + 1, nullptr);
+    uint16_t both = (uint16_t)(((r0 | (r0 >> 8)) & 0xFF) << 8) | ((r1 | (r1 >> 8)) & 0xFF);
+    uint8_t hit = sprite & (uint8_t)((both << (pos & 7)) >> 8);
+
+    // No hit in the left 8 pixels while either layer is clipped there, and never at x = 255
+    if (sx < 8 && (mask & 0x06) != 0x06) hit &= (uint8_t)((1 << sx) - 1);
+    if (sx >= 248) hit &= (uint8_t)(0xFF << (sx - 247));
+    if (hit == 0) return;
+
+    int k = 0;
+    while (!(hit & (0x80 >> k))) k++;
+    hitDot = (int16_t)(sx + k + 2);
+}
+
+// Pixels of this line
+void ppu2C02::renderLine()
+{
+    NES_TRACE_SCOPE("ppu line");
+    uint8_t *out = frameBuffer + scanline * WIDTH;
+    uint8_t greyscale = (mask & 0x01) ? 0x30 : 0x3F;
+    if (!rendering())
+    {
+        memset(out, palette[0] & greyscale, WIDTH);
+        return;
+    }
+
+    // Background, 33 tiles so fine X can scroll into the last one
+    uint8_t bg[33 * 8] = {};
+    if (mask & 0x08)
+    {
+        for (int n = 0; n < 33; n++)
+        {
+            uint8_t at = 0;
+            uint16_t r = tileRow(n, &at);
+            for (int k = 0; k < 8; k++)
+            {
+                uint8_t p = ((r >> (7 - k)) & 0x01) | ((r >> (14 - k)) & 0x02);
+                bg[n * 8 + k] = p ? (at << 2) | p : 0;
+            }
+        }
+        if (!(mask & 0x02)) memset(bg + x, 0, 8);
+    }
+
+    // Sprites, drawn back to front so the lowest OAM index ends up in front
+    uint8_t spr[WIDTH + 8] = {};
+    bool behind[WIDTH + 8] = {};
+    if (mask & 0x10)
+    {
+        for (int s = lineCount - 1; s >= 0; s--)
+        {
+            uint8_t i = lineSprites[s];
+            uint8_t lo, hi;
+            spriteRow(i, lo, hi);
+            uint8_t attr = bus->oam[i * 4 + 2];
+            int sx = bus->oam[i * 4 + 3];
+            for (int k = 0; k < 8; k++)
+            {
+                uint8_t p = ((lo >> (7 - k)) & 0x01) | (((hi >> (7 - k)) & 0x01) << 1);
+                if (p == 0) continue;
+                spr[sx + k] = 0x10 | ((attr & 0x03) << 2) | p;
+                behind[sx + k] = attr & 0x20;
+            }
+        }
+        if (!(mask & 0x04)) memset(spr, 0, 8);
+    }
+
+    // Compose
+    for (int px = 0; px < WIDTH; px++)
+    {
+        uint8_t b = bg[px + x];
+        uint8_t s = spr[px];
+        uint8_t i = (s != 0 && (b == 0 || !behind[px])) ? s : b;
+        out[px] = palette[i] & greyscale;
+    }
+}
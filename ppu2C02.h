@@ -0,0 +1,142 @@
+// PPU 2C02 header file to define the picture processing unit class
+// https://www.nesdev.org/wiki/PPU
+// A scanline renderer with an event driven timing model. The PPU runs lazily: the bus catches it up to the CPU
+// before every register access and after every instruction, and it jumps from one timing event to the next
+// (start of a line, sprite 0 hit, end of a line, vblank, pre-render) instead of ticking every dot. Register reads
+// see the PPU at the cycle of the access. An NMI edge found while catching up is latched on the CPU cycle of its
+// dot, so the CPU takes it at the same boundary as if the PPU had run alongside it.
+// Pixels are only produced for frames that are rendered. Skipped frames run the same timing model, so vblank,
+// NMI, sprite 0 hit, sprite overflow and $2002 reads are identical whether a frame is rendered or not.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+
+class Bus;
+
+class ppu2C02
+{
+    public:
+        // Constructor and Destructor
+        ppu2C02();
+        ~ppu2C02();
+
+        // Connect PPU to bus, for OAM and the NMI line
+        void ConnectBus(Bus *n)
+        {
+            bus = n;
+        }
+
+        // Power on state, the dot counter keeps running so the PPU stays in step with the CPU
+        void reset();
+        // Copy the state of another PPU, the bus, frame buffer and render setting stay as they are
+        void copyState(const ppu2C02 &from);
+        // Serialized state for checkpoints on disk, what copyState() copies, host byte order. CHR-RAM is included,
+        // CHR-ROM is not. LoadState() reads from data, moves it past the PPU and returns false, changing nothing, if the
+        // data is short or does not match the CHR-ROM or CHR-RAM of the cartridge inserted here.
+        void SaveState(std::vector<uint8_t> &out) const;
+        bool LoadState(const uint8_t *&data, const uint8_t *end);
+
+        // Cartridge
+        // Nametable mirroring, https://www.nesdev.org/wiki/Mirroring
+        enum MIRROR
+        {
+            MIRROR_HORIZONTAL,
+            MIRROR_VERTICAL,
+        };
+        // CHR-ROM is not copied, nullptr selects 8KB of CHR-RAM
+        void InsertCHR(const uint8_t *data, size_t size, MIRROR m);
+
+        // CPU interface, registers $2000-$2007
+        // https://www.nesdev.org/wiki/PPU_registers
+        uint8_t cpuRead(uint8_t reg, bool bReadOnly = false);
+        void cpuWrite(uint8_t reg, uint8_t data);
+
+        // Run up to a dot count since power on, 3 dots per CPU cycle
+        void run(uint64_t target);
+        uint64_t GetDots() const { return dots; }
+
+        //~~~~~~~~~~~~~~~
+        // Output
+        //~~~~~~~~~~~~~~~
+        static constexpr int WIDTH = 256;
+        static constexpr int HEIGHT = 240;
+        // WIDTH x HEIGHT palette indices (0-63), attached by the host, nothing is rendered while it is nullptr
+        uint8_t *frameBuffer = nullptr;
+        // Render-skip, render one frame in renderEvery (1 renders every frame, 0 never renders)
+        uint32_t renderEvery = 1;
+        // Frames completed since power on (a frame completes when vblank starts) and whether the last one was rendered
+        uint64_t frameCount = 0;
+        bool bFrameRendered = false;
+
+        // Position of the beam
+        int16_t scanline = 0; // 0-239 visible, 240 post-render, 241-260 vblank, 261 pre-render
+        int16_t dot = 0; // 0-340
+
+        // Registers
+        uint8_t ctrl = 0x00; // $2000 PPUCTRL
+        uint8_t mask = 0x00; // $2001 PPUMASK
+        uint8_t status = 0x00; // $2002 PPUSTATUS
+
+    private:
+        // Pointer to the bus
+        Bus *bus = nullptr;
+
+        // Internal registers
+        // https://www.nesdev.org/wiki/PPU_scrolling
+        uint16_t v = 0x0000; // Current VRAM address
+        uint16_t t = 0x0000; // Temporary VRAM address
+        uint8_t x = 0x00; // Fine X scroll
+        bool w = false; // First or second write toggle
+        uint8_t readBuffer = 0x00; // $2007 read buffer
+        uint8_t openBus = 0x00; // Last value written to a register
+        bool nmiLine = false; // Level driven onto the CPU NMI line
+
+        // Memory
+        std::array<uint8_t, 2 * 1024> vram; // Nametables
+        std::array<uint8_t, 32> palette;
+        std::array<uint8_t, 8 * 1024> chrRam; // Used when the cartridge has no CHR-ROM
+        const uint8_t *chrRom = nullptr;
+        MIRROR mirror = MIRROR_HORIZONTAL;
+
+        // Timing
+        uint64_t dots = 0; // Dots since power on
+        bool bOdd = false; // Odd frames skip a dot of the pre-render line while rendering
+        bool bRender = false; // This frame produces pixels
+        int16_t hitDot = -1; // Dot of this line that sets sprite 0 hit, -1 if none
+        bool bOverflowLine = false; // More than 8 sprites on this line
+
+        // Sprites on the current line, in OAM order
+        uint8_t lineSprites[8];
+        uint8_t lineCount = 0;
+
+        const uint8_t *chr() const { return chrRom != nullptr ? chrRom : chrRam.data(); }
+        bool rendering() const { return (mask & 0x18) != 0; }
+
+        // PPU address space
+        uint8_t ppuRead(uint16_t addr) const;
+        void ppuWrite(uint16_t addr, uint8_t data);
+        uint16_t mirrorAddr(uint16_t addr) const;
+
+        // Drive the NMI line from vblank and PPUCTRL
+        void updateNMI();
+        // Next dot of this line with something to do, the line length if none
+        int16_t nextEvent() const;
+        // Handle the event at the current dot
+        void event();
+
+        // Background pattern row of the n-th tile from v, bit 15 is the leftmost pixel of the first tile
+        uint16_t tileRow(int n, uint8_t *attribute) const;
+        // Sprite pattern row on this line, bit 7 is the leftmost pixel, false if the sprite is not on the line
+        bool spriteRow(uint8_t i, uint8_t &lo, uint8_t &hi) const;
+        // Find the sprites of this line and the dot sprite 0 hits on, from coverage masks only
+        void evaluateLine();
+        // Pixels of this line into the frame buffer
+        void renderLine();
+        // Scroll increments, https://www.nesdev.org/wiki/PPU_scrolling#Wrapping_around
+        void incrementY();
+        void copyX() { v = (v & ~0x041F) | (t & 0x041F); }
+        void copyY() { v = (v & ~0x7BE0) | (t & 0x7BE0); }
+};